@@ -1,5 +1,6 @@
 #pragma once
 #include "../common/file_system.h"
+#include "../common/machine.h"
 #include "../common/vector.h"
 #include "../engine/basic_types.h"
 #include "../engine/path.h"
@@ -14,7 +15,10 @@ class Unit;
 
 namespace ai {
 
-class WaterHex;
+class Influence;
+class InfluenceFloods;
+class ThreatPass;
+class WaterBody;
 
 enum ThreatState {
 	TS_INTERIOR,			// territory occupied by a friendly combatant, surrounded by friendly territory or deep water.
@@ -56,11 +60,28 @@ public:
 	engine::Unit*	unit;
 };
 
+/*
+ *	Actor
+ *
+ *	The AI player for one force.  Its picture of the map, the threat
+ *	state of each hex and the strengths projected onto the front, is
+ *	kept up to date as the game goes rather than redrawn each day.
+ *	Changes to the map mark hexes dirty; computeThreat reclassifies
+ *	the dirty hexes and their neighbors and refloods only those units
+ *	and victory locations whose earlier floods came near a hex that
+ *	changed.  The strengths themselves are recomputed from the saved
+ *	floods each time, since losses and supply change them everywhere.
+ */
 class Actor {
-	Actor() {}
+	friend InfluenceFloods;
+	friend ThreatPass;
+
+	Actor();
 public:
 	Actor(engine::Game* game, engine::Force* force);
 
+	~Actor();
+
 	static Actor* factory(fileSystem::Storage::Reader* r);
 
 	void store(fileSystem::Storage::Writer* o) const;
@@ -78,8 +99,16 @@ public:
 	void calculateVpValues();
 
 	void calculateFrontOwnership();
-
-	void analyzeDeepWater();
+	/*
+	 *	verify
+	 *
+	 *	Throws away everything computeThreat and calculateVpValues have
+	 *	saved, does both over from scratch and reports any hex where the
+	 *	results differ from the ones kept up to date.  This is a debugging
+	 *	aid, used when global::verifyAiThreat is set.  Returns the number
+	 *	of hexes that differed.
+	 */
+	int verify();
 
 	void setThreat(engine::xpoint hex, ThreatState ts);
 
@@ -116,7 +145,43 @@ public:
 
 	engine::Game* game() const { return _game; }
 
+	void onSituationChanged(engine::xpoint hex);
+
+	void onArrival(engine::Unit* u);
+
 private:
+	void markDirty(engine::xpoint hex);
+
+	void surveyMap();
+
+	void warmUnitCaches();
+
+	void packHex(engine::xpoint hex);
+
+	void classifyHex(engine::xpoint hex);
+
+	void reclassify();
+
+	void noteThreat(engine::xpoint hex);
+
+	void classifyCoasts();
+
+	void recordChanges();
+
+	void markTouched(engine::xpoint hex);
+
+	bool stale(const Influence* influence) const;
+
+	void applyFrontStrengths();
+
+	void spreadFriendlyStrength();
+
+	void discardFloods();
+
+	int index(engine::xpoint hex) const {
+		return _columns * hex.y + hex.x;
+	}
+
 	FrontInfo*& frontInfo(engine::xpoint hex) {
 		return _infoMap[_columns * hex.y + hex.x];
 	}
@@ -135,10 +200,31 @@ private:
 	FrontInfo**		_infoMap;
 	ThreatState*	_threatMap;
 	FrontInfo*		_frontList;
-	bool			_anyEnemy;
-	bool			_anyFriendly;
-	WaterHex*		_waterHex;
-	WaterHex*		_visitedHex;
+
+		// The incremental update
+
+	bool						_rebuild;			// The whole map must be reclassified
+	byte*						_owner;				// Force index of each hex's occupier, or one of HEX_*
+	byte*						_dirtyMark;
+	vector<engine::xpoint>		_dirty;				// Hexes changed since the last update
+	unsigned*					_noted;				// Update in which each hex's old state was noted
+	unsigned					_update;
+	vector<engine::xpoint>		_changed;			// Hexes reclassified in this update...
+	vector<ThreatState>			_was;				// ... and the states they had before
+	vector<engine::xpoint>		_front;				// The TS_FRONT hexes, in row order
+	int							_counts[TS_DEEP_WATER + 1];
+	int							_tileColumns;
+	byte*						_touched;			// Tiles of the map with a hex changed in this update
+	vector<int>					_touchedTiles;
+	vector<WaterBody*>			_waterBodies;
+	byte*						_shore;				// Hexes next to deep water
+	vector<Influence*>			_enemyFloods;		// Saved floods, in the order of calculateMap
+	vector<Influence*>			_friendlyFloods;
+	vector<engine::xpoint>		_victoryHexes;
+	vector<Influence*>			_victoryFloods;		// One per victory hex, or null
+	void*						_changedHandler;
+	void*						_situationHandler;
+	void*						_arrivalHandler;
 };
 
 class OwnerPath : public engine::UnitPath {
@@ -156,9 +242,47 @@ private:
 	engine::Unit*	_unit;
 };
 
+/*
+ *	Influence
+ *
+ *	The result of one flood from hex, by an InfluencePath for unit or
+ *	a VictoryPath: the front hexes reached, in the order the search
+ *	reviewed them, and the distance to each.  The strength projected
+ *	onto each is worked out from the distance when the flood is
+ *	applied, so a flood stays good as the unit's strength changes.
+ *	low and high bound every hex the search visited; the flood has to
+ *	be done again if anything near those bounds changes.
+ */
+class Influence {
+public:
+	Influence(engine::Unit* u, engine::xpoint hx) : hex(hx), low(hx), high(hx) {
+		unit = u;
+		carrier = engine::UC_FOOT;
+	}
+
+	void include(engine::xpoint hx) {
+		if (hx.x < low.x)
+			low.x = hx.x;
+		if (hx.x > high.x)
+			high.x = hx.x;
+		if (hx.y < low.y)
+			low.y = hx.y;
+		if (hx.y > high.y)
+			high.y = hx.y;
+	}
+
+	engine::Unit*			unit;
+	engine::xpoint			hex;
+	engine::UnitCarriers	carrier;
+	engine::xpoint			low;
+	engine::xpoint			high;
+	vector<engine::xpoint>	reached;
+	vector<int>				distance;
+};
+
 class InfluencePath : public engine::UnitPath {
 public:
-	void fill(engine::Unit* u, engine::xpoint A, int maxDist, ThreatState mustMatch, Actor* actor);
+	void fill(Influence* influence, int maxDist, ThreatState mustMatch, Actor* actor);
 
 	virtual engine::PathContinuation visit(engine::xpoint a);
 
@@ -171,11 +295,12 @@ private:
 	ThreatState		_mustMatch;
 	Actor*			_actor;
 	engine::Unit*	_unit;
+	Influence*		_influence;
 };
 
 class VictoryPath : public engine::UnitPath {
 public:
-	void fill(int vp, engine::xpoint A, Actor* actor);
+	void fill(Influence* influence, Actor* actor);
 
 	virtual engine::PathContinuation visit(engine::xpoint a);
 
@@ -186,17 +311,19 @@ public:
 private:
 	int				_maxDist;
 	Actor*			_actor;
-	int				_value;
+	Influence*		_influence;
 };
-
-class WaterHex {
+/*
+ *	WaterBody
+ *
+ *	One connected stretch of deep water and the land hexes along its
+ *	shore.  The map's terrain does not change during a game, so these
+ *	are found once.  A body touching both enemy and friendly interior
+ *	territory makes its friendly shore coast that must be defended.
+ */
+class WaterBody {
 public:
-	WaterHex(engine::xpoint hx) : hex(hx) {
-		next = null;
-	}
-
-	engine::xpoint		hex;
-	WaterHex*			next;
+	vector<engine::xpoint>	shore;
 };
 
 }  // namespace ai
@@ -7,16 +7,53 @@
 #include "../engine/game.h"
 #include "../engine/game_map.h"
 #include "../engine/global.h"
+#include "../engine/parallel.h"
 #include "../engine/scenario.h"
 #include "../engine/theater.h"
 #include "../engine/unit.h"
 
 namespace ai {
 
-InfluencePath influencePath;
 OwnerPath ownerPath;
 VictoryPath victoryPath;
 
+/*
+ *	Hexes are summarized for classification in one byte: the index
+ *	of the force occupying the hex, or one of these.
+ */
+static const byte HEX_IMPASSABLE = 0xff;
+static const byte HEX_DEEP_WATER = 0xfe;
+static const byte HEX_NEUTRAL = 0xfd;
+/*
+ *	The map-wide passes hand out the map in bands of this many rows.
+ */
+static const int BAND_ROWS = 16;
+/*
+ *	Changes are remembered in tiles of TILE by TILE hexes.  A saved
+ *	flood is done again if there was a change in any tile within
+ *	REACH hexes of the hexes it visited.  The cost of a step depends
+ *	on the detachments next to either end of it, so a change reaches
+ *	two hexes.
+ */
+static const int TILE = 8;
+static const int REACH = 2;
+/*
+ *	How far, in minutes of movement, a unit's influence reaches.
+ */
+static const int FLOOD_DISTANCE = 72*60;
+
+static const int THREAT_STATES = TS_DEEP_WATER + 1;
+
+static bool before(engine::xpoint a, engine::xpoint b) {
+	return a.y < b.y || (a.y == b.y && a.x < b.x);
+}
+
+static void deleteFloods(vector<Influence*>& floods) {
+	for (int i = 0; i < floods.size(); i++)
+		delete floods[i];
+	floods.clear();
+}
+
 void checkForAiPlayers(engine::Game* game) {
 	if (global::aiForces.size() > 0) {
 		if (global::aiForces == "all") {
@@ -43,19 +80,59 @@ void run(engine::Force* force) {
 	a->release();
 	a->computeThreat();
 	a->calculateVpValues();
+	if (global::verifyAiThreat)
+		a->verify();
 	a->calculateFrontOwnership();
 	a->stats();
 }
 
+Actor::Actor() {
+	_game = null;
+	_force = null;
+	_columns = 0;
+	_infoMap = null;
+	_threatMap = null;
+	_frontList = null;
+	_rebuild = true;
+	_owner = null;
+	_dirtyMark = null;
+	_noted = null;
+	_update = 0;
+	_tileColumns = 0;
+	_touched = null;
+	_shore = null;
+	_changedHandler = null;
+	_situationHandler = null;
+	_arrivalHandler = null;
+}
+
 Actor::Actor(engine::Game* game, engine::Force* force) {
 	_game = game;
 	_force = force;
 	engine::HexMap* map = game->map();
 	_columns = map->getColumns();
 	int rows = map->getRows();
-	_threatMap = new ThreatState[_columns * rows];
-	_infoMap = new FrontInfo*[_columns * rows];
+	int cells = _columns * rows;
+	_threatMap = new ThreatState[cells];
+	_infoMap = new FrontInfo*[cells];
 	_frontList = null;
+	_rebuild = true;
+	_owner = new byte[cells];
+	_dirtyMark = new byte[cells];
+	memset(_dirtyMark, 0, cells);
+	_noted = new unsigned[cells];
+	memset(_noted, 0, cells * sizeof (unsigned));
+	_update = 0;
+	_tileColumns = (_columns + TILE - 1) / TILE;
+	int tiles = _tileColumns * ((rows + TILE - 1) / TILE);
+	_touched = new byte[tiles];
+	memset(_touched, 0, tiles);
+	_shore = new byte[cells];
+	memset(_shore, 0, cells);
+	memset(_counts, 0, sizeof _counts);
+	_changedHandler = map->changed.addHandler(this, &Actor::onSituationChanged);
+	_situationHandler = map->situationChanged.addHandler(this, &Actor::onSituationChanged);
+	_arrivalHandler = force->arrival.addHandler(this, &Actor::onArrival);
 /*
 	for (c := global.game.force[idx].combatants; c != null; c = c.next){
 		cc := new CombatantCommander(c)
@@ -65,6 +142,26 @@ Actor::Actor(engine::Game* game, engine::Force* force) {
  */
 }
 
+Actor::~Actor() {
+	if (_changedHandler)
+		_game->map()->changed.removeHandler(_changedHandler);
+	if (_situationHandler)
+		_game->map()->situationChanged.removeHandler(_situationHandler);
+	if (_arrivalHandler)
+		_force->arrival.removeHandler(_arrivalHandler);
+	if (_infoMap)
+		release();
+	discardFloods();
+	_waterBodies.deleteAll();
+	delete [] _threatMap;
+	delete [] _infoMap;
+	delete [] _owner;
+	delete [] _dirtyMark;
+	delete [] _noted;
+	delete [] _touched;
+	delete [] _shore;
+}
+
 Actor* Actor::factory(fileSystem::Storage::Reader* r) {
 	Actor* actor = new Actor();
 	if (r->read(&actor->_game) &&
@@ -85,86 +182,135 @@ bool Actor::equals(Actor *actor) {
 	return true;
 }
 
-void Actor::computeThreat() {
-	engine::xpoint hex;
+/*
+ *	ThreatPass
+ *
+ *	The passes of a reclassification of the whole map.  Each band of
+ *	rows is one work item and only writes to the hexes in its own
+ *	band, so the bands run side by side.
+ */
+class ThreatPass : public engine::ParallelTask {
+public:
+	enum Phase {
+		PACK,				// summarize each hex
+		CLASSIFY,			// threat states, all but the coasts
+		COUNT				// hexes in each threat state
+	};
+
+	ThreatPass(Actor* actor) {
+		_actor = actor;
+		engine::HexMap* map = actor->game()->map();
+		_columns = map->getColumns();
+		_rows = map->getRows();
+		_bands = (_rows + BAND_ROWS - 1) / BAND_ROWS;
+		_counts = new int[_bands * THREAT_STATES];
+		memset(_counts, 0, _bands * THREAT_STATES * sizeof (int));
+	}
 
-	for (hex.y = 0; hex.y < _game->map()->getRows(); hex.y++)
-		for (hex.x = 0; hex.x < _game->map()->getColumns(); hex.x++) {
-			ThreatState maxThreat = TS_INTERIOR;
-			int cell = _game->map()->getCell(hex) & 0xf;
-			if (impassable(cell)) {
-				setThreat(hex, TS_IMPASSABLE);
-				continue;
-			}
-			int country = _game->map()->getOccupier(hex);
-			engine::Force* f = _game->theater()->combatants[country]->force;
-			if (f == null)
-				maxThreat = TS_NEUTRAL;
-			else if (f != _force)
-				maxThreat = TS_ENEMY;
-			else {
-				for (engine::HexDirection n = 0; n < 6; n++) {
-					engine::xpoint hx = engine::neighbor(hex, n);
-					if (!_game->map()->valid(hx))
-						continue;
-					int cell = _game->map()->getCell(hx) & 0xf;
-					if (impassable(cell))
-						continue;
-					int ncountry = _game->map()->getOccupier(hx);
-					engine::Force* nf = _game->theater()->combatants[ncountry]->force;
-					if (nf == f)		// friendly territory
-						continue;
-					else if (nf == null)
-						maxThreat = TS_BORDER;
-					else {
-						maxThreat = TS_FRONT;
-						break;
-					}
-				}
-			}
-			if (maxThreat == TS_FRONT) {
-				engine::Detachment* d = _game->map()->getDetachments(hex);
-				float enemyStrength = 0.0f;
-				float friendlyStrength = 0.0f;
-				if (d != null) {
-					if (d->unit->combatant()->force != _force) {
-						while (d != null) {
-							enemyStrength += d->unit->attack();
-							d = d->next;
-						}
-					} else {
-						while (d != null) {
-							friendlyStrength += d->unit->defense();
-							d = d->next;
-						}
-					}
+	~ThreatPass() {
+		delete [] _counts;
+	}
+
+	void runPhase(Phase phase) {
+		_phase = phase;
+		engine::runParallel(this, _bands);
+	}
+
+	virtual void run(int item, int worker) {
+		engine::xpoint hex;
+		int last = (item + 1) * BAND_ROWS;
+		if (last > _rows)
+			last = _rows;
+		for (hex.y = item * BAND_ROWS; hex.y < last; hex.y++)
+			for (hex.x = 0; hex.x < _columns; hex.x++) {
+				switch (_phase) {
+				case	PACK:
+					_actor->packHex(hex);
+					break;
+
+				case	CLASSIFY:
+					_actor->classifyHex(hex);
+					break;
+
+				case	COUNT:
+					_counts[item * THREAT_STATES + _actor->getThreat(hex)]++;
+					break;
 				}
-				setEnemyAp(hex, enemyStrength);
-				setFriendlyAp(hex, friendlyStrength);
 			}
-			setThreat(hex, maxThreat);
-		}
+	}
 
-		// This goes through the initial classification of impassable
-		// terrain and reclassifies deep water zones.  Bodies of water
-		// completely surrounded by friendly coastlines do not need to
-		// be defended.  All other coastlines require some quantity of
-		// defense against enemy landings.
+	int count(ThreatState ts) const {
+		int n = 0;
+		for (int i = 0; i < _bands; i++)
+			n += _counts[i * THREAT_STATES + ts];
+		return n;
+	}
 
-	for (hex.y = 0; hex.y < _game->map()->getRows(); hex.y++)
-		for (hex.x = 0; hex.x < _game->map()->getColumns(); hex.x++) {
-			ThreatState ts = getThreat(hex);
-			if (ts != TS_IMPASSABLE)
-				continue;
-			int c = _game->map()->getCell(hex) & 0xf;
-			if (c != engine::DEEP_WATER)
-				continue;
-			_waterHex = new WaterHex(hex);
-			setThreat(hex, TS_DEEP_WATER);
-			_anyEnemy = false;
-			_anyFriendly = false;
-			analyzeDeepWater();
-		}
+private:
+	Actor*				_actor;
+	Phase				_phase;
+	int					_columns;
+	int					_rows;
+	int					_bands;
+	int*				_counts;			// THREAT_STATES per band
+};
+
+/*
+ *	warmUnitCaches
+ *
+ *	A unit works out its totals and MoveInfo the first time they are
+ *	asked for after a change, and a detachment's totals take in those
+ *	of any detached subordinates.  The parallel passes read them from
+ *	several threads, so two workers could both build the totals of
+ *	one unit.  Building them all here, on one thread, prevents that.
+ */
+void Actor::warmUnitCaches() {
+	engine::HexMap* map = _game->map();
+	engine::xpoint hex;
+	for (hex.y = 0; hex.y < map->getRows(); hex.y++)
+		for (hex.x = 0; hex.x < _columns; hex.x++)
+			for (engine::Detachment* d = map->getDetachments(hex); d != null; d = d->next) {
+				d->unit->attack();
+				d->unit->carrier(map);
+			}
+}
+
+void Actor::computeThreat() {
+	engine::HexMap* map = _game->map();
+
+	_update++;
+	_changed.clear();
+	_was.clear();
+	for (int i = 0; i < _touchedTiles.size(); i++)
+		_touched[_touchedTiles[i]] = 0;
+	_touchedTiles.clear();
+	warmUnitCaches();
+	if (_rebuild) {
+		ThreatPass pass(this);
+
+		surveyMap();
+		pass.runPhase(ThreatPass::PACK);
+		pass.runPhase(ThreatPass::CLASSIFY);
+		classifyCoasts();
+		_changed.clear();
+		_was.clear();
+		pass.runPhase(ThreatPass::COUNT);
+		for (int ts = 0; ts < THREAT_STATES; ts++)
+			_counts[ts] = pass.count(ThreatState(ts));
+		_front.clear();
+		engine::xpoint hex;
+		for (hex.y = 0; hex.y < map->getRows(); hex.y++)
+			for (hex.x = 0; hex.x < _columns; hex.x++)
+				if (threatState(hex) == TS_FRONT)
+					_front.push_back(hex);
+		for (int i = 0; i < _dirty.size(); i++)
+			_dirtyMark[index(_dirty[i])] = 0;
+		_dirty.clear();
+		discardFloods();
+		_rebuild = false;
+	} else
+		reclassify();
+	applyFrontStrengths();
 
 		// Calculate enemyStrength first
 
@@ -173,84 +319,334 @@ void Actor::computeThreat() {
 		// Now calculate friendlyStrength
 
 	calculateMap(TS_INTERIOR);
-	for (hex.y = 0; hex.y < _game->map()->getRows(); hex.y++)
-		for (hex.x = 0; hex.x < _game->map()->getColumns(); hex.x++) {
-			engine::Detachment* d = _game->map()->getDetachments(hex);
-			if (d == null)
-				continue;
-			if (d->unit->combatant()->force != _force)
+	spreadFriendlyStrength();
+
+	int coasts = _counts[TS_COAST];
+	int fronts = _counts[TS_FRONT];
+	int interior = _counts[TS_INTERIOR];
+	int enemy = _counts[TS_ENEMY];
+	int border = _counts[TS_BORDER];
+	int water = _counts[TS_DEEP_WATER];
+	int rest = _counts[TS_NEUTRAL] + _counts[TS_IMPASSABLE];
+	debugPrint("interior=" + string(interior) + "\n");
+	debugPrint("coasts=" + string(coasts) + "\n");
+	debugPrint("fronts=" + string(fronts) + "\n");
+	debugPrint("border=" + string(border) + "\n");
+	debugPrint("total ours=" + string(interior + coasts + fronts + border) + "\n");
+	debugPrint("enemy=" + string(enemy) + "\n");
+	debugPrint("water=" + string(water) + "\n");
+	debugPrint("rest=" + string(rest) + "\n");
+}
+/*
+ *	reclassify
+ *
+ *	A hex's threat state depends only on who occupies it and its
+ *	neighbors, so only the dirty hexes and the hexes next to them are
+ *	classified again.  The coasts are done over only if a hex along
+ *	a shore changed.
+ */
+void Actor::reclassify() {
+	engine::HexMap* map = _game->map();
+	for (int i = 0; i < _dirty.size(); i++)
+		packHex(_dirty[i]);
+	for (int i = 0; i < _dirty.size(); i++) {
+		engine::xpoint hex = _dirty[i];
+		_dirtyMark[index(hex)] = 0;
+		markTouched(hex);
+		noteThreat(hex);
+		classifyHex(hex);
+		for (engine::HexDirection n = 0; n < 6; n++) {
+			engine::xpoint hx = engine::neighbor(hex, n);
+			if (!map->valid(hx))
 				continue;
-			ThreatState ts = getThreat(hex);
-			switch (ts) {
-			case	TS_COAST:
-			case	TS_BORDER:
-			case	TS_FRONT:
+			noteThreat(hx);
+			classifyHex(hx);
+		}
+	}
+	_dirty.clear();
+	for (int i = 0; i < _changed.size(); i++)
+		if (_shore[index(_changed[i])] && threatState(_changed[i]) != _was[i]) {
+			classifyCoasts();
+			break;
+		}
+	recordChanges();
+}
+/*
+ *	noteThreat
+ *
+ *	Remembers the state hex had at the start of this update, before
+ *	it is changed.
+ */
+void Actor::noteThreat(engine::xpoint hex) {
+	int i = index(hex);
+	if (_noted[i] == _update)
+		return;
+	_noted[i] = _update;
+	_changed.push_back(hex);
+	_was.push_back(_threatMap[i]);
+}
+/*
+ *	classifyCoasts
+ *
+ *	Bodies of water completely surrounded by friendly coastlines do
+ *	not need to be defended.  All other coastlines require some
+ *	quantity of defense against enemy landings.  The bodies are taken
+ *	in the order they were found, and a shore hex made coast by an
+ *	earlier body no longer counts as friendly interior for a later
+ *	one, so the coasts come out as they did when the bodies were
+ *	traced afresh each day.
+ */
+void Actor::classifyCoasts() {
+	for (int i = 0; i < _waterBodies.size(); i++) {
+		WaterBody* wb = _waterBodies[i];
+		for (int j = 0; j < wb->shore.size(); j++)
+			if (threatState(wb->shore[j]) == TS_COAST) {
+				noteThreat(wb->shore[j]);
+				threatState(wb->shore[j]) = TS_INTERIOR;
+			}
+	}
+	for (int i = 0; i < _waterBodies.size(); i++) {
+		WaterBody* wb = _waterBodies[i];
+		bool anyEnemy = false;
+		bool anyFriendly = false;
+		for (int j = 0; j < wb->shore.size(); j++) {
+			ThreatState ts = threatState(wb->shore[j]);
+			if (ts == TS_ENEMY)
+				anyEnemy = true;
+			else if (ts == TS_INTERIOR)
+				anyFriendly = true;
+		}
+		if (!anyEnemy || !anyFriendly)
+			continue;
+		for (int j = 0; j < wb->shore.size(); j++)
+			if (threatState(wb->shore[j]) == TS_INTERIOR) {
+				noteThreat(wb->shore[j]);
+				threatState(wb->shore[j]) = TS_COAST;
+			}
+	}
+}
+/*
+ *	recordChanges
+ *
+ *	Brings the counts and the list of front hexes up to date with the
+ *	hexes whose state changed in this update, and marks them touched
+ *	so the floods that reached them are done again.
+ */
+void Actor::recordChanges() {
+	vector<engine::xpoint> added;
+	bool removed = false;
+	for (int i = 0; i < _changed.size(); i++) {
+		engine::xpoint hex = _changed[i];
+		ThreatState ts = threatState(hex);
+		if (ts == _was[i])
+			continue;
+		_counts[_was[i]]--;
+		_counts[ts]++;
+		markTouched(hex);
+		if (_was[i] == TS_FRONT)
+			removed = true;
+		else if (ts == TS_FRONT) {
+			int j;
+			added.push_back(hex);
+			for (j = added.size() - 1; j > 0 && before(hex, added[j - 1]); j--)
+				added[j] = added[j - 1];
+			added[j] = hex;
+		}
+	}
+	if (!removed && added.size() == 0)
+		return;
+	vector<engine::xpoint> front;
+	int j = 0;
+	for (int i = 0; i < _front.size(); i++) {
+		engine::xpoint hex = _front[i];
+		if (threatState(hex) != TS_FRONT)
+			continue;
+		while (j < added.size() && before(added[j], hex))
+			front.push_back(added[j++]);
+		front.push_back(hex);
+	}
+	while (j < added.size())
+		front.push_back(added[j++]);
+	_front.clear();
+	for (int i = 0; i < front.size(); i++)
+		_front.push_back(front[i]);
+}
+
+void Actor::markTouched(engine::xpoint hex) {
+	int t = (hex.y / TILE) * _tileColumns + hex.x / TILE;
+	if (_touched[t])
+		return;
+	_touched[t] = 1;
+	_touchedTiles.push_back(t);
+}
+/*
+ *	stale
+ *
+ *	Returns true if something changed in this update close enough to
+ *	the hexes the flood visited that it might have come out otherwise.
+ */
+bool Actor::stale(const Influence* influence) const {
+	if (_touchedTiles.size() == 0)
+		return false;
+	int rows = _game->map()->getRows();
+	int left = influence->low.x - REACH;
+	int right = influence->high.x + REACH;
+	int top = influence->low.y - REACH;
+	int bottom = influence->high.y + REACH;
+	if (left < 0)
+		left = 0;
+	if (right >= _columns)
+		right = _columns - 1;
+	if (top < 0)
+		top = 0;
+	if (bottom >= rows)
+		bottom = rows - 1;
+	for (int y = top / TILE; y <= bottom / TILE; y++)
+		for (int x = left / TILE; x <= right / TILE; x++)
+			if (_touched[y * _tileColumns + x])
+				return true;
+	return false;
+}
+/*
+ *	applyFrontStrengths
+ *
+ *	Each front hex starts out with the strength of the units in it.
+ *	The front list is in row order, so the front information is
+ *	created in the same order however the front was found.
+ */
+void Actor::applyFrontStrengths() {
+	engine::HexMap* map = _game->map();
+	for (int i = 0; i < _front.size(); i++) {
+		engine::xpoint hex = _front[i];
+		engine::Detachment* d = map->getDetachments(hex);
+		float enemyStrength = 0.0f;
+		float friendlyStrength = 0.0f;
+		if (d != null) {
+			if (d->unit->combatant()->force != _force) {
 				while (d != null) {
-					double def = d->unit->defense() / 4;
-					for (engine::HexDirection i = 0; i < 6; i++) {
-						engine::xpoint hx = engine::neighbor(hex, i);
-						if (!_game->map()->valid(hx))
-							continue;
-						if (_game->map()->getDetachments(hx) != null)
-							continue;
-						ts = getThreat(hx);
-						if (ts != TS_FRONT)
-							continue;
-						float f = getFriendlyAp(hx);
-						setFriendlyAp(hx, f + def);
-					}
+					enemyStrength += d->unit->attack();
+					d = d->next;
+				}
+			} else {
+				while (d != null) {
+					friendlyStrength += d->unit->defense();
 					d = d->next;
 				}
 			}
 		}
+		setEnemyAp(hex, enemyStrength);
+		setFriendlyAp(hex, friendlyStrength);
+	}
+}
+/*
+ *	spreadFriendlyStrength
+ *
+ *	Each empty front hex gathers a quarter of the defense of the
+ *	friendly units next to it.  The neighbors are taken in row
+ *	order, the order in which spreading the strength out from
+ *	each unit in turn would reach the hex, so the sums round the
+ *	same way.
+ */
+void Actor::spreadFriendlyStrength() {
+	engine::HexMap* map = _game->map();
+	int rows = map->getRows();
+	for (int k = 0; k < _front.size(); k++) {
+		engine::xpoint hex = _front[k];
+		if (map->getDetachments(hex) != null)
+			continue;
+		engine::xpoint sources[6];
+		int count = 0;
+		for (engine::HexDirection n = 0; n < 6; n++) {
+			engine::xpoint hx = engine::neighbor(hex, n);
+			if (hx.x < 0 || hx.x >= _columns || hx.y < 0 || hx.y >= rows)
+				continue;
+			int j;
+			for (j = count; j > 0; j--) {
+				engine::xpoint prior = sources[j - 1];
+				if (before(prior, hx))
+					break;
+				sources[j] = prior;
+			}
+			sources[j] = hx;
+			count++;
+		}
+		float f = getFriendlyAp(hex);
+		bool changed = false;
+		for (int i = 0; i < count; i++) {
+			engine::Detachment* d = map->getDetachments(sources[i]);
+			if (d == null)
+				continue;
+			if (d->unit->combatant()->force != _force)
+				continue;
+			ThreatState ts = getThreat(sources[i]);
+			if (ts != TS_COAST &&
+				ts != TS_BORDER &&
+				ts != TS_FRONT)
+				continue;
+			while (d != null) {
+				double def = d->unit->defense() / 4;
+				f = float(f + def);
+				d = d->next;
+			}
+			changed = true;
+		}
+		if (changed)
+			setFriendlyAp(hex, f);
+	}
+}
 
-	int coasts = 0;
-	int fronts = 0;
-	int interior = 0;
-	int enemy = 0;
-	int border = 0;
-	int water = 0;
-	int rest = 0;
-	for (hex.y = 0; hex.y < _game->map()->getRows(); hex.y++)
-		for (hex.x = 0; hex.x < _game->map()->getColumns(); hex.x++) {
-			ThreatState ts = getThreat(hex);
-			switch (ts) {
-			case	TS_COAST:
-				coasts++;
-				break;
-
-			case	TS_FRONT:
-				fronts++;
-				break;
-
-			case	TS_INTERIOR:
-				interior++;
-				break;
-
-			case	TS_ENEMY:
-				enemy++;
-				break;
+void Actor::discardFloods() {
+	deleteFloods(_enemyFloods);
+	deleteFloods(_friendlyFloods);
+	deleteFloods(_victoryFloods);
+	for (int i = 0; i < _victoryHexes.size(); i++)
+		_victoryFloods.push_back(null);
+}
 
-			case	TS_BORDER:
-				border++;
-				break;
+int Actor::verify() {
+	int cells = _columns * _game->map()->getRows();
+	ThreatState* threat = new ThreatState[cells];
+	memcpy(threat, _threatMap, cells * sizeof (ThreatState));
+	FrontInfo** info = new FrontInfo*[cells];
+	memcpy(info, _infoMap, cells * sizeof (FrontInfo*));
+	FrontInfo* list = _frontList;
 
-			case	TS_DEEP_WATER:
-				water++;
-				break;
+	_frontList = null;
+	memset(_infoMap, 0, cells * sizeof (FrontInfo*));
+	_rebuild = true;
+	computeThreat();
+	calculateVpValues();
 
-			default:
-				rest++;
+	int differences = 0;
+	engine::xpoint hex;
+	for (hex.y = 0; hex.y < _game->map()->getRows(); hex.y++)
+		for (hex.x = 0; hex.x < _columns; hex.x++) {
+			int i = index(hex);
+			bool same = threat[i] == _threatMap[i];
+			if (same && (info[i] != null || _infoMap[i] != null)) {
+				FrontInfo empty(hex);
+				FrontInfo* kept = info[i] != null ? info[i] : &empty;
+				FrontInfo* built = _infoMap[i] != null ? _infoMap[i] : &empty;
+				same = kept->enemyAp == built->enemyAp &&
+					   kept->friendlyAp == built->friendlyAp &&
+					   kept->enemyVp == built->enemyVp &&
+					   kept->friendlyVp == built->friendlyVp;
+			}
+			if (!same) {
+				debugPrint("AI threat differs at [" + string(hex.x) + ":" + hex.y + "]\n");
+				differences++;
 			}
 		}
-	debugPrint("interior=" + string(interior) + "\n");
-	debugPrint("coasts=" + string(coasts) + "\n");
-	debugPrint("fronts=" + string(fronts) + "\n");
-	debugPrint("border=" + string(border) + "\n");
-	debugPrint("total ours=" + string(interior + coasts + fronts + border) + "\n");
-	debugPrint("enemy=" + string(enemy) + "\n");
-	debugPrint("water=" + string(water) + "\n");
-	debugPrint("rest=" + string(rest) + "\n");
+	if (differences > 0)
+		warningMessage(string(differences) + " hexes of the AI threat map were not kept up to date");
+	while (list != null) {
+		FrontInfo* fnext = list->next;
+		delete list;
+		list = fnext;
+	}
+	delete [] threat;
+	delete [] info;
+	return differences;
 }
 
 void Actor::stats() {
@@ -281,35 +677,188 @@ void Actor::release() {
 	memset(_infoMap, 0, sizeof _infoMap[0] * (_columns * _game->map()->getRows()));
 }
 
-void Actor::calculateMap(ThreatState mustMatch) {
-	engine::xpoint hex;
-	for (hex.y = 0; hex.y < _game->map()->getRows(); hex.y++)
-		for (hex.x = 0; hex.x < _game->map()->getColumns(); hex.x++) {
-			engine::Detachment* d = _game->map()->getDetachments(hex);
-			if (d == null)
-				continue;
-			ThreatState ts = getThreat(hex);
-			if (ts != mustMatch)
-				continue;
-			while (d != null) {
-				influencePath.fill(d->unit, hex, 72*60, mustMatch, this);
-				d = d->next;
+/*
+ *	InfluenceFloods
+ *
+ *	The floods for one call to calculateMap.  The units to flood from
+ *	are collected a band of rows at a time.  Each is matched against
+ *	the floods saved from the last update: a unit that has not moved
+ *	or changed carriers, with nothing changed near the hexes its flood
+ *	visited, keeps its flood.  The rest are flooded, with each worker
+ *	thread flooding from one unit at a time with its own InfluencePath.
+ *	The results are added into the front information in the order the
+ *	units were collected, just as when the floods ran one by one.
+ */
+class InfluenceFloods : public engine::ParallelTask {
+public:
+	InfluenceFloods(Actor* actor, ThreatState mustMatch) {
+		_actor = actor;
+		_mustMatch = mustMatch;
+		if (mustMatch == TS_ENEMY)
+			_saved = &actor->_enemyFloods;
+		else
+			_saved = &actor->_friendlyFloods;
+		_rows = actor->game()->map()->getRows();
+		_bands = (_rows + BAND_ROWS - 1) / BAND_ROWS;
+		_found = new vector<Influence*>[_bands];
+		_paths = new InfluencePath[engine::parallelWorkers()];
+	}
+
+	~InfluenceFloods() {
+		delete [] _found;
+		delete [] _paths;
+	}
+
+	void fill() {
+		_phase = COLLECT;
+		engine::runParallel(this, _bands);
+		engine::HexMap* map = _actor->game()->map();
+		vector<Influence*>& saved = *_saved;
+		int next = 0;
+		for (int i = 0; i < _bands; i++)
+			for (int j = 0; j < _found[i].size(); j++) {
+				Influence* influence = _found[i][j];
+				influence->carrier = map->calculateCarrier(influence->unit);
+
+					// Both lists are in the order the units were
+					// collected, so the saved floods from this hex,
+					// if any, are at next.
+
+				while (next < saved.size() && (saved[next] == null || before(saved[next]->hex, influence->hex)))
+					next++;
+				Influence* kept = null;
+				for (int k = next; k < saved.size(); k++) {
+					Influence* s = saved[k];
+					if (s == null)
+						continue;
+					if (s->hex.x != influence->hex.x || s->hex.y != influence->hex.y)
+						break;
+					if (s->unit == influence->unit && s->carrier == influence->carrier) {
+						saved[k] = null;
+						if (_actor->stale(s))
+							delete s;
+						else
+							kept = s;
+						break;
+					}
+				}
+				if (kept != null) {
+					delete influence;
+					influence = kept;
+				} else {
+
+						// The floods share the map's edge cost tables,
+						// so those have to be built before the threads
+						// start.
+
+					map->prepareEdgeCosts(influence->carrier, engine::MM_BEST);
+					_floods.push_back(influence);
+				}
+				_influences.push_back(influence);
 			}
+		deleteFloods(saved);
+		_phase = FLOOD;
+		engine::runParallel(this, _floods.size());
+		for (int i = 0; i < _influences.size(); i++) {
+			Influence* influence = _influences[i];
+			float strength;
+			if (_mustMatch == TS_ENEMY)
+				strength = influence->unit->attack();
+			else
+				strength = influence->unit->defense();
+			for (int j = 0; j < influence->reached.size(); j++) {
+				float f = (FLOOD_DISTANCE - influence->distance[j]) / float(FLOOD_DISTANCE);
+				if (_mustMatch == TS_ENEMY)
+					_actor->incrementEnemyAp(influence->reached[j], float(f * strength));
+				else
+					_actor->incrementFriendlyAp(influence->reached[j], float(f * strength));
+			}
+			saved.push_back(influence);
 		}
+	}
+
+	virtual void run(int item, int worker) {
+		if (_phase == FLOOD) {
+			_paths[worker].fill(_floods[item], FLOOD_DISTANCE, _mustMatch, _actor);
+			return;
+		}
+		engine::HexMap* map = _actor->game()->map();
+		engine::xpoint hex;
+		int last = (item + 1) * BAND_ROWS;
+		if (last > _rows)
+			last = _rows;
+		for (hex.y = item * BAND_ROWS; hex.y < last; hex.y++)
+			for (hex.x = 0; hex.x < map->getColumns(); hex.x++) {
+				engine::Detachment* d = map->getDetachments(hex);
+				if (d == null)
+					continue;
+				if (_actor->getThreat(hex) != _mustMatch)
+					continue;
+				for (; d != null; d = d->next)
+					_found[item].push_back(new Influence(d->unit, hex));
+			}
+	}
+
+private:
+	enum Phase {
+		COLLECT,
+		FLOOD
+	};
+
+	Actor*				_actor;
+	ThreatState			_mustMatch;
+	Phase				_phase;
+	int					_rows;
+	int					_bands;
+	vector<Influence*>*	_saved;				// The Actor's floods for _mustMatch
+	vector<Influence*>*	_found;				// Units collected, one list per band
+	vector<Influence*>	_influences;		// All the floods to apply, in order
+	vector<Influence*>	_floods;			// The ones that have to be flooded
+	InfluencePath*		_paths;				// One per worker
+};
+
+void Actor::calculateMap(ThreatState mustMatch) {
+	InfluenceFloods floods(this, mustMatch);
+
+	floods.fill();
 }
 
 void Actor::calculateVpValues() {
-	engine::xpoint hex;
-	for (hex.y = 0; hex.y < _game->map()->getRows(); hex.y++) {
-		for (hex.x = 0; hex.x < _game->map()->getColumns(); hex.x++) {
-			ThreatState ts = getThreat(hex);
-			if (ts == TS_NEUTRAL || 
-				ts == TS_IMPASSABLE ||
-				ts == TS_DEEP_WATER)
+	engine::HexMap* map = _game->map();
+	int maxDist = int(_game->scenario()->end - _game->time());
+	for (int i = 0; i < _victoryHexes.size(); i++) {
+		engine::xpoint hex = _victoryHexes[i];
+		Influence* influence = _victoryFloods[i];
+		if (influence != null && stale(influence)) {
+			delete influence;
+			influence = null;
+			_victoryFloods[i] = null;
+		}
+		ThreatState ts = getThreat(hex);
+		if (ts == TS_NEUTRAL || 
+			ts == TS_IMPASSABLE ||
+			ts == TS_DEEP_WATER)
+			continue;
+		if (influence == null) {
+			influence = new Influence(null, hex);
+			victoryPath.fill(influence, this);
+			_victoryFloods[i] = influence;
+		}
+
+			// The flood was cut off at the time left in the game when
+			// it was done.  There is less time left now, so the hexes
+			// that are now out of reach are passed over.
+
+		int vp = map->getVictoryPoints(hex);
+		for (int j = 0; j < influence->reached.size(); j++) {
+			int gval = influence->distance[j];
+			if (gval >= maxDist)
 				continue;
-			int vp = _game->map()->getVictoryPoints(hex);
-			if (vp != 0)
-				victoryPath.fill(vp, hex, this);
+			float f = (maxDist - gval) / float(maxDist);
+			if (ts == TS_ENEMY)
+				incrementEnemyVp(influence->reached[j], f * vp);
+			else
+				incrementFriendlyVp(influence->reached[j], f * vp);
 		}
 	}
 }
@@ -344,49 +893,114 @@ void Actor::calculateFrontOwnership() {
 	}
 }
 
-void Actor::analyzeDeepWater() {
-	_visitedHex = null;
-	while (_waterHex != null) {
-		WaterHex* wh = _waterHex;
-		_waterHex = _waterHex->next;
-		wh->next = _visitedHex;
-		_visitedHex = wh;
-		for (engine::HexDirection i = 0; i < 6; i++) {
-			engine::xpoint hx = engine::neighbor(wh->hex, i);
-			if (!_game->map()->valid(hx))
+/*
+ *	surveyMap
+ *
+ *	Finds the parts of the map that do not change during a game: the
+ *	bodies of deep water with their shores, and the victory locations.
+ *	The bodies are numbered in the order a row by row scan first comes
+ *	to them.
+ */
+void Actor::surveyMap() {
+	engine::HexMap* map = _game->map();
+	int cells = _columns * map->getRows();
+	int* body = new int[cells];
+	for (int i = 0; i < cells; i++)
+		body[i] = -1;
+	_waterBodies.deleteAll();
+	memset(_shore, 0, cells);
+	_victoryHexes.clear();
+	vector<engine::xpoint> water;
+	engine::xpoint hex;
+	for (hex.y = 0; hex.y < map->getRows(); hex.y++)
+		for (hex.x = 0; hex.x < _columns; hex.x++) {
+			if (map->getVictoryPoints(hex) != 0)
+				_victoryHexes.push_back(hex);
+			if (body[index(hex)] >= 0)
 				continue;
-			ThreatState ts = getThreat(hx);
-			if (ts == TS_ENEMY)
-				_anyEnemy = true;
-			else if (ts == TS_IMPASSABLE){
-				int c = _game->map()->getCell(hx) & 0xf;
-				if (c != engine::DEEP_WATER)
-					continue;
-				WaterHex* wh2 = new WaterHex(hx);
-				wh2->next = _waterHex;
-				_waterHex = wh2;
-				setThreat(hx, TS_DEEP_WATER);
-			} else if (ts == TS_INTERIOR)
-				_anyFriendly = true;
+			if ((map->getCell(hex) & 0xf) != engine::DEEP_WATER)
+				continue;
+			int b = _waterBodies.size();
+			WaterBody* wb = new WaterBody;
+			_waterBodies.push_back(wb);
+			body[index(hex)] = b;
+			water.clear();
+			water.push_back(hex);
+			for (int i = 0; i < water.size(); i++) {
+				for (engine::HexDirection n = 0; n < 6; n++) {
+					engine::xpoint hx = engine::neighbor(water[i], n);
+					if (!map->valid(hx))
+						continue;
+					int j = index(hx);
+					if (body[j] == b)
+						continue;
+					body[j] = b;
+					if ((map->getCell(hx) & 0xf) == engine::DEEP_WATER)
+						water.push_back(hx);
+					else {
+						wb->shore.push_back(hx);
+						_shore[j] = 1;
+					}
+				}
+			}
 		}
+	delete [] body;
+}
+
+void Actor::packHex(engine::xpoint hex) {
+	engine::HexMap* map = _game->map();
+	int i = index(hex);
+	int cell = map->getCell(hex) & 0xf;
+	if (impassable(cell)) {
+		if (cell == engine::DEEP_WATER)
+			_owner[i] = HEX_DEEP_WATER;
+		else
+			_owner[i] = HEX_IMPASSABLE;
+		return;
 	}
-	if (_anyEnemy && _anyFriendly) {
-		for (WaterHex* wh = _visitedHex; wh != null; wh = wh->next) {
-			for (engine::HexDirection i = 0; i < 6; i++) {
-				engine::xpoint hx = engine::neighbor(wh->hex, i);
-				if (!_game->map()->valid(hx))
-					continue;
-				ThreatState ts = getThreat(hx);
-				if (ts == TS_INTERIOR)
-					setThreat(hx, TS_COAST);
+	int country = map->getOccupier(hex);
+	engine::Force* f = _game->theater()->combatants[country]->force;
+	if (f == null)
+		_owner[i] = HEX_NEUTRAL;
+	else
+		_owner[i] = byte(f->index);
+}
+
+void Actor::classifyHex(engine::xpoint hex) {
+	engine::HexMap* map = _game->map();
+	ThreatState maxThreat = TS_INTERIOR;
+	byte owner = _owner[index(hex)];
+	if (owner == HEX_DEEP_WATER) {
+		threatState(hex) = TS_DEEP_WATER;
+		return;
+	}
+	if (owner == HEX_IMPASSABLE) {
+		threatState(hex) = TS_IMPASSABLE;
+		return;
+	}
+	if (owner == HEX_NEUTRAL)
+		maxThreat = TS_NEUTRAL;
+	else if (owner != _force->index)
+		maxThreat = TS_ENEMY;
+	else {
+		for (engine::HexDirection n = 0; n < 6; n++) {
+			engine::xpoint hx = engine::neighbor(hex, n);
+			if (!map->valid(hx))
+				continue;
+			byte nowner = _owner[index(hx)];
+			if (nowner == HEX_IMPASSABLE || nowner == HEX_DEEP_WATER)
+				continue;
+			if (nowner == owner)		// friendly territory
+				continue;
+			else if (nowner == HEX_NEUTRAL)
+				maxThreat = TS_BORDER;
+			else {
+				maxThreat = TS_FRONT;
+				break;
 			}
 		}
 	}
-	while (_visitedHex != null) {
-		WaterHex* wh = _visitedHex;
-		_visitedHex = _visitedHex->next;
-		delete wh;
-	}
+	threatState(hex) = maxThreat;
 }
 
 void Actor::setThreat(engine::xpoint hex, ThreatState ts) {
@@ -481,6 +1095,25 @@ void Actor::ensureFrontInfo(engine::xpoint hex) {
 	}
 }
 
+void Actor::onSituationChanged(engine::xpoint hex) {
+	markDirty(hex);
+}
+
+void Actor::onArrival(engine::Unit* u) {
+	if (u->detachment() != null)
+		markDirty(u->detachment()->location());
+}
+
+void Actor::markDirty(engine::xpoint hex) {
+	if (!_game->map()->valid(hex))
+		return;
+	int i = index(hex);
+	if (_dirtyMark[i])
+		return;
+	_dirtyMark[i] = 1;
+	_dirty.push_back(hex);
+}
+
 engine::Unit* OwnerPath::find(Actor* actor, engine::xpoint A) {
 	_actor = actor;
 	source = A;
@@ -501,28 +1134,33 @@ engine::PathContinuation OwnerPath::visit(engine::xpoint a) {
 }
 
 int OwnerPath::kost(engine::xpoint a, engine::HexDirection dir, engine::xpoint b) {
-	float f;
 	ThreatState ts = _actor->getThreat(b);
 	if (ts != TS_FRONT)
 		return 100001;
 	else
-		return engine::movementCost(map(), a, dir, b, null, engine::UC_FTRACK, engine::MM_ROAD, &f, false);
+		return engine::pathCost(map(), a, dir, b, null, engine::UC_FTRACK, engine::MM_ROAD, false);
 }
 
 void OwnerPath::finished(engine::HexMap *map, engine::SegmentKind kind) {
 }
 
-void InfluencePath::fill(engine::Unit *u, engine::xpoint A, int maxDist, ThreatState mustMatch, Actor *actor) {
-	source = A;
+void InfluencePath::fill(Influence* influence, int maxDist, ThreatState mustMatch, Actor *actor) {
+	source = influence->hex;
 	destination.x = -1;
-	_unit = u;
+	_unit = influence->unit;
+	_influence = influence;
 	engine::HexMap* map = actor->game()->map();
-	cache(map, u);
+	cache(map, _unit);
+
+		// The floods have always used MM_BEST, the value the one shared
+		// path object started out with.  Each worker now has its own.
+
+	moveManner = engine::MM_BEST;
 	_maxDist = maxDist;
 	_mustMatch = mustMatch;
 	_actor = actor;
 	visitLimit = 1000;
-	engine::visit(map, this, A, maxDist, engine::SK_ORDER);
+	engine::visit(map, this, source, maxDist, engine::SK_ORDER);
 }
 
 engine::PathContinuation InfluencePath::visit(engine::xpoint a) {
@@ -538,28 +1176,21 @@ void InfluencePath::finished(engine::HexMap *map, engine::SegmentKind kind) {
 }
 
 void InfluencePath::reviewHex(engine::HexMap* map, engine::xpoint a, int gval) {
+	_influence->include(a);
 	ThreatState ts2 = _actor->getThreat(a);
 	if (ts2 != TS_FRONT &&
 		ts2 != TS_COAST &&
 		ts2 != TS_BORDER)
 		return;
 	if (gval <= _maxDist) {
-		float f = (_maxDist - gval) / float(_maxDist);
-		float strength = 0.0f;
-		if (_mustMatch == TS_ENEMY)
-			strength = _unit->attack();
-		else
-			strength = _unit->defense();
-		if (_mustMatch == TS_ENEMY)
-			_actor->incrementEnemyAp(a, float(f * strength));
-		else
-			_actor->incrementFriendlyAp(a, float(f * strength));
+		_influence->reached.push_back(a);
+		_influence->distance.push_back(gval);
 	}
 }
 
-void VictoryPath::fill(int vp, engine::xpoint A, Actor* actor) {
-	_value = vp;
-	source = A;
+void VictoryPath::fill(Influence* influence, Actor* actor) {
+	_influence = influence;
+	source = influence->hex;
 	destination.x = -1;
 	moveManner = engine::MM_CROSS_COUNTRY;
 	_maxDist = int(actor->game()->scenario()->end - actor->game()->time());
@@ -567,7 +1198,7 @@ void VictoryPath::fill(int vp, engine::xpoint A, Actor* actor) {
 	engine::HexMap* map = actor->game()->map();
 	cache(map, null);
 	visitLimit = 10000;
-	engine::visit(map, this, A, _maxDist, engine::SK_ORDER);
+	engine::visit(map, this, source, _maxDist, engine::SK_ORDER);
 }
 
 engine::PathContinuation VictoryPath::visit(engine::xpoint a) {
@@ -587,19 +1218,16 @@ void VictoryPath::finished(engine::HexMap *map, engine::SegmentKind kind) {
 }
 
 void VictoryPath::reviewHex(engine::HexMap *map, engine::xpoint hex, int gval) {
-	ThreatState ts = _actor->getThreat(source);
+	_influence->include(hex);
 	ThreatState ts2 = _actor->getThreat(hex);
 	if (ts2 != TS_FRONT &&
 		ts2 != TS_COAST &&
 		ts2 != TS_BORDER)
 		return;
 	if (gval <= _maxDist){
-		float f = (_maxDist - gval) / float(_maxDist);
 		debugPrint("[" + string(hex.x) + ":" + hex.y + "]->" + gval + "\n");
-		if (ts == TS_ENEMY)
-			_actor->incrementEnemyVp(hex, f * _value);
-		else
-			_actor->incrementFriendlyVp(hex, f * _value);
+		_influence->reached.push_back(hex);
+		_influence->distance.push_back(gval);
 	}
 }
 /*
@@ -0,0 +1,153 @@
+#include "../common/platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/file_system.h"
+#include "../engine/engine.h"
+#include "../engine/force.h"
+#include "../engine/game.h"
+#include "../engine/game_time.h"
+#include "../engine/global.h"
+#include "../engine/pool.h"
+#include "../engine/scenario.h"
+#include "../engine/simulation.h"
+/*
+ *	batch
+ *
+ *	Runs one scenario from start to finish with no display, then
+ *	reports the outcome, how long it took and how hard it worked the
+ *	engine's object pools.  It links only the engine and ai code, so
+ *	it can run unattended on build machines.
+ *
+ *	Usage:
+ *
+ *		batch [ options ] scenario.scn
+ *
+ *	Options:
+ *
+ *		-seed n		Random seed.  Zero (the default) picks one from the clock.
+ *		-ai forces	Commanders to be played by the AI (default "all").
+ *		-threads n	Worker threads for the engine (default one per processor).
+ *		-data dir	Data folder (default: the parent of the scenario's folder).
+ *		-mapcache dir	Keep memory mapped .xmp2 copies of the maps in dir.
+ *		-save file	Write the final game state to file (.hsv, or .hsb for
+ *					a snapshot without the event log).
+ *		-journal file	Append events too old to keep in memory to file.
+ *		-autosave file	Save the game to file at the end of each day.
+ *		-deltas		With a .hsb autosave file, write a full base snapshot
+ *					once and only the changes from it each day after.
+ *		-log		Write the engine log to the console.
+ *		-verifyai	Check the AI's incremental threat map against a full
+ *					rebuild every day (slow).
+ */
+static void usage() {
+	fprintf(stderr, "Use is: batch [ -seed n ] [ -ai forces ] [ -threads n ] [ -data dir ] [ -mapcache dir ] [ -save file ] [ -journal file ] [ -autosave file ] [ -deltas ] [ -log ] [ -verifyai ] scenario.scn\n");
+	exit(2);
+}
+
+static void reportError(const string& filename, const string& explanation, script::fileOffset_t location) {
+	fprintf(stderr, "%s(@%d) : %s\n", filename.c_str(), int(location), explanation.c_str());
+}
+
+int main(int argc, char** argv) {
+	unsigned seed = 0;
+	string saveFile;
+	string dataFolder;
+	string scenarioFile;
+
+	global::aiForces = "all";
+	for (int i = 1; i < argc; i++) {
+		string arg(argv[i]);
+		if (arg == "-log")
+			engine::logToConsole();
+		else if (arg == "-verifyai")
+			global::verifyAiThreat = true;
+		else if (arg == "-deltas")
+			global::autosaveDeltas = true;
+		else if (argv[i][0] != '-')
+			scenarioFile = arg;
+		else if (i + 1 >= argc)
+			usage();
+		else if (arg == "-seed")
+			seed = strtoul(argv[++i], null, 10);
+		else if (arg == "-ai")
+			global::aiForces = argv[++i];
+		else if (arg == "-threads")
+			global::workerThreads = atoi(argv[++i]);
+		else if (arg == "-data")
+			dataFolder = argv[++i];
+		else if (arg == "-mapcache")
+			global::mapCacheFolder = fileSystem::absolutePath(argv[++i]);
+		else if (arg == "-save")
+			saveFile = argv[++i];
+		else if (arg == "-journal")
+			global::historyJournal = argv[++i];
+		else if (arg == "-autosave")
+			global::autosaveFile = argv[++i];
+		else
+			usage();
+	}
+	if (scenarioFile.size() == 0)
+		usage();
+	scenarioFile = fileSystem::absolutePath(scenarioFile);
+	if (dataFolder.size() == 0)
+		dataFolder = fileSystem::pathRelativeTo("..", scenarioFile);
+	global::dataFolder = fileSystem::absolutePath(dataFolder);
+	global::reportError = reportError;
+	engine::initForGame();
+
+	__int64 start = millisecondMark();
+	const engine::Scenario* scenario = engine::loadScenario(scenarioFile);
+	double loadSeconds = (millisecondMark() - start) / 1000.0;
+	if (scenario == null) {
+		engine::printErrorMessages();
+		fprintf(stderr, "Could not load scenario %s\n", scenarioFile.c_str());
+		return 1;
+	}
+
+		// Pick the clock seed here rather than leave it to the game, so
+		// that the seed printed below is the one the run used.
+
+	if (seed == 0) {
+		seed = unsigned(millisecondMark());
+		if (seed == 0)
+			seed = 1;
+	}
+	engine::SimulationStats stats;
+	engine::Game* game = engine::runSimulation(scenario, seed, &stats);
+	if (game == null) {
+		fprintf(stderr, "Game failed to start from scenario\n");
+		return 1;
+	}
+	game->calculateVictory();
+
+	printf("scenario %s\n", scenarioFile.c_str());
+	printf("seed %u\n", seed);
+	printf("end %s\n", engine::fromGameDate(game->time()).c_str());
+	for (int i = 0; i < game->force.size(); i++) {
+		engine::Force* f = game->force[i];
+		printf("force %s victory %d ammo %g\n", f->definition()->name.c_str(), f->victory, f->ammoConsumed());
+	}
+	double slowest = 0;
+	for (int i = 0; i < stats.daySeconds.size(); i++)
+		if (stats.daySeconds[i] > slowest)
+			slowest = stats.daySeconds[i];
+	printf("load %g seconds\n", loadSeconds);
+	printf("start %g seconds\n", stats.startSeconds);
+	printf("run %g seconds, %d days, %u events\n", stats.runSeconds, stats.daySeconds.size(), stats.events);
+	if (stats.daySeconds.size() > 0)
+		printf("day %g seconds average, %g slowest\n", stats.runSeconds / stats.daySeconds.size(), slowest);
+	engine::EventHistory* h = game->history();
+	printf("history %d events in memory, %d journaled, %d discarded\n", h->size(), h->spilled(), h->discarded());
+	for (const engine::ObjectPool* p = engine::ObjectPool::first(); p != null; p = p->next())
+		printf("pool %s %.0f allocations, %.0f reused, %.0f large, %d live, %d peak, %d chunks\n", p->name(), 
+					double(p->allocations), double(p->reuses), double(p->large), p->live, p->peak, p->chunks);
+
+	int status = 0;
+	if (saveFile.size() > 0 && !game->save(saveFile)) {
+		fprintf(stderr, "Could not save %s\n", saveFile.c_str());
+		status = 1;
+	}
+	delete game;
+	return status;
+}
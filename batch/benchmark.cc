@@ -0,0 +1,468 @@
+#include "../common/platform.h"
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../common/file_system.h"
+#include "../common/random.h"
+#include "../engine/combat.h"
+#include "../engine/detachment.h"
+#include "../engine/engine.h"
+#include "../engine/game.h"
+#include "../engine/game_event.h"
+#include "../engine/game_map.h"
+#include "../engine/global.h"
+#include "../engine/path.h"
+#include "../engine/scenario.h"
+#include "../engine/unit.h"
+/*
+ *	benchmark
+ *
+ *	Times the engine operations that dominate a game turn and writes
+ *	the results as JSON, so that builds can be compared.  For each
+ *	scenario it measures:
+ *
+ *		loadScenario			one cold load (the file web caches the result)
+ *		HexMap::load			loading the scenario's map again from disk
+ *		unitPath.find			random moves of up to 30 hexes by placed detachments
+ *		unitPath.find/rail		random entrained moves of up to 100 hexes between rail hexes
+ *		depotPath.find			a supply search from every placed detachment
+ *		Game::post/10000		posting into a queue with 10000 pending events
+ *		Game::post/100000		the same with 100000 pending events
+ *		advanceClock			one full game day, AI included
+ *		Combat::makeCurrent		every combat on the map at the end of each day, in a
+ *								copy of the game saved and loaded back for the purpose,
+ *								so the fights timed do not change the game being run
+ *
+ *	Every sample is one call, recorded in microseconds.  All random
+ *	choices come from the seed, so two runs with the same seed and
+ *	scenarios time the same work.
+ *
+ *	Usage:
+ *
+ *		benchmark [ options ] [ scenario.scn ... ]
+ *
+ *	Options:
+ *
+ *		-seed n			Seed for the games and the benchmark's own choices (default 1).
+ *		-iterations n	Samples for the repeated benchmarks (default 1000).
+ *		-days n			Game days to run per scenario (default 1).
+ *		-threads n		Worker threads for the engine (default one per processor).
+ *		-bidirectional n	Search unit paths of n or more hexes from both ends
+ *						(default 0, never).
+ *		-landmarks n	Landmarks in each map's path estimate index (default 0, none).
+ *		-hierarchical n	Plan unit paths of n or more hexes across map clusters
+ *						(default 0, never).
+ *		-railnetwork n	Route entrained moves over the rail network (1), or
+ *						search the hexes (0, the default).
+ *		-data dir		Data folder (default: the current directory).
+ *		-mapcache dir	Keep memory mapped .xmp2 copies of the maps in dir, so
+ *						HexMap::load times the mapped load.
+ *		-o file			Write the JSON to file instead of the console.
+ *
+ *	With no scenarios named, kursk.5.scn, rumantsyev.15.scn and
+ *	europe.41.5.scn from the data folder are used.
+ */
+static const char* defaultScenarios[] = {
+	"kursk.5.scn",
+	"rumantsyev.15.scn",
+	"europe.41.5.scn",
+};
+
+static double ticksPerMicrosecond;
+
+static __int64 tick() {
+	LARGE_INTEGER t;
+
+	QueryPerformanceCounter(&t);
+	return t.QuadPart;
+}
+
+class Benchmark {
+public:
+	Benchmark(const string& name, const string& scenario) {
+		_name = name;
+		_scenario = scenario;
+		_start = 0;
+	}
+
+	void start() {
+		_start = tick();
+	}
+
+	void stop() {
+		_samples.push_back((tick() - _start) / ticksPerMicrosecond);
+	}
+
+	void write(FILE* out, bool last) const;
+
+private:
+	string			_name;
+	string			_scenario;
+	vector<double>	_samples;
+	__int64			_start;
+};
+
+static vector<Benchmark*> benchmarks;
+
+static Benchmark* benchmark(const string& name, const string& scenario) {
+	Benchmark* b = new Benchmark(name, scenario);
+	benchmarks.push_back(b);
+	return b;
+}
+
+static int compareSamples(const void* a, const void* b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	if (x < y)
+		return -1;
+	else if (x > y)
+		return 1;
+	else
+		return 0;
+}
+/*
+ *	percentile
+ *
+ *	Nearest rank percentile of n sorted samples.
+ */
+static double percentile(const double* sorted, int n, int p) {
+	int rank = (p * n + 99) / 100;
+	if (rank < 1)
+		rank = 1;
+	return sorted[rank - 1];
+}
+
+static string jsonString(const string& s) {
+	string result("\"");
+	for (int i = 0; i < s.size(); i++) {
+		char c = s.c_str()[i];
+		if (c == '"' || c == '\\')
+			result.push_back('\\');
+		result.push_back(c);
+	}
+	result.push_back('"');
+	return result;
+}
+
+void Benchmark::write(FILE* out, bool last) const {
+	int n = _samples.size();
+	fprintf(out, "\t\t{ \"name\": %s, \"scenario\": %s, \"count\": %d, \"unit\": \"us\"",
+				jsonString(_name).c_str(), jsonString(_scenario).c_str(), n);
+	if (n > 0) {
+		double* sorted = new double[n];
+		double sum = 0;
+		for (int i = 0; i < n; i++) {
+			sorted[i] = _samples[i];
+			sum += sorted[i];
+		}
+		qsort(sorted, n, sizeof (double), compareSamples);
+		fprintf(out, ", \"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f",
+					sorted[0], sum / n, percentile(sorted, n, 50), percentile(sorted, n, 90),
+					percentile(sorted, n, 99), sorted[n - 1]);
+		delete [] sorted;
+	}
+	fprintf(out, " }%s\n", last ? "" : ",");
+}
+/*
+ *	BenchmarkEvent
+ *
+ *	Filler for the event queue benchmarks.  These events are always
+ *	unscheduled again before they can happen.
+ */
+class BenchmarkEvent : public engine::GameEvent {
+	typedef engine::GameEvent super;
+public:
+	BenchmarkEvent(minutes time) : super(time) {
+	}
+
+	virtual string name() {
+		return "Benchmark";
+	}
+
+	virtual string toString() {
+		return "";
+	}
+
+	virtual void execute() {
+	}
+};
+
+static int pick(random::Random* r, int n) {
+	int i = int(r->uniform() * n);
+	return i < n ? i : n - 1;
+}
+
+static void collectDetachments(engine::HexMap* map, vector<engine::Detachment*>* output) {
+	engine::xpoint hx;
+	for (hx.x = map->subsetOrigin().x; hx.x < map->subsetOpposite().x; hx.x++)
+		for (hx.y = map->subsetOrigin().y; hx.y < map->subsetOpposite().y; hx.y++)
+			for (engine::Detachment* d = map->getDetachments(hx); d != null; d = d->next)
+				output->push_back(d);
+}
+
+static void benchMapLoad(engine::HexMap* map, const string& label, int iterations) {
+	Benchmark* b = benchmark("HexMap::load", label);
+	for (int i = 0; i < iterations; i++) {
+		engine::HexMap* m = new engine::HexMap(map->filename, map->places.filename(), map->terrainKey.filename(), 0, 0);
+		b->start();
+		bool loaded = m->load();
+		b->stop();
+		delete m;
+		if (!loaded) {
+			fprintf(stderr, "Could not load map %s\n", map->filename.c_str());
+			return;
+		}
+	}
+}
+
+static void benchUnitPath(engine::Game* game, const string& label, vector<engine::Detachment*>& detachments, random::Random* r, int iterations) {
+	Benchmark* b = benchmark("unitPath.find", label);
+	engine::HexMap* map = game->map();
+	if (detachments.size() == 0)
+		return;
+	for (int i = 0; i < iterations; i++) {
+		engine::Detachment* d = detachments[pick(r, detachments.size())];
+		engine::xpoint dest(d->location().x + pick(r, 61) - 30, d->location().y + pick(r, 61) - 30);
+		if (!map->valid(dest))
+			continue;
+		b->start();
+		engine::Segment* s = engine::unitPath.find(map, d->unit, d->location(), engine::UM_MOVE, dest, false);
+		b->stop();
+		delete s;
+	}
+}
+
+static void benchRailPath(engine::Game* game, const string& label, vector<engine::Detachment*>& detachments, random::Random* r, int iterations) {
+	Benchmark* b = benchmark("unitPath.find/rail", label);
+	engine::HexMap* map = game->map();
+	vector<engine::Detachment*> entrained;
+	for (int i = 0; i < detachments.size(); i++)
+		if (map->hasRails(detachments[i]->location()))
+			entrained.push_back(detachments[i]);
+	if (entrained.size() == 0)
+		return;
+	for (int i = 0; i < iterations; i++) {
+		engine::Detachment* d = entrained[pick(r, entrained.size())];
+		engine::xpoint dest(d->location().x + pick(r, 201) - 100, d->location().y + pick(r, 201) - 100);
+		if (!map->valid(dest) || !map->hasRails(dest))
+			continue;
+		b->start();
+		engine::Segment* s = engine::unitPath.find(map, d->unit, d->location(), engine::UM_ENTRAINED, dest, false);
+		b->stop();
+		delete s;
+	}
+}
+
+static void benchDepotPath(const string& label, vector<engine::Detachment*>& detachments) {
+	Benchmark* b = benchmark("depotPath.find", label);
+	for (int i = 0; i < detachments.size(); i++) {
+		engine::Detachment* d = detachments[i];
+		b->start();
+		engine::Segment* s = engine::depotPath.find(d, d->location());
+		b->stop();
+		delete s;
+	}
+}
+
+static void benchPost(engine::Game* game, const string& label, int pending, random::Random* r, int iterations) {
+	vector<engine::GameEvent*> events;
+	minutes base = game->time() + 1;
+	for (int i = 0; i < pending; i++) {
+		engine::GameEvent* e = new BenchmarkEvent(base + minutes(r->uniform() * 30 * engine::oneDay));
+		game->post(e);
+		events.push_back(e);
+	}
+	Benchmark* b = benchmark(string("Game::post/") + pending, label);
+	for (int i = 0; i < iterations; i++) {
+		engine::GameEvent* e = new BenchmarkEvent(base + minutes(r->uniform() * 30 * engine::oneDay));
+		b->start();
+		game->post(e);
+		b->stop();
+		game->unschedule(e);
+		delete e;
+	}
+	for (int i = 0; i < events.size(); i++) {
+		game->unschedule(events[i]);
+		delete events[i];
+	}
+}
+
+static void benchCombats(engine::Game* game, Benchmark* b) {
+	engine::HexMap* map = game->map();
+	engine::xpoint hx;
+	for (hx.x = map->subsetOrigin().x; hx.x < map->subsetOpposite().x; hx.x++)
+		for (hx.y = map->subsetOrigin().y; hx.y < map->subsetOpposite().y; hx.y++) {
+			engine::Combat* c = map->combat(hx);
+			if (c == null)
+				continue;
+			b->start();
+			c->makeCurrent();
+			b->stop();
+		}
+}
+
+/*
+ *	benchCombatsOnCopy
+ *
+ *	Saves the game to a scratch file and times the combats of the game
+ *	loaded back from it.  The copy is thrown away afterwards, so the
+ *	combats resolved here never touch the game itself.
+ */
+static bool benchCombatsOnCopy(engine::Game* game, Benchmark* b) {
+	char folder[MAX_PATH];
+	char scratch[MAX_PATH];
+
+	if (GetTempPathA(sizeof folder, folder) == 0 ||
+		GetTempFileNameA(folder, "bch", 0, scratch) == 0) {
+		fprintf(stderr, "Could not make a scratch file for the combat copy\n");
+		return false;
+	}
+	bool result = false;
+	if (game->save(scratch)) {
+		engine::Game* copy = engine::loadGame(scratch);
+		if (copy != null) {
+			benchCombats(copy, b);
+			delete copy;
+			result = true;
+		}
+	}
+	DeleteFileA(scratch);
+	if (!result)
+		fprintf(stderr, "Could not save and load a copy of the game to time its combats\n");
+	return result;
+}
+
+static bool benchScenario(const string& filename, const string& label, unsigned seed, int iterations, int days) {
+	Benchmark* load = benchmark("loadScenario", label);
+	load->start();
+	const engine::Scenario* scenario = engine::loadScenario(filename);
+	load->stop();
+	if (scenario == null) {
+		engine::printErrorMessages();
+		fprintf(stderr, "Could not load scenario %s\n", filename.c_str());
+		return false;
+	}
+	benchMapLoad(scenario->map(), label, iterations / 100 + 1);
+
+	engine::Game* game = engine::startGame(scenario, seed);
+	if (game == null) {
+		fprintf(stderr, "Game failed to start from scenario %s\n", filename.c_str());
+		return false;
+	}
+	random::Random r(seed);
+	vector<engine::Detachment*> detachments;
+	collectDetachments(game->map(), &detachments);
+
+	benchUnitPath(game, label, detachments, &r, iterations);
+	benchDepotPath(label, detachments);
+	benchPost(game, label, 10000, &r, iterations);
+	benchPost(game, label, 100000, &r, iterations);
+	benchRailPath(game, label, detachments, &r, iterations);
+
+	Benchmark* day = benchmark("advanceClock", label);
+	Benchmark* combat = benchmark("Combat::makeCurrent", label);
+	for (int i = 0; i < days && !game->over(); i++) {
+		day->start();
+		game->advanceClock();
+		day->stop();
+		if (!benchCombatsOnCopy(game, combat))
+			break;
+	}
+	delete game;
+	return true;
+}
+
+static void usage() {
+	fprintf(stderr, "Use is: benchmark [ -seed n ] [ -iterations n ] [ -days n ] [ -threads n ] [ -bidirectional n ] [ -landmarks n ] [ -hierarchical n ] [ -railnetwork n ] [ -data dir ] [ -mapcache dir ] [ -o file ] [ scenario.scn ... ]\n");
+	exit(2);
+}
+
+static void reportError(const string& filename, const string& explanation, script::fileOffset_t location) {
+	fprintf(stderr, "%s(@%d) : %s\n", filename.c_str(), int(location), explanation.c_str());
+}
+
+int main(int argc, char** argv) {
+	unsigned seed = 1;
+	int iterations = 1000;
+	int days = 1;
+	string dataFolder(".");
+	string outputFile;
+	vector<string> scenarios;
+
+	global::aiForces = "all";
+	for (int i = 1; i < argc; i++) {
+		string arg(argv[i]);
+		if (argv[i][0] != '-')
+			scenarios.push_back(arg);
+		else if (i + 1 >= argc)
+			usage();
+		else if (arg == "-seed")
+			seed = strtoul(argv[++i], null, 10);
+		else if (arg == "-iterations")
+			iterations = atoi(argv[++i]);
+		else if (arg == "-days")
+			days = atoi(argv[++i]);
+		else if (arg == "-threads")
+			global::workerThreads = atoi(argv[++i]);
+		else if (arg == "-bidirectional")
+			global::bidirectionalPathDistance = atoi(argv[++i]);
+		else if (arg == "-landmarks")
+			global::landmarkCount = atoi(argv[++i]);
+		else if (arg == "-hierarchical")
+			global::hierarchicalPathDistance = atoi(argv[++i]);
+		else if (arg == "-railnetwork")
+			global::railNetworkPaths = atoi(argv[++i]) != 0;
+		else if (arg == "-data")
+			dataFolder = argv[++i];
+		else if (arg == "-mapcache")
+			global::mapCacheFolder = fileSystem::absolutePath(argv[++i]);
+		else if (arg == "-o")
+			outputFile = argv[++i];
+		else
+			usage();
+	}
+	global::dataFolder = fileSystem::absolutePath(dataFolder);
+	if (scenarios.size() == 0)
+		for (int i = 0; i < dimOf(defaultScenarios); i++)
+			scenarios.push_back(global::dataFolder + "/scenarios/" + defaultScenarios[i]);
+	global::reportError = reportError;
+	engine::initForGame();
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	ticksPerMicrosecond = frequency.QuadPart / 1000000.0;
+
+	int status = 0;
+	for (int i = 0; i < scenarios.size(); i++) {
+		string label = scenarios[i];
+		int slash = label.size();
+		while (slash > 0 && label.c_str()[slash - 1] != '/' && label.c_str()[slash - 1] != '\\')
+			slash--;
+		label = label.substr(slash);
+		if (!benchScenario(fileSystem::absolutePath(scenarios[i]), label, seed, iterations, days))
+			status = 1;
+	}
+
+	FILE* out = stdout;
+	if (outputFile.size() > 0) {
+		out = fopen(outputFile.c_str(), "w");
+		if (out == null) {
+			fprintf(stderr, "Could not write %s\n", outputFile.c_str());
+			return 1;
+		}
+	}
+	fprintf(out, "{\n");
+	fprintf(out, "\t\"seed\": %u,\n", seed);
+	fprintf(out, "\t\"iterations\": %d,\n", iterations);
+	fprintf(out, "\t\"days\": %d,\n", days);
+	fprintf(out, "\t\"results\": [\n");
+	for (int i = 0; i < benchmarks.size(); i++)
+		benchmarks[i]->write(out, i == benchmarks.size() - 1);
+	fprintf(out, "\t]\n");
+	fprintf(out, "}\n");
+	if (out != stdout)
+		fclose(out);
+	benchmarks.deleteAll();
+	return status;
+}
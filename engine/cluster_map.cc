@@ -0,0 +1,370 @@
+#include "../common/platform.h"
+#include "cluster_map.h"
+
+#include "game_map.h"
+#include "global.h"
+#include "path.h"
+
+namespace engine {
+
+const int CLUSTER_UNREACHED = -1;
+/*
+ *	ClusterTour
+ *
+ *	Tours the hexes of one cluster from a hex in it, or, if toward
+ *	is set, finds the distances from the hexes of the cluster to it.
+ */
+class ClusterTour : public PathHeuristic {
+public:
+	ClusterTour(ClusterMap* clusters) {
+		_clusters = clusters;
+		cluster = 0;
+		toward = false;
+	}
+
+	virtual int kost(xpoint a, HexDirection dir, xpoint b) {
+		if (_clusters->clusterOf(b) != cluster)
+			return MAXIMUM_PATH_LENGTH + 1;
+		int w;
+		if (toward)
+			w = _clusters->weight(b, reverseDirection(dir));
+		else
+			w = _clusters->weight(a, dir);
+		if (w > MAXIMUM_PATH_LENGTH)
+			return w;
+		return w + _clusters->_step;
+	}
+
+	virtual void reviewHex(HexMap* map, xpoint a, int gval) {
+		xpoint o = _clusters->_origin;
+		int x = (a.x - o.x) % CLUSTER_SIZE;
+		int y = (a.y - o.y) % CLUSTER_SIZE;
+		_clusters->_local[y * CLUSTER_SIZE + x] = gval;
+	}
+
+	int				cluster;
+	bool			toward;
+
+private:
+	ClusterMap*		_clusters;
+};
+
+ClusterMap::ClusterMap(HexMap* map, UnitCarriers carriers, MoveManner moveManner) {
+	_map = map;
+	_carriers = carriers;
+	_moveManner = moveManner;
+	_step = int(24 * global::kmPerHex / 30);
+	_minimumStep = _step;
+	_origin = map->subsetOrigin();
+	_opposite = map->subsetOpposite();
+	_clusterColumns = (_opposite.x - _origin.x + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+	_clusterRows = (_opposite.y - _origin.y + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+	int count = _clusterColumns * _clusterRows;
+	_clusters = new Cluster[count];
+	for (int i = 0; i < count; i++)
+		_clusters[i].dirty = true;
+	_rebuilds = 0;
+	_tour = new ClusterTour(this);
+	_local = new int[CLUSTER_SIZE * CLUSTER_SIZE];
+	_stamp = new unsigned[count * CLUSTER_GATES];
+	_index = new int[count * CLUSTER_GATES];
+	for (int i = 0; i < count * CLUSTER_GATES; i++)
+		_stamp[i] = 0;
+	_generation = 0;
+}
+
+ClusterMap::~ClusterMap() {
+	delete [] _clusters;
+	delete _tour;
+	delete [] _local;
+	delete [] _stamp;
+	delete [] _index;
+}
+
+void ClusterMap::changed(xpoint hx, HexDirection dir) {
+	if (_map->valid(hx))
+		_clusters[clusterOf(hx)].dirty = true;
+	xpoint n = neighbor(hx, dir);
+	if (_map->valid(n))
+		_clusters[clusterOf(n)].dirty = true;
+}
+
+bool ClusterMap::plan(xpoint A, xpoint B, vector<xpoint>* waypoints) {
+	int ca = clusterOf(A);
+	int cb = clusterOf(B);
+	if (ca == cb)
+		return false;
+	Cluster* first = cluster(ca);
+	Cluster* last = cluster(cb);
+	_minimumStep = _step + _map->minimumEdgeCost(_carriers, _moveManner);
+
+		// Connect the gates of B's cluster to B.
+
+	vector<int> toGoal;
+	tour(cb, B, true);
+	for (int i = 0; i < last->gates.size(); i++)
+		toGoal.push_back(local(cb, last->gates[i]));
+
+	_generation++;
+	if (_generation == 0) {
+		int slots = _clusterColumns * _clusterRows * CLUSTER_GATES;
+		for (int i = 0; i < slots; i++)
+			_stamp[i] = 0;
+		_generation = 1;
+	}
+	_nodes.clear();
+	_open.clear();
+
+		// Connect A to the gates of its own cluster.
+
+	tour(ca, A, false);
+	for (int i = 0; i < first->gates.size(); i++) {
+		int d = local(ca, first->gates[i]);
+		if (d != CLUSTER_UNREACHED)
+			relax(ca, i, d, -1, false, B);
+	}
+
+	int best = MAXIMUM_PATH_LENGTH;
+	int bestNode = -1;
+	while (_open.size() > 0) {
+		PlanEntry e = _open[0];
+		int n = _open.size() - 1;
+		PlanEntry moved = _open[n];
+		_open.resize(n);
+		if (n > 0) {
+			int i = 0;
+			for (;;) {
+				int child = 2 * i + 1;
+				if (child >= n)
+					break;
+				if (child + 1 < n && _open[child + 1].fval < _open[child].fval)
+					child++;
+				if (_open[child].fval >= moved.fval)
+					break;
+				_open[i] = _open[child];
+				i = child;
+			}
+			_open[i] = moved;
+		}
+		if (e.fval >= best)
+			break;
+		if (_nodes[e.node].closed || _nodes[e.node].gval != e.gval)
+			continue;						// A better entry for the node came first
+		_nodes[e.node].closed = true;
+		int c = _nodes[e.node].cluster;
+		int gate = _nodes[e.node].gate;
+		int g = e.gval;
+		Cluster* cl = cluster(c);
+		if (c == cb && toGoal[gate] != CLUSTER_UNREACHED && g + toGoal[gate] < best) {
+			best = g + toGoal[gate];
+			bestNode = e.node;
+		}
+		int count = cl->gates.size();
+		for (int j = 0; j < count; j++) {
+			int d = cl->distance[gate * count + j];
+			if (j != gate && d != CLUSTER_UNREACHED)
+				relax(c, j, g + d, e.node, false, B);
+		}
+		for (int i = 0; i < cl->links.size(); i++) {
+			const Link& l = cl->links[i];
+			if (l.gate != gate)
+				continue;
+			int next = clusterOf(l.to);
+			int j = gateIndex(cluster(next), l.to);
+			if (j >= 0)
+				relax(next, j, g + l.cost, e.node, true, B);
+		}
+	}
+	if (bestNode < 0)
+		return false;
+
+	vector<xpoint> entries;
+	for (int n = bestNode; n >= 0; n = _nodes[n].parent)
+		if (_nodes[n].viaLink)
+			entries.push_back(_clusters[_nodes[n].cluster].gates[_nodes[n].gate]);
+	waypoints->clear();
+	for (int i = entries.size() - 1; i >= 0; i--)
+		waypoints->push_back(entries[i]);
+	if (waypoints->size() == 0 || (*waypoints)[waypoints->size() - 1] != B)
+		waypoints->push_back(B);
+	return true;
+}
+
+ClusterMap::Cluster* ClusterMap::cluster(int c) {
+	if (_clusters[c].dirty)
+		rebuild(c);
+	return &_clusters[c];
+}
+/*
+ *	rebuild
+ *
+ *	Finds the gates of cluster c along its borders with each of the
+ *	clusters around it, then the distances between them.
+ */
+void ClusterMap::rebuild(int c) {
+	Cluster* cl = &_clusters[c];
+	cl->dirty = false;
+	cl->gates.clear();
+	cl->links.clear();
+	int cx = c % _clusterColumns;
+	int cy = c / _clusterColumns;
+	for (int dy = -1; dy <= 1; dy++)
+		for (int dx = -1; dx <= 1; dx++) {
+			if (dx == 0 && dy == 0)
+				continue;
+			if (cx + dx < 0 || cx + dx >= _clusterColumns ||
+				cy + dy < 0 || cy + dy >= _clusterRows)
+				continue;
+			border(c, (cy + dy) * _clusterColumns + cx + dx);
+		}
+	int count = cl->gates.size();
+	cl->distance.resize(count * count);
+	for (int i = 0; i < count; i++) {
+		tour(c, cl->gates[i], false);
+		for (int j = 0; j < count; j++)
+			cl->distance[i * count + j] = local(c, cl->gates[j]);
+	}
+	_rebuilds++;
+}
+/*
+ *	border
+ *
+ *	Adds to cluster c the gates of the entrances between it and
+ *	cluster other.  The edges are always scanned from the side of the
+ *	lower numbered cluster, so both clusters choose the same gates.
+ */
+void ClusterMap::border(int c, int other) {
+	int lo = c < other ? c : other;
+	int hi = c < other ? other : c;
+	xpoint corner(_origin.x + (lo % _clusterColumns) * CLUSTER_SIZE,
+				  _origin.y + (lo / _clusterColumns) * CLUSTER_SIZE);
+	vector<Crossing> run;
+	xpoint hx;
+	for (hx.y = corner.y; hx.y < corner.y + CLUSTER_SIZE && hx.y < _opposite.y; hx.y++)
+		for (hx.x = corner.x; hx.x < corner.x + CLUSTER_SIZE && hx.x < _opposite.x; hx.x++)
+			for (HexDirection dir = 0; dir < 6; dir++) {
+				xpoint n = neighbor(hx, dir);
+				if (!_map->valid(n) || clusterOf(n) != hi)
+					continue;
+				Crossing x;
+				x.from = hx;
+				x.to = n;
+				x.forward = weight(hx, dir);
+				x.backward = weight(n, reverseDirection(dir));
+				bool passable = x.forward <= MAXIMUM_PATH_LENGTH || x.backward <= MAXIMUM_PATH_LENGTH;
+
+					// An entrance ends at an edge that cannot be crossed
+					// either way, or where the border turns a corner.
+
+				if (run.size() > 0) {
+					const Crossing& p = run[run.size() - 1];
+					if (!passable || hexDistance(p.from, hx) > 1 || hexDistance(p.to, n) > 1) {
+						addEntrance(c, run);
+						run.clear();
+					}
+				}
+				if (passable)
+					run.push_back(x);
+			}
+	if (run.size() > 0)
+		addEntrance(c, run);
+}
+
+void ClusterMap::addEntrance(int c, const vector<Crossing>& run) {
+	if (run.size() <= ENTRANCE_WIDTH)
+		addCrossing(c, run[run.size() / 2]);
+	else {
+		addCrossing(c, run[0]);
+		addCrossing(c, run[run.size() - 1]);
+	}
+}
+
+void ClusterMap::addCrossing(int c, const Crossing& x) {
+	Cluster* cl = &_clusters[c];
+	bool low = clusterOf(x.from) == c;
+	xpoint mine = low ? x.from : x.to;
+	int g = gateIndex(cl, mine);
+	if (g < 0) {
+		if (cl->gates.size() >= CLUSTER_GATES)
+			return;
+		g = cl->gates.size();
+		cl->gates.push_back(mine);
+	}
+	int cost = low ? x.forward : x.backward;
+	if (cost <= MAXIMUM_PATH_LENGTH) {
+		Link l;
+		l.gate = g;
+		l.to = low ? x.to : x.from;
+		l.cost = cost + _step;
+		cl->links.push_back(l);
+	}
+}
+
+int ClusterMap::gateIndex(const Cluster* cl, xpoint hx) const {
+	for (int i = 0; i < cl->gates.size(); i++)
+		if (cl->gates[i] == hx)
+			return i;
+	return -1;
+}
+
+int ClusterMap::weight(xpoint hx, HexDirection dir) {
+	int c = _map->edgeCost(hx, dir, _carriers, _moveManner, true);
+	int o = _map->edgeCost(hx, dir, _carriers, _moveManner, false);
+	return c < o ? c : o;
+}
+
+void ClusterMap::tour(int c, xpoint origin, bool toward) {
+	for (int i = 0; i < CLUSTER_SIZE * CLUSTER_SIZE; i++)
+		_local[i] = CLUSTER_UNREACHED;
+	_tour->cluster = c;
+	_tour->toward = toward;
+	_tour->source = origin;
+	_tour->visitLimit = CLUSTER_SIZE * CLUSTER_SIZE;
+	engine::visit(_map, _tour, origin, MAXIMUM_PATH_LENGTH, SK_ORDER);
+	_tour->review(_map);
+}
+
+int ClusterMap::local(int c, xpoint hx) const {
+	int x = (hx.x - _origin.x) % CLUSTER_SIZE;
+	int y = (hx.y - _origin.y) % CLUSTER_SIZE;
+	return _local[y * CLUSTER_SIZE + x];
+}
+
+void ClusterMap::relax(int c, int gate, int g, int parent, bool viaLink, xpoint goal) {
+	int slot = c * CLUSTER_GATES + gate;
+	int ni;
+	if (_stamp[slot] != _generation) {
+		_stamp[slot] = _generation;
+		ni = _nodes.size();
+		_index[slot] = ni;
+		PlanNode n;
+		n.cluster = c;
+		n.gate = gate;
+		n.closed = false;
+		_nodes.push_back(n);
+	} else {
+		ni = _index[slot];
+		if (_nodes[ni].closed || g >= _nodes[ni].gval)
+			return;
+	}
+	_nodes[ni].gval = g;
+	_nodes[ni].parent = parent;
+	_nodes[ni].viaLink = viaLink;
+
+	PlanEntry e;
+	e.gval = g;
+	e.fval = g + hexDistance(_clusters[c].gates[gate], goal) * _minimumStep;
+	e.node = ni;
+	int i = _open.size();
+	_open.push_back(e);
+	while (i > 0) {
+		int parentSlot = (i - 1) / 2;
+		if (_open[parentSlot].fval <= e.fval)
+			break;
+		_open[i] = _open[parentSlot];
+		i = parentSlot;
+	}
+	_open[i] = e;
+}
+
+}  // namespace engine
@@ -0,0 +1,156 @@
+#pragma once
+#include "../common/vector.h"
+#include "basic_types.h"
+#include "constants.h"
+
+namespace engine {
+
+class ClusterTour;
+class HexMap;
+
+const int CLUSTER_SIZE = 16;				// Hexes along each side of a cluster
+const int CLUSTER_GATES = 64;				// Most gates one cluster will have
+const int ENTRANCE_WIDTH = 6;				// Entrances wider than this get a gate at each end
+/*
+ *	ClusterMap
+ *
+ *	A coarse picture of one of a map's edge cost tables, for planning
+ *	long marches (HPA*).  The map is cut into square clusters of
+ *	CLUSTER_SIZE hexes on a side.  Each stretch of passable edges along
+ *	the border between two clusters is an entrance, and the hexes on
+ *	either side of one or two edges of each entrance are gates.  Within
+ *	a cluster, the cheapest distance between each pair of its gates,
+ *	using only hexes in the cluster, is cached.
+ *
+ *	plan searches the graph of gates, which is much smaller than the
+ *	map, and returns the hexes where the route it finds enters each
+ *	cluster.  UnitPath then finds the actual route a couple of
+ *	clusters at a time, with all the costs a unit faces.
+ *
+ *	Costs here are those of the edge cost table (the lower of the on
+ *	and off road costs) plus the distance charge UnitPath::kost adds
+ *	for each step.  The enemy is left out, since that depends on the
+ *	force doing the moving.  When the map changes the cost of an edge,
+ *	the clusters on either side of it are rebuilt the next time a plan
+ *	needs them; the rest are left alone.
+ */
+class ClusterMap {
+public:
+	ClusterMap(HexMap* map, UnitCarriers carriers, MoveManner moveManner);
+
+	~ClusterMap();
+	/*
+	 *	changed
+	 *
+	 *	Marks the clusters on both sides of the edge from hx in
+	 *	direction dir to be rebuilt.
+	 */
+	void changed(xpoint hx, HexDirection dir);
+	/*
+	 *	plan
+	 *
+	 *	Plans a route from A to B through the clusters.  On success,
+	 *	*waypoints is set to the hexes where the route enters each
+	 *	cluster after A's, ending with B.  Returns false if A and B are
+	 *	in the same cluster or no route connects them.
+	 */
+	bool plan(xpoint A, xpoint B, vector<xpoint>* waypoints);
+
+	int clusterOf(xpoint hx) const {
+		return ((hx.y - _origin.y) / CLUSTER_SIZE) * _clusterColumns + (hx.x - _origin.x) / CLUSTER_SIZE;
+	}
+
+	int rebuilds() const { return _rebuilds; }
+
+private:
+	friend ClusterTour;
+
+	ClusterMap(const ClusterMap&);
+
+	void operator= (const ClusterMap&);
+
+	class Link {
+	public:
+		int				gate;				// Index of the gate in this cluster
+		xpoint			to;					// Gate hex in the next cluster
+		int				cost;
+	};
+
+	class Cluster {
+	public:
+		bool			dirty;
+		vector<xpoint>	gates;
+		vector<int>		distance;			// From each gate (row) to each gate (column)
+		vector<Link>	links;				// Steps out of the cluster
+	};
+
+	class Crossing {
+	public:
+		xpoint			from;				// In the lower numbered cluster
+		xpoint			to;
+		int				forward;			// Cost from from to to
+		int				backward;			// Cost from to to from
+	};
+
+	class PlanNode {
+	public:
+		int				cluster;
+		int				gate;
+		int				gval;
+		int				parent;				// Index in _nodes, or -1
+		bool			viaLink;			// Reached from another cluster
+		bool			closed;
+	};
+
+	class PlanEntry {
+	public:
+		int				fval;
+		int				gval;
+		int				node;
+	};
+
+	Cluster* cluster(int c);
+
+	void rebuild(int c);
+
+	void border(int c, int other);
+
+	void addEntrance(int c, const vector<Crossing>& run);
+
+	void addCrossing(int c, const Crossing& x);
+
+	int gateIndex(const Cluster* cl, xpoint hx) const;
+
+	int weight(xpoint hx, HexDirection dir);
+
+	void tour(int c, xpoint origin, bool toward);
+
+	int local(int c, xpoint hx) const;
+
+	void relax(int c, int gate, int g, int parent, bool viaLink, xpoint goal);
+
+	HexMap*			_map;
+	UnitCarriers	_carriers;
+	MoveManner		_moveManner;
+	int				_step;					// Distance charge for each hex entered
+	int				_minimumStep;			// No more than the cost of any step
+	xpoint			_origin;
+	xpoint			_opposite;
+	int				_clusterColumns;
+	int				_clusterRows;
+	Cluster*		_clusters;
+	int				_rebuilds;
+	ClusterTour*	_tour;
+	int*			_local;					// Distances found by the last tour, CLUSTER_SIZE squared
+
+		// Working state of plan, with a node slot for each gate of
+		// each cluster.
+
+	unsigned*		_stamp;
+	int*			_index;
+	unsigned		_generation;
+	vector<PlanNode>	_nodes;
+	vector<PlanEntry>	_open;				// Binary heap on fval, may hold stale entries
+};
+
+}  // namespace engine
@@ -13,7 +13,9 @@
 #include "game.h"
 #include "game_event.h"
 #include "global.h"
+#include "parallel.h"
 #include "path.h"
+#include "pool.h"
 #include "theater.h"
 #include "unit.h"
 #include "unitdef.h"
@@ -22,8 +24,15 @@ namespace engine {
 
 static tons calculateSalvo(WeaponClass weaponClass, const Theater* theater, InvolvedUnit* iu, int j, bool isAttacker);
 
+static float directFireDoctrineRate(const Theater* theater, InvolvedUnit* iu, bool firesAtAmmo, bool isAttacker);
+
+static float indirectFireDoctrineRate(const Theater* theater, InvolvedUnit* iu, bool isAttacker);
+
 static bool combatsHappened = false;
 
+static ObjectPool involvedDetachmentPool("InvolvedDetachment");
+static ObjectPool involvedUnitPool("InvolvedUnit");
+
 static Function atPenetration;
 static Function apFortificationProtection;
 static Function apLineSuppression;
@@ -78,6 +87,14 @@ public:
 		_idetachment = idet;
 	}
 
+	static void* operator new(size_t size) {
+		return involvedUnitPool.allocate(size);
+	}
+
+	static void operator delete(void* p, size_t size) {
+		involvedUnitPool.release(p, size);
+	}
+
 	void log();
 
 	InvolvedUnit*		next;
@@ -88,10 +105,10 @@ public:
 			return 0.0;
 		switch (_idetachment->edge()) {
 		case EDGE_COAST:
-			return global::coastEdgeAdjust;
+			return unit->game()->parameters.coastEdgeAdjust;
 
 		case EDGE_RIVER:
-			return global::riverEdgeAdjust;
+			return unit->game()->parameters.riverEdgeAdjust;
 
 		default:
 			return 1.0;
@@ -102,22 +119,33 @@ public:
 		_idetachment->detachedUnit->detachment()->prepareToDefend();
 	}
 
-	float computeFirepower(float pATWeaponFiresAT, float ammoRatio, CombatGroup* cg, bool isAttacker) {
-		if (detachment() == null)
-			return 0;
-		const Theater* theater = unit->game()->theater();
+	/*
+	 *	directFireRate
+	 *
+	 *	The multiplier that fatigue, ammunition supply, the attack
+	 *	edge and doctrine apply to each direct fire salvo of the unit.
+	 */
+	double directFireRate(float ammoRatio, bool isAttacker) {
+		const GameParameters& parameters = unit->game()->parameters;
 		float f = 1 - detachment()->fatigue;
 		float fatigueAdjust;
 		if (isAttacker)
-			fatigueAdjust = f * (1 - global::maxFatigueOffensiveDirectFireModifier) + global::maxFatigueOffensiveDirectFireModifier;
+			fatigueAdjust = f * (1 - parameters.maxFatigueOffensiveDirectFireModifier) + parameters.maxFatigueOffensiveDirectFireModifier;
 		else
-			fatigueAdjust = f * (1 - global::maxFatigueDefensiveDirectFireModifier) + global::maxFatigueDefensiveDirectFireModifier;
-		float doctrineRate;				// consumption rate
+			fatigueAdjust = f * (1 - parameters.maxFatigueDefensiveDirectFireModifier) + parameters.maxFatigueDefensiveDirectFireModifier;
 		double unitRate = fatigueAdjust * ammoRatio * this->unitRate();
 		if (isAttacker)
 			unitRate *= doctrine()->adcRate;
 		else
 			unitRate *= doctrine()->dacRate;
+		return unitRate;
+	}
+
+	float computeFirepower(float pATWeaponFiresAT, float ammoRatio, CombatGroup* cg, bool isAttacker) {
+		if (detachment() == null)
+			return 0;
+		const Theater* theater = unit->game()->theater();
+		double unitRate = directFireRate(ammoRatio, isAttacker);
 
 		float firepower = 0;
 		for (int j = 0; j < unit->equipment_size(); j++) {
@@ -167,9 +195,10 @@ private:
 
 Combat::Combat(Detachment *attacker) 
     : attackers(attacker->game()), 
-	  defenders(attacker->game()) {
+	  defenders(attacker->game()),
+	  _random(1) {
 	init(attacker->game(), attacker->destination);
-	attacker->action = DA_ATTACKING;
+	attacker->setAction(DA_ATTACKING);
 	Detachment* d = _game->map()->getDetachments(location);
 	attackers.enlist(attacker, 0, true, false);
 	if (d == null) {
@@ -213,7 +242,8 @@ void Combat::initInfiltration() {
 
 Combat::Combat(Game* game, xpoint hex) 
     : attackers(game), 
-	  defenders(game) {
+	  defenders(game),
+	  _random(1) {
 	init(game, hex);
 	combatClass = CC_MEETING;
 	_density = 1;
@@ -276,6 +306,7 @@ void Combat::init(Game* game, xpoint hex) {
 	}
 	_start = game->time();
 	_lastChecked = _start;
+	_firedTo = _start;
 	_nextEvent = null;
 	_game = game;
 	location = hex;
@@ -325,7 +356,7 @@ InvolvedDetachment* Combat::involve(Detachment* d, float preparation) {
 
 		case	CC_MEETING:
 			_game->purge(d);
-			d->action = DA_ATTACKING;
+			d->setAction(DA_ATTACKING);
 			d->destination = location;
 			idet = defenders.enlist(d, preparation, true, false);
 			break;
@@ -337,7 +368,7 @@ InvolvedDetachment* Combat::involve(Detachment* d, float preparation) {
 	} else {
 		if (combatClass == CC_MEETING)
 			_game->purge(d);
-		d->action = DA_ATTACKING;
+		d->setAction(DA_ATTACKING);
 		d->destination = location;
 		idet = attackers.enlist(d, preparation, true, false);
 	}
@@ -382,7 +413,6 @@ bool Combat::makeCurrent(SchedulingChoice schedule) {
 		// casualties to happen
 
 	if (_game->time() > _lastChecked) {
-		float elapsedDays = float(_game->time() - _lastChecked) / oneDay;
 		if (engine::logging())
 			engine::logPrintf("%s @[%d:%d] lastChecked %s\n", combatClassNames[combatClass], location.x, location.y,
 															  logGameTime(_lastChecked).c_str());
@@ -390,38 +420,14 @@ bool Combat::makeCurrent(SchedulingChoice schedule) {
 
 		bool defendersReallyAttacking = (combatClass == CC_MEETING);
 
-		attackers.scrub(this, true);
-		defenders.scrub(this, defendersReallyAttacking);
-		float attack = attackers.fireOn(&defenders, true, elapsedDays);
-		float defense = defenders.fireOn(&attackers, defendersReallyAttacking, elapsedDays);
-		engine::logPrintf("\n    attack=%g defense=%g\n", attack, defense);
-		_ratio = attack / defense;
-		if (combatClass != CC_MEETING) {
-			if (defenders._deployed)
-				computeDefensiveFront(defenders._deployed->detachedUnit);
-			_density = calculateDensity(defense / elapsedDays);
-			_involvedDefense = ratioToDefense(_ratio / _density);
-			defenders.setDefenseInvolvement(_involvedDefense);
-		}
-		if (engine::logging())
-			logInputs();
-		attackers.consumeFuel(true, elapsedDays);
-		defenders.consumeFuel(defendersReallyAttacking, elapsedDays);
-		attackers.consumeAmmunition(elapsedDays, true);
-		defenders.consumeAmmunition(elapsedDays, defendersReallyAttacking);
-		attackers.adjustAttackers(this);
-		if (defendersReallyAttacking)
-			defenders.adjustAttackers(this);
-		else
-			defenders.adjustDefenders(this, elapsedDays);
-		if (logging()) {
-			attackers.logDetail("Attackers");
-			defenders.logDetail("Defenders");
+			// fireConcurrently may have resolved this step already.
+
+		if (_firedTo < _game->time()) {
+			seedStep();
+			fire();
+			attackers.invalidateTotals();
+			defenders.invalidateTotals();
 		}
-		attackers.deductLosses(&defenders, true, this);
-		defenders.deductLosses(&attackers, defendersReallyAttacking, this);
-		if (logging())
-			logLosses();
 		attackers.scrub(this, true);
 		defenders.scrub(this, defendersReallyAttacking);
 
@@ -455,6 +461,139 @@ bool Combat::makeCurrent(SchedulingChoice schedule) {
 	return true;
 }
 
+class CombatStepTask : public ParallelTask {
+public:
+	CombatStepTask(const vector<Combat*>& combats) : _combats(combats) {
+	}
+
+	virtual void run(int item, int worker) {
+		_combats[item]->fire();
+	}
+
+private:
+	const vector<Combat*>&	_combats;
+};
+
+/*
+ *	Returns true if a is b or one of them is under the other.  A
+ *	unit's totals include those of everything under it, so combats
+ *	whose detachments are so related cannot be resolved side by side.
+ */
+static bool related(Unit* a, Unit* b) {
+	for (Unit* u = a; u != null; u = u->parent)
+		if (u == b)
+			return true;
+	for (Unit* u = b; u != null; u = u->parent)
+		if (u == a)
+			return true;
+	return false;
+}
+
+void Combat::fireConcurrently(Game* game, const vector<Combat*>& due) {
+	vector<Combat*> batch;
+	vector<Unit*> involved;
+	vector<Unit*> mine;
+
+	for (int i = 0; i < due.size(); i++) {
+		Combat* c = due[i];
+		if (c->_firedTo >= game->time())
+			continue;
+		bool overlaps = false;
+		for (int j = 0; j < batch.size(); j++)
+			if (batch[j] == c)
+				overlaps = true;
+		mine.clear();
+		for (InvolvedDetachment* idet = c->attackers._deployed; idet != null; idet = idet->next)
+			if (idet->detachedUnit->detachment() != null)
+				mine.push_back(idet->detachedUnit);
+		for (InvolvedDetachment* idet = c->defenders._deployed; idet != null; idet = idet->next)
+			if (idet->detachedUnit->detachment() != null)
+				mine.push_back(idet->detachedUnit);
+		for (int j = 0; j < involved.size() && !overlaps; j++)
+			for (int k = 0; k < mine.size(); k++)
+				if (related(involved[j], mine[k])) {
+					overlaps = true;
+					break;
+				}
+		if (overlaps || !c->firesIndependently())
+			continue;
+		for (int k = 0; k < mine.size(); k++)
+			involved.push_back(mine[k]);
+		batch.push_back(c);
+	}
+	if (batch.size() == 0)
+		return;
+
+		// Seeds are drawn in event order, before any worker starts.
+
+	for (int i = 0; i < batch.size(); i++)
+		batch[i]->seedStep();
+
+		// fire writes the combat log to one shared file and text
+		// buffer, neither of which is locked, so while the log is
+		// open the combats fire one by one, in event order.
+
+	if (engine::logging()) {
+		for (int i = 0; i < batch.size(); i++)
+			batch[i]->fire();
+	} else {
+		CombatStepTask task(batch);
+		runParallel(&task, batch.size());
+	}
+	for (int i = 0; i < batch.size(); i++) {
+		batch[i]->attackers.invalidateTotals();
+		batch[i]->defenders.invalidateTotals();
+	}
+}
+
+bool Combat::firesIndependently() {
+	return attackers.scrubIsQuiet(this, true) &&
+		   defenders.scrubIsQuiet(this, combatClass == CC_MEETING);
+}
+
+void Combat::seedStep() {
+	_random.set(unsigned(_game->random.dieRoll(1, 0x7fffffff)));
+}
+
+void Combat::fire() {
+	float elapsedDays = float(_game->time() - _firedTo) / oneDay;
+	_firedTo = _game->time();
+	bool defendersReallyAttacking = (combatClass == CC_MEETING);
+
+	attackers.scrub(this, true);
+	defenders.scrub(this, defendersReallyAttacking);
+	float attack = attackers.fireOn(&defenders, true, elapsedDays, this);
+	float defense = defenders.fireOn(&attackers, defendersReallyAttacking, elapsedDays, this);
+	engine::logPrintf("\n    attack=%g defense=%g\n", attack, defense);
+	_ratio = attack / defense;
+	if (combatClass != CC_MEETING) {
+		if (defenders._deployed)
+			computeDefensiveFront(defenders._deployed->detachedUnit);
+		_density = calculateDensity(defense / elapsedDays);
+		_involvedDefense = ratioToDefense(_ratio / _density);
+		defenders.setDefenseInvolvement(_involvedDefense);
+	}
+	if (engine::logging())
+		logInputs();
+	attackers.consumeFuel(true, elapsedDays);
+	defenders.consumeFuel(defendersReallyAttacking, elapsedDays);
+	attackers.consumeAmmunition(elapsedDays, true);
+	defenders.consumeAmmunition(elapsedDays, defendersReallyAttacking);
+	attackers.adjustAttackers(this);
+	if (defendersReallyAttacking)
+		defenders.adjustAttackers(this);
+	else
+		defenders.adjustDefenders(this, elapsedDays);
+	if (logging()) {
+		attackers.logDetail("Attackers");
+		defenders.logDetail("Defenders");
+	}
+	attackers.deductLosses(&defenders, true, this);
+	defenders.deductLosses(&attackers, defendersReallyAttacking, this);
+	if (logging())
+		logLosses();
+}
+
 bool Combat::scheduleNextEvent() {
 	if (_nextEvent != null) {
 		engine::log("***** Unexpected _nextEvent in scheduleNextEvent *****");
@@ -660,7 +799,8 @@ void Combat::nextEventHappened() {
 
 Combat::Combat(Game* game, xpoint hex, CombatClass combatClass) 
     : attackers(game), 
-	  defenders(game) {
+	  defenders(game),
+	  _random(1) {
 	init(game, hex);
 	this->combatClass = combatClass;
 	game->map()->set_combat(hex, this);
@@ -740,7 +880,7 @@ void CombatGroup::purge() {
 
 			// Have to calculate this here, after the detachment has been removed.
 
-		d->action = DA_IDLE;
+		d->setAction(DA_IDLE);
 		d->destination.x = -1;
 	}
 	_line.clear();
@@ -825,20 +965,20 @@ void CombatGroup::enlist(InvolvedDetachment* idet, Unit* u, bool isAttacker, boo
 		if (!isDefendingInfiltration)
 			_passive.enlist(idet, u);
 	} else if (r == BR_ART) {
-		if (!isDefendingInfiltration || _game->random.uniform() < global::defensiveInfiltrationInvolvement) {
+		if (!isDefendingInfiltration || _game->random.uniform() < _game->parameters.defensiveInfiltrationInvolvement) {
 			_artillery.enlist(idet, u);
 			if (isAttacker)
-				d->action = DA_ATTACKING;
+				d->setAction(DA_ATTACKING);
 			else
-				d->action = DA_DEFENDING;
+				d->setAction(DA_DEFENDING);
 		}
 	} else {
-		if (!isDefendingInfiltration || _game->random.uniform() < global::defensiveInfiltrationInvolvement) {
+		if (!isDefendingInfiltration || _game->random.uniform() < _game->parameters.defensiveInfiltrationInvolvement) {
 			_line.enlist(idet, u);
 			if (isAttacker)
-				d->action = DA_ATTACKING;
+				d->setAction(DA_ATTACKING);
 			else
-				d->action = DA_DEFENDING;
+				d->setAction(DA_DEFENDING);
 		}
 	}
 }
@@ -961,6 +1101,15 @@ void CombatGroup::scrub(Combat* c, bool isAttacker) {
 	_atWeaponCount = _line.atWeaponCount();
 }
 
+bool CombatGroup::scrubIsQuiet(Combat* c, bool isAttacker) {
+	for (InvolvedDetachment* iu = _deployed; iu != null; iu = iu->next)
+		if (iu->detachedUnit->isEmpty())
+			return false;
+	if (isAttacker || _passive.units() == null)
+		return true;
+	return c->calculateDensity(defensivePower()) >= 1;
+}
+
 void CombatGroup::dressLine(Combat* c) {
 	float defense = defensivePower();
 	for (;;) {
@@ -1022,12 +1171,12 @@ float CombatGroup::defensivePower() {
 		   _artillery.computeArtillery(1, 1, null, false);
 }
 
-float CombatGroup::fireOn(CombatGroup* opponent, bool isAttacker, float days) {
+float CombatGroup::fireOn(CombatGroup* opponent, bool isAttacker, float days, Combat* c) {
 	_firesATAmmoSum += _line.firesATAmmoCount() * days;
 
 		// Probability that an AT weapon will fire at a hard target object
 
-	float pATWeaponFiresAT = opponent->_hardTargetCount * global::atRatio / _atWeaponCount;
+	float pATWeaponFiresAT = opponent->_hardTargetCount * _game->parameters.atRatio / _atWeaponCount;
 
 	if (pATWeaponFiresAT > 1)
 		pATWeaponFiresAT = 1;
@@ -1063,11 +1212,11 @@ float CombatGroup::fireOn(CombatGroup* opponent, bool isAttacker, float days) {
 
 	// Randomize ammunition use.
 
-	double mult = pow(10.0, global::ammoUseStdDev * _game->random.normal());
-	if (mult < global::ammoUseMinMult)
-		mult = global::ammoUseMinMult;
-	else if (mult > global::ammoUseMaxMult)
-		mult = global::ammoUseMaxMult;
+	double mult = pow(10.0, _game->parameters.ammoUseStdDev * c->_random.normal());
+	if (mult < _game->parameters.ammoUseMinMult)
+		mult = _game->parameters.ammoUseMinMult;
+	else if (mult > _game->parameters.ammoUseMaxMult)
+		mult = _game->parameters.ammoUseMaxMult;
 	_ammoRatio *= mult;
 
 	_totalSalvo = (_assaultAmmo * days + _preparationAmmo) * _ammoRatio;
@@ -1094,7 +1243,7 @@ float CombatGroup::fireOn(CombatGroup* opponent, bool isAttacker, float days) {
 			al += _artLine[i];
 			ar += _artRear[i];
 		}
-		float ratio = (1 - global::artilleryRearAreaFire) / global::artilleryRearAreaFire;
+		float ratio = (1 - _game->parameters.artilleryRearAreaFire) / _game->parameters.artilleryRearAreaFire;
 		if (al < ratio * ar) {
 			for (int i = 0; i < WEIGHT_CLASSES; i++) {
 				if (_artRear[i] > 0) {
@@ -1189,10 +1338,10 @@ void CombatGroup::adjustDefenders(Combat* c, float elapsedDays) {
 
 void CombatGroup::adjustAll(Combat* c) {
 	for (int w = 0; w < WEIGHT_CLASSES; w++) {
-		_artLine[w] = _artLine[w] * global::apScale;
-		_artRear[w] = _artRear[w] * global::apScale;
-		_ap[w] = _ap[w] * global::apScale;
-		_at[w] = _at[w] * global::atScale;
+		_artLine[w] = _artLine[w] * _game->parameters.apScale;
+		_artRear[w] = _artRear[w] * _game->parameters.apScale;
+		_ap[w] = _ap[w] * _game->parameters.apScale;
+		_at[w] = _at[w] * _game->parameters.atScale;
 	}
 }
 
@@ -1241,7 +1390,7 @@ void CombatGroup::deductLosses(CombatGroup* opponent, bool isAttacker, Combat* c
 	for (int i = 0; i < PENETRATION_CLASSES; i++) {
 		int at = int(opponent->_at[i]);
 		if (at > 0)
-			at = _line.deductAtLosses(at, i, this, isAttacker);
+			at = _line.deductAtLosses(at, i, this, isAttacker, c);
 	}
 	int lineTC = _line.targetCount();
 
@@ -1257,7 +1406,7 @@ void CombatGroup::deductLosses(CombatGroup* opponent, bool isAttacker, Combat* c
 
 	int rearTC = _artillery.targetCount() + _passive.targetCount();
 	for (int i = 0; i < WEIGHT_CLASSES; i++) {
-		float ap = opponent->_artRear[i] * global::rearAccuracy;
+		float ap = opponent->_artRear[i] * _game->parameters.rearAccuracy;
 		if (ap > 0) {
 			ap = _artillery.deductApLosses(ap, i, this, &rearTC, isAttacker, c);
 			if (ap > 0)
@@ -1269,12 +1418,17 @@ void CombatGroup::deductLosses(CombatGroup* opponent, bool isAttacker, Combat* c
 
 	lineTC = _line.targetCount();
 	for (int i = 0; i < WEIGHT_CLASSES; i++){
-		float ap = opponent->_artLine[i] * global::lineAccuracy;
+		float ap = opponent->_artLine[i] * _game->parameters.lineAccuracy;
 		if (ap > 0)
 			ap = _line.deductApLosses(ap, i, this, &lineTC, isAttacker, c);
 	}
 }
 
+void CombatGroup::invalidateTotals() {
+	for (InvolvedDetachment* idet = _deployed; idet != null; idet = idet->next)
+		idet->detachedUnit->invalidateTotals();
+}
+
 InvolvedDetachment::InvolvedDetachment(Detachment* d, float preparation, bool isAttacker) {
 	next = null;
 	detachedUnit = d->unit;
@@ -1295,6 +1449,14 @@ InvolvedDetachment::InvolvedDetachment(Detachment* d, float preparation, bool is
 InvolvedDetachment::~InvolvedDetachment() {
 }
 
+void* InvolvedDetachment::operator new(size_t size) {
+	return involvedDetachmentPool.allocate(size);
+}
+
+void InvolvedDetachment::operator delete(void* p, size_t size) {
+	involvedDetachmentPool.release(p, size);
+}
+
 void InvolvedDetachment::log() {
 	engine::logPrintf("    unit %s %s %s %s", detachedUnit->name().c_str(), 
 											  unitSizeNames[detachedUnit->definition()->sizeIndex() + 1], 
@@ -1313,6 +1475,7 @@ void InvolvedUnit::log() {
 TroopCategory::TroopCategory(Game* game) {
 	_units = null;
 	_game = game;
+	_rowsValid = false;
 }
 
 TroopCategory::~TroopCategory() {
@@ -1324,6 +1487,7 @@ void TroopCategory::clear() {
 }
 
 void TroopCategory::deleteInolvedUnits() {
+	invalidateRows();
 	while (_units) {
 		InvolvedUnit* iu = _units;
 		_units = _units->next;
@@ -1349,11 +1513,13 @@ void TroopCategory::enlist(InvolvedDetachment* idet, Unit* u) {
 void TroopCategory::enlist(InvolvedUnit* iu) {
 	iu->next = _units;
 	_units = iu;
+	invalidateRows();
 }
 
 void TroopCategory::cancel(Detachment* d) {
 	InvolvedUnit* uPrev = null;
 
+	invalidateRows();
 	for (InvolvedUnit* iu = _units; iu != null; ) {
 		InvolvedUnit* iuNext = iu->next;
 		if (iu->detachment() == d) {
@@ -1388,57 +1554,94 @@ InvolvedUnit* TroopCategory::pickOne() {
 		previousIu->next = iu->next;
 	else
 		_units = iu->next;
+	invalidateRows();
 	return iu;
 }
 
-int TroopCategory::hardTargetCount() {
-	int count = 0;
+void TroopCategory::buildRows() {
+	if (_rowsValid)
+		return;
+	_unitRows.clear();
+	_rowEquipment.clear();
+	_rowWeapon.clear();
+	_rowClass.clear();
+	_rowFiresAtAmmo.clear();
+	_rowRate.clear();
+	_rowAp.clear();
+	_rowApWt.clear();
+	_rowAt.clear();
+	_rowAtPen.clear();
+	_rowArmor.clear();
+	_rowRange.clear();
 	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next) {
-		double unitRate = iu->unitRate();
-		int uCount = 0;
+		_unitRows.push_back(_rowEquipment.size());
 		for (int j = 0; j < iu->unit->equipment_size(); j++) {
 			AvailableEquipment* ae = iu->unit->equipment(j);
-			if (ae->definition->weapon->weaponClass == WC_AFV)
-				uCount += ae->onHand;
+			Weapon* w = ae->definition->weapon;
+			_rowEquipment.push_back(ae);
+			_rowWeapon.push_back(w);
+			_rowClass.push_back(w->weaponClass);
+			_rowFiresAtAmmo.push_back(w->firesAtAmmo());
+			_rowRate.push_back(w->rate);
+			_rowAp.push_back(w->ap);
+			_rowApWt.push_back(w->apWt);
+			_rowAt.push_back(w->at);
+			_rowAtPen.push_back(w->atpen);
+			_rowArmor.push_back(w->armor);
+			_rowRange.push_back(w->range);
 		}
+	}
+	_unitRows.push_back(_rowEquipment.size());
+	_rowsValid = true;
+}
+
+int TroopCategory::hardTargetCount() {
+	buildRows();
+	int count = 0;
+	int u = 0;
+	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next, u++) {
+		double unitRate = iu->unitRate();
+		int uCount = 0;
+		for (int r = _unitRows[u]; r < _unitRows[u + 1]; r++)
+			if (_rowClass[r] == WC_AFV)
+				uCount += _rowEquipment[r]->onHand;
 		count += int(uCount * unitRate);
 	}
 	return count;
 }
 
 void TroopCategory::calculateTargetCount() {
+	buildRows();
 	_targetCount = 0;
-	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next) {
-		for (int j = 0; j < iu->unit->equipment_size(); j++)
-			_targetCount += iu->unit->equipment(j)->onHand;
-	}
+	for (int r = 0; r < _rowEquipment.size(); r++)
+		_targetCount += _rowEquipment[r]->onHand;
 }
 
 int TroopCategory::atWeaponCount() {
+	buildRows();
 	int count = 0;
-	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next) {
+	int u = 0;
+	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next, u++) {
 		double unitRate = iu->unitRate();
 		int uCount = 0;
-		for (int j = 0; j < iu->unit->equipment_size(); j++) {
-			AvailableEquipment* ae = iu->unit->equipment(j);
-			if (ae->definition->weapon->at > 0)
-				uCount += ae->onHand;
-		}
+		for (int r = _unitRows[u]; r < _unitRows[u + 1]; r++)
+			if (_rowAt[r] > 0)
+				uCount += _rowEquipment[r]->onHand;
 		count += int(uCount * unitRate);
 	}
 	return count;
 }
 
 int TroopCategory::firesATAmmoCount() {
+	buildRows();
 	int count = 0;
-	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next) {
+	int u = 0;
+	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next, u++) {
 		double unitRate = iu->unitRate();
 		int uCount = 0;
-		for (int j = 0; j < iu->unit->equipment_size(); j++) {
-			AvailableEquipment* ae = iu->unit->equipment(j);
-			if (ae->definition->weapon->firesAtAmmo())
-				uCount += ae->onHand;
-		}
+		for (int r = _unitRows[u]; r < _unitRows[u + 1]; r++)
+			if (_rowFiresAtAmmo[r])
+				uCount += _rowEquipment[r]->onHand;
 		count += int(uCount * unitRate);
 	}
 	return count;
@@ -1472,27 +1675,59 @@ tons TroopCategory::computeAmmunition(bool isAttacker, WeaponClass weaponClass,
 float TroopCategory::computeFirepower(float pATWeaponFiresAT, float ammoRatio, CombatGroup* cg, bool isAttacker) {
 	if (_units == null)
 		return 0;
+	buildRows();
+	const Theater* theater = _game->theater();
 	float firepower = 0;
-	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next)
-		firepower += iu->computeFirepower(pATWeaponFiresAT, ammoRatio, cg, isAttacker);
+	int u = 0;
+	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next, u++) {
+
+			// This is InvolvedUnit::computeFirepower, run over the rows.
+
+		if (iu->detachment() == null)
+			continue;
+		double unitRate = iu->directFireRate(ammoRatio, isAttacker);
+		float atRate = directFireDoctrineRate(theater, iu, true, isAttacker);
+		float smallArmsRate = directFireDoctrineRate(theater, iu, false, isAttacker);
+
+		float unitFirepower = 0;
+		for (int r = _unitRows[u]; r < _unitRows[u + 1]; r++) {
+			float doctrineRate = _rowFiresAtAmmo[r] ? atRate : smallArmsRate;
+			tons salvo = (_rowEquipment[r]->onHand * _rowRate[r] * doctrineRate) / 1000;
+			salvo *= unitRate;
+
+			if (_rowAt[r] != 0){
+				if (cg)
+					cg->addAt(_rowAtPen[r], pATWeaponFiresAT * _rowAt[r] * salvo);
+				unitFirepower += pATWeaponFiresAT * _rowAt[r] * salvo;
+				salvo *= (1 - pATWeaponFiresAT);
+			}
+
+			if (cg)
+				cg->addAp(_rowApWt[r], _rowAp[r] * salvo);
+			unitFirepower += _rowAp[r] * salvo;
+		}
+		firepower += unitFirepower;
+	}
 	return firepower;
 }
 
 float TroopCategory::computeArtillery(float ammoRatio, float days, CombatGroup* cg, bool isAttacker) {
 	if (_units == null)
 		return 0;
+	buildRows();
 	const Theater* theater = _units->unit->game()->theater();
 	int shortRange = global::kmPerHex / 2;
 	float firepower = 0;
-	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next) {
+	int u = 0;
+	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next, u++) {
 		if (iu->detachment() == null)
 			continue;
 		float f = 1 - iu->detachment()->fatigue;
 		float fatigueAdjust;
 		if (isAttacker)
-			fatigueAdjust = f * (1 - global::maxFatigueOffensiveIndirectFireModifier) + global::maxFatigueOffensiveIndirectFireModifier;
+			fatigueAdjust = f * (1 - _game->parameters.maxFatigueOffensiveIndirectFireModifier) + _game->parameters.maxFatigueOffensiveIndirectFireModifier;
 		else
-			fatigueAdjust = f * (1 - global::maxFatigueDefensiveIndirectFireModifier) + global::maxFatigueDefensiveIndirectFireModifier;
+			fatigueAdjust = f * (1 - _game->parameters.maxFatigueDefensiveIndirectFireModifier) + _game->parameters.maxFatigueDefensiveIndirectFireModifier;
 
 		double unitRate = fatigueAdjust * ammoRatio * (days + iu->idetachment()->preparation);
 
@@ -1501,17 +1736,17 @@ float TroopCategory::computeArtillery(float ammoRatio, float days, CombatGroup*
 		else
 			unitRate *= iu->doctrine()->dacRate;
 
-		for (int j = 0; j < iu->unit->equipment_size(); j++) {
-			AvailableEquipment* ae = iu->unit->equipment(j);
-			Weapon* w = ae->definition->weapon;
-			if (w->range == 0)
+		float doctrineRate = indirectFireDoctrineRate(theater, iu, isAttacker);
+		for (int r = _unitRows[u]; r < _unitRows[u + 1]; r++) {
+			if (_rowRange[r] == 0)
 				continue;
-			tons salvo = w->ap * calculateSalvo(WC_ART, theater, iu, j, isAttacker) * unitRate;
+			tons volley = (_rowEquipment[r]->onHand * _rowRate[r] * doctrineRate) / 1000;
+			tons salvo = _rowAp[r] * volley * unitRate;
 			if (cg) {
-				if (w->range < shortRange)
-					cg->_artLine[w->apWt] += salvo;
+				if (_rowRange[r] < shortRange)
+					cg->_artLine[_rowApWt[r]] += salvo;
 				else
-					cg->_artRear[w->apWt] += salvo;
+					cg->_artRear[_rowApWt[r]] += salvo;
 			}
 			firepower += salvo;
 		}
@@ -1519,9 +1754,11 @@ float TroopCategory::computeArtillery(float ammoRatio, float days, CombatGroup*
 	return firepower;
 }
 
-int TroopCategory::deductAtLosses(int at, int penetration, CombatGroup* cg, bool isAttacker) {
+int TroopCategory::deductAtLosses(int at, int penetration, CombatGroup* cg, bool isAttacker, Combat* c) {
+	buildRows();
 	int h = cg->_hardTargetCount;
-	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next) {
+	int u = 0;
+	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next, u++) {
 		if (iu->detachment() == null)
 			continue;
 		if (at == 0)
@@ -1532,30 +1769,31 @@ int TroopCategory::deductAtLosses(int at, int penetration, CombatGroup* cg, bool
 		else
 			unitMultiplier = iu->doctrine()->aacRate;
 		float unitRate = iu->unitRate();
-		for (int j = 0; h > 0 && j < iu->unit->equipment_size(); j++) {
-			AvailableEquipment* ae = iu->unit->equipment(j);
-			Weapon* w = ae->definition->weapon;
-			if (ae->onHand == 0)
+		for (int r = _unitRows[u]; h > 0 && r < _unitRows[u + 1]; r++) {
+			if (_rowClass[r] != WC_AFV)
 				continue;
-			if (w->weaponClass != WC_AFV)
+			AvailableEquipment* ae = _rowEquipment[r];
+			if (ae->onHand == 0)
 				continue;
-			int delta = penetration - w->armor;
+			int delta = penetration - _rowArmor[r];
 			double p = ae->onHand * unitRate / h;
-			int n = _game->random.binomial(int(at * penetrationAdjust[delta + PENETRATION_CLASSES] * unitMultiplier), p);
+			int n = c->_random.binomial(int(at * penetrationAdjust[delta + PENETRATION_CLASSES] * unitMultiplier), p);
 //				engine::log("deductAT " + w->name + ": " + at + " p=" + p + " ->" + n)
 			h -= ae->onHand * unitRate;
 			if (n == 0)
 				continue;
 			at -= int(n / (penetrationAdjust[delta + PENETRATION_CLASSES] * unitMultiplier));
-			p = global::basicATHitProbability;
-			int l = _game->random.binomial(n, p);
+			p = _game->parameters.basicATHitProbability;
+			int l = c->_random.binomial(n, p);
 //				engine::log("p2=" + p + " ->" + l + " vs " + ae.onHand)
 			if (l == 0)
 				continue;
 			if (l > ae->onHand)
 				l = ae->onHand;
+			Weapon* w = _rowWeapon[r];
 			cg->_losses.onHand()[w->index] += l;
 			ae->onHand -= l;
+			iu->unit->invalidateTotals(iu->detachedUnit());
 			float f = l * w->fuelCap;
 			float ratio = iu->detachment()->fuel() / iu->detachedUnit()->fuelCapacity();
 //				engine::log("ratio=" + ratio + " fuel=" + f)
@@ -1570,7 +1808,9 @@ int TroopCategory::deductAtLosses(int at, int penetration, CombatGroup* cg, bool
 float TroopCategory::deductApLosses(float ap, int weight, CombatGroup* cg, 
 								    int* targetCount,
 									bool isAttacker, Combat* c) {
-	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next) {
+	buildRows();
+	int u = 0;
+	for (InvolvedUnit* iu = _units; iu != null; iu = iu->next, u++) {
 		if (iu->detachment() == null)
 			continue;
 		if (int(ap) == 0)
@@ -1584,45 +1824,46 @@ float TroopCategory::deductApLosses(float ap, int weight, CombatGroup* cg,
 			unitMultiplier = iu->doctrine()->adcRate;
 			switch (iu->edge()) {
 			case EDGE_RIVER:
-				unitMultiplier *= global::riverCasualtyMultiplier;
+				unitMultiplier *= _game->parameters.riverCasualtyMultiplier;
 				break;
 
 			case EDGE_COAST:
-				unitMultiplier *= global::coastCasualtyMultiplier;
+				unitMultiplier *= _game->parameters.coastCasualtyMultiplier;
 				break;
 			}
 		} else {
 			unitMultiplier = iu->doctrine()->aacRate;
 		}
-		for (int j = 0; j < iu->unit->equipment_size(); j++) {
-			AvailableEquipment* ae = iu->unit->equipment(j);
-			Weapon* w = ae->definition->weapon;
+		for (int r = _unitRows[u]; r < _unitRows[u + 1]; r++) {
+			AvailableEquipment* ae = _rowEquipment[r];
 			if (ae->onHand == 0)
 				continue;
-			int armorClass = w->armor;
+			int armorClass = _rowArmor[r];
 			if (baseArmorClass > armorClass)
 				armorClass = baseArmorClass;
 			int delta = weight - armorClass;
 			double
 				p = double(ae->onHand) / *targetCount;
-			int n = _game->random.binomial(int(ap * penetrationAdjust[delta + PENETRATION_CLASSES] * unitMultiplier), p);
+			int n = c->_random.binomial(int(ap * penetrationAdjust[delta + PENETRATION_CLASSES] * unitMultiplier), p);
 //				engine::log("deductAP " + e.weapon.name + ": " + int(ap) + " p=" + p + " ->" + n)
 			*targetCount -= ae->onHand;
 			if (n == 0)
 				continue;
 			ap -= n / (penetrationAdjust[delta + PENETRATION_CLASSES] * unitMultiplier);
 			if (isAttacker)
-				p = global::defensiveAPHitProbability;
+				p = _game->parameters.defensiveAPHitProbability;
 			else
-				p = global::offensiveAPHitProbability;
-			int l = _game->random.binomial(n, p);
+				p = _game->parameters.offensiveAPHitProbability;
+			int l = c->_random.binomial(n, p);
 //				engine::log("p2=" + p + " ->" + l + " vs " + ae.onHand)
 			if (l == 0)
 				continue;
 			if (l > ae->onHand)
 				l = ae->onHand;
+			Weapon* w = _rowWeapon[r];
 			cg->_losses.onHand()[w->index] += l;
 			ae->onHand -= l;
+			iu->unit->invalidateTotals(iu->detachedUnit());
 			tons f = l * w->fuelCap;
 			float ratio = iu->detachment()->fuel() / iu->detachedUnit()->fuelCapacity();
 //				engine::log("ratio=" + ratio + " fuel=" + f)
@@ -1808,7 +2049,6 @@ tons normalVolley(Detachment* d, bool forPreparation) {
 static tons calculateSalvo(WeaponClass weaponClass, const Theater* theater, InvolvedUnit* iu, int j, bool isAttacker) {
 	AvailableEquipment* ae = iu->unit->equipment(j);
 	Weapon* w = ae->definition->weapon;
-	int n;
 	float doctrineRate;
 
 	switch (weaponClass) {
@@ -1817,21 +2057,7 @@ static tons calculateSalvo(WeaponClass weaponClass, const Theater* theater, Invo
 		if (!w->firesAtAmmo())
 			return 0;
 	case	WC_INF:
-		if (isAttacker) {
-			if (w->firesAtAmmo())
-				doctrineRate = iu->doctrine()->aatRate;
-			else
-				doctrineRate = iu->doctrine()->adfRate;
-		} else {
-			if (w->firesAtAmmo())
-				doctrineRate = iu->doctrine()->datRate;
-			else
-				doctrineRate = iu->doctrine()->ddfRate;
-		}
-		if (w->firesAtAmmo())
-			doctrineRate *= theater->intensity[iu->detachment()->intensity]->atRateMultiplier;
-		else
-			doctrineRate *= theater->intensity[iu->detachment()->intensity]->smallArmsRateMultiplier;
+		doctrineRate = directFireDoctrineRate(theater, iu, w->firesAtAmmo(), isAttacker);
 		break;
 	// Classes of indirect-fire ammunition usage
 	case	WC_RKT:
@@ -1840,15 +2066,43 @@ static tons calculateSalvo(WeaponClass weaponClass, const Theater* theater, Invo
 	case	WC_ART:
 		if (w->range == 0)
 			return 0;
-		if (isAttacker)
-			doctrineRate = iu->doctrine()->aifRate;
-		else
-			doctrineRate = iu->doctrine()->difRate;
-		doctrineRate *= theater->intensity[iu->detachment()->intensity]->artilleryRateMultiplier;
+		doctrineRate = indirectFireDoctrineRate(theater, iu, isAttacker);
 		break;
 	}
 	// divide by 1000 converts from w->rate (kg) to tons.
 	return (ae->onHand * w->rate * doctrineRate) / 1000;
 }
 
+static float directFireDoctrineRate(const Theater* theater, InvolvedUnit* iu, bool firesAtAmmo, bool isAttacker) {
+	float doctrineRate;
+
+	if (isAttacker) {
+		if (firesAtAmmo)
+			doctrineRate = iu->doctrine()->aatRate;
+		else
+			doctrineRate = iu->doctrine()->adfRate;
+	} else {
+		if (firesAtAmmo)
+			doctrineRate = iu->doctrine()->datRate;
+		else
+			doctrineRate = iu->doctrine()->ddfRate;
+	}
+	if (firesAtAmmo)
+		doctrineRate *= theater->intensity[iu->detachment()->intensity]->atRateMultiplier;
+	else
+		doctrineRate *= theater->intensity[iu->detachment()->intensity]->smallArmsRateMultiplier;
+	return doctrineRate;
+}
+
+static float indirectFireDoctrineRate(const Theater* theater, InvolvedUnit* iu, bool isAttacker) {
+	float doctrineRate;
+
+	if (isAttacker)
+		doctrineRate = iu->doctrine()->aifRate;
+	else
+		doctrineRate = iu->doctrine()->difRate;
+	doctrineRate *= theater->intensity[iu->detachment()->intensity]->artilleryRateMultiplier;
+	return doctrineRate;
+}
+
 }  // namespace engine
@@ -234,7 +234,9 @@
 #pragma once
 #include "../common/event.h"
 #include "../common/machine.h"
+#include "../common/random.h"
 #include "../common/string.h"
+#include "../common/vector.h"
 #include "basic_types.h"
 #include "constants.h"
 #include "tally.h"
@@ -256,15 +258,18 @@ namespace engine {
 const int WEIGHT_CLASSES = 15;
 const int PENETRATION_CLASSES = 15;
 
+class AvailableEquipment;
 class Combat;
 class CombatGroup;
 class CombatObject;
+class CombatStepTask;
 class Detachment;
 class DetachmentEvent;
 class Game;
 class InvolvedDetachment;
 class InvolvedUnit;
 class Unit;
+class Weapon;
 class WeaponsData;
 
 class TroopCategory {
@@ -316,7 +321,7 @@ public:
 
 	tons computeAmmunition(bool isAttacker, WeaponClass weaponClass, bool forPreparation);
 
-	int deductAtLosses(int at, int penetration, CombatGroup* cg, bool isAttacker);
+	int deductAtLosses(int at, int penetration, CombatGroup* cg, bool isAttacker, Combat* c);
 
 	float deductApLosses(float ap, int weight, CombatGroup* cg, 
 						 int* targetCount,
@@ -327,10 +332,46 @@ public:
 	int targetCount() const { return _targetCount; }
 private:
 	void deleteInolvedUnits();
-
-	InvolvedUnit*		_units;
-	Game*				_game;
-	int					_targetCount;
+	/*
+	 *	buildRows
+	 *
+	 *	The fire and loss loops run over the enlisted units' equipment
+	 *	many times per combat step (once per weight and penetration
+	 *	class for losses).  Rather than chase Unit -> AvailableEquipment
+	 *	-> Equipment -> Weapon for every item on every pass, the weapon
+	 *	factors are copied into parallel arrays, one row per equipment
+	 *	slot, in the order the units and their equipment are walked.
+	 *	Keeping that order keeps the sums and the random draws exactly
+	 *	as they were.  Rows for the i'th unit in _units run from
+	 *	_unitRows[i] up to _unitRows[i + 1].
+	 *
+	 *	Only the enlisted units change the rows (a unit's equipment
+	 *	slots are fixed once it is created), so they are rebuilt
+	 *	lazily after an enlist, cancel or pickOne.  On-hand counts
+	 *	change constantly, so they are always read through the row's
+	 *	equipment pointer.
+	 */
+	void buildRows();
+
+	void invalidateRows() { _rowsValid = false; }
+
+	InvolvedUnit*				_units;
+	Game*						_game;
+	int							_targetCount;
+
+	bool						_rowsValid;
+	vector<int>					_unitRows;
+	vector<AvailableEquipment*>	_rowEquipment;
+	vector<Weapon*>				_rowWeapon;
+	vector<byte>				_rowClass;		// WeaponClass
+	vector<byte>				_rowFiresAtAmmo;
+	vector<float>				_rowRate;
+	vector<float>				_rowAp;
+	vector<int>					_rowApWt;
+	vector<int>					_rowAt;
+	vector<int>					_rowAtPen;
+	vector<int>					_rowArmor;
+	vector<int>					_rowRange;
 };
 
 class CombatGroup {
@@ -412,10 +453,18 @@ private:
 	bool cancel(InvolvedDetachment* iu);
 
 	void scrub(Combat* c, bool isAttacker);
+	/*
+	 *	scrubIsQuiet
+	 *
+	 *	Returns true if a scrub right now would only recount the
+	 *	targets: no unit needs to be eliminated and no reserves need
+	 *	to be drawn into the line.
+	 */
+	bool scrubIsQuiet(Combat* c, bool isAttacker);
 
 	void dressLine(Combat* c);
 
-	float fireOn(CombatGroup* opponent, bool isAttacker, float days);
+	float fireOn(CombatGroup* opponent, bool isAttacker, float days, Combat* c);
 
 	void setDefenseInvolvement(float involvedDefense);
 
@@ -430,6 +479,14 @@ private:
 	void consumeAmmunition(float days, bool isAttacker);
 
 	void deductLosses(CombatGroup* opponent, bool isAttacker, Combat* c);
+	/*
+	 *	invalidateTotals
+	 *
+	 *	Losses only mark the totals up to each detachment's own unit,
+	 *	so that combats can be resolved side by side.  This marks the
+	 *	formations above them.
+	 */
+	void invalidateTotals();
 
 	// Test API
 
@@ -540,6 +597,24 @@ public:
 	 *		true	otherwise
 	 */
 	bool makeCurrent(SchedulingChoice schedule = SCHEDULE_NEXT_EVENT);
+	/*
+	 *	fireConcurrently
+	 *
+	 *	The due list holds the combats whose events fall at the
+	 *	current minute, in the order those events will happen.  Those
+	 *	that share no detachment with a combat earlier in the list,
+	 *	and have no detachment above or below one of its detachments
+	 *	in the order of battle, have their fire and losses for the
+	 *	step resolved now, side by side on the worker threads.  While
+	 *	the log is open they are resolved one at a time instead.  What
+	 *	follows from the losses (retreats, disruptions, the end of the
+	 *	combat) still happens in event order when each combat is next
+	 *	made current.  Steps are seeded in list order, so the thread
+	 *	count does not change the outcome.
+	 */
+	static void fireConcurrently(Game* game, const vector<Combat*>& due);
+
+	minutes firedTo() const { return _firedTo; }
 	/*
 	 *	isInvolved
 	 *
@@ -611,6 +686,30 @@ private:
 	bool scheduleNextEvent();
 
 	void computeDefensiveFront(Unit* defender);
+	/*
+	 *	firesIndependently
+	 *
+	 *	Returns true if the next step of this combat can be resolved
+	 *	on a worker thread: the scrub that starts the step would change
+	 *	nothing outside the combat.
+	 */
+	bool firesIndependently();
+	/*
+	 *	seedStep
+	 *
+	 *	Seeds the generator for the step about to be resolved.
+	 */
+	void seedStep();
+	/*
+	 *	fire
+	 *
+	 *	Resolves the fire, ammunition and fuel use and losses of both
+	 *	sides from the last time they were resolved up to now.
+	 *	Nothing outside the combat's own detachments is touched, and
+	 *	the game's generator is only used if the scrub has to draw
+	 *	reserves into the line (see firesIndependently).
+	 */
+	void fire();
 	/*
 	 *	FUNCTION:	takePostCombatActions
 	 *
@@ -624,6 +723,10 @@ private:
 
 	void clearNextEvent();
 
+	friend CombatGroup;
+	friend CombatStepTask;
+	friend TroopCategory;
+
 	// Test API
 
 	friend CombatObject;
@@ -642,7 +745,9 @@ private:
 	byte					_semiBlockedHexes;
 	byte					_blockedHexes;
 	minutes					_lastChecked;
+	minutes					_firedTo;		// Losses are resolved up to this time
 	DetachmentEvent*		_nextEvent;
+	random::Random			_random;		// Drawn on by the step being resolved
 
 		// Terrain and fortification modifiers:
 
@@ -659,6 +764,10 @@ public:
 
 	~InvolvedDetachment();
 
+	static void* operator new(size_t size);
+
+	static void operator delete(void* p, size_t size);
+
 	void log();
 
 	InvolvedDetachment*		next;
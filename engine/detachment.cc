@@ -11,6 +11,7 @@
 #include "game_event.h"
 #include "global.h"
 #include "order.h"
+#include "parallel.h"
 #include "path.h"
 #include "scenario.h"
 #include "theater.h"
@@ -160,7 +161,7 @@ void Detachment::regroup(UnitModes m) {
 						  global::modeScaleFactor * 
 						  global::kmPerHex *
 						  unit->regroupRateModifier());
-	action = DA_REGROUPING;
+	setAction(DA_REGROUPING);
 	_regroupTo = m;
 	new ModeEvent(this, m, dur);
 }
@@ -214,7 +215,7 @@ void Detachment::finishRegroup(UnitModes m) {
 	adoptMode(m);
 	Combat* c = _map->combat(_location);
 	if (c != null) {
-		action = DA_IDLE;
+		setAction(DA_IDLE);
 		c->reshuffle();
 		if (action != DA_IDLE)
 			return;
@@ -225,7 +226,7 @@ void Detachment::finishRegroup(UnitModes m) {
 void Detachment::goIdle() {
 	if (engine::logging())
 		engine::log("goIdle " + unit->name());
-	action = DA_IDLE;
+	setAction(DA_IDLE);
 	if (orders != null) {
 		if (orders->cancelling){
 			cancelOrders();
@@ -276,11 +277,11 @@ void Detachment::standby() {
 	if (action != DA_IDLE) {
 		engine::log("standby(): action != DA_IDLE");
 		this->log();
-		action = DA_IDLE;
+		setAction(DA_IDLE);
 	}
 	if (inCombat() &&
 		_mode == UM_DEFEND) {
-		action = DA_DEFENDING;
+		setAction(DA_DEFENDING);
 		return;
 	}
 	if (unit->hq()) {
@@ -426,11 +427,12 @@ void Detachment::moveTo(xpoint hex) {
 }
 
 void Detachment::disrupt(Combat* c) {
-	action = DA_DISRUPTED;
-	float n = global::basicDisruptDuration + global::basicDisruptStdDev * c->game()->random.normal();
+	setAction(DA_DISRUPTED);
+	const GameParameters& parameters = c->game()->parameters;
+	float n = parameters.basicDisruptDuration + parameters.basicDisruptStdDev * c->game()->random.normal();
 	if (n < 0)
 		n = 0;
-	float fatigueAdjust = 1 + fatigue * (global::maxFatigueUndisruptModifier - 1);
+	float fatigueAdjust = 1 + fatigue * (parameters.maxFatigueUndisruptModifier - 1);
 	float denom = c->ratio();
 	if (denom > 3)
 		denom = 3 + (denom - 3) / 5;
@@ -460,7 +462,7 @@ void Detachment::advanceAfterCombat(xpoint hx, minutes started) {
 									   MM_CROSS_COUNTRY, &f, true);
 	minutes spentDuration = game()->time() - started;
 	if (spentDuration < rawCost) {
-		action = DA_MARCHING;
+		setAction(DA_MARCHING);
 		new MoveEvent(this, hx, (rawCost - spentDuration) / 2);
 	} else
 		moveTo(hx);
@@ -524,7 +526,7 @@ bool Detachment::startRetreat(Combat* combat) {
 //			fatalMessage("Unexpected non-defending unit starting to retreat");
 //		return true;
 	}
-	action = DA_RETREATING;
+	setAction(DA_RETREATING);
 	destination = neighbor(_location, bestDir);
 
 	float f;
@@ -570,7 +572,7 @@ void Detachment::abortAction() {
 	case	DA_REGROUPING:
 		game()->purge(this);
 		issue(null, null);
-		action = DA_CANCELLING;
+		setAction(DA_CANCELLING);
 		break;
 
 	case	DA_ATTACKING:
@@ -580,7 +582,7 @@ void Detachment::abortAction() {
 		} else
 			c->cancel(this);
 		issue(null, null);
-		action = DA_CANCELLING;
+		setAction(DA_CANCELLING);
 		break;
 
 	case	DA_IDLE:
@@ -591,8 +593,8 @@ void Detachment::abortAction() {
 void Detachment::cancelOrders() {
 	if (orders != null) {
 		if (orders->state == SOS_ISSUING) {
-			IssueEvent* ie = game()->extractIssueEvent(orders);
-			action = DA_CANCELLING;
+			IssueEvent* ie = game()->extractIssueEvent(this, orders);
+			setAction(DA_CANCELLING);
 			ie->clear();
 			issue(null, ie);
 		}
@@ -645,12 +647,24 @@ void Detachment::place(xpoint location) {
 }
 
 void Detachment::adoptMode(UnitModes m) {
+	bool zoc = exertsZOC();
 	_mode = m;
+	if (zoc != exertsZOC())
+		_map->zocChanged(this);
 	Force* force = unit->combatant()->force;
 	if (force)
 		force->game()->changed.fire(unit);
 }
 
+void Detachment::setAction(DetachmentAction a) {
+	bool zoc = exertsZOC();
+	action = a;
+	if (zoc != exertsZOC())
+		_map->zocChanged(this);
+	else
+		_map->situationChanged.fire(_location);
+}
+
 void Detachment::post(StandingOrder* o) {
 	if (orders == null)
 		orders = o;
@@ -718,19 +732,19 @@ float Detachment::defensiveEndurance(Combat* c) {
 		vari = global::lowDensityEnduranceModifier;
 	else
 		vari = 1.0f;
-	float n = endurance(global::maxFatigueRetreatModifier, vari);
+	float n = endurance(game()->parameters.maxFatigueRetreatModifier, vari);
 	if (c->blockedHexes() + c->semiBlockedHexes() >= 6)
 		n = n * global::isolatedEnduranceModifier;
 	return n / c->enduranceModifier();
 }
 
 float Detachment::offensiveEndurance(Combat* c) {
-	return endurance(global::maxFatigueDisruptModifier, 1) * c->enduranceModifier();
+	return endurance(game()->parameters.maxFatigueDisruptModifier, 1) * c->enduranceModifier();
 }
 
 float Detachment::endurance(float fatigueMod, float lowDensityMod) {
-	float n = global::basicCombatEndurance + 
-				lowDensityMod * global::basicCombatEnduranceStdDev * game()->random.normal();
+	float n = game()->parameters.basicCombatEndurance + 
+				lowDensityMod * game()->parameters.basicCombatEnduranceStdDev * game()->random.normal();
 	if (n < 0)
 		n = 0;
 	float fatigueAdjust = (1 - fatigue) * (1 - fatigueMod) + fatigueMod;
@@ -1169,22 +1183,17 @@ void Detachment::checkSupplyLine() {
 	}
 
 	if (_supplySource != null){
-		MoveInfo mi;
-
-		memset(&mi, 0, sizeof mi);
-		unit->calculate(&mi);
+		const MoveInfo* mi = unit->moveInfo();
 
 		for (int i = UC_MINCARRIER; i < UC_MAXCARRIER; i++)
-			if (mi.supplyLoad[i] != 0){
+			if (mi->supplyLoad[i] != 0){
 				int mins = 0;
-				for (Segment* s = _supplyLine; s != null; s = s->next){
-					float f;
-					mins += movementCost(_map, s->hex, s->dir, s->nextp, unit->combatant()->force, UnitCarriers(i), MM_ROAD, &f, false);
-				}
+				for (Segment* s = _supplyLine; s != null; s = s->next)
+					mins += pathCost(_map, s->hex, s->dir, s->nextp, unit->combatant()->force, UnitCarriers(i), MM_ROAD, false);
 				int sortieLength = 2 * mins + 60; // 60 = loading/unloading time
 				if (logging())
-					engine::logPrintf("      %s %gt load length %g hours\n", unitCarrierNames[i], mi.supplyLoad[i], sortieLength / 60.0);
-				_supplyRate += mi.supplyLoad[i] / sortieLength;
+					engine::logPrintf("      %s %gt load length %g hours\n", unitCarrierNames[i], mi->supplyLoad[i], sortieLength / 60.0);
+				_supplyRate += mi->supplyLoad[i] / sortieLength;
 			}
 		if (logging())
 			engine::logPrintf("  %s supplyRate %gt/day\n", unit->name().c_str(), _supplyRate * 60 * 24); 
@@ -1195,6 +1204,153 @@ void Detachment::checkSupplyLine() {
 		return;
 	}
 }
+/*
+ *	SupplyLineSearch
+ *
+ *	This holds the searches for one call to refreshSupplyLines.  A request
+ *	is made for each detachment that checkSupplyLine would have to search
+ *	for, and each worker thread has its own path objects to search with.
+ *
+ *	Requests for the nearest depot are answered from a SupplyField, one
+ *	per force and carrier, built in parallel before the other searches.
+ *	A request the field cannot answer falls back to a DepotPath search.
+ */
+class SupplyLineSearch : public ParallelTask {
+public:
+	SupplyLineSearch(HexMap* map) {
+		_workers = parallelWorkers();
+		_supplyPaths = new SupplyPath[_workers];
+		_depotPaths = new DepotPath[_workers];
+		for (int i = 0; i < NFORCES; i++)
+			for (int j = 0; j < UC_MAXCARRIER; j++)
+				_fields[i][j] = null;
+		collect(map);
+	}
+
+	~SupplyLineSearch() {
+		delete [] _supplyPaths;
+		delete [] _depotPaths;
+		for (int i = 0; i < NFORCES; i++)
+			for (int j = 0; j < UC_MAXCARRIER; j++)
+				delete _fields[i][j];
+	}
+	/*
+	 *	search
+	 *
+	 *	Builds the supply fields, answers what depot requests it can
+	 *	from them, then runs the remaining searches.
+	 */
+	void search() {
+		_phase = BUILD_FIELDS;
+		runParallel(this, _builds.size());
+		for (int i = 0; i < _requests.size(); i++) {
+			Request& r = _requests[i];
+			if (r.source == null) {
+				SupplyField* f = _fields[r.force->index][r.carriers];
+				if (f->find(r.detachment, &r.line, &r.source))
+					continue;
+			}
+			_searches.push_back(i);
+		}
+		_phase = FIND_LINES;
+		runParallel(this, _searches.size());
+	}
+
+	virtual void run(int item, int worker) {
+		if (_phase == BUILD_FIELDS) {
+			SupplyField* f = _builds[item];
+			f->build(f->force, f->carriers);
+			return;
+		}
+		Request& r = _requests[_searches[item]];
+		Detachment* d = r.detachment;
+		if (r.source != null)
+			r.line = _supplyPaths[worker].find(d->unit, d->_location, r.source->_location);
+		else {
+			r.line = _depotPaths[worker].find(d, d->_location);
+			r.source = _depotPaths[worker].sourceDepot;
+		}
+	}
+	/*
+	 *	commit
+	 *
+	 *	Stores the results in the order the requests were collected,
+	 *	just as checkSupplyLine would have.
+	 */
+	void commit() {
+		for (int i = 0; i < _requests.size(); i++) {
+			Request& r = _requests[i];
+			r.detachment->_supplySource = r.source;
+			r.detachment->_supplyLine = r.line;
+		}
+	}
+
+private:
+	enum Phase {
+		BUILD_FIELDS,
+		FIND_LINES
+	};
+
+	struct Request {
+		Detachment*		detachment;
+		SupplyDepot*	source;				// The headquarters to reach, or null to look for any depot
+		Segment*		line;
+		Force*			force;
+		UnitCarriers	carriers;
+	};
+
+	void collect(HexMap* map) {
+		xpoint hx;
+		for (hx.x = map->subsetOrigin().x; hx.x < map->subsetOpposite().x; hx.x++)
+			for (hx.y = map->subsetOrigin().y; hx.y < map->subsetOpposite().y; hx.y++)
+				for (Detachment* d = map->getDetachments(hx); d != null; d = d->next) {
+					if (d->_supplyLine != null)
+						continue;
+
+						// A depot in the same hex needs no search
+
+					if (getSupplyDepot(d, d->_location) != null)
+						continue;
+					Request r;
+					r.detachment = d;
+					r.source = d->unit->findSourceHq();
+					r.line = null;
+					r.force = d->unit->combatant()->force;
+					r.carriers = map->calculateCarrier(d->unit);
+
+						// The searches share the map's edge cost tables, so
+						// they have to be built before the threads start.
+
+					map->prepareEdgeCosts(r.carriers, MM_ROAD);
+					if (r.source == null) {
+						SupplyField*& f = _fields[r.force->index][r.carriers];
+						if (f == null) {
+							f = new SupplyField();
+							f->force = r.force;
+							f->carriers = r.carriers;
+							_builds.push_back(f);
+						}
+					}
+					_requests.push_back(r);
+				}
+	}
+
+	int					_workers;
+	Phase				_phase;
+	SupplyPath*			_supplyPaths;
+	DepotPath*			_depotPaths;
+	SupplyField*		_fields[NFORCES][UC_MAXCARRIER];
+	vector<SupplyField*> _builds;
+	vector<Request>		_requests;
+	vector<int>			_searches;			// Requests left after the fields are consulted
+};
+
+void refreshSupplyLines(HexMap* map) {
+	SupplyLineSearch search(map);
+
+	search.search();
+	search.commit();
+}
 
 		// This is only done for detachments that have depots in them.
 
@@ -16,6 +16,7 @@ class ParticipantObject;
 class Segment;
 class StandingOrder;
 class SupplyDepot;
+class SupplyLineSearch;
 class Unit;
 
 enum DetachmentAction {
@@ -33,6 +34,7 @@ extern const char* detachmentActionNames[];
 
 class Detachment {
 	friend ParticipantObject;
+	friend SupplyLineSearch;
 protected:
 	Detachment();
 public:
@@ -52,7 +54,7 @@ public:
 
 	Detachment*			next; 		// list of detachments at same location
 	Unit*				unit;
-	DetachmentAction	action;
+	DetachmentAction	action;			// Assign with setAction, so the map's ZOC stays current
 	minutes				timeInPosition;
 	float				fatigue;
 	StandingOrder*		orders;
@@ -124,6 +126,13 @@ public:
 	 *	The detachment is immediately set into the given mode.
 	 */
 	void adoptMode(UnitModes m);
+	/*
+	 *	setAction
+	 *
+	 *	Changes what the detachment is doing, telling the map
+	 *	if that changes whether it exerts a ZOC.
+	 */
+	void setAction(DetachmentAction a);
 
 	void post(StandingOrder* o);
 	/*
@@ -312,5 +321,21 @@ private:
 };
 
 SupplyDepot* getSupplyDepot(Detachment* excludeThis, xpoint hex);
+/*
+ *	refreshSupplyLines
+ *
+ *	Finds supply lines for every detachment on the map that has
+ *	none and needs a path search to get one.  The searches run in
+ *	parallel, but the results are stored in map order, so the game
+ *	plays out the same however many threads were used.  Supply
+ *	rates are computed when each detachment is next made current.
+ *
+ *	The lines are found from the map as it stands when this is
+ *	called (at the start of each day), not when each detachment is
+ *	made current.  A detachment this finds no line for searches
+ *	again on demand, since depots or enemy zones of control may have
+ *	changed by then.
+ */
+void refreshSupplyLines(HexMap* map);
 
 }  // namespace engine
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include "engine_test.h"
 
 #include <typeinfo.h>
+#include <new>
+#include "../ai/ai.h"
 #include "../common/atom.h"
 #include "../common/hill_climb.h"
 #include "../common/parser.h"
@@ -10,12 +12,18 @@
 #include "detachment.h"
 #include "doctrine.h"
 #include "engine.h"
+#include "force.h"
 #include "game.h"
 #include "game_map.h"
 #include "game_time.h"
 #include "global.h"
+#include "landmarks.h"
+#include "mapped_file.h"
 #include "order.h"
+#include "parallel.h"
 #include "path.h"
+#include "pool.h"
+#include "rail_network.h"
 #include "scenario.h"
 #include "theater.h"
 #include "unit.h"
@@ -95,27 +103,27 @@ bool GameObject::run() {
 		}
 		a = get("ammoOnly");
 		if (a && a->toString().toBool()) {
-			global::basicATHitProbability = 0;
-			global::offensiveAPHitProbability = 0;
-			global::defensiveAPHitProbability = 0;
+			_game->parameters.basicATHitProbability = 0;
+			_game->parameters.offensiveAPHitProbability = 0;
+			_game->parameters.defensiveAPHitProbability = 0;
 		}
 		a = get("randomize");
 		if (a && !a->toString().toBool()) {
-			global::ammoUseStdDev = 0;
-			global::basicDisruptStdDev = 0;
-			global::basicCombatEnduranceStdDev = 0;
-			global::breakdownModifier = 0;
-			global::basicCombatEndurance = 50;
+			_game->parameters.ammoUseStdDev = 0;
+			_game->parameters.basicDisruptStdDev = 0;
+			_game->parameters.basicCombatEnduranceStdDev = 0;
+			_game->parameters.breakdownModifier = 0;
+			_game->parameters.basicCombatEndurance = 50;
 		}
 		a = get("fatigue");
 		if (a && !a->toString().toBool()) {
-			global::maxFatigueDefensiveDirectFireModifier = 1;
-			global::maxFatigueDefensiveIndirectFireModifier = 1;
-			global::maxFatigueOffensiveDirectFireModifier = 1;
-			global::maxFatigueOffensiveIndirectFireModifier = 1;
-			global::maxFatigueRetreatModifier = 1;
-			global::maxFatigueDisruptModifier = 1;
-			global::maxFatigueUndisruptModifier = 1;
+			_game->parameters.maxFatigueDefensiveDirectFireModifier = 1;
+			_game->parameters.maxFatigueDefensiveIndirectFireModifier = 1;
+			_game->parameters.maxFatigueOffensiveDirectFireModifier = 1;
+			_game->parameters.maxFatigueOffensiveIndirectFireModifier = 1;
+			_game->parameters.maxFatigueRetreatModifier = 1;
+			_game->parameters.maxFatigueDisruptModifier = 1;
+			_game->parameters.maxFatigueUndisruptModifier = 1;
 		}
 		bool result = runAnyContent();
 		delete _game;
@@ -139,6 +147,28 @@ static void swap(float& a, float& b) {
 }
 
 class SummarizeObject;
+/*
+ *	The parameters the hill climb varies, with their ranges and steps.
+ */
+struct CalibratedParameter {
+	float*		value;
+	float		minimum;
+	float		maximum;
+	float		step;
+};
+
+static CalibratedParameter calibratedParameters[] = {
+	{ &global::basicATHitProbability,		0.04f, 0.3f, 0.04f },
+	{ &global::offensiveAPHitProbability,	0.04f, 0.3f, 0.04f },
+	{ &global::defensiveAPHitProbability,	0.04f, 0.3f, 0.04f },
+	{ &global::rearAccuracy,				0.05f, 0.5f, 0.05f },
+	{ &global::lineAccuracy,				0.05f, 0.9f, 0.05f },
+};
+/*
+ *	Summarize objects are counted as they run, so that a child process
+ *	running one repeat of a calibration can find the one it was given.
+ */
+static int summarizeObjects;
 
 class GameHillClimb : public explore::HillClimb {
 public:
@@ -152,21 +182,43 @@ private:
 	SummarizeObject*		_so;
 };
 
+/*
+ *	SummarizeObject
+ *
+ *	Collects the results of the combats it contains.  With explore:
+ *	hill-climb, it calibrates the parameters in calibratedParameters
+ *	against the historical results instead:
+ *
+ *		steps		Hill climb steps (default 1).
+ *		seed		First random seed for the games.
+ *		randomize	Start from random values (with a seed if not true).
+ *		average		Repeats, with successive seeds, scored per candidate.
+ *		workers		Child processes the repeats are spread over (default
+ *					one per processor).
+ *		results		File the final values and score are written to.
+ */
 class SummarizeObject : script::Object {
 public:
 	static script::Object* factory() {
 		return new SummarizeObject();
 	}
 
-	SummarizeObject() {}
+	SummarizeObject() {
+		_average = 1;
+		_workers = 1;
+	}
 
 	virtual bool isRunnable() const { return true; }
 
 	virtual bool run() {
 		_gameHillClimb = null;
+		_ordinal = summarizeObjects++;
 		ScenarioObject* so;
 		if (containedBy(&so)) {
 			_theater = so->scenario()->theater();
+			string job = childJob();
+			if (job.size())
+				return runJob(job);
 			Atom* a = get("explore");
 			if (a) {
 				if (a->toString() == "hill-climb") {
@@ -189,6 +241,13 @@ public:
 					a = get("average");
 					if (a)
 						_average = a->toString().toInt();
+					_workers = parallelWorkers();
+					a = get("workers");
+					if (a)
+						_workers = a->toString().toInt();
+					a = get("results");
+					if (a)
+						_results = a->toString();
 					return hillClimb(steps, randomize, seed);
 				} else {
 					printf("Unknown explore: value\n");
@@ -236,11 +295,10 @@ public:
 //		_gameHillClimb->defineVariable(sovietDoctrine->adcRate, 0.2f, 3.0f, 0.2f);
 //		_gameHillClimb->defineVariable(sovietDoctrine->dacRate, 0.2f, 3.0f, 0.2f);
 //		_gameHillClimb->defineVariable(sovietDoctrine->ddcRate, 0.2f, 3.0f, 0.2f);
-		_gameHillClimb->defineVariable(global::basicATHitProbability, 0.04f, 0.3f, 0.04f);
-		_gameHillClimb->defineVariable(global::offensiveAPHitProbability, 0.04f, 0.3f, 0.04f);
-		_gameHillClimb->defineVariable(global::defensiveAPHitProbability, 0.04f, 0.3f, 0.04f);
-		_gameHillClimb->defineVariable(global::rearAccuracy, 0.05f, 0.5f, 0.05f);
-		_gameHillClimb->defineVariable(global::lineAccuracy, 0.05f, 0.9f, 0.05f);
+		for (int i = 0; i < dimOf(calibratedParameters); i++) {
+			CalibratedParameter& p = calibratedParameters[i];
+			_gameHillClimb->defineVariable(*p.value, p.minimum, p.maximum, p.step);
+		}
 		if (randomize)
 			_gameHillClimb->randomize();
 		printf("Before solving:\n");
@@ -248,29 +306,37 @@ public:
 		steps = _gameHillClimb->solve(steps);
 		printf("After solving %d steps:\n", steps);
 		_gameHillClimb->writeVariables(stdout);
-		runOnce(true);
+		double score = runOnce(true);
+		if (_results.size())
+			return writeResults(steps, score);
 		return true;
 	}
-
+	/*
+	 *	runOnce
+	 *
+	 *	Scores the current parameter values, averaged over _average
+	 *	repeats with successive random seeds.  With more than one worker
+	 *	the repeats run in child processes, each of which loads its own
+	 *	copy of the scenario, since a Scenario can only carry one game at
+	 *	a time.  Each repeat gets the same seed either way and the scores
+	 *	are added up in repeat order, so the result does not depend on
+	 *	the number of workers.
+	 */
 	double runOnce(bool printSubscores) {
+		if (_workers > 1 && _average > 1 && !printSubscores)
+			return runRepeatsInParallel();
 		double sum = 0;
 		unsigned oldSeed = global::randomSeed;
 		for (int i = 0; i < _average; i++) {
 			__int64 start = millisecondMark();
-			bool result = runAnyContent();
+			double x;
+			bool result = runRepeat(printSubscores, &x);
 			__int64 end = millisecondMark();
 			if (!result) {
+				global::randomSeed = oldSeed;
 				_gameHillClimb->cancel();
 				return 0;
 			}
-			double x = computeAggregateScore(printSubscores);
-			_inputs.clear();
-			_outputs.clear();
-			dictionary<TallySet*>::iterator tsi = _tallySets.begin();
-			while (tsi.valid()) {
-				(*tsi)->tallies.deleteAll();
-				tsi.next();
-			}
 			printf(" -- Iteration took %g seconds", (end - start) / 1000.0);
 			if (_average > 1)
 				printf(" partial score = %g", x);
@@ -282,6 +348,93 @@ public:
 		return sum / _average;
 	}
 
+	bool runRepeat(bool printSubscores, double* score) {
+		bool result = runAnyContent();
+		if (result)
+			*score = computeAggregateScore(printSubscores);
+		_inputs.clear();
+		_outputs.clear();
+		dictionary<TallySet*>::iterator tsi = _tallySets.begin();
+		while (tsi.valid()) {
+			(*tsi)->tallies.deleteAll();
+			tsi.next();
+		}
+		return result;
+	}
+
+	double runRepeatsInParallel() {
+		RepeatTask task(this);
+		__int64 start = millisecondMark();
+		bool result = runProcesses(&task, _average, _workers);
+		__int64 end = millisecondMark();
+		double sum = 0;
+		for (int i = 0; i < _average; i++) {
+			if (!task.succeeded[i])
+				result = false;
+			else
+				printf(" -- partial score = %g\n", task.scores[i]);
+			sum += task.scores[i];
+		}
+		if (!result) {
+			printf("A repeat failed in its child process\n");
+			_gameHillClimb->cancel();
+			return 0;
+		}
+		printf(" -- %d iterations took %g seconds\n", _average, (end - start) / 1000.0);
+		return sum / _average;
+	}
+	/*
+	 *	runJob
+	 *
+	 *	In a child process started by runRepeatsInParallel, runs the one
+	 *	repeat the job names and writes its score for the parent.  The
+	 *	job is the ordinal of the summarize object, the random seed and
+	 *	the values of the calibrated parameters.  Every other summarize
+	 *	object in the script is skipped.
+	 */
+	bool runJob(const string& job) {
+		const char* cp = job.c_str();
+		int ordinal;
+		unsigned seed;
+		int n;
+		if (sscanf(cp, "%d %u%n", &ordinal, &seed, &n) < 2)
+			fatalMessage("Bad calibration job: " + job);
+		if (ordinal != _ordinal)
+			return true;
+		cp += n;
+		for (int i = 0; i < dimOf(calibratedParameters); i++) {
+			if (sscanf(cp, "%g%n", calibratedParameters[i].value, &n) < 1)
+				fatalMessage("Bad calibration job: " + job);
+			cp += n;
+		}
+		engine::closeLog();
+		verboseOutput = false;
+		global::randomSeed = seed;
+		_gameHillClimb = new GameHillClimb(this, new random::Random(seed));
+		double score;
+		if (!runRepeat(false, &score))
+			exit(1);
+		printf("score: %.17g\n", score);
+		fflush(stdout);
+		exit(0);
+		return true;
+	}
+
+	bool writeResults(int steps, double score) {
+		FILE* fp = fopen(_results.c_str(), "w");
+		if (fp == null) {
+			printf("Could not write results to %s\n", _results.c_str());
+			return false;
+		}
+		fprintf(fp, "Steps: %d\n", steps);
+		fprintf(fp, "Average: %d\n", _average);
+		fprintf(fp, "Seed: %u\n", global::randomSeed);
+		fprintf(fp, "Score: %.17g\n", score);
+		_gameHillClimb->writeVariables(fp);
+		fclose(fp);
+		return true;
+	}
+
 	void accumulate(const string& name, CombatGroup* cg, const Combatant* combatant, 
 					int menLost, int tanksLost, int gunsLost, 
 					int ammoUsed, int saAmmoUsed, int atAmmoUsed, int rktAmmoUsed, int gunAmmoUsed,
@@ -657,6 +810,45 @@ public:
 	const Theater* theater() const { return _theater; }
 	GameHillClimb* gameHillClimb() const { return _gameHillClimb; }
 private:
+	class RepeatTask : public ProcessTask {
+	public:
+		RepeatTask(SummarizeObject* so) {
+			_so = so;
+			scores.resize(so->_average);
+			succeeded.resize(so->_average);
+			for (int i = 0; i < so->_average; i++) {
+				scores[i] = 0;
+				succeeded[i] = false;
+			}
+		}
+
+		virtual string job(int item) {
+			char buffer[32];
+			sprintf(buffer, "%d %u", _so->_ordinal, global::randomSeed + item);
+			string s = buffer;
+			for (int i = 0; i < dimOf(calibratedParameters); i++) {
+				sprintf(buffer, " %.9g", *calibratedParameters[i].value);
+				s = s + buffer;
+			}
+			return s;
+		}
+
+		virtual void finish(int item, int exitCode, const string& output) {
+			if (exitCode != 0)
+				return;
+			const char* cp = strstr(output.c_str(), "score: ");
+			if (cp == null)
+				return;
+			succeeded[item] = sscanf(cp + 7, "%lg", &scores[item]) == 1;
+		}
+
+		vector<double>	scores;
+		vector<bool>	succeeded;
+
+	private:
+		SummarizeObject*	_so;
+	};
+
 	class TallySet {
 	public:
 		TallySet() {
@@ -690,6 +882,9 @@ private:
 	const Theater*			_theater;
 	GameHillClimb*			_gameHillClimb;
 	int						_average;
+	int						_workers;
+	int						_ordinal;
+	string					_results;
 };
 
 double GameHillClimb::computeScore() {
@@ -1218,7 +1413,7 @@ public:
 		_combatant->game()->map()->placeOnTop(d);
 		if (d->_supplySource)
 			d->_supplySource->makeCurrent();
-		d->action = DA_IDLE;
+		d->setAction(DA_IDLE);
 		d->makeCurrent();
 		d->timeInPosition = tip;
 		d->intensity = intensity;
@@ -1773,110 +1968,833 @@ private:
 	int					_maxDist;
 	FillPath*			_fillPath;
 };
+/*
+ *	TerrainPath
+ *
+ *	Charges each step one more than the terrain code of the hex it
+ *	enters, so the paths it finds go around rough ground and the two
+ *	ways seek can search have real work to do.
+ */
+class TerrainPath : public StraightPath {
+public:
+	TerrainPath() {
+		visitLimit = 100000000;
+		minimumStep = 1;
+		_map = null;
+	}
 
-class VisitedObject : public script::Object {
+	Segment* route(HexMap* map, xpoint A, xpoint B) {
+		_map = map;
+		source = A;
+		destination = B;
+		foundIt = false;
+		seek(map, MAXIMUM_PATH_LENGTH, SK_ORDER);
+		return path;
+	}
+
+	virtual int kost(xpoint a, HexDirection dir, xpoint b) {
+		return 1 + (_map->getCell(b) & 0x0f);
+	}
+
+	virtual bool blocked(xpoint a) const {
+		return false;
+	}
+
+protected:
+	HexMap*			_map;
+};
+/*
+ *	BlockedPath
+ *
+ *	A TerrainPath that will not go on from hexes of one terrain.
+ *	Its visit does more than watch for the destination, so seek must
+ *	never search from both ends for it.
+ */
+class BlockedPath : public TerrainPath {
 public:
-	static script::Object* factory() {
-		return new VisitedObject();
+	BlockedPath(int stopCell) {
+		_stopCell = stopCell;
+	}
+
+	virtual PathContinuation visit(xpoint a) {
+		if (a == destination) {
+			foundIt = true;
+			return PC_STOP_ALL;
+		}
+		if (a != source && blocked(a))
+			return PC_STOP_THIS;
+		return PC_CONTINUE;
+	}
+
+	virtual bool meetsHalfway() const { return false; }
+
+	virtual bool blocked(xpoint a) const {
+		return (_map->getCell(a) & 0x0f) == _stopCell;
 	}
 
 private:
-	VisitedObject() {}
+	int				_stopCell;
+};
+/*
+ *	MeetObject
+ *
+ *	Finds paths between random pairs of hexes of the enclosing map, once
+ *	with the one ended A* search and once with global::bidirectionalPathDistance
+ *	set so that seek searches from both ends.  The two must agree on
+ *	whether there is a path and on its cost.  A path whose visit stops
+ *	the search at some hexes must get the same answer both times, and
+ *	none of its paths may pass through a hex where visit stopped.
+ */
+/*
+ *	WeightTour
+ *
+ *	Tours the map from a hex, moving at the weights of a landmark index,
+ *	and records the cheapest distance to each hex, or LANDMARK_UNREACHED.
+ */
+class WeightTour : public PathHeuristic {
+public:
+	WeightTour(const Landmarks* landmarks, int cells) {
+		_landmarks = landmarks;
+		distance = new int[cells];
+		visitLimit = cells;
+		_cells = cells;
+	}
+
+	~WeightTour() {
+		delete [] distance;
+	}
+
+	void tour(HexMap* map, xpoint a) {
+		for (int i = 0; i < _cells; i++)
+			distance[i] = LANDMARK_UNREACHED;
+		source = a;
+		engine::visit(map, this, a, MAXIMUM_PATH_LENGTH, SK_ORDER);
+		review(map);
+	}
+
+	virtual int kost(xpoint a, HexDirection dir, xpoint b) {
+		return _landmarks->weight(a, dir);
+	}
+
+	virtual void reviewHex(HexMap* map, xpoint a, int gval) {
+		distance[a.y * map->getColumns() + a.x] = gval;
+	}
+
+	int*				distance;
+
+private:
+	const Landmarks*	_landmarks;
+	int					_cells;
+};
+/*
+ *	LandmarksObject
+ *
+ *	Builds a landmark index for foot movement on the enclosing map and
+ *	checks that its estimates never exceed the true distance between
+ *	random pairs of hexes.  Then lowers a move of the map's own index,
+ *	which must leave it stale and giving no bound until the map's
+ *	refreshLandmarks rebuilds it.
+ */
+class LandmarksObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new LandmarksObject();
+	}
 
 	virtual bool validate(script::Parser* parser) {
-		Atom* a = get("remaining");
-		if (a) {
-			_remaining = a->toString().toInt();
-			return true;
+		Atom* a = get("parent");
+		if (a == null || typeid(*a) != typeid(MapObject)) {
+			printf("Landmarks object must appear in the contents of a map\n");
+			return false;
 		}
-		_remaining = -1;	
-		a = get("x");
-		if (a == null) {
-			printf("Missing x property\n");
+		_map = (MapObject*)a;
+		a = get("count");
+		if (a)
+			_count = a->toString().toInt();
+		a = get("sources");
+		if (a)
+			_sources = a->toString().toInt();
+		a = get("seed");
+		if (a)
+			_seed = a->toString().toInt();
+		return true;
+	}
+
+	virtual bool run() {
+		HexMap* map = _map->map();
+		Landmarks landmarks(map);
+		xpoint hx;
+		for (hx.y = map->subsetOrigin().y; hx.y < map->subsetOpposite().y; hx.y++)
+			for (hx.x = map->subsetOrigin().x; hx.x < map->subsetOpposite().x; hx.x++)
+				for (HexDirection dir = 0; dir < 6; dir++) {
+					int c = map->edgeCost(hx, dir, UC_FOOT, MM_ROAD, true);
+					int o = map->edgeCost(hx, dir, UC_FOOT, MM_ROAD, false);
+					landmarks.lower(hx, dir, c < o ? c : o);
+				}
+		landmarks.build(_count, string());
+		if (landmarks.stale() || landmarks.count() == 0) {
+			printf("No landmarks were chosen\n");
 			return false;
 		}
-		_hex.x = a->toString().toInt();
-		a = get("y");
-		if (a == null) {
-			printf("Missing y property\n");
+		printf("%d landmarks\n", landmarks.count());
+
+		int cells = map->getRows() * map->getColumns();
+		WeightTour t(&landmarks, cells);
+		random::Random r(_seed);
+		int bounded = 0;
+		int pairs = 0;
+		for (int i = 0; i < _sources; i++) {
+			xpoint a;
+			a.x = map->subsetOrigin().x + int(r.uniform() * (map->subsetOpposite().x - map->subsetOrigin().x));
+			a.y = map->subsetOrigin().y + int(r.uniform() * (map->subsetOpposite().y - map->subsetOrigin().y));
+			t.tour(map, a);
+			for (hx.y = map->subsetOrigin().y; hx.y < map->subsetOpposite().y; hx.y++)
+				for (hx.x = map->subsetOrigin().x; hx.x < map->subsetOpposite().x; hx.x++) {
+					int d = t.distance[hx.y * map->getColumns() + hx.x];
+					if (d == LANDMARK_UNREACHED)
+						continue;
+					int e = landmarks.estimate(a, hx);
+					if (e > d) {
+						printf("[%d:%d]->[%d:%d] estimate %d is over the distance %d\n", a.x, a.y, hx.x, hx.y, e, d);
+						return false;
+					}
+					if (e > 0)
+						bounded++;
+					pairs++;
+				}
+		}
+		printf("%d of %d estimates gave a bound\n", bounded, pairs);
+
+		int saved = global::landmarkCount;
+		global::landmarkCount = _count;
+		bool result = refresh(map);
+		global::landmarkCount = saved;
+		return result;
+	}
+
+private:
+	LandmarksObject() {
+		_count = 8;
+		_sources = 4;
+		_seed = 1;
+	}
+
+	bool refresh(HexMap* map) {
+		Landmarks* lm = map->landmarks(UC_FOOT, MM_ROAD);
+		if (lm == null || lm->stale()) {
+			printf("The map has no current landmark index\n");
 			return false;
 		}
-		_hex.y = a->toString().toInt();
-		a = get("gval");
-		if (a == null) {
-			printf("Missing stop property\n");
+		xpoint a = lm->landmark(0);
+		xpoint b = lm->landmark(lm->count() > 1 ? 1 : 0);
+		HexDirection dir;
+		for (dir = 0; dir < 6; dir++)
+			if (lm->weight(a, dir) > 1 && lm->weight(a, dir) <= MAXIMUM_PATH_LENGTH)
+				break;
+		if (dir == 6) {
+			printf("No move out of landmark [%d:%d] to lower\n", a.x, a.y);
+			return false;
+		}
+		lm->lower(a, dir, lm->weight(a, dir) - 1);
+		if (!lm->stale() || lm->estimate(a, b) != 0) {
+			printf("Lowering a weight did not leave the index stale\n");
+			return false;
+		}
+		if (map->landmarks(UC_FOOT, MM_ROAD) != lm || !lm->stale()) {
+			printf("Asking for the index again rebuilt it\n");
+			return false;
+		}
+		map->refreshLandmarks();
+		if (lm->stale()) {
+			printf("refreshLandmarks left the index stale\n");
 			return false;
 		}
-		_gval = a->toString().toInt();
 		return true;
 	}
 
-	virtual bool run() {
-		PathObject* po;
-		if (containedBy(&po)) {
-			FillPath* fillPath = po->fillPath();
+	MapObject*		_map;
+	int				_count;
+	int				_sources;
+	unsigned		_seed;
+};
 
-			if (_remaining >= 0) {
-				int total = 0;
-				for (int i = 0; i < fillPath->visited.size(); i++) {
-					if (fillPath->visited[i].hex.x != -1)
-						total++;
-				}
-				if (total != _remaining) {
-					printf("Expected %d remaining cells in search, found %d\n", _remaining, total);
-					return false;
+/*
+ *	ClustersObject
+ *
+ *	Sends units of the enclosing game to random hexes at least distance
+ *	away, finding each path once with the flat search and once planned
+ *	across the map's clusters and refined.  A refined path must be
+ *	whole, must exist whenever the flat one does and may cost no more
+ *	than slack percent over it.  The average excess is reported, which
+ *	is the measure of what global::hierarchicalPathDistance costs.
+ */
+class ClustersObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new ClustersObject();
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		Atom* a = get("pairs");
+		if (a)
+			_pairs = a->toString().toInt();
+		a = get("distance");
+		if (a)
+			_distance = a->toString().toInt();
+		a = get("slack");
+		if (a)
+			_slack = a->toString().toInt();
+		a = get("seed");
+		if (a)
+			_seed = a->toString().toInt();
+		return true;
+	}
+
+	virtual bool run() {
+		GameObject* go;
+		if (!containedBy(&go)) {
+			printf("Not contained by a game object.\n");
+			return false;
+		}
+		HexMap* map = go->game()->map();
+		vector<Detachment*> detachments;
+		xpoint hx;
+		for (hx.x = map->subsetOrigin().x; hx.x < map->subsetOpposite().x; hx.x++)
+			for (hx.y = map->subsetOrigin().y; hx.y < map->subsetOpposite().y; hx.y++)
+				for (Detachment* d = map->getDetachments(hx); d != null; d = d->next)
+					detachments.push_back(d);
+		if (detachments.size() == 0) {
+			printf("No units on the map.\n");
+			return false;
+		}
+		random::Random r(_seed);
+		UnitPath flat;
+		UnitPath planned;
+		int saved = global::hierarchicalPathDistance;
+		bool result = true;
+		int compared = 0;
+		double flatTotal = 0;
+		double plannedTotal = 0;
+		for (int i = 0; i < _pairs && result; i++) {
+			Detachment* d = detachments[int(r.uniform() * detachments.size())];
+			xpoint A = d->location();
+			xpoint B;
+			int tries = 0;
+			do {
+				B.x = map->subsetOrigin().x + int(r.uniform() * (map->subsetOpposite().x - map->subsetOrigin().x));
+				B.y = map->subsetOrigin().y + int(r.uniform() * (map->subsetOpposite().y - map->subsetOrigin().y));
+			} while (hexDistance(A, B) < _distance && ++tries < 100);
+			if (hexDistance(A, B) < _distance)
+				continue;
+			global::hierarchicalPathDistance = 0;
+			Segment* f = flat.find(map, d->unit, A, UM_MOVE, B, false);
+			global::hierarchicalPathDistance = _distance;
+			Segment* p = planned.find(map, d->unit, A, UM_MOVE, B, false);
+			double fc;
+			double pc;
+			if (f != null && p == null) {
+				printf("[%d:%d]->[%d:%d] found flat but not planned\n", A.x, A.y, B.x, B.y);
+				result = false;
+			} else if (f != null && (!whole(f, A, B, &fc) || !whole(p, A, B, &pc)))
+				result = false;
+			else if (f != null) {
+				if (pc * 100 > fc * (100 + _slack)) {
+					printf("[%d:%d]->[%d:%d] planned path costs %g, flat %g\n", A.x, A.y, B.x, B.y, pc, fc);
+					result = false;
 				}
-				return runAnyContent();
+				flatTotal += fc;
+				plannedTotal += pc;
+				compared++;
 			}
-			for (int i = 0; i < fillPath->visited.size(); i++) {
-				if (fillPath->visited[i].hex == _hex &&
-					fillPath->visited[i].gval == _gval) {
-					if (!runAnyContent())
-						return false;
-					fillPath->visited[i].hex.x = -1;
-					return true;
-				}
+			delete f;
+			delete p;
+		}
+		global::hierarchicalPathDistance = saved;
+		if (compared > 0)
+			printf("%d paths compared, planned paths cost %.1f%% more in all\n", compared, 100 * (plannedTotal - flatTotal) / flatTotal);
+		else
+			printf("No paths compared.\n");
+		return result;
+	}
+
+private:
+	ClustersObject() {
+		_pairs = 100;
+		_distance = 48;
+		_slack = 25;
+		_seed = 1;
+	}
+	/*
+	 *	whole
+	 *
+	 *	Checks that path steps from hex to neighboring hex from A to B
+	 *	and sets *cost to its cost.
+	 */
+	static bool whole(Segment* path, xpoint A, xpoint B, double* cost) {
+		xpoint at = A;
+		*cost = 0;
+		for (Segment* s = path; s != null; s = s->next) {
+			if (s->hex != at || hexDistance(s->hex, s->nextp) != 1) {
+				printf("[%d:%d]->[%d:%d] path breaks at [%d:%d]\n", A.x, A.y, B.x, B.y, at.x, at.y);
+				return false;
 			}
-			printf("hex [%d:%d] expected gval= %d not found\n", _hex.x, _hex.y, _gval);
-			return false;
-		} else {
-			printf("Not contained in a path object\n");
+			*cost += s->cost;
+			at = s->nextp;
+		}
+		if (at != B) {
+			printf("[%d:%d]->[%d:%d] path ends at [%d:%d]\n", A.x, A.y, B.x, B.y, at.x, at.y);
 			return false;
 		}
+		return true;
 	}
 
-private:
-	int					_remaining;
-	xpoint				_hex;
-	int					_gval;
+	int			_pairs;
+	int			_distance;
+	int			_slack;
+	unsigned	_seed;
 };
 
-class ReportObject : script::Object {
+/*
+ *	RailTour
+ *
+ *	Tours the map from a hex along open rails, at the costs the rail
+ *	network charges, and records the cheapest cost to each hex, or
+ *	MAXIMUM_PATH_LENGTH + 1 if no open rails reach it.
+ */
+class RailTour : public PathHeuristic {
 public:
-	static script::Object* factory() {
-		return new ReportObject();
+	RailTour(HexMap* map, int step) {
+		_map = map;
+		_step = step;
+		_cells = map->getRows() * map->getColumns();
+		distance = new int[_cells];
+		visitLimit = _cells;
 	}
 
-	ReportObject() {}
+	~RailTour() {
+		delete [] distance;
+	}
 
-	virtual bool isRunnable() const { return true; }
+	void tour(xpoint a) {
+		for (int i = 0; i < _cells; i++)
+			distance[i] = MAXIMUM_PATH_LENGTH + 1;
+		source = a;
+		engine::visit(_map, this, a, MAXIMUM_PATH_LENGTH, SK_ORDER);
+		review(_map);
+	}
+	/*
+	 *	open
+	 *
+	 *	As RailNetwork sees it: a train can cross the edge both ways.
+	 */
+	bool open(xpoint hx, HexDirection dir) const {
+		xpoint n = neighbor(hx, dir);
+		return _map->valid(hx) &&
+			   _map->valid(n) &&
+			   _map->edgeCost(hx, dir, UC_RAIL, MM_RAIL, true) <= MAXIMUM_PATH_LENGTH &&
+			   _map->edgeCost(n, reverseDirection(dir), UC_RAIL, MM_RAIL, true) <= MAXIMUM_PATH_LENGTH;
+	}
+
+	virtual int kost(xpoint a, HexDirection dir, xpoint b) {
+		if (!open(a, dir))
+			return MAXIMUM_PATH_LENGTH;
+		return _step + _map->edgeCost(a, dir, UC_RAIL, MM_RAIL, true);
+	}
+
+	virtual void reviewHex(HexMap* map, xpoint a, int gval) {
+		distance[a.y * map->getColumns() + a.x] = gval;
+	}
+
+	int*			distance;
+
+private:
+	HexMap*			_map;
+	int				_step;
+	int				_cells;
+};
+/*
+ *	RailsObject
+ *
+ *	Checks RailNetwork::route on the enclosing map against a search of
+ *	the hexes along the same rails, from random rail hexes to every
+ *	other.  The costs must agree and each route must be a chain of open
+ *	rail edges from A to B costing what route says.  The check is made
+ *	on the map as loaded, again after tearing up some rail edges, and
+ *	again after mending them, so the network's repairs are covered too.
+ */
+class RailsObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new RailsObject();
+	}
 
 	virtual bool validate(script::Parser* parser) {
-		SummarizeObject* so;
-		if (containedBy(&so)) {
-			if (get("score"))
-				so->includeInScore(get("tally"));
+		Atom* a = get("parent");
+		if (a == null || typeid(*a) != typeid(MapObject)) {
+			printf("Rails object must appear in the contents of a map\n");
+			return false;
 		}
+		_map = (MapObject*)a;
+		a = get("sources");
+		if (a)
+			_sources = a->toString().toInt();
+		a = get("cuts");
+		if (a)
+			_cuts = a->toString().toInt();
+		a = get("seed");
+		if (a)
+			_seed = a->toString().toInt();
 		return true;
 	}
 
 	virtual bool run() {
-		Atom* a = get("combatant");
-		if (a == null)
+		HexMap* map = _map->map();
+		bool saved = global::railNetworkPaths;
+		global::railNetworkPaths = true;
+		bool result = check(map);
+		global::railNetworkPaths = saved;
+		return result;
+	}
+
+private:
+	RailsObject() {
+		_sources = 10;
+		_cuts = 20;
+		_seed = 1;
+	}
+
+	bool check(HexMap* map) {
+		int step = int(24 * global::kmPerHex / 30);
+		RailTour t(map, step);
+		vector<xpoint> rails;
+		xpoint hx;
+		for (hx.y = map->subsetOrigin().y; hx.y < map->subsetOpposite().y; hx.y++)
+			for (hx.x = map->subsetOrigin().x; hx.x < map->subsetOpposite().x; hx.x++)
+				for (HexDirection dir = 0; dir < 6; dir++)
+					if (t.open(hx, dir)) {
+						rails.push_back(hx);
+						break;
+					}
+		if (rails.size() == 0) {
+			printf("The map has no open rails\n");
 			return false;
-		string combatant = a->toString();
-		SummarizeObject* so;
-		if (containedBy(&so)) {
+		}
+		RailNetwork* net = map->railNetwork();
+		printf("%d rail hexes, %d nodes, %d tracks\n", rails.size(), net->nodes(), net->tracks());
+		random::Random r(_seed);
+		if (!compare(map, net, &t, rails, &r, step, "as loaded"))
+			return false;
+
+		vector<xpoint> cutHexes;
+		vector<HexDirection> cutDirs;
+		for (int i = 0; i < _cuts; i++) {
+			xpoint a = rails[int(r.uniform() * rails.size())];
+			for (HexDirection dir = 0; dir < 6; dir++)
+				if (t.open(a, dir) && (map->getTransportEdge(a, dir) & TF_TORN_RAIL) == 0) {
+					map->setTransportEdge(a, dir, TF_TORN_RAIL);
+					cutHexes.push_back(a);
+					cutDirs.push_back(dir);
+					break;
+				}
+		}
+		printf("%d rail edges torn up\n", cutHexes.size());
+		bool result = compare(map, net, &t, rails, &r, step, "torn");
+		for (int i = 0; i < cutHexes.size(); i++)
+			map->clearTransportEdge(cutHexes[i], cutDirs[i], TF_TORN_RAIL);
+		if (result)
+			result = compare(map, net, &t, rails, &r, step, "mended");
+		return result;
+	}
+
+	bool compare(HexMap* map, RailNetwork* net, RailTour* t, const vector<xpoint>& rails, random::Random* r, int step, const char* state) {
+		int routes = 0;
+		for (int i = 0; i < _sources; i++) {
+			xpoint A = rails[int(r->uniform() * rails.size())];
+			t->tour(A);
+			for (int j = 0; j < rails.size(); j++) {
+				xpoint B = rails[j];
+				int expected = t->distance[B.y * map->getColumns() + B.x];
+				vector<xpoint> hexes;
+				int c = net->route(A, B, step, &hexes, null);
+				if (c > MAXIMUM_PATH_LENGTH && expected > MAXIMUM_PATH_LENGTH)
+					continue;
+				if (c != expected) {
+					printf("%s: [%d:%d]->[%d:%d] route costs %d, the hex search %d\n", state, A.x, A.y, B.x, B.y, c, expected);
+					return false;
+				}
+				if (!follow(map, t, hexes, A, B, step, c, state))
+					return false;
+				routes++;
+			}
+		}
+		printf("%s: %d routes agree\n", state, routes);
+		return true;
+	}
+	/*
+	 *	follow
+	 *
+	 *	Checks that hexes is a chain of open rail edges from A to B that
+	 *	costs cost.
+	 */
+	static bool follow(HexMap* map, RailTour* t, const vector<xpoint>& hexes, xpoint A, xpoint B, int step, int cost, const char* state) {
+		if (hexes.size() == 0 || hexes[0] != A || hexes[hexes.size() - 1] != B) {
+			printf("%s: [%d:%d]->[%d:%d] route does not run from A to B\n", state, A.x, A.y, B.x, B.y);
+			return false;
+		}
+		int total = 0;
+		for (int i = 1; i < hexes.size(); i++) {
+			HexDirection dir;
+			for (dir = 0; dir < 6; dir++)
+				if (neighbor(hexes[i - 1], dir) == hexes[i])
+					break;
+			if (dir == 6 || !t->open(hexes[i - 1], dir)) {
+				printf("%s: [%d:%d]->[%d:%d] route leaves the rails at [%d:%d]\n", state, A.x, A.y, B.x, B.y, hexes[i - 1].x, hexes[i - 1].y);
+				return false;
+			}
+			total += step + map->edgeCost(hexes[i - 1], dir, UC_RAIL, MM_RAIL, true);
+		}
+		if (total != cost) {
+			printf("%s: [%d:%d]->[%d:%d] route hexes cost %d, route says %d\n", state, A.x, A.y, B.x, B.y, total, cost);
+			return false;
+		}
+		return true;
+	}
+
+	MapObject*		_map;
+	int				_sources;
+	int				_cuts;
+	unsigned		_seed;
+};
+
+class MeetObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new MeetObject();
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		Atom* a = get("parent");
+		if (a == null || typeid(*a) != typeid(MapObject)) {
+			printf("Meet object must appear in the contents of a map\n");
+			return false;
+		}
+		_map = (MapObject*)a;
+		a = get("pairs");
+		if (a)
+			_pairs = a->toString().toInt();
+		a = get("stop");
+		if (a)
+			_stopCell = a->toString().toInt();
+		a = get("seed");
+		if (a)
+			_seed = a->toString().toInt();
+		return true;
+	}
+
+	virtual bool run() {
+		HexMap* map = _map->map();
+		random::Random r(_seed);
+		TerrainPath terrain;
+		BlockedPath blocked(_stopCell);
+		int saved = global::bidirectionalPathDistance;
+		bool result = true;
+		int found = 0;
+		for (int i = 0; i < _pairs && result; i++) {
+			xpoint A = randomHex(map, &r);
+			xpoint B = randomHex(map, &r);
+			if (!compare(map, &terrain, A, B) ||
+				!compare(map, &blocked, A, B))
+				result = false;
+			if (terrain.foundIt)
+				found++;
+		}
+		global::bidirectionalPathDistance = saved;
+		printf("%d of %d pairs connected\n", found, _pairs);
+		return result;
+	}
+
+private:
+	MeetObject() {
+		_pairs = 200;
+		_stopCell = 0;
+		_seed = 1;
+	}
+
+	static xpoint randomHex(HexMap* map, random::Random* r) {
+		xpoint o = map->subsetOrigin();
+		xpoint x = map->subsetOpposite();
+		xpoint hx;
+		hx.x = o.x + int(r->uniform() * (x.x - o.x));
+		hx.y = o.y + int(r->uniform() * (x.y - o.y));
+		return hx;
+	}
+	/*
+	 *	compare
+	 *
+	 *	Routes from A to B both ways and checks that the answers agree.
+	 *	Leaves foundIt as the last search set it.
+	 */
+	bool compare(HexMap* map, TerrainPath* p, xpoint A, xpoint B) {
+		global::bidirectionalPathDistance = 0;
+		Segment* one = p->route(map, A, B);
+		bool foundOne = p->foundIt;
+		global::bidirectionalPathDistance = 1;
+		Segment* both = p->route(map, A, B);
+		bool result = true;
+		int costOne;
+		int costBoth;
+		if (foundOne != p->foundIt) {
+			printf("[%d:%d]->[%d:%d] found by %s search only\n", A.x, A.y, B.x, B.y, foundOne ? "the one ended" : "the two ended");
+			result = false;
+		} else if (foundOne &&
+				   (!walk(p, one, A, B, &costOne) || !walk(p, both, A, B, &costBoth)))
+			result = false;
+		else if (foundOne && costOne != costBoth) {
+			printf("[%d:%d]->[%d:%d] costs %d one ended, %d two ended\n", A.x, A.y, B.x, B.y, costOne, costBoth);
+			result = false;
+		}
+		delete one;
+		delete both;
+		return result;
+	}
+	/*
+	 *	walk
+	 *
+	 *	Checks that path steps from hex to neighboring hex from A to B
+	 *	and never goes on from a hex p calls blocked.  Sets *cost
+	 *	to the cost of the path.
+	 */
+	static bool walk(TerrainPath* p, Segment* path, xpoint A, xpoint B, int* cost) {
+		xpoint at = A;
+		*cost = 0;
+		for (Segment* s = path; s != null; s = s->next) {
+			if (s->hex != at || hexDistance(s->hex, s->nextp) != 1) {
+				printf("[%d:%d]->[%d:%d] path breaks at [%d:%d]\n", A.x, A.y, B.x, B.y, at.x, at.y);
+				return false;
+			}
+			if (s->hex != A && p->blocked(s->hex)) {
+				printf("[%d:%d]->[%d:%d] path goes on from blocked hex [%d:%d]\n", A.x, A.y, B.x, B.y, at.x, at.y);
+				return false;
+			}
+			*cost += int(s->cost);
+			at = s->nextp;
+		}
+		if (at != B) {
+			printf("[%d:%d]->[%d:%d] path ends at [%d:%d]\n", A.x, A.y, B.x, B.y, at.x, at.y);
+			return false;
+		}
+		return true;
+	}
+
+	MapObject*		_map;
+	int				_pairs;
+	int				_stopCell;
+	unsigned		_seed;
+};
+
+class VisitedObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new VisitedObject();
+	}
+
+private:
+	VisitedObject() {}
+
+	virtual bool validate(script::Parser* parser) {
+		Atom* a = get("remaining");
+		if (a) {
+			_remaining = a->toString().toInt();
+			return true;
+		}
+		_remaining = -1;	
+		a = get("x");
+		if (a == null) {
+			printf("Missing x property\n");
+			return false;
+		}
+		_hex.x = a->toString().toInt();
+		a = get("y");
+		if (a == null) {
+			printf("Missing y property\n");
+			return false;
+		}
+		_hex.y = a->toString().toInt();
+		a = get("gval");
+		if (a == null) {
+			printf("Missing stop property\n");
+			return false;
+		}
+		_gval = a->toString().toInt();
+		return true;
+	}
+
+	virtual bool run() {
+		PathObject* po;
+		if (containedBy(&po)) {
+			FillPath* fillPath = po->fillPath();
+
+			if (_remaining >= 0) {
+				int total = 0;
+				for (int i = 0; i < fillPath->visited.size(); i++) {
+					if (fillPath->visited[i].hex.x != -1)
+						total++;
+				}
+				if (total != _remaining) {
+					printf("Expected %d remaining cells in search, found %d\n", _remaining, total);
+					return false;
+				}
+				return runAnyContent();
+			}
+			for (int i = 0; i < fillPath->visited.size(); i++) {
+				if (fillPath->visited[i].hex == _hex &&
+					fillPath->visited[i].gval == _gval) {
+					if (!runAnyContent())
+						return false;
+					fillPath->visited[i].hex.x = -1;
+					return true;
+				}
+			}
+			printf("hex [%d:%d] expected gval= %d not found\n", _hex.x, _hex.y, _gval);
+			return false;
+		} else {
+			printf("Not contained in a path object\n");
+			return false;
+		}
+	}
+
+private:
+	int					_remaining;
+	xpoint				_hex;
+	int					_gval;
+};
+
+class ReportObject : script::Object {
+public:
+	static script::Object* factory() {
+		return new ReportObject();
+	}
+
+	ReportObject() {}
+
+	virtual bool isRunnable() const { return true; }
+
+	virtual bool validate(script::Parser* parser) {
+		SummarizeObject* so;
+		if (containedBy(&so)) {
+			if (get("score"))
+				so->includeInScore(get("tally"));
+		}
+		return true;
+	}
+
+	virtual bool run() {
+		Atom* a = get("combatant");
+		if (a == null)
+			return false;
+		string combatant = a->toString();
+		SummarizeObject* so;
+		if (containedBy(&so)) {
 			if (so->gameHillClimb() != null) {
 				return true;
 //				Tally* t = getTally(so);
@@ -2205,6 +3123,641 @@ private:
 	FortObject() {}
 };
 
+/*
+ *	QueueTestEvent
+ *
+ *	An event that does nothing when it happens but note that it did.
+ *	order counts the posts, so events due at the same minute must
+ *	happen in increasing order.
+ */
+class QueueTestEvent : public GameEvent {
+	typedef GameEvent super;
+public:
+	QueueTestEvent(minutes time, vector<QueueTestEvent*>* executed) : super(time) {
+		_executed = executed;
+		order = 0;
+	}
+
+	virtual string name() {
+		return "QueueTest";
+	}
+
+	virtual string toString() {
+		return string() + order;
+	}
+
+	virtual void execute() {
+		_executed->push_back(this);
+	}
+
+	int		order;
+
+private:
+	vector<QueueTestEvent*>*	_executed;
+};
+/*
+ *	EventQueueObject
+ *
+ *	Posts a batch of events at random minutes, many of them at the
+ *	same minute, reschedules some and unschedules others, then runs
+ *	the queue.  The events must happen in time order, and those due
+ *	at the same minute in the order they were last posted.
+ */
+class EventQueueObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new EventQueueObject();
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		Atom* a = get("events");
+		if (a)
+			_events = a->toString().toInt();
+		a = get("seed");
+		if (a)
+			_seed = a->toString().toInt();
+		return true;
+	}
+
+	virtual bool run() {
+		GameObject* go;
+		if (!containedBy(&go)) {
+			printf("Not contained by a game object.\n");
+			return false;
+		}
+		Game* game = go->game();
+		game->purgeAllEvents();
+		random::Random r(_seed);
+		vector<QueueTestEvent*> posted;
+		vector<QueueTestEvent*> executed;
+		minutes base = game->time() + 1;
+		int posts = 0;
+		for (int i = 0; i < _events; i++) {
+			QueueTestEvent* e = new QueueTestEvent(base + minutes(r.uniform() * 100), &executed);
+			e->order = posts++;
+			game->post(e);
+			posted.push_back(e);
+		}
+		int expected = _events;
+		for (int i = 0; i < _events; i++) {
+			QueueTestEvent* e = posted[i];
+			if (i % 11 == 0) {
+				game->unschedule(e);
+				expected--;
+			} else if (i % 7 == 0) {
+				e->order = posts++;
+				game->reschedule(e, base + minutes(r.uniform() * 100));
+			}
+		}
+		game->processEvents(base + 100);
+		bool result = true;
+		if (executed.size() != expected) {
+			printf("%d events happened, expected %d\n", executed.size(), expected);
+			result = false;
+		}
+		for (int i = 1; i < executed.size() && result; i++) {
+			QueueTestEvent* a = executed[i - 1];
+			QueueTestEvent* b = executed[i];
+			if (a->time() > b->time() ||
+				(a->time() == b->time() && a->order > b->order)) {
+				printf("Event %d at %u happened before event %d at %u\n", a->order, a->time(), b->order, b->time());
+				result = false;
+			}
+		}
+		for (int i = 0; i < posted.size(); i++)
+			game->unschedule(posted[i]);
+		posted.deleteAll();
+		return result;
+	}
+
+private:
+	EventQueueObject() {
+		_events = 10000;
+		_seed = 1;
+	}
+
+	int			_events;
+	unsigned	_seed;
+};
+
+/*
+ *	SnapshotObject
+ *
+ *	Autosaves the enclosing game with deltas turned on, plays a day so
+ *	the next autosave is a delta against the first, and writes a full
+ *	snapshot of the same moment beside it.  Both must load back to the
+ *	same game, at the game's time, and the delta must be the smaller
+ *	file.  Snapshots leave out the event log, so the two loaded games
+ *	are compared with each other rather than with the game itself.
+ */
+class SnapshotObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new SnapshotObject();
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		Atom* a = get("filename");
+		if (a == null || !a->toString().endsWith(".hsb"))
+			return false;
+		_path = fileSystem::pathRelativeTo(a->toString(), parser->filename());
+		return true;
+	}
+
+	virtual bool run() {
+		GameObject* go;
+		if (!containedBy(&go)) {
+			printf("Not enclosed by a game object.\n");
+			return false;
+		}
+		Game* game = go->game();
+		string fullPath = _path.substr(0, _path.size() - 4) + ".full.hsb";
+		string savedFile = global::autosaveFile;
+		bool savedDeltas = global::autosaveDeltas;
+		global::autosaveFile = _path;
+		global::autosaveDeltas = true;
+		bool result = game->autosave();
+		game->advanceClock();
+		global::autosaveFile = savedFile;
+		global::autosaveDeltas = savedDeltas;
+		if (!result || !game->save(fullPath)) {
+			printf("Could not write the snapshots.\n");
+			return false;
+		}
+		Game* delta = loadGame(_path);
+		Game* full = loadGame(fullPath);
+		if (delta == null || full == null) {
+			printf("Could not load the snapshots back.\n");
+			result = false;
+		} else if (delta->time() != game->time()) {
+			printf("Delta snapshot is at %u, the game at %u\n", delta->time(), game->time());
+			result = false;
+		} else if (!delta->equals(full)) {
+			printf("Delta and full snapshots load different games.\n");
+			result = false;
+		}
+		delete delta;
+		delete full;
+		MappedFile d;
+		MappedFile f;
+		if (!result)
+			return false;
+		if (!d.open(_path) || !f.open(fullPath)) {
+			printf("Could not reopen the snapshots.\n");
+			return false;
+		}
+		printf("Delta is %d bytes, full snapshot %d bytes\n", d.size(), f.size());
+		if (d.size() >= f.size()) {
+			printf("Delta snapshot is no smaller than a full one.\n");
+			return false;
+		}
+		return true;
+	}
+
+private:
+	string _path;
+};
+
+/*
+ *	HistoryObject
+ *
+ *	Fills a history with no journal past its limit, which must keep
+ *	every event, then two histories sharing one journal, taking turns,
+ *	which must each keep only their limit in memory and read back all
+ *	of their own events, in order, and none of the other's.
+ */
+class HistoryObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new HistoryObject();
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		Atom* a = get("filename");
+		if (a == null)
+			return false;
+		_path = fileSystem::pathRelativeTo(a->toString(), parser->filename());
+		a = get("events");
+		if (a)
+			_events = a->toString().toInt();
+		a = get("limit");
+		if (a)
+			_limit = a->toString().toInt();
+		return true;
+	}
+
+	virtual bool run() {
+		bool result = true;
+		EventHistory whole(_limit);
+		for (int i = 0; i < _events; i++)
+			whole.remember(new QueueTestEvent(i, null));
+		if (whole.size() != _events || whole.discarded() != 0) {
+			printf("History with no journal kept %d of %d events\n", whole.size(), _events);
+			result = false;
+		}
+		if (!check(whole, 0, 0))
+			result = false;
+
+		remove(_path.c_str());
+		EventHistory a(_limit);
+		EventHistory b(_limit);
+		if (!a.openJournal(_path) || !b.openJournal(_path)) {
+			printf("Could not open journal '%s'\n", _path.c_str());
+			return false;
+		}
+		for (int i = 0; i < _events; i++) {
+			a.remember(new QueueTestEvent(i, null));
+			b.remember(new QueueTestEvent(JOURNAL_OFFSET + i, null));
+		}
+		int spilled = _events > _limit ? _events - _limit : 0;
+		if (a.size() != _limit || a.spilled() != spilled ||
+			b.size() != _limit || b.spilled() != spilled) {
+			printf("Journaled histories hold %d and %d events, spilled %d and %d, expected %d and %d\n",
+				   a.size(), b.size(), a.spilled(), b.spilled(), _limit, spilled);
+			result = false;
+		}
+		if (!check(a, 0, spilled) || !check(b, JOURNAL_OFFSET, spilled))
+			result = false;
+		a.clear();
+		b.clear();
+		remove(_path.c_str());
+		return result;
+	}
+
+private:
+	static const int JOURNAL_OFFSET = 1000000;
+
+	HistoryObject() {
+		_events = 10000;
+		_limit = 100;
+	}
+	/*
+	 *	check
+	 *
+	 *	The events of h must have times first, first + 1, and so on,
+	 *	_events of them, the first spilled of which came from the
+	 *	journal.
+	 */
+	bool check(const EventHistory& h, int first, int spilled) {
+		int n = 0;
+		for (EventHistory::iterator i = h.begin(); i.valid(); i.next(), n++) {
+			if (i->time != minutes(first + n) || i->kind != "QueueTest") {
+				printf("History entry %d is %s at %u, expected QueueTest at %d\n", n, i->kind.c_str(), i->time, first + n);
+				return false;
+			}
+			if ((i->event == null) != (n < spilled)) {
+				printf("History entry %d %s in memory\n", n, i->event == null ? "is not" : "is");
+				return false;
+			}
+		}
+		if (n != _events) {
+			printf("History holds %d events, expected %d\n", n, _events);
+			return false;
+		}
+		return true;
+	}
+
+	string	_path;
+	int		_events;
+	int		_limit;
+};
+
+static ObjectPool testPool("test");
+/*
+ *	PoolTask
+ *
+ *	Each item takes a run of blocks of assorted sizes from testPool,
+ *	fills each with its own item number, checks that nothing else
+ *	wrote over them and gives them back.
+ */
+class PoolTask : public ParallelTask {
+public:
+	PoolTask() {
+		failed = false;
+	}
+
+	virtual void run(int item, int worker) {
+		const int BLOCKS = 100;
+		char* block[BLOCKS];
+		int size[BLOCKS];
+		for (int i = 0; i < BLOCKS; i++) {
+			size[i] = 1 + (item * 7 + i * 13) % POOL_LARGEST;
+			block[i] = (char*)testPool.allocate(size[i]);
+			memset(block[i], item & 0xff, size[i]);
+		}
+		for (int i = 0; i < BLOCKS; i++) {
+			for (int j = 0; j < size[i]; j++)
+				if (block[i][j] != char(item & 0xff))
+					failed = true;
+			testPool.release(block[i], size[i]);
+		}
+	}
+
+	volatile bool	failed;
+};
+/*
+ *	PoolObject
+ *
+ *	Exercises an ObjectPool of its own.  Every block must be aligned
+ *	and distinct from every other, released blocks must be handed out
+ *	again, blocks too large for the pool must come from the heap, and
+ *	worker threads allocating and releasing at the same time must never
+ *	be given the same block.
+ */
+class PoolObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new PoolObject();
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		Atom* a = get("blocks");
+		if (a)
+			_blocks = a->toString().toInt();
+		a = get("threads");
+		if (a)
+			_threads = a->toString().toInt();
+		return true;
+	}
+
+	virtual bool run() {
+		int live = testPool.live;
+		vector<char*> blocks;
+		if (!fill(&blocks))
+			return false;
+		for (int i = 0; i < blocks.size(); i++)
+			testPool.release(blocks[i], size(i));
+		if (testPool.live != live) {
+			printf("%d blocks still live after all were released\n", testPool.live - live);
+			return false;
+		}
+
+			// The same sizes again should all come off the free lists.
+
+		__int64 reuses = testPool.reuses;
+		blocks.clear();
+		if (!fill(&blocks))
+			return false;
+		if (testPool.reuses - reuses != _blocks) {
+			printf("Only %d of %d blocks were reused\n", int(testPool.reuses - reuses), _blocks);
+			return false;
+		}
+		for (int i = 0; i < blocks.size(); i++)
+			testPool.release(blocks[i], size(i));
+
+		__int64 large = testPool.large;
+		void* p = testPool.allocate(POOL_LARGEST + 1);
+		memset(p, 0, POOL_LARGEST + 1);
+		testPool.release(p, POOL_LARGEST + 1);
+		if (testPool.large != large + 1) {
+			printf("A block of %d bytes did not go to the heap\n", POOL_LARGEST + 1);
+			return false;
+		}
+
+			// An open log makes runParallel keep to one thread.
+
+		bool wasLogging = engine::logging();
+		engine::closeLog();
+		int oldThreads = global::workerThreads;
+		global::workerThreads = _threads;
+		PoolTask task;
+		runParallel(&task, _threads * 16);
+		global::workerThreads = oldThreads;
+		if (wasLogging)
+			engine::logToConsole();
+		if (task.failed) {
+			printf("Two threads were given the same block\n");
+			return false;
+		}
+		if (testPool.live != live) {
+			printf("%d blocks still live after the threads finished\n", testPool.live - live);
+			return false;
+		}
+		return true;
+	}
+
+private:
+	PoolObject() {
+		_blocks = 1000;
+		_threads = 4;
+	}
+
+	int size(int i) const {
+		return 1 + i % POOL_LARGEST;
+	}
+	/*
+	 *	Allocates _blocks blocks of all the sizes the pool serves, fills
+	 *	each with a pattern and checks that no block overwrote another.
+	 */
+	bool fill(vector<char*>* blocks) {
+		for (int i = 0; i < _blocks; i++) {
+			char* p = (char*)testPool.allocate(size(i));
+			if (size_t(p) % POOL_GRAIN != 0) {
+				printf("Block of %d bytes is not aligned\n", size(i));
+				return false;
+			}
+			memset(p, i & 0xff, size(i));
+			blocks->push_back(p);
+		}
+		for (int i = 0; i < _blocks; i++)
+			for (int j = 0; j < size(i); j++)
+				if ((*blocks)[i][j] != char(i & 0xff)) {
+					printf("Block %d of %d bytes was overwritten\n", i, size(i));
+					return false;
+				}
+		return true;
+	}
+
+	int		_blocks;
+	int		_threads;
+};
+/*
+ *	InfluenceObject
+ *
+ *	Floods AI influence from each detachment in a hex twice, with one
+ *	InfluencePath built over zeroed memory and one built over memory
+ *	full of ones, and checks that both reach the same hexes at the same
+ *	distances.  A path object that left any of its settings to whatever
+ *	memory it was given would fail this.
+ */
+class InfluenceObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new InfluenceObject();
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		Atom* x = get("x");
+		Atom* y = get("y");
+		if (x == null || y == null) {
+			printf("Need x: and y: properties\n");
+			return false;
+		}
+		_hex.x = x->toString().toInt();
+		_hex.y = y->toString().toInt();
+		Atom* a = get("distance");
+		if (a)
+			_distance = a->toString().toInt();
+		return true;
+	}
+
+	virtual bool run() {
+		GameObject* go;
+		if (!containedBy(&go)) {
+			printf("Not contained by a game object.\n");
+			return false;
+		}
+		Game* game = go->game();
+		Detachment* d = game->map()->getDetachments(_hex);
+		if (d == null) {
+			printf("No detachments at [%d:%d]\n", _hex.x, _hex.y);
+			return false;
+		}
+		Force* f = d->unit->combatant()->force;
+		if (f->actor() == null)
+			f->makeActor();
+		ai::Actor* actor = f->actor();
+		actor->computeThreat();
+		ai::ThreatState ts = actor->getThreat(_hex);
+		for (; d != null; d = d->next) {
+			ai::Influence zeroed(d->unit, _hex);
+			ai::Influence filled(d->unit, _hex);
+			flood(&zeroed, 0, ts, actor);
+			flood(&filled, 0xff, ts, actor);
+			if (zeroed.reached.size() != filled.reached.size()) {
+				printf("Influence of %s reached %d hexes, and %d from a dirty path object\n",
+						d->unit->definition()->effectiveUid(d->unit->parent).c_str(), zeroed.reached.size(), filled.reached.size());
+				return false;
+			}
+			for (int i = 0; i < zeroed.reached.size(); i++)
+				if (zeroed.reached[i].x != filled.reached[i].x ||
+					zeroed.reached[i].y != filled.reached[i].y ||
+					zeroed.distance[i] != filled.distance[i]) {
+					printf("Influence of %s differs from a dirty path object at [%d:%d]\n",
+							d->unit->definition()->effectiveUid(d->unit->parent).c_str(), zeroed.reached[i].x, zeroed.reached[i].y);
+					return false;
+				}
+		}
+		return true;
+	}
+
+private:
+	InfluenceObject() {
+		_distance = 72 * 60;
+	}
+
+	void flood(ai::Influence* influence, int fill, ai::ThreatState ts, ai::Actor* actor) {
+		char* memory = new char[sizeof (ai::InfluencePath)];
+		memset(memory, fill, sizeof (ai::InfluencePath));
+		ai::InfluencePath* path = new (memory) ai::InfluencePath;
+		path->fill(influence, _distance, ts, actor);
+		path->~InfluencePath();
+		delete [] memory;
+	}
+
+	xpoint	_hex;
+	int		_distance;
+};
+/*
+ *	ConcurrencyObject
+ *
+ *	Plays the enclosing scenario for some days twice, once with one
+ *	worker thread and once with several, and checks that both games
+ *	end in the same state.  Combats, supply and AI searches all run on
+ *	the workers when they can, but none of that may change the game.
+ *	The log is closed while the games run, since an open log makes
+ *	everything run on one thread.
+ */
+class ConcurrencyObject : public script::Object {
+public:
+	static script::Object* factory() {
+		return new ConcurrencyObject();
+	}
+
+	virtual bool validate(script::Parser* parser) {
+		Atom* a = get("days");
+		if (a)
+			_days = a->toString().toInt();
+		a = get("threads");
+		if (a)
+			_threads = a->toString().toInt();
+		a = get("seed");
+		if (a)
+			_seed = a->toString().toInt();
+		if (_days < 1 || _threads < 2) {
+			printf("Need days: of at least 1 and threads: of at least 2\n");
+			return false;
+		}
+		return true;
+	}
+
+	virtual bool run() {
+		ScenarioObject* so;
+		if (!containedBy(&so)) {
+			printf("Not contained by a scenario object.\n");
+			return false;
+		}
+		bool wasLogging = engine::logging();
+		engine::closeLog();
+		int oldThreads = global::workerThreads;
+		string serial, parallel;
+		bool result = playOut(so->scenario(), 1, &serial) &&
+					  playOut(so->scenario(), _threads, &parallel);
+		global::workerThreads = oldThreads;
+		if (wasLogging)
+			engine::logToConsole();
+		if (!result) {
+			printf("Game failed to start from scenario\n");
+			return false;
+		}
+		if (serial != parallel) {
+			printf("With %d threads the game ended differently:\n", _threads);
+			printf("Serial:\n%s\nParallel:\n%s\n", serial.c_str(), parallel.c_str());
+			return false;
+		}
+		return true;
+	}
+
+private:
+	ConcurrencyObject() {
+		_days = 1;
+		_threads = 4;
+		_seed = 1;
+	}
+
+	bool playOut(const Scenario* scenario, int threads, string* output) {
+		global::workerThreads = threads;
+		Game* game = startGame(scenario, _seed);
+		if (game == null)
+			return false;
+		for (int i = 0; i < _days && !game->over(); i++)
+			game->advanceClock();
+
+		*output = string("events ") + int(game->eventsProcessed()) + " random " + game->random.save() + "\n";
+		char buffer[128];
+		HexMap* map = game->map();
+		xpoint hx;
+		for (hx.x = map->subsetOrigin().x; hx.x < map->subsetOpposite().x; hx.x++)
+			for (hx.y = map->subsetOrigin().y; hx.y < map->subsetOpposite().y; hx.y++) {
+				for (Detachment* d = map->getDetachments(hx); d != null; d = d->next) {
+					sprintf(buffer, "[%d:%d] on hand %d fatigue %.9g\n", hx.x, hx.y, d->unit->totals().onHand, d->fatigue);
+					*output = *output + buffer;
+				}
+				Combat* c = map->combat(hx);
+				if (c != null) {
+					sprintf(buffer, "[%d:%d] combat ratio %.9g\n", hx.x, hx.y, c->ratio());
+					*output = *output + buffer;
+				}
+			}
+		delete game;
+		return true;
+	}
+
+	int			_days;
+	int			_threads;
+	unsigned	_seed;
+};
+
 void initTestObjects() {
 	engine::logToConsole();
 	script::objectFactory("scenario", ScenarioObject::factory);
@@ -2226,6 +3779,16 @@ void initTestObjects() {
 	script::objectFactory("report", ReportObject::factory);
 	script::objectFactory("transfer", TransferObject::factory);
 	script::objectFactory("fort", FortObject::factory);
+	script::objectFactory("concurrency", ConcurrencyObject::factory);
+	script::objectFactory("influence", InfluenceObject::factory);
+	script::objectFactory("pool", PoolObject::factory);
+	script::objectFactory("event_queue", EventQueueObject::factory);
+	script::objectFactory("snapshot", SnapshotObject::factory);
+	script::objectFactory("history", HistoryObject::factory);
+	script::objectFactory("meet", MeetObject::factory);
+	script::objectFactory("landmarks", LandmarksObject::factory);
+	script::objectFactory("clusters", ClustersObject::factory);
+	script::objectFactory("rails", RailsObject::factory);
 }
 
 }  // namespace engine
@@ -0,0 +1,236 @@
+#include "../common/platform.h"
+#include "event_history.h"
+
+#include "../common/file_system.h"
+#include "game_event.h"
+#include "unit.h"
+
+namespace engine {
+
+const int JOURNAL_MAGIC = ('H' << 24) + ('J' << 16) + ('N' << 8) + '1';
+const int JOURNAL_VERSION = 2;
+const int JOURNAL_NAME_MAX = 255;			// Longer names are cut short
+/*
+ *	JournalHeader
+ *
+ *	A journal starts with this header, followed by records, each a
+ *	JournalRecord and then the kind and unit names it gives the
+ *	lengths of.  Each history that opens the journal first appends
+ *	an opening record with no names, and the offset of that record
+ *	is the session of it and of every record the history spills
+ *	after it, in the order the events happened.
+ */
+struct JournalHeader {
+	int				magic;
+	int				version;
+};
+
+struct JournalRecord {
+	long			session;
+	minutes			time;
+	unsigned short	kindLength;
+	unsigned short	unitLength;
+};
+
+EventHistory::EventHistory(int limit) {
+	_capacity = limit;
+	_limit = limit;
+	_ring = new GameEvent*[limit];
+	_first = 0;
+	_count = 0;
+	_journal = null;
+	_session = -1;
+	_spilled = 0;
+	_discarded = 0;
+}
+
+EventHistory::~EventHistory() {
+	clear();
+	delete [] _ring;
+}
+
+void EventHistory::remember(GameEvent* e) {
+	while (_journal != null && _count >= _limit)
+		spill();
+	if (_count == _capacity)
+		grow();
+	e->_next = newest();
+	_ring[(_first + _count) % _capacity] = e;
+	_count++;
+}
+
+void EventHistory::adopt(GameEvent* newest) {
+	if (newest == null)
+		return;
+	int n = 0;
+	for (GameEvent* e = newest; e != null; e = e->_next)
+		n++;
+	GameEvent** list = new GameEvent*[n];
+	int i = n;
+	for (GameEvent* e = newest; e != null; e = e->_next)
+		list[--i] = e;
+	for (i = 0; i < n; i++)
+		remember(list[i]);
+	delete [] list;
+}
+
+void EventHistory::clear() {
+	for (int i = 0; i < _count; i++)
+		delete _ring[(_first + i) % _capacity];
+	_first = 0;
+	_count = 0;
+	closeJournal();
+}
+
+bool EventHistory::openJournal(const string& filename) {
+	closeJournal();
+	_journal = fopen(filename.c_str(), "a+b");
+	if (_journal == null)
+		return false;
+	JournalHeader h;
+	fseek(_journal, 0, SEEK_END);
+	bool good;
+	if (ftell(_journal) == 0) {
+		h.magic = JOURNAL_MAGIC;
+		h.version = JOURNAL_VERSION;
+		good = fwrite(&h, sizeof h, 1, _journal) == 1;
+	} else {
+		fseek(_journal, 0, SEEK_SET);
+		good = fread(&h, sizeof h, 1, _journal) == 1 &&
+			   h.magic == JOURNAL_MAGIC &&
+			   h.version == JOURNAL_VERSION;
+	}
+	JournalRecord r;
+	if (good && fseek(_journal, 0, SEEK_END) == 0) {
+		r.session = ftell(_journal);
+		r.time = 0;
+		r.kindLength = 0;
+		r.unitLength = 0;
+		if (fwrite(&r, sizeof r, 1, _journal) == 1 &&
+			fflush(_journal) == 0) {
+			_session = r.session;
+			return true;
+		}
+	}
+	closeJournal();
+	return false;
+}
+
+void EventHistory::closeJournal() {
+	if (_journal != null) {
+		fclose(_journal);
+		_journal = null;
+	}
+}
+
+EventHistory::iterator EventHistory::begin() const {
+	return iterator(this);
+}
+
+GameEvent* EventHistory::newest() const {
+	if (_count == 0)
+		return null;
+	return _ring[(_first + _count - 1) % _capacity];
+}
+
+void EventHistory::grow() {
+	GameEvent** ring = new GameEvent*[2 * _capacity];
+	for (int i = 0; i < _count; i++)
+		ring[i] = _ring[(_first + i) % _capacity];
+	delete [] _ring;
+	_ring = ring;
+	_capacity *= 2;
+	_first = 0;
+}
+
+void EventHistory::spill() {
+	GameEvent* e = _ring[_first];
+	_first = (_first + 1) % _capacity;
+	_count--;
+	if (_count > 0)
+		_ring[_first]->_next = null;
+	if (_journal != null) {
+		string kind = e->name();
+		string unit;
+		if (e->subject() != null)
+			unit = e->subject()->name();
+		JournalRecord r;
+		r.session = _session;
+		r.time = e->time();
+		r.kindLength = (unsigned short)(kind.size() < JOURNAL_NAME_MAX ? kind.size() : JOURNAL_NAME_MAX);
+		r.unitLength = (unsigned short)(unit.size() < JOURNAL_NAME_MAX ? unit.size() : JOURNAL_NAME_MAX);
+
+			// The stream is shared with iterators, which seek about
+			// in it, so go back to the end first.
+
+		if (fseek(_journal, 0, SEEK_END) == 0 &&
+			fwrite(&r, sizeof r, 1, _journal) == 1 &&
+			fwrite(kind.c_str(), 1, r.kindLength, _journal) == r.kindLength &&
+			fwrite(unit.c_str(), 1, r.unitLength, _journal) == r.unitLength)
+			_spilled++;
+		else {
+			warningMessage("Write error on event journal");
+			closeJournal();
+			_discarded++;
+		}
+	} else
+		_discarded++;
+	delete e;
+}
+
+EventHistory::iterator::iterator(const EventHistory* history) {
+	_history = history;
+	_offset = history->_journal != null ? history->_session + sizeof (JournalRecord) : -1;
+	_index = 0;
+	_valid = true;
+	next();
+}
+
+void EventHistory::iterator::next() {
+	if (_offset >= 0) {
+		if (readJournal())
+			return;
+		_offset = -1;
+	}
+	if (_index < _history->_count) {
+		GameEvent* e = _history->_ring[(_history->_first + _index) % _history->_capacity];
+		_index++;
+		_entry.time = e->time();
+		_entry.kind = e->name();
+		if (e->subject() != null)
+			_entry.unit = e->subject()->name();
+		else
+			_entry.unit = "";
+		_entry.event = e;
+	} else
+		_valid = false;
+}
+
+bool EventHistory::iterator::readJournal() {
+	FILE* fp = _history->_journal;
+	if (fp == null)
+		return false;
+	fflush(fp);
+	JournalRecord r;
+	char buffer[2 * JOURNAL_NAME_MAX];
+
+		// Records of other histories sharing the journal are skipped.
+
+	do {
+		if (fseek(fp, _offset, SEEK_SET) != 0 ||
+			fread(&r, sizeof r, 1, fp) != 1)
+			return false;
+		if (r.kindLength > JOURNAL_NAME_MAX ||
+			r.unitLength > JOURNAL_NAME_MAX ||
+			fread(buffer, 1, r.kindLength + r.unitLength, fp) != r.kindLength + r.unitLength)
+			return false;
+		_offset += sizeof r + r.kindLength + r.unitLength;
+	} while (r.session != _history->_session);
+	_entry.time = r.time;
+	_entry.kind = string(buffer, r.kindLength);
+	_entry.unit = string(buffer + r.kindLength, r.unitLength);
+	_entry.event = null;
+	return true;
+}
+
+}  // namespace engine
@@ -0,0 +1,136 @@
+#pragma once
+#include <stdio.h>
+#include "../common/string.h"
+#include "basic_types.h"
+
+namespace engine {
+
+class GameEvent;
+
+const int HISTORY_CAPACITY = 4096;			// Events an EventHistory keeps in memory while journaling
+/*
+ *	HistoryEntry
+ *
+ *	One event of a game's history, as an EventHistory iterator
+ *	presents it.  Entries read back from the journal have only the
+ *	time, the name of the kind of event and the name of the unit it
+ *	happened to; entries still in memory also have the event itself.
+ */
+class HistoryEntry {
+public:
+	minutes			time;
+	string			kind;				// The event's name()
+	string			unit;				// Name of the event's subject, or empty
+	GameEvent*		event;				// null if the event was spilled
+};
+/*
+ *	EventHistory
+ *
+ *	The events that have happened in a game, kept so that past
+ *	situations can be reconstructed.  The events are kept in memory,
+ *	in a ring that grows as needed, so with no journal open the whole
+ *	history is kept (and saved with the game).
+ *
+ *	While a journal is open, only the most recent events (up to the
+ *	limit) stay in memory.  Beyond that, the oldest event is spilled:
+ *	a compact record of it is appended to the journal and the event
+ *	is deleted, so memory use stays the same however long the game
+ *	runs.  A game saved then holds only the events still in memory.
+ *
+ *	Any number of histories may share a journal file, in one process
+ *	or in several run one after another.  Each tags its records with
+ *	an id of its own and reads back only those.
+ *
+ *	The events in memory are also linked, newest first, through
+ *	their next pointers, the form in which a game stores and
+ *	compares its event log.
+ */
+class EventHistory {
+public:
+	class iterator {
+		friend EventHistory;
+	public:
+		bool valid() const { return _valid; }
+
+		void next();
+
+		const HistoryEntry& operator* () const { return _entry; }
+
+		const HistoryEntry* operator-> () const { return &_entry; }
+
+	private:
+		iterator(const EventHistory* history);
+
+		bool readJournal();
+
+		const EventHistory*	_history;
+		long				_offset;		// Next journal record, or -1 when the journal is done
+		int					_index;			// Next event in memory, counting from the oldest
+		bool				_valid;
+		HistoryEntry		_entry;
+	};
+
+	EventHistory(int limit);
+
+	~EventHistory();
+
+	void remember(GameEvent* e);
+	/*
+	 *	adopt
+	 *
+	 *	Remembers each event of a list linked newest first, as it
+	 *	was stored, oldest first.
+	 */
+	void adopt(GameEvent* newest);
+	/*
+	 *	clear
+	 *
+	 *	Deletes the events in memory and closes the journal.
+	 */
+	void clear();
+	/*
+	 *	openJournal
+	 *
+	 *	Spilled events are appended to the file from now on, under a
+	 *	new id, so a history reopening a journal does not see the
+	 *	records it wrote before.  A new journal is created if the file
+	 *	does not exist.  Returns false if the file cannot be opened or
+	 *	is not a journal.
+	 */
+	bool openJournal(const string& filename);
+
+	void closeJournal();
+	/*
+	 *	begin
+	 *
+	 *	Iterates the whole history, oldest first: the journal, then
+	 *	the events still in memory.  The history must not change
+	 *	while an iterator is in use.
+	 */
+	iterator begin() const;
+
+	GameEvent* newest() const;
+
+	int size() const { return _count; }
+
+	int spilled() const { return _spilled; }
+
+	int discarded() const { return _discarded; }
+
+private:
+	void spill();
+
+	void grow();
+
+	GameEvent**		_ring;
+	int				_capacity;			// Size of _ring
+	int				_limit;				// Events kept in memory while journaling
+	int				_first;				// Index in _ring of the oldest event
+	int				_count;
+	FILE*			_journal;
+	long			_session;			// Journal offset of this history's opening record, its id
+	int				_spilled;			// Events written to the journal
+	int				_discarded;			// Events spilled with no journal open
+};
+
+}  // namespace engine
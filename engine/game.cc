@@ -2,13 +2,9 @@
 #include "game.h"
 
 #include <typeinfo.h>
-#include <time.h>
 #include "../ai/ai.h"
-#include "../common/locale.h"
-#include "../display/window.h"
 #include "../test/test.h"
 #include "../ui/map_ui.h"
-#include "../ui/ui.h"
 #include "combat.h"
 #include "detachment.h"
 #include "doctrine.h"
@@ -19,6 +15,7 @@
 #include "global.h"
 #include "order.h"
 #include "scenario.h"
+#include "snapshot.h"
 #include "theater.h"
 #include "unit.h"
 #include "unitdef.h"
@@ -35,6 +32,8 @@ Game* startGame(const Scenario* scenario, unsigned seed) {
 }
 
 Game* loadGame(const string& filename) {
+	if (filename.endsWith(".hsb"))
+		return loadSnapshot(filename);
 	Game* game;
 	fileSystem::Storage s(filename, &global::storageMap);
 	if (!s.load())
@@ -46,26 +45,98 @@ Game* loadGame(const string& filename) {
 		return null;
 }
 
-Game::Game(const Scenario* scenario, unsigned seed) : random(1) {
+void GameParameters::fromGlobals() {
+	atRatio = global::atRatio;
+	artilleryRearAreaFire = global::artilleryRearAreaFire;
+	ammoUseStdDev = global::ammoUseStdDev;
+	ammoUseMaxMult = global::ammoUseMaxMult;
+	ammoUseMinMult = global::ammoUseMinMult;
+	rearAccuracy = global::rearAccuracy;
+	lineAccuracy = global::lineAccuracy;
+	defensiveInfiltrationInvolvement = global::defensiveInfiltrationInvolvement;
+	riverEdgeAdjust = global::riverEdgeAdjust;
+	coastEdgeAdjust = global::coastEdgeAdjust;
+	riverCasualtyMultiplier = global::riverCasualtyMultiplier;
+	coastCasualtyMultiplier = global::coastCasualtyMultiplier;
+	basicATHitProbability = global::basicATHitProbability;
+	atScale = global::atScale;
+	offensiveAPHitProbability = global::offensiveAPHitProbability;
+	defensiveAPHitProbability = global::defensiveAPHitProbability;
+	apScale = global::apScale;
+	basicCombatEndurance = global::basicCombatEndurance;
+	basicCombatEnduranceStdDev = global::basicCombatEnduranceStdDev;
+	basicDisruptDuration = global::basicDisruptDuration;
+	basicDisruptStdDev = global::basicDisruptStdDev;
+	breakdownModifier = global::breakdownModifier;
+	maxFatigueDefensiveDirectFireModifier = global::maxFatigueDefensiveDirectFireModifier;
+	maxFatigueOffensiveDirectFireModifier = global::maxFatigueOffensiveDirectFireModifier;
+	maxFatigueDefensiveIndirectFireModifier = global::maxFatigueDefensiveIndirectFireModifier;
+	maxFatigueOffensiveIndirectFireModifier = global::maxFatigueOffensiveIndirectFireModifier;
+	maxFatigueRetreatModifier = global::maxFatigueRetreatModifier;
+	maxFatigueDisruptModifier = global::maxFatigueDisruptModifier;
+	maxFatigueUndisruptModifier = global::maxFatigueUndisruptModifier;
+}
+
+	// Every field is a float, so the parameters are stored and compared
+	// as an array of them, in declaration order.
+
+static const int PARAMETER_COUNT = sizeof (GameParameters) / sizeof (float);
+
+void GameParameters::store(fileSystem::Storage::Writer* o) const {
+	const float* f = &atRatio;
+	for (int i = 0; i < PARAMETER_COUNT; i++)
+		o->write(f[i]);
+}
+
+bool GameParameters::read(fileSystem::Storage::Reader* r) {
+	float* f = &atRatio;
+	for (int i = 0; i < PARAMETER_COUNT; i++)
+		if (!r->read(&f[i]))
+			return false;
+	return true;
+}
+
+bool GameParameters::equals(const GameParameters& p) const {
+	const float* f = &atRatio;
+	const float* pf = &p.atRatio;
+	for (int i = 0; i < PARAMETER_COUNT; i++)
+		if (f[i] != pf[i])
+			return false;
+	return true;
+}
+
+Game::Game(const Scenario* scenario, unsigned seed) : random(1), _history(HISTORY_CAPACITY) {
 	_scenario = scenario;
-	_eventQueue = null;
-	_eventLog = null;
+	_postSequence = 0;
+	_eventsProcessed = 0;
+	_savedQueue = null;
+	_savedLog = null;
 	_activeEvent = null;
 	_time = _scenario->start;
 	_terminated = false;
+	_autosaveBase = false;
+	storeHistory = true;
+	openHistoryJournal();
 	if (seed != 0)
 		random.set(seed);
 	else
 		random.set();
+	parameters.fromGlobals();
 	init();
 }
 /* Note: the random seed here will be overwritten with the saved
    game state, so any value will do here.  Note we supply something
    to avoid a system call to initialize the seed.
  */
-Game::Game() : random(1) {
+Game::Game() : random(1), _history(HISTORY_CAPACITY) {
+	_postSequence = 0;
+	_eventsProcessed = 0;
+	_savedQueue = null;
+	_savedLog = null;
 	_activeEvent = null;
+	_autosaveBase = false;
 	dirty = false;
+	storeHistory = true;
 }
 
 Game::~Game() {
@@ -81,11 +152,12 @@ Game::~Game() {
 	//    current queue.  With the map scrubbed (which erases
 	//	  all detachments and combats), there should be nothing
 	//	  else pointing at events.
-	while (_eventLog != null) {
-		GameEvent* e = _eventLog;
-		_eventLog = e->next();
+	while (_savedLog != null) {
+		GameEvent* e = _savedLog;
+		_savedLog = e->next();
 		delete e;
 	}
+	_history.clear();
 	purgeAllEvents();
 	// 3. Delete the force objects and any attached
 	//    AI data.
@@ -101,24 +173,40 @@ Game* Game::factory(fileSystem::Storage::Reader* r) {
 	if (r->read(&g->_time) &&
 		r->read(&g->_terminated) &&
 		r->read(&g->_scenario) &&
-		r->read(&g->_eventQueue) &&
-		r->read(&g->_eventLog) &&
+		r->read(&g->_savedQueue) &&
+		r->read(&g->_savedLog) &&
 		r->read(&g->_countryData) &&
 		r->read(&g->_fortData) &&
 		r->read(&g->force[0]) &&
 		r->read(&g->force[1]) &&
 		r->read(&randomSeed)) {
 		g->random.set(randomSeed);
+			// Saves made before the parameters were kept end with the
+			// unit sets.  Later ones follow the unit sets with the
+			// parameters and then the unit set count.  A theater has far
+			// fewer combatants than there are parameters, so the field
+			// count tells the two apart.
 		int i = r->remainingFieldCount();
+		bool hasParameters = i > PARAMETER_COUNT;
+		if (hasParameters)
+			i -= PARAMETER_COUNT + 1;
 		g->_unitSets.resize(i);
-		i = 0;
-		while (!r->endOfRecord()) {
-			if (!r->read(&g->_unitSets[i])) {
+		for (int j = 0; j < i; j++) {
+			if (!r->read(&g->_unitSets[j])) {
 				delete g;
 				return null;
 			}
-			i++;
 		}
+		if (hasParameters) {
+			int unitSetCount;
+			if (!g->parameters.read(r) ||
+				!r->read(&unitSetCount) ||
+				unitSetCount != i) {
+				delete g;
+				return null;
+			}
+		} else
+			g->parameters.fromGlobals();
 		return g;
 	} else {
 		delete g;
@@ -130,8 +218,8 @@ void Game::store(fileSystem::Storage::Writer* o) const {
 	o->write(_time);
 	o->write(_terminated);
 	o->write(_scenario);
-	o->write(_eventQueue);
-	o->write(_eventLog);
+	o->write(threadEventQueue());
+	o->write(storeHistory ? _history.newest() : null);
 	o->write(encodeCountryData(_scenario->map()));
 	o->write(encodeFortsData(_scenario->map()));
 	for (int i = 0; i < force.size(); i++)
@@ -139,6 +227,8 @@ void Game::store(fileSystem::Storage::Writer* o) const {
 	o->write(random.save());
 	for (int i = 0; i < _unitSets.size(); i++)
 		o->write(_unitSets[i]);
+	parameters.store(o);
+	o->write(_unitSets.size());
 /*
 	1. save force[i]
 		1.a. save force[i].combatant[j]
@@ -165,6 +255,20 @@ bool Game::restore() {
 	decodeFortsData(_scenario->map(), _fortData.c_str(), _fortData.size());
 	_countryData.clear();
 	_fortData.clear();
+	openHistoryJournal();
+	_history.adopt(_savedLog);
+	_savedLog = null;
+
+		// The queue was saved in execution order, so posting it
+		// back in that order reproduces the same sequence stamps.
+
+	while (_savedQueue != null) {
+		GameEvent* e = _savedQueue;
+		_savedQueue = e->_next;
+		e->_next = null;
+		e->_sequence = _postSequence++;
+		enqueue(e);
+	}
 	return true;
 }
 
@@ -172,8 +276,9 @@ bool Game::equals(Game* game) {
 	if (_time == game->_time &&
 		_terminated == game->_terminated &&
 		_scenario->equals(game->_scenario) &&
-		test::deepCompare(_eventLog, game->_eventLog) &&
-		test::deepCompare(_eventQueue, game->_eventQueue) &&
+		parameters.equals(game->parameters) &&
+		test::deepCompare(_history.newest(), game->_history.newest()) &&
+		test::deepCompare(threadEventQueue(), game->threadEventQueue()) &&
 		force.size() == game->force.size()) {
 		for (int i = 0; i < force.size(); i++)
 			if (!force[i]->equals(game->force[i]))
@@ -193,6 +298,7 @@ void Game::terminate() {
 
 void Game::advanceClock() {
 	if (_time < _scenario->end) {
+		_scenario->map()->refreshLandmarks();
 		for (int i = 0; i < force.size(); i++)
 			if (force[i]->isAI())
 				ai::run(force[i]);
@@ -202,6 +308,7 @@ void Game::advanceClock() {
 		execute(endTime);
 		if (endTime >= _scenario->end)
 			_terminated = true;
+		autosave();
 		updateUi.fire();
 	}
 }
@@ -227,10 +334,14 @@ void Game::setupForces() {
 	for (int i = 0; i < NFORCES; i++)
 		force[i]->marshallArmies();
 
+		// Find all the initial supply lines in one pass.
+
+	HexMap* map = _scenario->map();
+	refreshSupplyLines(map);
+
 		// And fortify any of the defending units.
 
 	xpoint hx;
-	HexMap* map = _scenario->map();
 	for (hx.x = map->subsetOrigin().x; hx.x < map->subsetOpposite().x; hx.x++){
 		for (hx.y = map->subsetOrigin().y; hx.y < map->subsetOpposite().y; hx.y++){
 			Detachment* d = map->getDetachments(hx);
@@ -250,6 +361,7 @@ void Game::setupForces() {
 
 void Game::execute(minutes endTime) {
 	allUnits(&Unit::actOnOrders);
+	refreshSupplyLines(_scenario->map());
 	engine::logSeparator();
 	processEvents(endTime);
 	allUnits(&Unit::updateUnitMaintenance);
@@ -260,24 +372,47 @@ void Game::execute(minutes endTime) {
 }
 
 bool Game::save(const string& filename) {
+	if (filename.endsWith(".hsb"))
+		return saveSnapshot(this, filename, "");
 	fileSystem::Storage s(filename, &global::storageMap);
 
 	s.store(this);
 	return s.write();
 }
 
+bool Game::autosave() {
+	const string& filename = global::autosaveFile;
+	if (filename.size() == 0)
+		return true;
+	bool result;
+	if (global::autosaveDeltas && filename.endsWith(".hsb")) {
+
+			// The base sits beside the autosave file, so the delta
+			// names it without its folder.
+
+		string baseFile = filename.substr(0, filename.size() - 4) + ".base.hsb";
+		int slash = baseFile.size();
+		while (slash > 0 && baseFile.c_str()[slash - 1] != '/' && baseFile.c_str()[slash - 1] != '\\')
+			slash--;
+		if (!_autosaveBase)
+			_autosaveBase = saveSnapshot(this, baseFile, "");
+		result = _autosaveBase && saveSnapshot(this, filename, baseFile.substr(slash));
+	} else
+		result = save(filename);
+	if (!result)
+		warningMessage("Couldn't autosave the game to " + filename);
+	return result;
+}
+
 void Game::post(GameEvent* ne) {
 	if (ne->occurred()) {
 		engine::log(string("+++ Bad post: ") + int(ne) + ": " + ne->toString() + " " + ne->dateStamp());
 		return;
 	}
-	GameEvent* e;
-	for (e = _eventQueue; e != null; e = e->next()){
-		if (ne == e) {
-			engine::log(string("Event already in list") + int(ne) + ": " + ne->toString());
-			dumpEvents();
-			fatalMessage("Event already queued up");
-		}
+	if (ne->queued()) {
+		engine::log(string("Event already in list") + int(ne) + ": " + ne->toString());
+		dumpEvents();
+		fatalMessage("Event already queued up");
 	}
 	if (engine::logging())
 		engine::log(string("post ") + ne->name() + " " + ne->toString() + " " + int(ne) + ": " + ne->dateStamp());
@@ -286,28 +421,17 @@ void Game::post(GameEvent* ne) {
 		dumpEvents();
 		fatalMessage("Bad time sequence on order");
 	}
-	GameEvent* elast = null;
-	for (e = _eventQueue; e != null; elast = e, e = e->next()) {
-		if (e->time() > ne->time())
-			break;
-	}
-	if (elast != null)
-		elast->insertAfter(ne);
-	else
-		_eventQueue = _eventQueue->insertBefore(ne);
+	ne->_sequence = _postSequence++;
+	enqueue(ne);
 	dirty = true;
 }
 
-IssueEvent* Game::extractIssueEvent(StandingOrder* o) {
-	GameEvent* elast = null;
-	for (GameEvent* e = _eventQueue; e != null; elast = e, e = e->next()) {
+IssueEvent* Game::extractIssueEvent(Detachment* d, StandingOrder* o) {
+	for (GameEvent* e = d->unit->pendingEvents; e != null; e = e->_unitNext) {
 		if (typeid(*e) == typeid(IssueEvent)) {
 			IssueEvent* ie = (IssueEvent*)e;
 			if (ie->order() == o) {
-				if (elast == null)
-					_eventQueue = e->next();
-				else
-					elast->popNext();
+				dequeue(ie);
 				return ie;
 			}
 		}
@@ -318,18 +442,13 @@ IssueEvent* Game::extractIssueEvent(StandingOrder* o) {
 void Game::purge(Detachment* d) {
 	if (engine::logging())
 		engine::log("purge(" + d->unit->name() + "}");
-	GameEvent* prev = null;
 	GameEvent* eNext;
-	for (GameEvent* e = _eventQueue; e != null; e = eNext) {
-		eNext = e->next();
+	for (GameEvent* e = d->unit->pendingEvents; e != null; e = eNext) {
+		eNext = e->_unitNext;
 		if (e->affects(d)) {
-			if (prev == null)
-				_eventQueue = e->next();
-			else
-				prev->popNext();
+			dequeue(e);
 			delete e;
-		} else
-			prev = e;
+		}
 	}
 }
 
@@ -345,21 +464,18 @@ void Game::reschedule(GameEvent* re, minutes t) {
 }
 
 void Game::unschedule(GameEvent* ue) {
-	GameEvent* prev = null;
-	for (GameEvent* e = _eventQueue; e != null; prev = e, e = e->next()) {
-		if (ue == e){
-			if (prev == null)
-				_eventQueue = e->next();
-			else
-				prev->popNext();
-			ue->_next = null;
-			break;
-		}
-	}
+	if (ue->queued())
+		dequeue(ue);
 }
 
 void Game::remember(GameEvent* e) {
-	_eventLog = _eventLog->insertBefore(e);
+	_history.remember(e);
+}
+
+void Game::openHistoryJournal() {
+	if (global::historyJournal.size() > 0 &&
+		!_history.openJournal(global::historyJournal))
+		warningMessage("Couldn't open event journal: " + global::historyJournal);
 }
 
 void Game::allUnits(bool (Unit::* f)()) {
@@ -401,8 +517,10 @@ Unit* Game::findByCommander(const string& commander) {
 }
 
 void Game::dumpEvents() {
+	if (!engine::logging())
+		return;
 	engine::log("////////////// " + fromGameDate(_time) + " " + fromGameTime(_time));
-	for (GameEvent* e = _eventQueue; e != null; e = e->next()) {
+	for (GameEvent* e = threadEventQueue(); e != null; e = e->next()) {
 		engine::log(string(int(e)) + ": " + e->toString() + " " + e->dateStamp());
 		if (e->occurred()) {
 			engine::log("**** aborted ***");
@@ -476,17 +594,19 @@ const Theater* Game::theater() const {
 }
 
 void Game::purgeAllEvents() {
-	while (_eventQueue != null) {
-		GameEvent* e = _eventQueue;
-		_eventQueue = e->next();
+	while (_eventQueue.size() > 0) {
+		GameEvent* e = _eventQueue[_eventQueue.size() - 1];
+		dequeue(e);
 		delete e;
 	}
 }
 
 void Game::processEvents(minutes endTime) {
-	while (_eventQueue != null && _eventQueue->time() <= endTime){
-		GameEvent* e = _eventQueue;
-		_eventQueue = e->next();
+	while (_eventQueue.size() > 0 && _eventQueue[0]->time() <= endTime){
+		GameEvent* e = _eventQueue[0];
+		if (e->combat() != null && e->combat()->firedTo() < e->time())
+			fireCombats(e->time());
+		dequeue(e);
 		dirty = true;
 		_time = e->time();
 		_activeEvent = e;
@@ -494,124 +614,178 @@ void Game::processEvents(minutes endTime) {
 			engine::log(string("execute ") + e->name() + " " + e->toString() + (int)(e) + ": ");
 		e->happen();
 		_activeEvent = null;
+		_eventsProcessed++;
 		engine::logSeparator();
 		updateUi.fire();
 		dumpEvents();
 	}
 	_time = endTime;
 }
-//
-// The time format is computed by taking the time_t value
-// and adjusting the base year so that a date dividing by oneMinute
-//
 
-minutes toGameDate(const string& s) {
-	if (s.size() == 0)
-		return 0;
+void Game::fireCombats(minutes t) {
+	_time = t;
 
-	SYSTEMTIME d;
+		// Only the part of the heap at or before time t needs to be
+		// searched.
 
-	if (!locale::toDate(s, &d))
-		fatalMessage("Bad time string: " + s);
-	if (d.wYear < 100)
-		d.wYear += 1900;
-	_int64 ftime;
-	if (!SystemTimeToFileTime(&d, (FILETIME*)&ftime))
-		return 0;
-	return minutes(ftime / oneMinute);
-}
-
-minutes toGameTime(const string& s) {
-	if (s.size() == 0)
-		return 0;
-
-	SYSTEMTIME d;
+	vector<GameEvent*> due;
+	vector<int> pending;
+	pending.push_back(0);
+	while (pending.size() > 0) {
+		int i = pending[pending.size() - 1];
+		pending.resize(pending.size() - 1);
+		if (i >= _eventQueue.size() || _eventQueue[i]->time() > t)
+			continue;
+		due.push_back(_eventQueue[i]);
+		pending.push_back(2 * i + 1);
+		pending.push_back(2 * i + 2);
+	}
 
-	memset(&d, 0, sizeof d);
+		// Put them in the order they will happen.
 
-		// First get the hour
+	for (int i = 1; i < due.size(); i++) {
+		GameEvent* e = due[i];
+		int j;
+		for (j = i; j > 0 && precedes(e, due[j - 1]); j--)
+			due[j] = due[j - 1];
+		due[j] = e;
+	}
 
-	int i = s.find(':');
-	if (i == string::npos)
-		return 0;
-	d.wHour = atoi(s.substr(0, i).c_str());
-	i++;
-	d.wMinute = atoi(s.substr(i + 1).c_str());
-	_int64 ftime;
-	if (!SystemTimeToFileTime(&d, (FILETIME*)&ftime))
-		return 0;
-	return minutes(ftime / oneMinute);
-}
+		// Only the combats up to the first other event can fire now.
+		// Anything else due at t, a supply arrival say, must happen
+		// before the combats that follow it.
 
-minutes toGameElapsed(const string& s) {
-	if (s.endsWith(" days")) {
-		int i = atoi(s.c_str());
-		return i * engine::oneDay;
-	} else if (s.endsWith(" hours")) {
-		int i = atoi(s.c_str());
-		return i * engine::oneHour;
-	} else
-		return toGameTime(s);
+	vector<Combat*> combats;
+	for (int i = 0; i < due.size() && due[i]->combat() != null; i++)
+		combats.push_back(due[i]->combat());
+	Combat::fireConcurrently(this, combats);
 }
 
-string fromGameDate(minutes m) {
-	if (m == 0)
-		return "";
+void Game::enqueue(GameEvent* e) {
+	e->_queueIndex = _eventQueue.size();
+	_eventQueue.push_back(e);
+	siftUp(e->_queueIndex);
 
-	_int64 t = ((_int64)m) * oneMinute;
-	SYSTEMTIME d;
-	if (!FileTimeToSystemTime((FILETIME*)&t, &d))
-		return "";
+		// File the event under its subject so that purge can find it
+		// without a scan of the queue.
 
-	int y = d.wYear;
-	if (y > 1900 && y < 1999)
-		y -= 1900;
-	return string(d.wMonth) + "/" + d.wDay + "/" + y;
+	Unit* u = e->subject();
+	if (u != null) {
+		e->_unitPrev = null;
+		e->_unitNext = u->pendingEvents;
+		if (u->pendingEvents != null)
+			u->pendingEvents->_unitPrev = e;
+		u->pendingEvents = e;
+	}
 }
 
-string fromGameTime(minutes m) {
-	if (m == 0)
-		return "";
-	_int64 t = ((_int64)m) * oneMinute;
-	SYSTEMTIME d;
-	if (!FileTimeToSystemTime((FILETIME*)&t, &d))
-		return "";
-
-	char buffer[10];
-	sprintf(buffer, "%02d:%02d", d.wHour, d.wMinute);
-	return buffer;
+void Game::dequeue(GameEvent* e) {
+	int i = e->_queueIndex;
+	int last = _eventQueue.size() - 1;
+	if (i != last) {
+		_eventQueue[i] = _eventQueue[last];
+		_eventQueue[i]->_queueIndex = i;
+		_eventQueue.resize(last);
+		siftDown(i);
+		siftUp(i);
+	} else
+		_eventQueue.resize(last);
+	e->_queueIndex = -1;
+	if (e->_unitPrev != null)
+		e->_unitPrev->_unitNext = e->_unitNext;
+	else {
+		Unit* u = e->subject();
+		if (u != null)
+			u->pendingEvents = e->_unitNext;
+	}
+	if (e->_unitNext != null)
+		e->_unitNext->_unitPrev = e->_unitPrev;
+	e->_unitNext = null;
+	e->_unitPrev = null;
+}
+
+void Game::siftUp(int i) {
+	GameEvent* e = _eventQueue[i];
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		GameEvent* p = _eventQueue[parent];
+		if (!precedes(e, p))
+			break;
+		_eventQueue[i] = p;
+		p->_queueIndex = i;
+		i = parent;
+	}
+	_eventQueue[i] = e;
+	e->_queueIndex = i;
 }
 
-string fromGameMonthDay(minutes m) {
-	if (m == 0)
-		return "";
+void Game::siftDown(int i) {
+	GameEvent* e = _eventQueue[i];
+	int n = _eventQueue.size();
+	for (;;) {
+		int child = 2 * i + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n && precedes(_eventQueue[child + 1], _eventQueue[child]))
+			child++;
+		if (!precedes(_eventQueue[child], e))
+			break;
+		_eventQueue[i] = _eventQueue[child];
+		_eventQueue[i]->_queueIndex = i;
+		i = child;
+	}
+	_eventQueue[i] = e;
+	e->_queueIndex = i;
+}
 
-	_int64 t = ((_int64)m) * oneMinute;
-	SYSTEMTIME d;
-	if (!FileTimeToSystemTime((FILETIME*)&t, &d))
-		return "";
+GameEvent* Game::threadEventQueue() const {
+	GameEvent* list = null;
+	for (int i = _eventQueue.size() - 1; i >= 0; i--) {
+		_eventQueue[i]->_next = list;
+		list = _eventQueue[i];
+	}
+	return sortEvents(list, _eventQueue.size());
+}
 
-	int y = d.wYear;
-	if (y > 1900 && y < 1999)
-		y -= 1900;
-	return string(d.wMonth) + "/" + d.wDay;
+bool Game::precedes(const GameEvent* a, const GameEvent* b) {
+	if (a->_time != b->_time)
+		return a->_time < b->_time;
+	return a->_sequence < b->_sequence;
 }
 /*
-traceGameTime: (t: minutes) string
-{
-	d: instance locale.Date
-
-	toDate(t, &d)
-	hrs := string(d.hour)
-	if (|hrs == 1)
-		hrs = "0" + hrs
-	mins := string(d.minute)
-	if (|mins == 1)
-		mins = "0" + mins
-	return d.month + "/" + d.day + " " + hrs + ":" + mins
+ *	A merge sort of the first n events of list, linked through
+ *	their next pointers.
+ */
+GameEvent* Game::sortEvents(GameEvent* list, int n) {
+	if (n <= 1) {
+		if (list != null)
+			list->_next = null;
+		return list;
+	}
+	int half = n / 2;
+	GameEvent* back = list;
+	for (int i = 0; i < half; i++)
+		back = back->_next;
+	GameEvent* a = sortEvents(list, half);
+	GameEvent* b = sortEvents(back, n - half);
+	GameEvent* head = null;
+	GameEvent** tail = &head;
+	while (a != null && b != null) {
+		if (precedes(b, a)) {
+			*tail = b;
+			b = b->_next;
+		} else {
+			*tail = a;
+			a = a->_next;
+		}
+		tail = &(*tail)->_next;
+	}
+	if (a != null)
+		*tail = a;
+	else
+		*tail = b;
+	return head;
 }
-*/
-
 void initForGame() {
 	// This list is order-sensitive.  Only add new entries at the end and
 	// NEVER delete any.
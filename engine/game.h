@@ -4,6 +4,7 @@
 #include "../common/random.h"
 #include "../common/vector.h"
 #include "constants.h"
+#include "event_history.h"
 #include "game_time.h"
 
 namespace engine {
@@ -24,8 +25,63 @@ class UnitSet;
 	// Testing objects
 
 class CombatObject;
+class EventQueueObject;
 
 Game* startGame(const Scenario* scenario, unsigned seed);
+/*
+ *	GameParameters
+ *
+ *	The combat tuning values a game runs with.  The defaults live in
+ *	the global settings (and the theater file); each Game takes its
+ *	own copy when it starts, and the combat and detachment code read
+ *	them only through the game.  A test or calibration run may alter
+ *	one game's parameters without disturbing any other game.
+ *
+ *	The parameters are saved with the game, so a restored game goes on
+ *	with the values it started with, whatever the defaults are when it
+ *	is loaded.  A save made before they were kept loads with the
+ *	defaults.
+ */
+class GameParameters {
+public:
+	void fromGlobals();
+
+	void store(fileSystem::Storage::Writer* o) const;
+
+	bool read(fileSystem::Storage::Reader* r);
+
+	bool equals(const GameParameters& p) const;
+
+	float		atRatio;
+	float		artilleryRearAreaFire;
+	float		ammoUseStdDev;
+	float		ammoUseMaxMult;
+	float		ammoUseMinMult;
+	float		rearAccuracy;
+	float		lineAccuracy;
+	float		defensiveInfiltrationInvolvement;
+	float		riverEdgeAdjust;
+	float		coastEdgeAdjust;
+	float		riverCasualtyMultiplier;
+	float		coastCasualtyMultiplier;
+	float		basicATHitProbability;
+	float		atScale;
+	float		offensiveAPHitProbability;
+	float		defensiveAPHitProbability;
+	float		apScale;
+	float		basicCombatEndurance;
+	float		basicCombatEnduranceStdDev;
+	float		basicDisruptDuration;
+	float		basicDisruptStdDev;
+	float		breakdownModifier;
+	float		maxFatigueDefensiveDirectFireModifier;
+	float		maxFatigueOffensiveDirectFireModifier;
+	float		maxFatigueDefensiveIndirectFireModifier;
+	float		maxFatigueOffensiveIndirectFireModifier;
+	float		maxFatigueRetreatModifier;
+	float		maxFatigueDisruptModifier;
+	float		maxFatigueUndisruptModifier;
+};
 
 Game* loadGame(const string& filename);
 
@@ -56,11 +112,31 @@ public:
 
 	void execute(minutes endTime);
 
+	/*
+	 *	save
+	 *
+	 *	Writes the game to filename.  A name ending in .hsb gets a
+	 *	full snapshot (see saveSnapshot), anything else a saved game
+	 *	with the complete event log.
+	 */
 	bool save(const string& filename);
+	/*
+	 *	autosave
+	 *
+	 *	Saves the game to global::autosaveFile, if one is set.  See
+	 *	global::autosaveDeltas.
+	 */
+	bool autosave();
 
 	void post(GameEvent* ne);
-
-	IssueEvent* extractIssueEvent(StandingOrder* o);
+	/*
+	 *	extractIssueEvent
+	 *
+	 *	Removes from the queue the IssueEvent that is delivering
+	 *	order o to detachment d and returns it, or null if there
+	 *	is no such event.
+	 */
+	IssueEvent* extractIssueEvent(Detachment* d, StandingOrder* o);
 
 	void purge(Detachment* d);
 
@@ -104,27 +180,71 @@ public:
 
 	minutes time() const { return _time; }
 
+	unsigned eventsProcessed() const { return _eventsProcessed; }
+
+	EventHistory* history() { return &_history; }
+
 	Event1<Unit*>							changed;
 	Event3<Unit*, xpoint, xpoint>			moved;
 
 	bool				dirty;
+	bool				storeHistory;	// If false, store leaves out the event log
 	vector<Force*>		force;
 	random::Random		random;
+	GameParameters		parameters;
 
 private:
 	// Test methods
 	friend CombatObject;
+	friend EventQueueObject;
 
 	void purgeAllEvents();
 
+	void openHistoryJournal();
+
 	void processEvents(minutes endTime);
+	/*
+	 *	fireCombats
+	 *
+	 *	Called when a combat event due at time t reaches the head of
+	 *	the queue and its combat has not fired at t yet.  That event
+	 *	and the combat events that follow it in queue order, up to the
+	 *	first event at t of any other kind, have their combats handed
+	 *	to Combat::fireConcurrently.
+	 */
+	void fireCombats(minutes t);
+
+	void enqueue(GameEvent* e);
+
+	void dequeue(GameEvent* e);
+
+	void siftUp(int i);
+
+	void siftDown(int i);
+	/*
+	 *	threadEventQueue
+	 *
+	 *	Links the queued events through their next pointers in the
+	 *	order they will be executed and returns the first one.  This
+	 *	is the form in which the queue is saved and compared.
+	 */
+	GameEvent* threadEventQueue() const;
+
+	static bool precedes(const GameEvent* a, const GameEvent* b);
+
+	static GameEvent* sortEvents(GameEvent* list, int n);
 
 	minutes					_time;			// Current time of the game
 	const Scenario*			_scenario;
-	GameEvent*				_eventQueue;		// List of currently active events.
+	vector<GameEvent*>		_eventQueue;	// Binary heap of currently active events.
+	unsigned				_postSequence;	// Stamped on each posted event to keep same-time events in order
+	unsigned				_eventsProcessed;
+	GameEvent*				_savedQueue;	// Stored temporarily here during load of a game save
 	GameEvent*				_activeEvent;
 	bool					_terminated;
-	GameEvent*				_eventLog;
+	bool					_autosaveBase;	// The base snapshot for autosave deltas has been written
+	GameEvent*				_savedLog;		// Stored temporarily here during load of a game save
+	EventHistory			_history;
 	string					_countryData;	// Stored temporarily here during load of a game save
 	string					_fortData;		// Stored temporarily here during load of a game save
 	vector<UnitSet*>		_unitSets;
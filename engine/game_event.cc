@@ -7,13 +7,28 @@
 #include "force.h"
 #include "game.h"
 #include "order.h"
+#include "pool.h"
 #include "theater.h"
 #include "unit.h"
 #include "unitdef.h"
 
 namespace engine {
 
+static ObjectPool eventPool("GameEvent");
+
 GameEvent::GameEvent() {
+	_queueIndex = -1;
+	_sequence = 0;
+	_unitNext = null;
+	_unitPrev = null;
+}
+
+void* GameEvent::operator new(size_t size) {
+	return eventPool.allocate(size);
+}
+
+void GameEvent::operator delete(void* p, size_t size) {
+	eventPool.release(p, size);
 }
 
 bool GameEvent::read(fileSystem::Storage::Reader* r) {
@@ -63,6 +78,14 @@ bool GameEvent::affects(Detachment *d) {
 	return false;
 }
 
+Unit* GameEvent::subject() const {
+	return null;
+}
+
+Combat* GameEvent::combat() const {
+	return null;
+}
+
 void GameEvent::insertAfter(GameEvent *e) {
 	e->_next = _next;
 	_next = e;
@@ -109,6 +132,10 @@ bool DetachmentEvent::affects(Detachment* d) {
 	return d == _detachedUnit->detachment();
 }
 
+Unit* DetachmentEvent::subject() const {
+	return _detachedUnit;
+}
+
 Detachment* DetachmentEvent::detachment() const {
 	return _detachedUnit->detachment();
 }
@@ -311,6 +338,10 @@ void DisruptEvent::execute() {
 	delete this;
 }
 
+Combat* DisruptEvent::combat() const {
+	return _combat;
+}
+
 string DisruptEvent::toString() {
 	string s;
 	if (_combat != null)
@@ -462,6 +493,10 @@ void RetreatEvent::execute() {
 	delete this;
 }
 
+Combat* RetreatEvent::combat() const {
+	return _combat;
+}
+
 string RetreatEvent::toString() {
 	string s;
 
@@ -504,6 +539,10 @@ void LetEvent::execute() {
 	delete this;
 }
 
+Combat* LetEvent::combat() const {
+	return _combat;
+}
+
 string LetEvent::toString() {
 	string s;
 	if (_combat != null)
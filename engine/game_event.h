@@ -9,6 +9,7 @@ namespace engine {
 class Combat;
 class Detachment;
 class Doctrine;
+class EventHistory;
 class Game;
 class HexMap;
 class InvolvedDetachment;
@@ -20,13 +21,16 @@ class Unit;
 
 	The atomic actions of the game are represented as Events.
 	Each event has a specific time when it occurs.  The
-	event queue is a list in increasing time order of the
-	events that are scheduled to happen in the future.  The
-	event log is a list in decreasing time order of the
-	events that happened in the past.  These are used to reconstruct
-	past situation reports.
+	event queue is a priority queue of the events that are
+	scheduled to happen in the future, ordered by time and,
+	for events at the same time, by the order in which they
+	were posted.  The event log (an EventHistory) holds the
+	events that happened in the past, the most recent ones in
+	memory and older ones in a journal.  These are used to
+	reconstruct past situation reports.
  */
 class GameEvent {
+	friend EventHistory;
 	friend Game;
 protected:
 	GameEvent();
@@ -35,9 +39,21 @@ public:
 		_time = time;
 		_occurred = false;
 		_next = null;
+		_queueIndex = -1;
+		_sequence = 0;
+		_unitNext = null;
+		_unitPrev = null;
 	}
 
 	virtual ~GameEvent() { }
+	/*
+	 *	Events of all kinds share one ObjectPool.  The destructor is
+	 *	virtual, so operator delete is given the size of the event's
+	 *	own class.
+	 */
+	static void* operator new(size_t size);
+
+	static void operator delete(void* p, size_t size);
 
 	virtual void store(fileSystem::Storage::Writer* o) const;
 
@@ -52,6 +68,24 @@ public:
 	virtual void execute() = 0;
 
 	virtual bool affects(Detachment* d);
+	/*
+	 *	subject
+	 *
+	 *	Returns the unit whose detachment this event may affect, or
+	 *	null if the event affects no detachment.  While the event is
+	 *	queued, the Game files it under this unit so that purge and
+	 *	extractIssueEvent need not scan the whole queue.
+	 */
+	virtual Unit* subject() const;
+	/*
+	 *	combat
+	 *
+	 *	Returns the combat this event brings up to date when it
+	 *	happens, or null if it is not one of a combat's own events.
+	 *	The Game uses this to find the combats that are due at the
+	 *	same minute.
+	 */
+	virtual Combat* combat() const;
 
 	void insertAfter(GameEvent* e);
 
@@ -68,6 +102,7 @@ public:
 	GameEvent* next() const { return _next; }
 	minutes time() const { return _time; }
 	bool occurred() const { return _occurred; }
+	bool queued() const { return _queueIndex >= 0; }
 
 protected:
 	bool read(fileSystem::Storage::Reader* r);
@@ -76,6 +111,13 @@ private:
 	GameEvent*		_next;
 	minutes			_time;
 	bool			_occurred;
+
+		// Scheduling state, maintained by the Game while the event is queued
+
+	int				_queueIndex;	// Slot in the event heap, -1 if not queued
+	unsigned		_sequence;		// Post order, breaks ties between events at the same time
+	GameEvent*		_unitNext;		// Other queued events with the same subject
+	GameEvent*		_unitPrev;
 };
 
 class DetachmentEvent : public GameEvent {
@@ -91,6 +133,8 @@ public:
 
 	virtual bool affects(Detachment* d);
 
+	virtual Unit* subject() const;
+
 	Detachment* detachment() const;
 
 	Unit* detachedUnit() const { return _detachedUnit; }
@@ -197,6 +241,8 @@ public:
 
 	virtual string toString();
 
+	virtual Combat* combat() const;
+
 	minutes started() const { return _started; }
 
 private:
@@ -266,6 +312,8 @@ public:
 
 	virtual string toString();
 
+	virtual Combat* combat() const;
+
 private:
 	Combat*				_combat;
 	InvolvedDetachment*	_iDetachment;
@@ -284,6 +332,8 @@ public:
 
 	virtual void execute();
 
+	virtual Combat* combat() const;
+
 	virtual string toString();
 
 private:
@@ -7,13 +7,18 @@
 #include "../ui/map_ui.h"
 #include "../ui/ui.h"
 #include "bitmap.h"
+#include "cluster_map.h"
 #include "combat.h"
 #include "detachment.h"
 #include "engine.h"
 #include "force.h"
 #include "game.h"
 #include "global.h"
+#include "landmarks.h"
+#include "mapped_file.h"
+#include "parallel.h"
 #include "path.h"
+#include "rail_network.h"
 #include "theater.h"
 #include "unit.h"
 
@@ -27,6 +32,28 @@ struct TransportDescriptor {
 //	filler:			byte
 };
 
+const int XMP2_MAGIC = ('X' << 24) + ('M' << 16) + ('P' << 8) + '2';
+const int XMP2_VERSION = 1;
+const int XMP2_ALIGNMENT = 64;
+/*
+ *	Xmp2Header
+ *
+ *	An .xmp2 file starts with this header.  The sections it points to
+ *	are aligned and laid out exactly as the HexMap planes are, so they
+ *	can be used in place.  Transport edges are stored as they are in an
+ *	.xmp file, with only the low eight bits of each edge kept.
+ */
+struct Xmp2Header {
+	int				magic;
+	int				version;
+	MapHeader		header;
+	int				cellsOffset;		// rows * cols unsigned shorts
+	int				transportOffset;	// rows * cols * 3 unsigned shorts
+};
+
+static string compiledFilename(const string& filename);
+static string cacheFilename(const string& filename, const string& suffix);
+
 static float intercepts[2];
 
 //EQUATOR:	public const int = 862//849			// y coord of equator
@@ -56,12 +83,13 @@ HexMap::HexMap(const string &filename, const string& placesFile, const string& t
 	_rowSize = cols;
 	_allocatedRows = rows;
 	memset(transportData, 0, sizeof transportData);
+	_mapping = null;
+	memset((void*)_edgeCosts, 0, sizeof _edgeCosts);
 	int data_length = header.cols * header.rows;
-	if (data_length) {
-		_hexes = new Hex[data_length];
-		memset(_hexes, 0, data_length * sizeof(Hex));
-	} else
-		_hexes = null;
+	if (data_length)
+		allocatePlanes(data_length);
+	else
+		_cells = null;
 }
 /*
 	new: (filename: string, parcMap: ParcMap, kilometersPerHex: float, rotation: int)
@@ -277,10 +305,119 @@ HexMap::HexMap(const string &filename, const string& placesFile, const string& t
  */
 
 HexMap::~HexMap() {
-	delete [] _hexes;
+	invalidateEdgeCosts();
+	freePlanes();
+}
+
+void HexMap::allocatePlanes(int length) {
+	if (_mapping == null) {
+		_cells = new unsigned short[length];
+		_transport = new unsigned short[length * 3];
+		memset(_cells, 0, length * sizeof (unsigned short));
+		memset(_transport, 0, length * 3 * sizeof (unsigned short));
+	}
+	_occupier = new byte[length];
+	_zoc = new byte[length];
+	_contact = new byte[length];
+	_features = new ui::Feature*[length];
+	_detachments = new Detachment*[length];
+	_combat = new Combat*[length];
+	memset(_occupier, 0, length);
+	memset(_zoc, 0, length);
+	memset(_contact, 0, length);
+	memset(_features, 0, length * sizeof (ui::Feature*));
+	memset(_detachments, 0, length * sizeof (Detachment*));
+	memset(_combat, 0, length * sizeof (Combat*));
+}
+
+void HexMap::freePlanes() {
+	if (_cells == null)
+		return;
+	if (_mapping != null)
+		delete _mapping;
+	else {
+		delete [] _cells;
+		delete [] _transport;
+	}
+	delete [] _occupier;
+	delete [] _zoc;
+	delete [] _contact;
+	delete [] _features;
+	delete [] _detachments;
+	delete [] _combat;
+}
+
+/*
+ *	detachMapping
+ *
+ *	Copies the planes held in the mapped file into memory of their own
+ *	and closes the file, so that it can be written.
+ */
+void HexMap::detachMapping() {
+	if (_mapping == null)
+		return;
+	int data_length = _allocatedRows * _rowSize;
+	unsigned short* cells = new unsigned short[data_length];
+	unsigned short* transport = new unsigned short[data_length * 3];
+	memcpy(cells, _cells, data_length * sizeof (unsigned short));
+	memcpy(transport, _transport, data_length * 3 * sizeof (unsigned short));
+	_cells = cells;
+	_transport = transport;
+	delete _mapping;
+	_mapping = null;
 }
 
 bool HexMap::load() {
+	string compiled = compiledFilename(filename);
+	bool loaded = false;
+	if (_cells == null) {
+		if (filename.endsWith(".xmp2"))
+			loaded = loadMapped(filename);
+		else if (compiled.size() > 0 && isUpToDate(compiled, filename))
+			loaded = loadMapped(compiled);
+	}
+	if (!loaded) {
+		if (!loadLegacy())
+			return false;
+		if (compiled.size() > 0)
+			saveXmp2(compiled);
+	}
+	if (!places.load(this, 0))
+		return false;
+	global::kmPerHex = hexScale();
+	invalidateEdgeCosts();
+	return terrainKey.load(this);
+}
+
+bool HexMap::loadMapped(const string& filename) {
+	MappedFile* m = new MappedFile();
+	if (!m->open(filename) || m->size() < int(sizeof (Xmp2Header))) {
+		delete m;
+		return false;
+	}
+	const Xmp2Header* h = (const Xmp2Header*)m->data();
+	int data_length = h->header.cols * h->header.rows;
+	if (h->magic != XMP2_MAGIC ||
+		h->version != XMP2_VERSION ||
+		data_length <= 0 ||
+		h->cellsOffset % XMP2_ALIGNMENT != 0 ||
+		h->transportOffset % XMP2_ALIGNMENT != 0 ||
+		h->cellsOffset + data_length * int(sizeof (unsigned short)) > m->size() ||
+		h->transportOffset + data_length * 3 * int(sizeof (unsigned short)) > m->size()) {
+		delete m;
+		return false;
+	}
+	header = h->header;
+	adoptHeader();
+	_mapping = m;
+	_cells = (unsigned short*)(m->data() + h->cellsOffset);
+	_transport = (unsigned short*)(m->data() + h->transportOffset);
+	allocatePlanes(data_length);
+	applyTransport();
+	return true;
+}
+
+bool HexMap::loadLegacy() {
 	FILE* fp = fileSystem::openBinaryFile(filename);
 	if (fp == null)
 		return false;
@@ -298,60 +435,74 @@ bool HexMap::load() {
 		fclose(fp);
 		return false;
 	}
-	_rowSize = header.cols;
-	_allocatedRows = header.rows;
-	_subsetOrigin.x = 0;
-	_subsetOrigin.y = 0;
-	_subsetOpposite.x = header.cols;
-	_subsetOpposite.y = header.rows;
+	adoptHeader();
 
 	int data_length = header.cols * header.rows;
-	if (_hexes == null) {
-		_hexes = new Hex[data_length];
-		memset(_hexes, 0, data_length * sizeof(Hex));
-	}
+	if (_cells == null)
+		allocatePlanes(data_length);
 
-	for (int i = 0; i < data_length; i++) {
-		unsigned short x;
-
-		if (fread(&x, sizeof x, 1, fp) != 1) {
-			fclose(fp);
-			return false;
-		}
-		_hexes[i].data = x;
+	if (fread(_cells, sizeof (unsigned short), data_length, fp) != data_length) {
+		fclose(fp);
+		return false;
 	}
 
 	TransportDescriptor* td = new TransportDescriptor[header.transportCnt];
 	int actualLen = fread(td, sizeof (TransportDescriptor), header.transportCnt, fp);
+	fclose(fp);
 	if (actualLen != header.transportCnt) {
-		fclose(fp);
+		delete [] td;
 		return false;
 	}
 
-	for (int t = 0; t < header.transportCnt; t++){
-		xpoint hx;
+		// Edges are stored as bytes, so no bridges come back from the file.
+		// The game will put them back in for the roads that need them.
 
+	for (int t = 0; t < header.transportCnt; t++){
 		int i = td[t].index;
-		hx.x = (xcoord)(i % header.cols);
-		hx.y = (xcoord)(i / header.cols);
+		if (i < 0 || i >= data_length)
+			continue;
 		for (int j = 0; j < 3; j++)
-			if (td[t].edgeSet[j] != 0)
-				setTransportEdge(hx, j, TransFeatures(td[t].edgeSet[j]));
+			_transport[i * 3 + j] |= td[t].edgeSet[j];
 	}
+	delete [] td;
+	applyTransport();
+	return true;
+}
 
-		// The game will put bridges back in for the roads that need them.
-
-	xpoint hx;
-	for (hx.x = 0; hx.x < header.cols; hx.x++)
-		for (hx.y = 0; hx.y < header.rows; hx.y++){
+void HexMap::adoptHeader() {
+	_rowSize = header.cols;
+	_allocatedRows = header.rows;
+	_subsetOrigin.x = 0;
+	_subsetOrigin.y = 0;
+	_subsetOpposite.x = header.cols;
+	_subsetOpposite.y = header.rows;
+}
+/*
+ *	applyTransport
+ *
+ *	Makes the transport features, which the map display draws, agree
+ *	with a freshly loaded transport plane.
+ */
+void HexMap::applyTransport() {
+	int data_length = _allocatedRows * _rowSize;
+	for (int i = 0; i < data_length; i++) {
+		unsigned short* t = &_transport[i * 3];
+		if ((t[0] | t[1] | t[2]) == 0)
+			continue;
+		if (_features[i] == null) {
+			ui::TransportFeature* tf = new ui::TransportFeature(this, 0, TransFeatures(t[0]));
+			tf->setEdge(1, TransFeatures(t[1]));
+			tf->setEdge(2, TransFeatures(t[2]));
+			_features[i] = tf;
+		} else {
+			xpoint hx;
+			hx.x = (xcoord)(i % _rowSize);
+			hx.y = (xcoord)(i / _rowSize);
 			for (int j = 0; j < 3; j++)
-				clearTransportEdge(hx, j, TF_BRIDGE);
+				if (t[j] != 0)
+					setTransportEdge(hx, j, TransFeatures(t[j]));
 		}
-	fclose(fp);
-	if (!places.load(this, 0))
-		return false;
-	global::kmPerHex = hexScale();
-	return terrainKey.load(this);
+	}
 }
 
 void HexMap::clean() {
@@ -360,10 +511,10 @@ void HexMap::clean() {
 		for (hx.y = 0; hx.y < header.rows; hx.y++) {
 			for (int j = 0; j < 3; j++)
 				clearTransportEdge(hx, j, TransFeatures(TF_BLOWN_BRIDGE|TF_RAIL_CLOGGED|TF_CLOGGED));
-			Hex& h = hex(hx);
-			if (h.combat != null) {
-				delete h.combat;
-				h.combat = null;
+			int i = index(hx);
+			if (_combat[i] != null) {
+				delete _combat[i];
+				_combat[i] = null;
 			}
 		}
 	for (hx.x = 0; hx.x < header.cols; hx.x++)
@@ -437,15 +588,7 @@ void HexMap::subset(xpoint pOrigin, xpoint pExtent) {
 }
 
 UnitCarriers HexMap::calculateCarrier(Unit* u) {
-	MoveInfo mi;
-
-	memset(&mi, 0, sizeof mi);
-	u->calculate(&mi);
-	const TerrainKeyItem& tki = terrainKey.table[CLEARED];
-	for (int i = UC_MINCARRIER; i < UC_MAXCARRIER; i++)
-		mi.rawCost[i] = int(1000 / tki.moveCost[i]);
-	deriveMoveCost(u, &mi);
-	return mi.carrier;
+	return u->carrier(this);
 }
 
 EdgeValues HexMap::edgeCrossing(xpoint p, HexDirection dir) {
@@ -754,6 +897,9 @@ bool HexMap::startingMeetingEngagement(xpoint hex, Force* force) {
 	}
  */
 bool HexMap::save() {
+	detachMapping();
+	if (filename.endsWith(".xmp2"))
+		return saveXmp2(filename);
 	if (!fileSystem::createBackupFile(filename)) {
 		warningMessage("Couldn't create backup file for: " + filename);
 		return false;
@@ -771,7 +917,7 @@ bool HexMap::save() {
 	}
 	header.transportCnt = 0;
 	for (int i = 0; i < _allocatedRows * _rowSize; i++) {
-		ui::Feature* f = _hexes[i].features;
+		ui::Feature* f = _features[i];
 		if (f == null)
 			continue;
 		ui::Feature* fx = f;
@@ -786,17 +932,16 @@ bool HexMap::save() {
 		fclose(fp);
 		return false;
 	}
-	for (int i = 0; i < _allocatedRows * _rowSize; i++) {
-		if (fwrite(&_hexes[i].data, sizeof (unsigned short), 1, fp) != 1) {
-			warningMessage("Write error on file: " + filename);
-			fclose(fp);
-			return false;
-		}
+	int data_length = _allocatedRows * _rowSize;
+	if (fwrite(_cells, sizeof (unsigned short), data_length, fp) != data_length) {
+		warningMessage("Write error on file: " + filename);
+		fclose(fp);
+		return false;
 	}
 	TransportDescriptor* td = new TransportDescriptor[header.transportCnt];
 	int t = 0;
 	for (int i = 0; i < _allocatedRows * _rowSize; i++) {
-		ui::Feature* f = _hexes[i].features;
+		ui::Feature* f = _features[i];
 		if (f == null)
 			continue;
 		ui::Feature* fx = f;
@@ -821,6 +966,42 @@ bool HexMap::save() {
 	return true;
 }
 
+bool HexMap::saveXmp2(const string& filename) {
+	static byte padding[XMP2_ALIGNMENT];
+
+	detachMapping();
+	int data_length = _allocatedRows * _rowSize;
+	Xmp2Header h;
+	memset(&h, 0, sizeof h);
+	h.magic = XMP2_MAGIC;
+	h.version = XMP2_VERSION;
+	h.header = header;
+	int cellsSize = data_length * sizeof (unsigned short);
+	int transportSize = cellsSize * 3;
+	h.cellsOffset = (sizeof h + XMP2_ALIGNMENT - 1) & ~(XMP2_ALIGNMENT - 1);
+	h.transportOffset = (h.cellsOffset + cellsSize + XMP2_ALIGNMENT - 1) & ~(XMP2_ALIGNMENT - 1);
+
+	unsigned short* transport = new unsigned short[data_length * 3];
+	for (int i = 0; i < data_length * 3; i++)
+		transport[i] = _transport[i] & 0xff;
+	FILE* fp = fileSystem::createBinaryFile(filename);
+	if (fp == null) {
+		delete [] transport;
+		warningMessage("Couldn't create file: " + filename);
+		return false;
+	}
+	bool result = fwrite(&h, sizeof h, 1, fp) == 1 &&
+				  fwrite(padding, 1, h.cellsOffset - sizeof h, fp) == h.cellsOffset - sizeof h &&
+				  fwrite(_cells, 1, cellsSize, fp) == cellsSize &&
+				  fwrite(padding, 1, h.transportOffset - h.cellsOffset - cellsSize, fp) == h.transportOffset - h.cellsOffset - cellsSize &&
+				  fwrite(transport, 1, transportSize, fp) == transportSize;
+	fclose(fp);
+	delete [] transport;
+	if (!result)
+		warningMessage("Write error on file: " + filename);
+	return result;
+}
+
 void HexMap::mergeElev(const string& filename, int lowThreshold, int middleThreshold, int highThreshold) {
 	BitMap* b = loadBitMap(filename);
 	xpoint hx;
@@ -1094,28 +1275,28 @@ void HexMap::setCell(xpoint hx, int index) {
 		if (!valid(hx))
 			return;
 
-		Hex& h = hex(hx);
-		h.data &= ~0xff;
-		h.data |= index;
+		unsigned short& c = _cells[this->index(hx)];
+		c &= ~0xff;
+		c |= index;
+		refreshEdgeCosts(hx);
     }
 
 void HexMap::setFeature(xpoint hx, ui::Feature* f) {
 	if (!valid(hx))
 		return;
 
-	Hex& h = hex(hx);
-	h.features = f;
+	_features[index(hx)] = f;
 }
 
 void HexMap::addFeature(xpoint hx, ui::Feature* f) {
 	if (!valid(hx))
 		return;
 
-	Hex& h = hex(hx);
-	if (h.features != null)
-		h.features->insert(f);
+	ui::Feature*& features = _features[index(hx)];
+	if (features != null)
+		features->insert(f);
 	else
-		h.features = f;
+		features = f;
 }
 
 void HexMap::hideFeature(xpoint p, ui::Feature *f) {
@@ -1145,8 +1326,7 @@ int HexMap::getVictoryPoints(xpoint hex) {
 ui::PlaceFeature* HexMap::getPlace(xpoint hx) {
 	if (!valid(hx))
 		return null;
-	Hex& h = hex(hx);
-	ui::Feature* fbase = h.features;
+	ui::Feature* fbase = _features[index(hx)];
 	if (fbase == null)
 		return null;
 	ui::Feature* fx = fbase;
@@ -1162,8 +1342,7 @@ ui::PlaceFeature* HexMap::getPlace(xpoint hx) {
 float HexMap::getFortification(xpoint hx) {
 	if (!valid(hx))
 		return 0;
-	Hex& h = hex(hx);
-	ui::Feature* fbase = h.features;
+	ui::Feature* fbase = _features[index(hx)];
 	if (fbase == null)
 		return 0;
 	ui::Feature* fx = fbase;
@@ -1179,14 +1358,13 @@ float HexMap::getFortification(xpoint hx) {
 void HexMap::setFortification(xpoint hx, float level) {
 	if (!valid(hx))
 		return;
-	Hex& h = hex(hx);
-	ui::Feature* fbase = h.features;
+	ui::Feature* fbase = _features[index(hx)];
 
 		// No features at all, make one
 
 	if (fbase == null){
 		if (level > 0)
-			h.features = new ui::FortificationFeature(this, level);
+			_features[index(hx)] = new ui::FortificationFeature(this, level);
 		return;
 	}
 
@@ -1220,18 +1398,7 @@ TransFeatures HexMap::getTransportEdge(xpoint hx, int e) {
 	if (!valid(hx))
 		return TF_NONE;
 
-	Hex& h = hex(hx);
-	ui::Feature* fbase = h.features;
-	if (fbase == null)
-		return TF_NONE;
-	ui::Feature* fx = fbase;
-	do {
-		if (fx->featureClass() == ui::FC_TRANSPORT){
-			return ((ui::TransportFeature*)fx)->edge(e);
-		}
-		fx = fx->next();
-	} while (fx != fbase);
-	return TF_NONE;
+	return TransFeatures(_transport[index(hx) * 3 + e]);
 }
 
 void HexMap::setTransportEdge(xpoint hx, int e, TransFeatures f) {
@@ -1239,10 +1406,14 @@ void HexMap::setTransportEdge(xpoint hx, int e, TransFeatures f) {
 	if (!valid(hx))
 		return;
 
-	Hex& h = hex(hx);
-	ui::Feature* fbase = h.features;
+	int i = index(hx);
+	if ((_transport[i * 3 + e] | f) != _transport[i * 3 + e]) {
+		_transport[i * 3 + e] |= f;
+		refreshEdgeCosts(hx);
+	}
+	ui::Feature* fbase = _features[i];
 	if (fbase == null) {
-		h.features = new ui::TransportFeature(this, e, f);
+		_features[i] = new ui::TransportFeature(this, e, f);
 		return;
 	}
 
@@ -1265,8 +1436,12 @@ void HexMap::clearTransportEdge(xpoint hx, int e, TransFeatures f) {
 	if (!valid(hx))
 		return;
 
-	Hex& h = hex(hx);
-	ui::Feature* fbase = h.features;
+	int i = index(hx);
+	if ((_transport[i * 3 + e] & f) != 0) {
+		_transport[i * 3 + e] &= ~f;
+		refreshEdgeCosts(hx);
+	}
+	ui::Feature* fbase = _features[i];
 	if (fbase == null)
 		return;
 
@@ -1289,15 +1464,14 @@ void HexMap::createDefaultBridges(const Theater* theater) {
 
 	for (hx.x = _subsetOrigin.x; hx.x < _subsetOpposite.x; hx.x++)
 		for (hx.y = _subsetOrigin.y; hx.y < _subsetOpposite.y; hx.y++) {
-			Hex& h = hex(hx);
-			int c = h.occupier;
+			int c = _occupier[index(hx)];
 			for (HexDirection dir = 0; dir < 3; dir++){
 				TransFeatures tf = getTransportEdge(hx, HexDirection(dir));
 				if (tf & (TF_RAIL|TF_ROAD|TF_PAVED|TF_FREEWAY)){
 					EdgeValues e = edgeCrossing(hx, dir);
 					if (e > EDGE_BORDER){
 						setTransportEdge(hx, HexDirection(dir), TransFeatures(tf | TF_BRIDGE));
-						int c2 = hex(neighbor(hx, HexDirection(dir))).occupier;
+						int c2 = _occupier[index(neighbor(hx, HexDirection(dir)))];
 						if (theater->combatants[c] &&
 							theater->combatants[c2] &&
 							theater->combatants[c]->force != theater->combatants[c2]->force)
@@ -1316,30 +1490,30 @@ void HexMap::setEdge(xpoint hx, int e, EdgeValues ve) {
 	int v = int(ve);
 	int mask = 3 << (8 + e * 2);
 	v <<= (8 + e * 2);
-	Hex& h = hex(hx);
-	h.data &= ~mask;
-	h.data |= v;
+	unsigned short& c = _cells[index(hx)];
+	c &= ~mask;
+	c |= v;
+	refreshZoc(hx);
+	refreshNeighbors(hx);
+	refreshEdgeCosts(hx);
 }
 
 int HexMap::getCell(xpoint hx) {
 	if (!valid(hx))
 		return NOT_IN_PLAY;
-	Hex& h = hex(hx);
-	return h.data & 0xff;
+	return _cells[index(hx)] & 0xff;
 }
 
 ui::Feature* HexMap::getFeature(xpoint hx) {
 	if (!valid(hx))
 		return null;
-	Hex& h = hex(hx);
-	return h.features;
+	return _features[index(hx)];
 }
 
 EdgeValues HexMap::getEdge(xpoint hx, int e) {
 	if (!valid(hx))
 		return EDGE_ERROR;
-	Hex& h = hex(hx);
-	int x = h.data;
+	int x = _cells[index(hx)];
 	x >>= 8 + e * 2;
 	return EdgeValues(x & 03);
 }
@@ -1350,21 +1524,21 @@ float HexMap::getDefense(xpoint hx) {
 
 Detachment* HexMap::getDetachments(xpoint hx) {
 	if (valid(hx))
-		return hex(hx).detachments;
+		return _detachments[index(hx)];
 	else
 		return null;
 }
 
 Combat* HexMap::combat(xpoint hx) const {
 	if (valid(hx))
-		return hex(hx).combat;
+		return _combat[index(hx)];
 	else
 		return null;
 }
 
 void HexMap::set_combat(xpoint hx, Combat* combat) {
 	if (valid(hx))
-		hex(hx).combat = combat;
+		_combat[index(hx)] = combat;
 }
 
 /*
@@ -1375,15 +1549,11 @@ void HexMap::set_combat(xpoint hx, Combat* combat) {
  *	given.
  */
 bool HexMap::enemyZoc(Force* force, xpoint hx) {
-	for (HexDirection i = 0; i < 6; i++) {
-		EdgeValues e = edgeCrossing(hx, i);
-		if (e == EDGE_COAST)
-			continue;
-		Detachment* d = getDetachments(neighbor(hx, i));
-		if (d != null && d->unit->opposes(force) && d->exertsZOC())
-			return true;
-	}
-	return false;
+	if (valid(hx))
+		return (_zoc[index(hx)] & (1 << force->index)) != 0;
+	byte zoc, contact;
+	scanNeighbors(hx, &zoc, &contact);
+	return (zoc & (1 << force->index)) != 0;
 }
 /*
  *	FUNCTION:	enemyContact
@@ -1393,15 +1563,273 @@ bool HexMap::enemyZoc(Force* force, xpoint hx) {
  *	given.
  */
 bool HexMap::enemyContact(Force* force, xpoint hx) {
+	if (valid(hx))
+		return (_contact[index(hx)] & (1 << force->index)) != 0;
+	byte zoc, contact;
+	scanNeighbors(hx, &zoc, &contact);
+	return (contact & (1 << force->index)) != 0;
+}
+
+const int IMPASSABLE_EDGE = MAXIMUM_PATH_LENGTH + 1;
+
+	// Moves the terrain key leaves at its default speed cost hundreds
+	// of thousands of minutes, so the tables hold full ints; only the
+	// impassable costs are folded into one value.
+
+static int packEdgeCost(int c) {
+	if (c > MAXIMUM_PATH_LENGTH)
+		return IMPASSABLE_EDGE;
+	else
+		return c;
+}
+
+int HexMap::edgeCost(xpoint hx, HexDirection dir, UnitCarriers carriers, MoveManner moveManner, bool useRoads) {
+	if (!valid(hx) || carriers < UC_MINCARRIER) {
+		float f;
+		return terrainMoveCost(this, hx, dir, neighbor(hx, dir), carriers, moveManner, useRoads, &f);
+	}
+	EdgeCosts* ec = edgeCosts(carriers, moveManner);
+	int i = index(hx) * 6 + dir;
+	return useRoads ? ec->roads[i] : ec->offRoad[i];
+}
+
+void HexMap::prepareEdgeCosts(UnitCarriers carriers, MoveManner moveManner) {
+	if (carriers >= UC_MINCARRIER) {
+		edgeCosts(carriers, moveManner);
+		landmarks(carriers, moveManner);
+		if (carriers == UC_RAIL || moveManner == MM_RAIL)
+			railNetwork();
+	}
+}
+
+Landmarks* HexMap::landmarks(UnitCarriers carriers, MoveManner moveManner) {
+	if (global::landmarkCount <= 0 || carriers < UC_MINCARRIER)
+		return null;
+	EdgeCosts* ec = edgeCosts(carriers, moveManner);
+	if (ec->landmarks == null) {
+
+			// Unlike the edge cost table, the index is not built under a
+			// lock, so a search on a worker thread must never get here.
+
+		if (runningParallel())
+			fatalMessage("Landmark index built during a parallel task, call prepareEdgeCosts first");
+		ec->landmarks = new Landmarks(this);
+		xpoint hx;
+		for (hx.y = _subsetOrigin.y; hx.y < _subsetOpposite.y; hx.y++)
+			for (hx.x = _subsetOrigin.x; hx.x < _subsetOpposite.x; hx.x++)
+				for (HexDirection dir = 0; dir < 6; dir++) {
+					int i = index(hx) * 6 + dir;
+					int c = ec->roads[i];
+					int o = ec->offRoad[i];
+					ec->landmarks->lower(hx, dir, c < o ? c : o);
+				}
+
+			// Only the tables for the map as it was loaded go in the
+			// file, not those rebuilt after changes made in play.
+
+		if (carriers == UC_RAIL)
+			moveManner = MM_RAIL;
+		string file;
+		if (filename.size() > 0)
+			file = cacheFilename(filename, string(".") + int(moveManner) + "." + int(carriers) + ".alt");
+		ec->landmarks->build(global::landmarkCount, file);
+	}
+	return ec->landmarks;
+}
+
+void HexMap::refreshLandmarks() {
+	for (int m = 0; m < dimOf(_edgeCosts); m++)
+		for (int c = 0; c < UC_MAXCARRIER; c++) {
+			EdgeCosts* ec = _edgeCosts[m][c];
+			if (ec != null && ec->landmarks != null && ec->landmarks->stale())
+				ec->landmarks->build(global::landmarkCount, string());
+		}
+}
+
+ClusterMap* HexMap::clusters(UnitCarriers carriers, MoveManner moveManner) {
+	if (global::hierarchicalPathDistance <= 0 || carriers < UC_MINCARRIER)
+		return null;
+	EdgeCosts* ec = edgeCosts(carriers, moveManner);
+	if (ec->clusters == null)
+		ec->clusters = new ClusterMap(this, carriers, moveManner);
+	return ec->clusters;
+}
+
+RailNetwork* HexMap::railNetwork() {
+	if (!global::railNetworkPaths)
+		return null;
+
+		// Rail moves cost the same whatever the carrier, so one network,
+		// kept with the table for rail carriers, serves them all.
+
+	EdgeCosts* ec = edgeCosts(UC_RAIL, MM_RAIL);
+	if (ec->rails == null)
+		ec->rails = new RailNetwork(this);
+	else
+		ec->rails->update();
+	return ec->rails;
+}
+
+int HexMap::minimumEdgeCost(UnitCarriers carriers, MoveManner moveManner) {
+	if (carriers < UC_MINCARRIER)
+		return 0;
+	EdgeCosts* ec = edgeCosts(carriers, moveManner);
+	if (ec->minimum == IMPASSABLE_EDGE)
+		return 0;
+	return ec->minimum;
+}
+
+void HexMap::invalidateEdgeCosts() {
+	for (int m = 0; m < dimOf(_edgeCosts); m++)
+		for (int c = 0; c < UC_MAXCARRIER; c++) {
+			EdgeCosts* ec = _edgeCosts[m][c];
+			if (ec == null)
+				continue;
+			if (ec->offRoad != ec->roads)
+				delete [] ec->offRoad;
+			delete [] ec->roads;
+			delete ec->landmarks;
+			delete ec->clusters;
+			delete ec->rails;
+			delete ec;
+			_edgeCosts[m][c] = null;
+		}
+}
+
+HexMap::EdgeCosts* HexMap::edgeCosts(UnitCarriers carriers, MoveManner moveManner) {
+	if (carriers == UC_RAIL)
+		moveManner = MM_RAIL;
+	EdgeCosts* ec = _edgeCosts[moveManner][carriers];
+	if (ec != null)
+		return ec;
+
+		// Searches running on worker threads may all ask for a new
+		// table at once.  Only one of them builds it, and the table is
+		// only stored where the others can see it once it is complete.
+
+	_edgeCostLock.lock();
+	ec = _edgeCosts[moveManner][carriers];
+	if (ec != null) {
+		_edgeCostLock.unlock();
+		return ec;
+	}
+	ec = new EdgeCosts;
+	int length = _allocatedRows * _rowSize * 6;
+	ec->roads = new int[length];
+
+		// Only these manners of movement take roads, so the others
+		// need just one table.
+
+	if (moveManner == MM_ROAD || moveManner == MM_BEST)
+		ec->offRoad = new int[length];
+	else
+		ec->offRoad = ec->roads;
+	ec->minimum = IMPASSABLE_EDGE;
+	ec->landmarks = null;
+	ec->clusters = null;
+	ec->rails = null;
+	xpoint hx;
+	for (hx.y = _subsetOrigin.y; hx.y < _subsetOpposite.y; hx.y++)
+		for (hx.x = _subsetOrigin.x; hx.x < _subsetOpposite.x; hx.x++)
+			for (HexDirection dir = 0; dir < 6; dir++)
+				computeEdgeCost(ec, carriers, moveManner, hx, dir);
+	_edgeCosts[moveManner][carriers] = ec;
+	_edgeCostLock.unlock();
+	return ec;
+}
+
+void HexMap::computeEdgeCost(EdgeCosts* ec, UnitCarriers carriers, MoveManner moveManner, xpoint hx, HexDirection dir) {
+	float f;
+	xpoint b = neighbor(hx, dir);
+	int i = index(hx) * 6 + dir;
+	ec->roads[i] = packEdgeCost(terrainMoveCost(this, hx, dir, b, carriers, moveManner, true, &f));
+	if (ec->offRoad != ec->roads)
+		ec->offRoad[i] = packEdgeCost(terrainMoveCost(this, hx, dir, b, carriers, moveManner, false, &f));
+
+		// The minimum is never raised when a cost goes up, so after
+		// map edits it may be lower than it needs to be, but never higher.
+
+	if (ec->roads[i] < ec->minimum)
+		ec->minimum = ec->roads[i];
+	if (ec->offRoad[i] < ec->minimum)
+		ec->minimum = ec->offRoad[i];
+	if (ec->landmarks != null) {
+		int c = ec->roads[i];
+		int o = ec->offRoad[i];
+		ec->landmarks->lower(hx, dir, c < o ? c : o);
+	}
+	if (ec->clusters != null)
+		ec->clusters->changed(hx, dir);
+	if (ec->rails != null)
+		ec->rails->changed(hx, dir);
+}
+/*
+ *	FUNCTION:	refreshEdgeCosts
+ *
+ *	Recomputes, in every table that has been built, the costs of the
+ *	moves out of and into hx.  That covers a change to the terrain in
+ *	hx and to any of its edges.
+ */
+void HexMap::refreshEdgeCosts(xpoint hx) {
+	for (int m = 0; m < dimOf(_edgeCosts); m++)
+		for (int c = 0; c < UC_MAXCARRIER; c++) {
+			EdgeCosts* ec = _edgeCosts[m][c];
+			if (ec == null)
+				continue;
+			for (HexDirection dir = 0; dir < 6; dir++) {
+				if (valid(hx))
+					computeEdgeCost(ec, UnitCarriers(c), MoveManner(m), hx, dir);
+				xpoint n = neighbor(hx, dir);
+				if (valid(n))
+					computeEdgeCost(ec, UnitCarriers(c), MoveManner(m), n, reverseDirection(dir));
+			}
+		}
+	situationChanged.fire(hx);
+}
+
+void HexMap::zocChanged(Detachment* d) {
+	if (getDetachments(d->location()) == d)
+		refreshNeighbors(d->location());
+	situationChanged.fire(d->location());
+}
+/*
+ *	FUNCTION:	refreshNeighbors
+ *
+ *	Only the first detachment in a hex counts toward the ZOC and
+ *	contact bits of its neighbors, so whenever that detachment
+ *	changes, or it changes whether it exerts a ZOC, the neighbors
+ *	are recalculated.
+ */
+void HexMap::refreshNeighbors(xpoint hx) {
+	for (HexDirection i = 0; i < 6; i++)
+		refreshZoc(neighbor(hx, i));
+}
+
+void HexMap::refreshZoc(xpoint hx) {
+	if (!valid(hx))
+		return;
+	int i = index(hx);
+	scanNeighbors(hx, &_zoc[i], &_contact[i]);
+}
+
+void HexMap::scanNeighbors(xpoint hx, byte* zoc, byte* contact) {
+	*zoc = 0;
+	*contact = 0;
 	for (HexDirection i = 0; i < 6; i++) {
 		EdgeValues e = edgeCrossing(hx, i);
 		if (e == EDGE_COAST)
 			continue;
 		Detachment* d = getDetachments(neighbor(hx, i));
-		if (d != null && d->unit->opposes(force))
-			return true;
+		if (d == null)
+			continue;
+		byte enemies = (1 << NFORCES) - 1;
+		Force* force = d->unit->combatant()->force;
+		if (force != null)
+			enemies &= ~(1 << force->index);
+		*contact |= enemies;
+		if (d->exertsZOC())
+			*zoc |= enemies;
 	}
-	return false;
 }
 /*
  *	FUNCTION: isFriendly
@@ -1422,50 +1850,59 @@ bool HexMap::attackingFrom(xpoint loc1, xpoint loc2) {
 
 void HexMap::remove(Detachment* detachment) {
 	Detachment* prev = null;
-	Hex& h = hex(detachment->location());
-	for (Detachment* d = h.detachments; d != null; prev = d, d = d->next)
+	Detachment*& detachments = _detachments[index(detachment->location())];
+	for (Detachment* d = detachments; d != null; prev = d, d = d->next)
 		if (d == detachment){
 			if (prev == null)
-				h.detachments = d->next;
+				detachments = d->next;
 			else
 				prev->next = d->next;
+			if (prev == null)
+				refreshNeighbors(detachment->location());
+			situationChanged.fire(detachment->location());
 			break;
 		}
 }
 
 void HexMap::place(Detachment* d) {
 	d->next = null;
-	Hex& h = hex(d->location());
-	if (h.detachments == null)
-		h.detachments = d;
-	else {
-		for (Detachment* dd = h.detachments; ; dd = dd->next) {
+	Detachment*& detachments = _detachments[index(d->location())];
+	if (detachments == null) {
+		detachments = d;
+		refreshNeighbors(d->location());
+	} else {
+		for (Detachment* dd = detachments; ; dd = dd->next) {
 			if (dd->next == null) {
 				dd->next = d;
 				break;
 			}
 		}
 	}
+	situationChanged.fire(d->location());
 }
 
 void HexMap::placeOnTop(Detachment* d) {
-	Hex& h = hex(d->location());
-	d->next = h.detachments;
-	h.detachments = d;
+	Detachment*& detachments = _detachments[index(d->location())];
+	d->next = detachments;
+	detachments = d;
+	refreshNeighbors(d->location());
+	situationChanged.fire(d->location());
 }
 
 void HexMap::setOccupier(xpoint hx, int index) {
 	if (!valid(hx))
 		return;
-	Hex& h = hex(hx);
-	h.occupier = index;
+	int i = this->index(hx);
+	if (_occupier[i] != index) {
+		_occupier[i] = index;
+		situationChanged.fire(hx);
+	}
 }
 
 int HexMap::getOccupier(xpoint hx) {
 	if (!valid(hx))
 		return 0;
-	Hex& h = hex(hx);
-	return h.occupier;
+	return _occupier[index(hx)];
 }
 
 float HexMap::getDensity(xpoint hx) {
@@ -1799,6 +2236,41 @@ void normalize(xpoint* hx, int* edge) {
 	}
 }
 
+/*
+ *	compiledFilename
+ *
+ *	The name of the .xmp2 file that load keeps in global::mapCacheFolder
+ *	for an .xmp file, or an empty string if filename is not an .xmp
+ *	file or there is no cache folder.
+ */
+static string compiledFilename(const string& filename) {
+	if (!filename.endsWith(".xmp"))
+		return string();
+	return cacheFilename(filename, ".xmp2");
+}
+/*
+ *	cacheFilename
+ *
+ *	The name of a file derived from filename, ending with suffix, in
+ *	global::mapCacheFolder, or an empty string if there is no cache
+ *	folder.  The name carries a hash of the full path, so maps of the
+ *	same name in different folders do not share a file.
+ */
+static string cacheFilename(const string& filename, const string& suffix) {
+	if (global::mapCacheFolder.size() == 0)
+		return string();
+	string path = fileSystem::absolutePath(filename);
+	unsigned h = 2166136261;
+	for (int i = 0; i < path.size(); i++) {
+		h ^= (unsigned char)path.c_str()[i];
+		h *= 16777619;
+	}
+	int slash = filename.size();
+	while (slash > 0 && filename.c_str()[slash - 1] != '/' && filename.c_str()[slash - 1] != '\\')
+		slash--;
+	return global::mapCacheFolder + "/" + filename.substr(slash) + "." + int(h & 0x7fffffff) + suffix;
+}
+
 HexMap* loadHexMap(const string& filename, const string& placesFile, const string& terrainKeyFile) {
 	static dictionary<HexMap*> maps;
 
@@ -5,6 +5,7 @@
 #include "../display/measurement.h"
 #include "basic_types.h"
 #include "constants.h"
+#include "parallel.h"
 
 namespace display {
 
@@ -22,11 +23,15 @@ class PlaceFeature;
 
 namespace engine {
 
+class ClusterMap;
 class Combat;
 class Detachment;
 class Force;
 class HexMap;
+class Landmarks;
+class MappedFile;
 class ParcMap;
+class RailNetwork;
 class PlaceDot;
 class TerrainKeyItem;
 class Theater;
@@ -423,6 +428,15 @@ public:
 	}
  */
     bool save();
+	/*
+	 *	saveXmp2
+	 *
+	 *	Writes the map in the .xmp2 format, which load can map straight
+	 *	into memory.  When global::mapCacheFolder is set and a legacy
+	 *	.xmp map is loaded with no up to date .xmp2 file for it in that
+	 *	folder, load calls this to make one.
+	 */
+	bool saveXmp2(const string& filename);
 
 	void mergeElev(const string& filename, int lowThreshold, int middleThreshold, int highThreshold);
 
@@ -507,11 +521,99 @@ public:
 	/*
 	 *	FUNCTION:	enemyContact
 	 *
-	 *	This function returns true if the hex in question is in an enemy
-	 *	zone of control.  Where the enemy is any other force than the one
+	 *	This function returns true if the hex in question is adjacent to an enemy
+	 *	unit.  Where the enemy is any other force than the one
 	 *	given.
 	 */
 	bool enemyContact(Force* force, xpoint hx);
+	/*
+	 *	FUNCTION:	zocChanged
+	 *
+	 *	This function must be called when the answer to exertsZOC
+	 *	may have changed for a detachment on the map.  Placing and
+	 *	removing detachments keeps the ZOC bits current on its own.
+	 */
+	void zocChanged(Detachment* d);
+	/*
+	 *	FUNCTION:	edgeCost
+	 *
+	 *	This function returns terrainMoveCost for the move from hx across
+	 *	the given edge, taken from a table kept for each carrier and manner
+	 *	of movement.  A table is built the first time it is asked for and
+	 *	kept current as the map is edited.  Searches running in parallel
+	 *	may ask for the same new table at once; one thread builds it while
+	 *	the others wait.
+	 */
+	int edgeCost(xpoint hx, HexDirection dir, UnitCarriers carriers, MoveManner moveManner, bool useRoads);
+	/*
+	 *	FUNCTION:	prepareEdgeCosts
+	 *
+	 *	Builds the edge cost table, and the landmark index if one is
+	 *	wanted, for the carrier and manner of movement if they are not
+	 *	built and current yet.  For rail movement, the rail network is
+	 *	brought up to date too.  The edge cost table itself can safely be
+	 *	built from a worker thread, but the landmark index and the rail
+	 *	network cannot, so call this before any searches that use them
+	 *	run in parallel.
+	 */
+	void prepareEdgeCosts(UnitCarriers carriers, MoveManner moveManner);
+	/*
+	 *	FUNCTION:	invalidateEdgeCosts
+	 *
+	 *	Throws away all the edge cost tables.  This must be called if
+	 *	anything terrainMoveCost uses, other than the map itself, changes.
+	 */
+	void invalidateEdgeCosts();
+	/*
+	 *	FUNCTION:	minimumEdgeCost
+	 *
+	 *	This function returns a cost no more than that of any move in
+	 *	the edge cost table for the carrier and manner of movement, so
+	 *	path searches can use it to estimate the cost of the moves
+	 *	still ahead of them.
+	 */
+	int minimumEdgeCost(UnitCarriers carriers, MoveManner moveManner);
+	/*
+	 *	FUNCTION:	landmarks
+	 *
+	 *	This function returns the landmark index for the edge cost
+	 *	table of the carrier and manner of movement, or null if
+	 *	global::landmarkCount is zero.  The index is built, or read
+	 *	from global::mapCacheFolder, the first time it is asked for.
+	 *	That must not happen inside runParallel, so prepareEdgeCosts
+	 *	does it first for searches that will run in parallel.
+	 *
+	 *	An index that has gone stale is left for refreshLandmarks to
+	 *	rebuild; until then it gives no bound and searches fall back
+	 *	on their plain estimates.
+	 */
+	Landmarks* landmarks(UnitCarriers carriers, MoveManner moveManner);
+	/*
+	 *	FUNCTION:	refreshLandmarks
+	 *
+	 *	Rebuilds every landmark index that has gone stale.  The game
+	 *	calls this at the start of each day, so the tours it takes are
+	 *	never made in the middle of a search.
+	 */
+	void refreshLandmarks();
+	/*
+	 *	FUNCTION:	clusters
+	 *
+	 *	This function returns the cluster map used to plan long marches
+	 *	for the carrier and manner of movement, or null if
+	 *	global::hierarchicalPathDistance is zero.  The clusters are
+	 *	built as plans need them.
+	 */
+	ClusterMap* clusters(UnitCarriers carriers, MoveManner moveManner);
+	/*
+	 *	FUNCTION:	railNetwork
+	 *
+	 *	This function returns the graph of the map's open rail lines,
+	 *	or null if global::railNetworkPaths is not set.  It is built
+	 *	the first time it is asked for, and brought up to date with
+	 *	any rails cut, clogged or repaired since the last call.
+	 */
+	RailNetwork* railNetwork();
 	/*
 	 *	FUNCTION: isFriendly
 	 *
@@ -556,27 +658,78 @@ public:
 	TerrainKey		terrainKey;
 
 	Event1<xpoint>	changed;
+	/*
+	 *	situationChanged
+	 *
+	 *	Fired when something the movement costs or the lines between the
+	 *	forces depend on changes in a hex: the detachments in it and what
+	 *	they are doing, who occupies it, or its terrain and transport.
+	 *	changed is for repainting; this is for code that keeps its own
+	 *	analysis of the map, such as the AI.
+	 */
+	Event1<xpoint>	situationChanged;
 
 	xpoint subsetOrigin() const { return _subsetOrigin; }
 	xpoint subsetOpposite() const { return _subsetOpposite; }
 
 private:
-	class Hex {
+	bool loadLegacy();
+
+	bool loadMapped(const string& filename);
+
+	void adoptHeader();
+
+	void applyTransport();
+
+	void allocatePlanes(int length);
+
+	void freePlanes();
+
+	void detachMapping();
+
+	void refreshNeighbors(xpoint hx);
+
+	void refreshZoc(xpoint hx);
+
+	void scanNeighbors(xpoint hx, byte* zoc, byte* contact);
+
+	class EdgeCosts {
 	public:
-		unsigned		data;
-		byte			occupier;				// Combatant who formally occupies this hex.
-		ui::Feature*	features;
-		Detachment*		detachments;
-		Combat*			combat;
+		int*			roads;				// Six per hex, for a unit free to use roads
+		int*			offRoad;			// Six per hex, may be the same as roads
+		int				minimum;			// No more than any cost in either table
+		Landmarks*		landmarks;			// null until asked for
+		ClusterMap*		clusters;			// null until asked for
+		RailNetwork*	rails;				// null until asked for, and only in the rail table
 	};
 
-	Hex& hex(xpoint hx) const { return _hexes[hx.y * _rowSize + hx.x]; }
+	EdgeCosts* edgeCosts(UnitCarriers carriers, MoveManner moveManner);
+
+	void computeEdgeCost(EdgeCosts* ec, UnitCarriers carriers, MoveManner moveManner, xpoint hx, HexDirection dir);
+
+	void refreshEdgeCosts(xpoint hx);
+
+	int index(xpoint hx) const { return hx.y * _rowSize + hx.x; }
 
 	int				_rowSize;
 	int				_allocatedRows;
 
-	// Both of the following are arrays rowSize by allocatedRows big.
-	Hex*			_hexes;
+	// Each of the following is an array rowSize by allocatedRows big.
+	// The hex data is split into planes so that path finding, which
+	// mostly reads cells, edges and transport, touches as little
+	// memory as possible.
+	unsigned short*	_cells;					// Terrain in the low byte, edges above, as stored in the file
+	unsigned short*	_transport;				// Three TransFeatures per hex, copied from the hex's TransportFeature
+	byte*			_occupier;				// Combatant who formally occupies this hex.
+	byte*			_zoc;					// Bit per force index, set if an enemy of that force exerts a ZOC here
+	byte*			_contact;				// Bit per force index, set if an enemy of that force is adjacent
+	ui::Feature**	_features;
+	Detachment**	_detachments;
+	Combat**		_combat;
+	MappedFile*		_mapping;				// If not null, _cells and _transport point into it
+	EdgeCosts* volatile	_edgeCosts[MM_CROSS_COUNTRY + 1][UC_MAXCARRIER];	// Stored only once built
+	SpinLock		_edgeCostLock;			// Held while a table is built
+
 	xpoint			_subsetOrigin;
 	xpoint			_subsetOpposite;
 };
@@ -0,0 +1,135 @@
+#include "../common/platform.h"
+#include "game_time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace engine {
+//
+// Game times count minutes from 1/1/1601, the same origin that
+// the Windows FILETIME uses, so saved games and scenario dates
+// written by earlier versions still mean the same thing.  The
+// calendar arithmetic is done here so the engine does not need
+// the Win32 date functions.
+//
+static const int daysTo1970 = 134774;		// 1/1/1601 through 12/31/1969
+
+static int daysFromCivil(int y, int m, int d) {
+	if (m <= 2)
+		y--;
+	int era = (y >= 0 ? y : y - 399) / 400;
+	int yoe = y - era * 400;
+	int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468 + daysTo1970;
+}
+
+static void civilFromDays(int z, int* y, int* m, int* d) {
+	z += 719468 - daysTo1970;
+	int era = (z >= 0 ? z : z - 146096) / 146097;
+	int doe = z - era * 146097;
+	int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	int mp = (5 * doy + 2) / 153;
+	*d = doy - (153 * mp + 2) / 5 + 1;
+	*m = mp < 10 ? mp + 3 : mp - 9;
+	*y = yoe + era * 400 + (*m <= 2);
+}
+/*
+ *	parseDate
+ *
+ *	Accepts dates of the form month/day/year.  Two digit years
+ *	are taken to be in the 1900's.
+ */
+static bool parseDate(const string& s, int* y, int* m, int* d) {
+	int fields[3];
+	const char* cp = s.c_str();
+	for (int i = 0; i < 3; i++) {
+		if (*cp < '0' || *cp > '9')
+			return false;
+		char* end;
+		fields[i] = strtol(cp, &end, 10);
+		cp = end;
+		if (i < 2) {
+			if (*cp != '/')
+				return false;
+			cp++;
+		}
+	}
+	if (*cp != 0)
+		return false;
+	*m = fields[0];
+	*d = fields[1];
+	*y = fields[2];
+	if (*y < 100)
+		*y += 1900;
+	if (*m < 1 || *m > 12 || *d < 1 || *d > 31)
+		return false;
+	return true;
+}
+
+minutes toGameDate(const string& s) {
+	if (s.size() == 0)
+		return 0;
+
+	int y, m, d;
+
+	if (!parseDate(s, &y, &m, &d))
+		fatalMessage("Bad time string: " + s);
+	return minutes(daysFromCivil(y, m, d)) * oneDay;
+}
+
+minutes toGameTime(const string& s) {
+	if (s.size() == 0)
+		return 0;
+
+		// The Win32 conversion this replaced was handed an hour and
+		// minute with no date, which it rejects, so every time of day
+		// has always come back as 0.  Scenarios and saved games depend
+		// on that, so it is kept.
+
+	return 0;
+}
+
+minutes toGameElapsed(const string& s) {
+	if (s.endsWith(" days")) {
+		int i = atoi(s.c_str());
+		return i * engine::oneDay;
+	} else if (s.endsWith(" hours")) {
+		int i = atoi(s.c_str());
+		return i * engine::oneHour;
+	} else
+		return toGameTime(s);
+}
+
+string fromGameDate(minutes m) {
+	if (m == 0)
+		return "";
+
+	int y, mon, d;
+	civilFromDays(int(m / oneDay), &y, &mon, &d);
+	if (y > 1900 && y < 1999)
+		y -= 1900;
+	return string(mon) + "/" + d + "/" + y;
+}
+
+string fromGameTime(minutes m) {
+	if (m == 0)
+		return "";
+
+	int t = int(m % oneDay);
+	char buffer[10];
+	sprintf(buffer, "%02d:%02d", t / oneHour, t % oneHour);
+	return buffer;
+}
+
+string fromGameMonthDay(minutes m) {
+	if (m == 0)
+		return "";
+
+	int y, mon, d;
+	civilFromDays(int(m / oneDay), &y, &mon, &d);
+	return string(mon) + "/" + d;
+}
+
+}  // namespace engine
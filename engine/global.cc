@@ -9,6 +9,7 @@ namespace global {
 
 string binFolder;
 string userFolder;
+string mapCacheFolder;
 string dataFolder;
 void (*reportError)(const string& filename, const string& explanation, script::fileOffset_t location);
 display::Annotation* (*reportInfo)(const string& filename, const string& info, script::fileOffset_t location);
@@ -33,11 +34,20 @@ string initialPlace;
 string aiForces;
 string rotation;
 engine::OOBSort oobSortOrder;
+int workerThreads = 0;
+int bidirectionalPathDistance = 0;
+int landmarkCount = 0;
+int hierarchicalPathDistance = 0;
+bool railNetworkPaths = false;
 
 	// Game mechanics info
 
 bool playOneTurnOnly;
 bool reportDetailedStatistics;
+bool verifyAiThreat;
+string historyJournal;
+string autosaveFile;
+bool autosaveDeltas;
 
 	// Game system parameters
 
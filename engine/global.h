@@ -52,6 +52,16 @@ extern string userFolder;
  *	The root of the set of installed scenarios and related databases.
  */
 extern string dataFolder;
+/*
+ *	mapCacheFolder
+ *
+ *	If not empty, the folder where loading a legacy .xmp map keeps an
+ *	.xmp2 copy of it, to be memory mapped by later loads, and where
+ *	the landmark indexes of maps are kept (.alt files).  Empty (the
+ *	default) means maps are always read from their .xmp files, the
+ *	indexes are computed afresh in each run, and nothing is written.
+ */
+extern string mapCacheFolder;
 extern void (*reportError)(const string& filename, const string& explanation, script::fileOffset_t location);
 extern display::Annotation* (*reportInfo)(const string& filename, const string& info, script::fileOffset_t location);
 
@@ -72,11 +82,63 @@ extern string aiForces;
 extern string rotation;
 extern engine::OOBSort oobSortOrder;
 
+	// The number of threads the engine may use for parallel work,
+	// such as supply line searches.  Zero means one per processor.
+
+extern int workerThreads;
+
+	// Unit and straight line paths between hexes at least this far
+	// apart are searched from both ends at once.  Zero means never.
+
+extern int bidirectionalPathDistance;
+
+	// The number of landmarks (at most 16) in the index kept for each
+	// edge cost table to sharpen the estimates of unit and supply path
+	// searches.  Zero means no index is built.
+
+extern int landmarkCount;
+
+	// Unit paths between hexes at least this far apart are planned
+	// across the clusters of the map first, then found one cluster at
+	// a time.  Zero (the default) means never.  It is off because the
+	// paths found that way are near, not at, the cheapest, so turning
+	// it on changes the moves units make in every game; the "clusters"
+	// engine test measures how much dearer they come out.
+
+extern int hierarchicalPathDistance;
+
+	// Entrained moves are routed over the graph of the map's rail
+	// lines instead of searching the hexes.  Off by default until the
+	// "rails" engine test, which checks the routes against a search of
+	// the hexes, has passed on the scenario maps.
+
+extern bool railNetworkPaths;
+
 	// Game mechanics info
 
 extern bool playOneTurnOnly;
 extern bool reportDetailedStatistics;
 
+	// When set, the AI checks the picture of the map it keeps up to
+	// date against one built from scratch, each time it runs.
+
+extern bool verifyAiThreat;
+
+	// If not empty, each game keeps only its most recent events in
+	// memory and appends older ones to this journal file, tagged so
+	// that games sharing the file each read back only their own.
+	// If empty, the whole history stays in memory.
+
+extern string historyJournal;
+
+	// If not empty, the game is saved to this file at the end of each
+	// day of play.  When autosaveDeltas is set and the file is a .hsb
+	// snapshot, the first save also writes a full base snapshot beside
+	// it, and each save after that holds only the changes from the base.
+
+extern string autosaveFile;
+extern bool autosaveDeltas;
+
 	// Game system parameters
 
 	// This is the total AP strength per kilometer of front
@@ -0,0 +1,290 @@
+#include "../common/platform.h"
+#include "landmarks.h"
+
+#include <stdio.h>
+#include "../common/file_system.h"
+#include "game_map.h"
+#include "path.h"
+
+namespace engine {
+
+const int LANDMARK_MAGIC = ('H' << 24) + ('A' << 16) + ('L' << 8) + 'T';
+const int LANDMARK_VERSION = 1;
+/*
+ *	LandmarkHeader
+ *
+ *	A landmark file holds this header, then the landmarks, then the
+ *	from and to tables of each landmark in turn, rows * columns ints
+ *	each.  The signature covers the number of landmarks asked for,
+ *	the map subset and the weights the tables were computed for, so
+ *	a file left over from an edited map or terrain key is not used.
+ */
+struct LandmarkHeader {
+	int				magic;
+	int				version;
+	int				rows;
+	int				columns;
+	int				count;
+	unsigned		signature;
+};
+/*
+ *	LandmarkTour
+ *
+ *	Tours every hex a landmark can reach, or, if toward is set, every
+ *	hex that can reach the landmark, and records the distances.
+ */
+class LandmarkTour : public PathHeuristic {
+public:
+	LandmarkTour(const Landmarks* landmarks, int columns) {
+		_landmarks = landmarks;
+		_columns = columns;
+		distance = null;
+		toward = false;
+	}
+
+	virtual int kost(xpoint a, HexDirection dir, xpoint b) {
+
+			// Going toward the landmark, the tour spreads out from it,
+			// but the moves are made the other way, from b to a.
+
+		if (toward)
+			return _landmarks->weight(b, reverseDirection(dir));
+		else
+			return _landmarks->weight(a, dir);
+	}
+
+	virtual void reviewHex(HexMap* map, xpoint a, int gval) {
+		distance[a.y * _columns + a.x] = gval;
+	}
+
+	int*			distance;
+	bool			toward;
+
+private:
+	const Landmarks*	_landmarks;
+	int					_columns;
+};
+
+static void tour(HexMap* map, LandmarkTour* t, xpoint origin, int* distance, bool toward) {
+	int cells = map->getRows() * map->getColumns();
+	for (int i = 0; i < cells; i++)
+		distance[i] = LANDMARK_UNREACHED;
+	t->distance = distance;
+	t->toward = toward;
+	t->source = origin;
+	t->visitLimit = cells;
+	engine::visit(map, t, origin, MAXIMUM_PATH_LENGTH, SK_ORDER);
+	t->review(map);
+}
+
+Landmarks::Landmarks(HexMap* map) {
+	_map = map;
+	_rows = map->getRows();
+	_columns = map->getColumns();
+	int length = _rows * _columns * 6;
+	_weight = new int[length];
+	for (int i = 0; i < length; i++)
+		_weight[i] = MAXIMUM_PATH_LENGTH + 1;
+	_count = 0;
+	_stale = true;
+}
+
+Landmarks::~Landmarks() {
+	clear();
+	delete [] _weight;
+}
+
+void Landmarks::lower(xpoint hx, HexDirection dir, int cost) {
+	if (cost > MAXIMUM_PATH_LENGTH)
+		return;
+	int i = index(hx) * 6 + dir;
+	if (cost < _weight[i]) {
+		_weight[i] = cost;
+		_stale = true;
+	}
+}
+
+void Landmarks::build(int count, const string& filename) {
+	if (count > LANDMARK_MAX)
+		count = LANDMARK_MAX;
+	if (filename.size() > 0) {
+		unsigned s = signature(count);
+		if (!read(filename, s)) {
+			compute(count);
+			write(filename, s);
+		}
+	} else
+		compute(count);
+	_stale = false;
+}
+
+int Landmarks::estimate(xpoint a, xpoint b) const {
+	if (_stale)
+		return 0;
+	int ia = index(a);
+	int ib = index(b);
+	int best = 0;
+	for (int i = 0; i < _count; i++) {
+
+			// A path from a to b, added to the cheapest path from the
+			// landmark to a, is a path from the landmark to b, so it
+			// can be no cheaper than the difference.  The same goes for
+			// paths on to the landmark.
+
+		int fa = _from[i][ia];
+		int fb = _from[i][ib];
+		if (fa != LANDMARK_UNREACHED && fb != LANDMARK_UNREACHED && fb - fa > best)
+			best = fb - fa;
+		int ta = _to[i][ia];
+		int tb = _to[i][ib];
+		if (ta != LANDMARK_UNREACHED && tb != LANDMARK_UNREACHED && ta - tb > best)
+			best = ta - tb;
+	}
+	return best;
+}
+
+unsigned Landmarks::signature(int count) const {
+	unsigned h = 2166136261;
+	xpoint origin = _map->subsetOrigin();
+	xpoint opposite = _map->subsetOpposite();
+	int fields[5] = { count, origin.x, origin.y, opposite.x, opposite.y };
+	for (int i = 0; i < 5; i++) {
+		h ^= unsigned(fields[i]);
+		h *= 16777619;
+	}
+	xpoint hx;
+	for (hx.y = origin.y; hx.y < opposite.y; hx.y++)
+		for (hx.x = origin.x; hx.x < opposite.x; hx.x++)
+			for (HexDirection dir = 0; dir < 6; dir++) {
+				h ^= unsigned(weight(hx, dir));
+				h *= 16777619;
+			}
+	return h;
+}
+
+void Landmarks::clear() {
+	for (int i = 0; i < _count; i++) {
+		delete [] _from[i];
+		delete [] _to[i];
+	}
+	_count = 0;
+}
+/*
+ *	compute
+ *
+ *	Chooses the landmarks by farthest point sampling.  A tour from a
+ *	hex near the middle of the map finds the first landmark, the hex
+ *	farthest from there.  Each landmark after that is the hex farthest
+ *	from its nearest landmark.  Only hexes connected to the middle of
+ *	the map are candidates, so islands do not waste landmarks.
+ */
+void Landmarks::compute(int count) {
+	clear();
+	xpoint origin = _map->subsetOrigin();
+	xpoint opposite = _map->subsetOpposite();
+	xpoint middle((origin.x + opposite.x) / 2, (origin.y + opposite.y) / 2);
+
+		// The middle hex itself may be at sea, so start from the
+		// nearest hex with a move out of it.
+
+	xpoint start(-1, -1);
+	int startDistance = 0;
+	xpoint hx;
+	for (hx.y = origin.y; hx.y < opposite.y; hx.y++)
+		for (hx.x = origin.x; hx.x < opposite.x; hx.x++) {
+			int d = hexDistance(hx, middle);
+			if (start.x != -1 && d >= startDistance)
+				continue;
+			for (HexDirection dir = 0; dir < 6; dir++)
+				if (weight(hx, dir) <= MAXIMUM_PATH_LENGTH && _map->valid(neighbor(hx, dir))) {
+					start = hx;
+					startDistance = d;
+					break;
+				}
+		}
+	if (start.x == -1)
+		return;
+
+	int cells = _rows * _columns;
+	int* nearest = new int[cells];
+	LandmarkTour t(this, _columns);
+	tour(_map, &t, start, nearest, false);
+	while (_count < count) {
+		int farthest = 0;
+		int choice = -1;
+		for (int i = 0; i < cells; i++)
+			if (nearest[i] > farthest) {
+				farthest = nearest[i];
+				choice = i;
+			}
+		if (choice < 0)
+			break;								// Every candidate is already a landmark
+		xpoint landmark(choice % _columns, choice / _columns);
+		_landmark[_count] = landmark;
+		_from[_count] = new int[cells];
+		_to[_count] = new int[cells];
+		tour(_map, &t, landmark, _from[_count], false);
+		tour(_map, &t, landmark, _to[_count], true);
+		const int* from = _from[_count];
+		for (int i = 0; i < cells; i++)
+			if (_count == 0 || (from[i] != LANDMARK_UNREACHED && from[i] < nearest[i]))
+				nearest[i] = from[i];
+		_count++;
+	}
+	delete [] nearest;
+}
+
+bool Landmarks::read(const string& filename, unsigned signature) {
+	FILE* fp = fileSystem::openBinaryFile(filename);
+	if (fp == null)
+		return false;
+	clear();
+	LandmarkHeader h;
+	bool result = fread(&h, sizeof h, 1, fp) == 1 &&
+				  h.magic == LANDMARK_MAGIC &&
+				  h.version == LANDMARK_VERSION &&
+				  h.rows == _rows &&
+				  h.columns == _columns &&
+				  h.count > 0 &&
+				  h.count <= LANDMARK_MAX &&
+				  h.signature == signature &&
+				  fread(_landmark, sizeof (xpoint), h.count, fp) == h.count;
+	int cells = _rows * _columns;
+	while (result && _count < h.count) {
+		_from[_count] = new int[cells];
+		_to[_count] = new int[cells];
+		_count++;
+		result = fread(_from[_count - 1], sizeof (int), cells, fp) == cells &&
+				 fread(_to[_count - 1], sizeof (int), cells, fp) == cells;
+	}
+	fclose(fp);
+	if (!result)
+		clear();
+	return result;
+}
+
+void Landmarks::write(const string& filename, unsigned signature) const {
+	FILE* fp = fileSystem::createBinaryFile(filename);
+	if (fp == null) {
+		warningMessage("Couldn't create file: " + filename);
+		return;
+	}
+	LandmarkHeader h;
+	h.magic = LANDMARK_MAGIC;
+	h.version = LANDMARK_VERSION;
+	h.rows = _rows;
+	h.columns = _columns;
+	h.count = _count;
+	h.signature = signature;
+	int cells = _rows * _columns;
+	bool result = fwrite(&h, sizeof h, 1, fp) == 1 &&
+				  fwrite(_landmark, sizeof (xpoint), _count, fp) == _count;
+	for (int i = 0; result && i < _count; i++)
+		result = fwrite(_from[i], sizeof (int), cells, fp) == cells &&
+				 fwrite(_to[i], sizeof (int), cells, fp) == cells;
+	fclose(fp);
+	if (!result)
+		warningMessage("Write error on file: " + filename);
+}
+
+}  // namespace engine
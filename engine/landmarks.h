@@ -0,0 +1,100 @@
+#pragma once
+#include "../common/string.h"
+#include "basic_types.h"
+
+namespace engine {
+
+class HexMap;
+
+const int LANDMARK_MAX = 16;				// Most landmarks an index will choose
+const int LANDMARK_UNREACHED = -1;			// Distance of a hex no path connects to a landmark
+/*
+ *	Landmarks
+ *
+ *	An ALT (A*, landmarks and the triangle inequality) index for one
+ *	of a map's edge cost tables.  A few landmark hexes are chosen,
+ *	each as far as possible from those chosen before it, and the
+ *	cheapest distance from each landmark to every hex, and from every
+ *	hex to each landmark, is recorded.  Since no path from a to b can
+ *	be cheaper than the difference between the distances of a and b
+ *	from (or to) a landmark, the largest such difference is a lower
+ *	bound on the cost of moving from a to b, usually a much tighter
+ *	one than the straight line distance gives on a large map.
+ *
+ *	The distances are found with the weight of each edge, which is
+ *	the lower of its on and off road costs.  A weight is only ever
+ *	lowered, so when play makes a move dearer (a blown bridge, a
+ *	clogged road) the bounds stay good.  When a move becomes cheaper
+ *	than its weight, the weight is lowered and the index goes stale:
+ *	estimate gives no bound until build is called again.
+ *
+ *	The tables describing the map as it was loaded can be saved to a
+ *	file, so later runs need not compute them.
+ */
+class Landmarks {
+public:
+	Landmarks(HexMap* map);
+
+	~Landmarks();
+	/*
+	 *	lower
+	 *
+	 *	Lowers the weight of the move from hx in direction dir to
+	 *	cost, if cost is lower.  Costs over MAXIMUM_PATH_LENGTH mean
+	 *	the move cannot be made.
+	 */
+	void lower(xpoint hx, HexDirection dir, int cost);
+	/*
+	 *	build
+	 *
+	 *	Chooses count landmarks and computes their distance tables
+	 *	from the current weights.  If filename is not empty, the
+	 *	tables are read from that file when it was written for the
+	 *	same weights, and otherwise written to it.
+	 */
+	void build(int count, const string& filename);
+	/*
+	 *	estimate
+	 *
+	 *	Returns a lower bound on the total weight of any path from a
+	 *	to b, or 0 if the index is stale.
+	 */
+	int estimate(xpoint a, xpoint b) const;
+
+	int weight(xpoint hx, HexDirection dir) const { return _weight[index(hx) * 6 + dir]; }
+
+	bool stale() const { return _stale; }
+
+	int count() const { return _count; }
+
+	xpoint landmark(int i) const { return _landmark[i]; }
+
+private:
+	Landmarks(const Landmarks&);
+
+	void operator= (const Landmarks&);
+
+	int index(xpoint hx) const { return hx.y * _columns + hx.x; }
+
+	unsigned signature(int count) const;
+
+	void clear();
+
+	void compute(int count);
+
+	bool read(const string& filename, unsigned signature);
+
+	void write(const string& filename, unsigned signature) const;
+
+	HexMap*			_map;
+	int				_rows;
+	int				_columns;
+	int*			_weight;				// Six per hex
+	int				_count;
+	bool			_stale;
+	xpoint			_landmark[LANDMARK_MAX];
+	int*			_from[LANDMARK_MAX];	// Distance from the landmark to each hex
+	int*			_to[LANDMARK_MAX];		// Distance from each hex to the landmark
+};
+
+}  // namespace engine
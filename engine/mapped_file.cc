@@ -0,0 +1,69 @@
+#include "../common/platform.h"
+#include "mapped_file.h"
+
+#include <windows.h>
+
+namespace engine {
+
+MappedFile::MappedFile() {
+	_file = INVALID_HANDLE_VALUE;
+	_mapping = null;
+	_data = null;
+	_size = 0;
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const string& filename) {
+	close();
+	_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, null, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, null);
+	if (_file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0 || size.HighPart != 0 || size.LowPart > 0x7fffffff) {
+		close();
+		return false;
+	}
+	_size = int(size.LowPart);
+	_mapping = CreateFileMappingA(_file, null, PAGE_WRITECOPY, 0, 0, null);
+	if (_mapping == null) {
+		close();
+		return false;
+	}
+	_data = (byte*)MapViewOfFile(_mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (_data == null) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close() {
+	if (_data != null) {
+		UnmapViewOfFile(_data);
+		_data = null;
+	}
+	if (_mapping != null) {
+		CloseHandle(_mapping);
+		_mapping = null;
+	}
+	if (_file != INVALID_HANDLE_VALUE) {
+		CloseHandle(_file);
+		_file = INVALID_HANDLE_VALUE;
+	}
+	_size = 0;
+}
+
+bool isUpToDate(const string& target, const string& source) {
+	WIN32_FILE_ATTRIBUTE_DATA t, s;
+
+	if (!GetFileAttributesExA(target.c_str(), GetFileExInfoStandard, &t))
+		return false;
+	if (!GetFileAttributesExA(source.c_str(), GetFileExInfoStandard, &s))
+		return true;
+	return CompareFileTime(&t.ftLastWriteTime, &s.ftLastWriteTime) >= 0;
+}
+
+}  // namespace engine
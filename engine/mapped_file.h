@@ -0,0 +1,41 @@
+#pragma once
+#include "../common/machine.h"
+#include "../common/string.h"
+
+namespace engine {
+/*
+ *	MappedFile
+ *
+ *	The whole contents of a file, mapped into memory.  The pages are
+ *	mapped copy-on-write, so the data may be changed in memory without
+ *	changing the file.  The file cannot be rewritten while it is open.
+ */
+class MappedFile {
+public:
+	MappedFile();
+
+	~MappedFile();
+
+	bool open(const string& filename);
+
+	void close();
+
+	byte* data() const { return _data; }
+
+	int size() const { return _size; }
+
+private:
+	void*			_file;
+	void*			_mapping;
+	byte*			_data;
+	int				_size;
+};
+/*
+ *	isUpToDate
+ *
+ *	Returns true if the file target exists and was written no earlier
+ *	than the file source.
+ */
+bool isUpToDate(const string& target, const string& source);
+
+}  // namespace engine
@@ -112,20 +112,27 @@ string StandingOrder::toString() {
 }
 
 MarchOrder::MarchOrder() {
+	_route = null;
+	_routeKept = false;
 }
 
 MarchOrder::~MarchOrder() {
+	discardRoute();
 }
 
 MarchOrder::MarchOrder(MarchRate mr) {
 	_marchRate = mr;
 	_mode = UM_MOVE;
+	_route = null;
+	_routeKept = false;
 }
 
 MarchOrder::MarchOrder(xpoint d, MarchRate mr, UnitModes mm) {
 	_destination = d;
 	_marchRate = mr;
 	_mode = mm;
+	_route = null;
+	_routeKept = false;
 }
 
 MarchOrder* MarchOrder::factory(fileSystem::Storage::Reader* r) {
@@ -166,7 +173,29 @@ bool MarchOrder::commonEquals(StandingOrder* o) {
 	if (super::equals(o) &&
 		_destination == mo->_destination &&
 		_marchRate == mo->_marchRate &&
-		_mode == mo->_mode)
+		_mode == mo->_mode &&
+		_routeKept == mo->_routeKept &&
+		test::deepCompare(_route, mo->_route) &&
+		(_route == null || _routeDestination == mo->_routeDestination))
+		return true;
+	else
+		return false;
+}
+
+void MarchOrder::storeRoute(fileSystem::Storage::Writer* o) const {
+	o->write(_route);
+	o->write(_routeDestination.x);
+	o->write(_routeDestination.y);
+	o->write(_routeKept);
+}
+
+bool MarchOrder::readRoute(fileSystem::Storage::Reader* r) {
+	if (r->endOfRecord())
+		return true;
+	if (r->read(&_route) &&
+		r->read(&_routeDestination.x) &&
+		r->read(&_routeDestination.y) &&
+		r->read(&_routeKept))
 		return true;
 	else
 		return false;
@@ -215,13 +244,13 @@ void MarchOrder::nextAction(Detachment* d) {
 			return;
 		}
 		if (d->inCombat() && _mode != UM_ATTACK) {
-			d->action = DA_RETREATING;
+			d->setAction(DA_RETREATING);
 			Combat* c = d->findCombatAtLocation();
 			if (c != null) {
 				c->cancel(d);
 			}
 		} else
-			d->action = DA_MARCHING;
+			d->setAction(DA_MARCHING);
 		d->destination = t->nextp;
 		Detachment* d2 = d->map()->getDetachments(t->nextp);
 		if (d2 != null) {
@@ -240,7 +269,7 @@ void MarchOrder::nextAction(Detachment* d) {
 		} else {
 			Combat* c = d->map()->combat(t->nextp);
 			if (c != null) {
-				d->action = DA_ATTACKING;
+				d->setAction(DA_ATTACKING);
 				if (c->include(d, 0))
 					return;
 			}
@@ -305,13 +334,44 @@ bool MarchOrder::canEnter(Detachment* d, xpoint p) {
 
 Segment* MarchOrder::computeNextHex(Detachment* d) {
 	bool confrontEnemy = (_mode == UM_ATTACK);
-	Segment* t = engine::unitPath.find(d->map(), d->unit, d->location(), _mode, _destination, confrontEnemy);
-	if (t != null)
-		return t;
-	else if (!confrontEnemy)
-		return engine::unitPath.find(d->map(), d->unit, d->location(), _mode, _destination, true);
-	else
-		return null;
+	xpoint at = d->location();
+
+		// Drop the step taken since the last call.
+
+	if (_route != null &&
+		_route->hex != at &&
+		_route->nextp == at) {
+		Segment* s = _route;
+		_route = s->next;
+		s->next = null;
+		delete s;
+	}
+	if (_route != null &&
+		_routeKept &&
+		_route->hex == at &&
+		_routeDestination == _destination &&
+		engine::unitPath.unchanged(d->map(), d->unit, at, _mode, _destination, confrontEnemy, _route))
+		return _route;
+	discardRoute();
+	_routeDestination = _destination;
+	_route = engine::unitPath.find(d->map(), d->unit, at, _mode, _destination, confrontEnemy);
+	if (_route != null)
+		_routeKept = true;
+	else if (!confrontEnemy) {
+
+			// A route that has to go through the enemy is only good
+			// for one step, since a better one may open up.
+
+		_route = engine::unitPath.find(d->map(), d->unit, at, _mode, _destination, true);
+		_routeKept = false;
+	}
+	return _route;
+}
+
+void MarchOrder::discardRoute() {
+	delete _route;
+	_route = null;
+	_routeKept = false;
 }
 
 string MarchOrder::toString() {
@@ -401,7 +461,8 @@ ConvergeOrder* ConvergeOrder::factory(fileSystem::Storage::Reader* r) {
 		r->read(&co->_weightedFatigue) &&
 		r->read(&co->_commonParent) &&
 		r->read(&co->_thenJoin) &&
-		r->read(&co->_target))
+		r->read(&co->_target) &&
+		co->readRoute(r))
 		return co;
 	else {
 		delete co;
@@ -415,6 +476,7 @@ void ConvergeOrder::store(fileSystem::Storage::Writer* o) const {
 	o->write(_commonParent);
 	o->write(_thenJoin);
 	o->write(_target);
+	storeRoute(o);
 }
 
 bool ConvergeOrder::equals(StandingOrder* o) {
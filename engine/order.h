@@ -104,7 +104,15 @@ public:
 	virtual void nextAction(Detachment* d);
 
 	bool canEnter(Detachment* d, xpoint p);
-
+	/*
+	 *	computeNextHex
+	 *
+	 *	Returns the route from the detachment's hex to the destination.
+	 *	The route belongs to the order.  It is kept from one step of
+	 *	the march to the next, and is only searched for again when the
+	 *	detachment strays from it or the cost of one of its remaining
+	 *	steps changes.
+	 */
 	Segment* computeNextHex(Detachment* d);
 
 	virtual string toString();
@@ -113,10 +121,25 @@ public:
 	UnitModes mode() const { return _mode; }
 	MarchRate marchRate() const { return _marchRate; }
 protected:
+	/*
+	 *	storeRoute, readRoute
+	 *
+	 *	The route is written after all of a record's other fields, so
+	 *	a record saved before routes were kept still reads.
+	 */
+	void storeRoute(fileSystem::Storage::Writer* o) const;
+
+	bool readRoute(fileSystem::Storage::Reader* r);
+
 	xpoint			_destination;
 private:
+	void discardRoute();
+
 	UnitModes		_mode;
 	MarchRate		_marchRate;
+	Segment*		_route;				// Remaining route, from the detachment's hex
+	xpoint			_routeDestination;
+	bool			_routeKept;			// false if _route may not be used for the next step
 };
 
 class JoinOrder : public MarchOrder {
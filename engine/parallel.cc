@@ -0,0 +1,217 @@
+#include "../common/platform.h"
+#include "parallel.h"
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "engine.h"
+#include "global.h"
+
+namespace engine {
+
+struct ParallelBatch {
+	ParallelTask*		task;
+	int					items;
+	volatile LONG		nextItem;
+};
+
+struct ParallelWorker {
+	ParallelBatch*		batch;
+	int					index;
+};
+
+static volatile LONG parallelRuns;			// runParallel calls under way
+
+static void runItems(ParallelBatch* batch, int worker) {
+	for (;;) {
+		int i = InterlockedIncrement(&batch->nextItem) - 1;
+		if (i >= batch->items)
+			break;
+		batch->task->run(i, worker);
+	}
+}
+
+static DWORD WINAPI workerThread(LPVOID arg) {
+	ParallelWorker* w = (ParallelWorker*)arg;
+	runItems(w->batch, w->index);
+	return 0;
+}
+
+void runParallel(ParallelTask* task, int items) {
+	int workers = parallelWorkers();
+	if (workers > items)
+		workers = items;
+	if (workers > MAXIMUM_WAIT_OBJECTS)
+		workers = MAXIMUM_WAIT_OBJECTS;
+	InterlockedIncrement(&parallelRuns);
+	if (workers <= 1 || engine::logging()) {
+		for (int i = 0; i < items; i++)
+			task->run(i, 0);
+		InterlockedDecrement(&parallelRuns);
+		return;
+	}
+	ParallelBatch batch;
+	batch.task = task;
+	batch.items = items;
+	batch.nextItem = 0;
+
+		// The calling thread is worker 0, so only start the rest.
+
+	HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+	ParallelWorker w[MAXIMUM_WAIT_OBJECTS];
+	int started = 0;
+	for (int i = 1; i < workers; i++) {
+		w[started].batch = &batch;
+		w[started].index = i;
+		threads[started] = CreateThread(null, 0, workerThread, &w[started], 0, null);
+		if (threads[started] == null)
+			break;
+		started++;
+	}
+	runItems(&batch, 0);
+	if (started > 0) {
+		WaitForMultipleObjects(started, threads, TRUE, INFINITE);
+		for (int i = 0; i < started; i++)
+			CloseHandle(threads[i]);
+	}
+	InterlockedDecrement(&parallelRuns);
+}
+
+bool runningParallel() {
+	return parallelRuns > 0;
+}
+
+	// The environment variable a child started by runProcesses finds its
+	// job in.
+
+static const char JOB_VARIABLE[] = "EUROPA_PROCESS_JOB";
+
+static string readOutput(const char* filename) {
+	string output;
+	FILE* fp = fopen(filename, "rb");
+	if (fp == null)
+		return output;
+	char buffer[4096];
+	for (;;) {
+		size_t n = fread(buffer, 1, sizeof buffer, fp);
+		if (n == 0)
+			break;
+		output = output + string(buffer, n);
+	}
+	fclose(fp);
+	return output;
+}
+
+bool runProcesses(ProcessTask* task, int items, int workers) {
+	if (workers < 1)
+		workers = 1;
+	if (workers > MAXIMUM_WAIT_OBJECTS)
+		workers = MAXIMUM_WAIT_OBJECTS;
+	char program[MAX_PATH];
+	char folder[MAX_PATH];
+	if (GetModuleFileNameA(null, program, sizeof program) == 0 ||
+		GetTempPathA(sizeof folder, folder) == 0)
+		return false;
+
+	SECURITY_ATTRIBUTES sa;
+	memset(&sa, 0, sizeof sa);
+	sa.nLength = sizeof sa;
+	sa.bInheritHandle = TRUE;
+
+	HANDLE running[MAXIMUM_WAIT_OBJECTS];
+	int item[MAXIMUM_WAIT_OBJECTS];
+	char output[MAXIMUM_WAIT_OBJECTS][MAX_PATH];
+	int active = 0;
+	int next = 0;
+	bool result = true;
+	while (active > 0 || (result && next < items)) {
+		if (result && next < items && active < workers) {
+
+				// Each child writes its output to a scratch file of its
+				// own, which is read back once the child exits.
+
+			if (GetTempFileNameA(folder, "job", 0, output[active]) == 0) {
+				result = false;
+				continue;
+			}
+			HANDLE out = CreateFileA(output[active], GENERIC_WRITE, FILE_SHARE_READ, &sa,
+									 CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, null);
+			if (out == INVALID_HANDLE_VALUE) {
+				DeleteFileA(output[active]);
+				result = false;
+				continue;
+			}
+			SetEnvironmentVariableA(JOB_VARIABLE, task->job(next).c_str());
+
+			STARTUPINFOA si;
+			memset(&si, 0, sizeof si);
+			si.cb = sizeof si;
+			si.dwFlags = STARTF_USESTDHANDLES;
+			si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+			si.hStdOutput = out;
+			si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+			PROCESS_INFORMATION pi;
+			char* commandLine = _strdup(GetCommandLineA());
+			BOOL started = CreateProcessA(program, commandLine, null, null, TRUE, 0, null, null, &si, &pi);
+			free(commandLine);
+			CloseHandle(out);
+			if (!started) {
+				DeleteFileA(output[active]);
+				result = false;
+				continue;
+			}
+			CloseHandle(pi.hThread);
+			running[active] = pi.hProcess;
+			item[active] = next;
+			active++;
+			next++;
+			continue;
+		}
+		DWORD w = WaitForMultipleObjects(active, running, FALSE, INFINITE);
+		int i = w - WAIT_OBJECT_0;
+		if (i < 0 || i >= active)
+			fatalMessage("Waiting for a child process failed");
+		DWORD exitCode;
+		if (!GetExitCodeProcess(running[i], &exitCode))
+			exitCode = DWORD(-1);
+		CloseHandle(running[i]);
+		task->finish(item[i], exitCode, readOutput(output[i]));
+		DeleteFileA(output[i]);
+		active--;
+		running[i] = running[active];
+		item[i] = item[active];
+		strcpy(output[i], output[active]);
+	}
+	SetEnvironmentVariableA(JOB_VARIABLE, null);
+	return result;
+}
+
+string childJob() {
+	char buffer[4096];
+	DWORD n = GetEnvironmentVariableA(JOB_VARIABLE, buffer, sizeof buffer);
+	if (n == 0 || n >= sizeof buffer)
+		return string();
+	return string(buffer, n);
+}
+
+void SpinLock::lock() {
+	while (InterlockedCompareExchange((volatile LONG*)&_lock, 1, 0) != 0)
+		YieldProcessor();
+}
+
+void SpinLock::unlock() {
+	InterlockedExchange((volatile LONG*)&_lock, 0);
+}
+
+int parallelWorkers() {
+	if (global::workerThreads > 0)
+		return global::workerThreads;
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	if (si.dwNumberOfProcessors < 1)
+		return 1;
+	return si.dwNumberOfProcessors;
+}
+
+}  // namespace engine
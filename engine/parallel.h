@@ -0,0 +1,105 @@
+#pragma once
+#include "../common/string.h"
+
+namespace engine {
+/*
+ *	ParallelTask
+ *
+ *	A batch of independent work items.  The run method is called
+ *	exactly once for each item, possibly from several threads at
+ *	the same time.  The worker argument identifies the calling
+ *	thread, so a task can keep per-thread scratch state (such as
+ *	PathHeuristic objects) in an array indexed by it.  Worker
+ *	numbers are always less than parallelWorkers().
+ *
+ *	Items are handed out one at a time, in increasing order, to
+ *	whichever worker is free, so run must not depend on the order
+ *	in which items finish.  Any result that has to be applied to
+ *	shared game state should be stored with the item and applied
+ *	after runParallel returns.
+ */
+class ParallelTask {
+public:
+	virtual ~ParallelTask() { }
+
+	virtual void run(int item, int worker) = 0;
+};
+/*
+ *	runParallel
+ *
+ *	Runs items 0 through items - 1 of task and returns when all of
+ *	them are done.  The calling thread does its share of the work.
+ *	While the engine log is open everything runs on the calling
+ *	thread, so that the log is written in item order.
+ */
+void runParallel(ParallelTask* task, int items);
+/*
+ *	runningParallel
+ *
+ *	Returns true while any runParallel call is under way, even one
+ *	running its items on the calling thread.  Code that must not be
+ *	reached from a parallel task, such as building shared tables,
+ *	can check this, so the mistake shows up in serial runs too.
+ */
+bool runningParallel();
+/*
+ *	parallelWorkers
+ *
+ *	The number of threads runParallel will use: global::workerThreads
+ *	if that is set, otherwise the number of processors.
+ */
+int parallelWorkers();
+/*
+ *	ProcessTask
+ *
+ *	A batch of independent jobs, each run by a copy of this program in
+ *	a process of its own.  That is the way to spread work that goes
+ *	through global state, such as a Scenario and its map, across
+ *	processors.  job describes item to its child, which finds it with
+ *	childJob.  finish is handed what the child wrote to its standard
+ *	output and its exit code.  Both are called on the calling thread.
+ */
+class ProcessTask {
+public:
+	virtual ~ProcessTask() { }
+
+	virtual string job(int item) = 0;
+
+	virtual void finish(int item, int exitCode, const string& output) = 0;
+};
+/*
+ *	runProcesses
+ *
+ *	Runs items 0 through items - 1 of task, each by starting this
+ *	program again with the same command line, at most workers at a
+ *	time, and returns when all of them have exited.  Returns false
+ *	if any child could not be started.
+ */
+bool runProcesses(ProcessTask* task, int items, int workers);
+/*
+ *	childJob
+ *
+ *	In a program started by runProcesses, the job it was given.  In any
+ *	other program, an empty string.
+ */
+string childJob();
+/*
+ *	SpinLock
+ *
+ *	A lock for short stretches of work that threads rarely contend
+ *	for.  unlock is a full memory barrier, so anything written while
+ *	the lock is held is visible to the next thread to take it.
+ */
+class SpinLock {
+public:
+	SpinLock() { _lock = 0; }
+
+	void lock();
+
+	void unlock();
+
+private:
+	volatile long		_lock;
+};
+
+}  // namespace engine
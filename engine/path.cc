@@ -3,6 +3,8 @@
 
 #include "../test/test.h"
 #include "game_map.h"
+#include "global.h"
+#include "pool.h"
 
 namespace engine {
 
@@ -33,9 +35,10 @@ UnitPath unitPath;
 // of Amit's unit pathfinding code, since it relied on his terrain
 // model.  I've had to substitute my own terrain model.
 //
-// I've also chosen to limit the code to a single thread at a time.
-// Repeat: this is not thread-safe code.  The OPEN set is maintained
-// in a Container object that is global to the process.
+// The code originally ran a single search at a time, with the OPEN
+// set kept in a Container object that was global to the process.  The
+// search state now lives in a PathSearch owned by each PathHeuristic,
+// so distinct heuristic objects can be used from different threads.
 //////////////////////////////////////////////////////////////////////
 // Amit's Path-finding (A*) code.
 //
@@ -96,182 +99,242 @@ UnitPath unitPath;
 	a point, more or less in order of the shortest distance traveled from the origin.  This way, we 
 	can use this algorithm to find paths, fill fields of influence, find nearest interesting points, 
 	distribute supplies, etc.
+
+	When the tour is aimed at a single goal, each node also carries the path's estimate of the
+	distance left, and the tour becomes a true A* search.
  */
 class Node {
 public:
-	Node*		prev;
-	Node*		next;
-
     xpoint		h;				// location on the map, in hex coordinates
     int			gval;			// g in A* represents how far we've already gone
     int			hval;			// h in A* represents an estimate of how far is left
+	int			heapIndex;		// slot in the OPEN heap
+	unsigned	sequence;		// when the node last entered or moved up in OPEN
 
-	Node() {
-		prev = null;
-		next = null;
-		h.x = 0;
-		h.y = 0;
-		gval = 0;
-		hval = 0;
-	}
-	
 	void init(xpoint h, int hval, int gval) {
 		this->h = h;
 		this->hval = hval;
 		this->gval = gval;
 	}
 
-	bool lessThan(Node* n) {
-		return gval + hval < n->gval + n->hval;
+		// Ties go to the node that most recently entered or moved
+		// up in OPEN.  This is the order the original sorted list
+		// produced, so paths come out the same as they always have.
+
+	bool lessThan(const Node* n) const {
+		int f = gval + hval;
+		int nf = n->gval + n->hval;
+		if (f != nf)
+			return f < nf;
+		return sequence > n->sequence;
 	}
 };
 // The mark array marks directions on the map.  The direction points
 // to the spot that is the previous spot along the path.  By starting
 // at the end, we can trace our way back to the start, and have a path.
-// It also stores 'f' values for each space on the map.  These are used
-// to determine whether something is in OPEN or not.  It stores 'g'
-// values to determine whether costs need to be propagated down.
+// It also records the OPEN node for each space on the map.  This is used
+// to determine whether something is in OPEN or not.
+//
+// A mark only counts if its generation matches the current search, so
+// nothing has to be erased between searches.
 struct Marking {
-    HexDirection	direction;	// !DirNone means OPEN || CLOSED
-	Node*			n;			// != null means OPEN
+	unsigned		generation;
+    HexDirection	direction;	// OPEN || CLOSED
+	int				n;			// Index into the node arena, the node is OPEN if its heapIndex >= 0
 };
 
 inline int xpointToIndex(HexMap* map, xpoint hx) {
 	return hx.y * map->getColumns() + hx.x;
 }
 
-class Container {
-public:
-	Node*			first;
-	Node*			last;
-
-	Node* getFirstNode() {
-		if (first == null)
-			return null;
-		Node* n = first;
-		first = n->next;
-		if (first != null)
-			first->prev = null;
-		else
-			last = null;
-		return n;
-	}
+PathSearch::PathSearch() {
+	_mark = null;
+	_cells = 0;
+	_generation = 0;
+	_nodes = null;
+	_open = null;
+	_visited = null;
+	_capacity = 0;
+	_nodeCount = 0;
+	_openCount = 0;
+	_visitedCount = 0;
+	_sequence = 0;
+}
 
-	void insert(Node* N) {
-		insert(N, last);
-	}
+PathSearch::~PathSearch() {
+	delete [] _mark;
+	delete [] _nodes;
+	delete [] _open;
+	delete [] _visited;
+}
 
-	void insert(Node* N, Node* n) {
-		for (; n != null; n = n->prev)
-			if (n->lessThan(N))
-				break;
-		N->prev = n;
-		if (n != null){
-			N->next = n->next;
-			n->next = N;
-		} else {
-			N->next = first;
-			first = N;
-		}
-		if (N->next != null)
-			N->next->prev = N;
-		else
-			last = N;
+void PathSearch::start(HexMap* map) {
+	int cells = map->getRows() * map->getColumns();
+	if (cells != _cells) {
+		delete [] _mark;
+		_cells = cells;
+		_mark = new Marking[cells];
+		for (int i = 0; i < cells; i++)
+			_mark[i].generation = 0;
+		_generation = 0;
 	}
+	_generation++;
+	if (_generation == 0) {
 
-	void append(Node* N) {
-		if (first == null){
-			N->next = null;
-			N->prev = null;
-			first = N;
-			last = N;
-		} else {
-			last->next = N;
-			N->prev = last;
-			N->next = null;
-			last = N;
-		}
-	}
+			// The stamp wrapped around, so old marks could look current.
 
-	void recalc(Node* N) {
-		if (N->prev == null)
-			return;					// already at the front of the heap
-		if (N->next != null)
-			N->next->prev = N->prev;
-		else
-			last = N->prev;
-		N->prev->next = N->next;
-		insert(N, N->prev);
+		for (int i = 0; i < _cells; i++)
+			_mark[i].generation = 0;
+		_generation = 1;
 	}
+	_nodeCount = 0;
+	_openCount = 0;
+	_visitedCount = 0;
+	_sequence = 0;
+}
 
-	void clear(HexMap* map, Node* N);
-		
-	void clear(HexMap* map);
-};
+HexDirection PathSearch::direction(HexMap* map, xpoint hx) const {
+	const Marking& m = _mark[xpointToIndex(map, hx)];
+	if (m.generation != _generation)
+		return DirNone;
+	return m.direction;
+}
 
-static Marking* mark;
-static Container open, freeNodes, visited;
-
-void Container::clear(HexMap* map, Node* N) {
-	mark[xpointToIndex(map, N->h)].direction = DirNone;
-	append(N);
-}
-	
-void Container::clear(HexMap* map) {
-	    // Erase the mark array, for all items in open
-	Node* n = first;
-	while (n != null){
-		Node* nNext = n->next;
-		freeNodes.clear(map, n);
-		n = nNext;
+int PathSearch::newNode(xpoint p, int h, int g) {
+	if (_nodeCount >= _capacity) {
+
+			// A hex only gets a node the first time it is reached, so
+			// no search needs more nodes than there are hexes.
+
+		int capacity = _capacity * 2;
+		if (capacity < 256)
+			capacity = 256;
+		if (capacity > _cells)
+			capacity = _cells;
+		Node* nodes = new Node[capacity];
+		int* open = new int[capacity];
+		int* visited = new int[capacity];
+		for (int i = 0; i < _nodeCount; i++)
+			nodes[i] = _nodes[i];
+		for (int i = 0; i < _openCount; i++)
+			open[i] = _open[i];
+		for (int i = 0; i < _visitedCount; i++)
+			visited[i] = _visited[i];
+		delete [] _nodes;
+		delete [] _open;
+		delete [] _visited;
+		_nodes = nodes;
+		_open = open;
+		_visited = visited;
+		_capacity = capacity;
 	}
-	first = null;
-	last = null;
+	int n = _nodeCount++;
+	_nodes[n].init(p, h, g);
+	_nodes[n].sequence = _sequence++;
+	_nodes[n].heapIndex = _openCount;
+	_open[_openCount++] = n;
+	siftUp(_nodes[n].heapIndex);
+	return n;
 }
 
-static int nodeCount = 0;
-
-static Node* newNode(xpoint p, int h, int g) {
-	Node* n = freeNodes.getFirstNode();
-	if (n == null){
-		nodeCount++;
-		n = new Node();
+int PathSearch::popFirst() {
+	if (_openCount == 0)
+		return -1;
+	int n = _open[0];
+	_openCount--;
+	if (_openCount > 0) {
+		_open[0] = _open[_openCount];
+		_nodes[_open[0]].heapIndex = 0;
+		siftDown(0);
 	}
-	n->init(p, h, g);
-	open.insert(n);
+	_nodes[n].heapIndex = -1;
 	return n;
 }
 
-static void propagate_down(HexMap* map, PathHeuristic* heuristic, Node* H);
+void PathSearch::recalc(int n) {
+	_nodes[n].sequence = _sequence++;
+	siftUp(_nodes[n].heapIndex);
+}
 
-void visit(HexMap* map, PathHeuristic* path, engine::xpoint A, int maxDist, SegmentKind kind) {
-	if (mark == null) {
-		int cells = map->getRows() * map->getColumns();
-		mark = new Marking[cells];
-		for (int i = 0; i < cells; i++)
-			mark[i].direction = DirNone;
+void PathSearch::siftUp(int i) {
+	int n = _open[i];
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		int p = _open[parent];
+		if (!_nodes[n].lessThan(&_nodes[p]))
+			break;
+		_open[i] = p;
+		_nodes[p].heapIndex = i;
+		i = parent;
+	}
+	_open[i] = n;
+	_nodes[n].heapIndex = i;
+}
+
+void PathSearch::siftDown(int i) {
+	int n = _open[i];
+	for (;;) {
+		int child = 2 * i + 1;
+		if (child >= _openCount)
+			break;
+		if (child + 1 < _openCount && _nodes[_open[child + 1]].lessThan(&_nodes[_open[child]]))
+			child++;
+		if (!_nodes[_open[child]].lessThan(&_nodes[n]))
+			break;
+		_open[i] = _open[child];
+		_nodes[_open[i]].heapIndex = i;
+		i = child;
 	}
+	_open[i] = n;
+	_nodes[n].heapIndex = i;
+}
+
+void visit(HexMap* map, PathHeuristic* path, engine::xpoint A, int maxDist, SegmentKind kind) {
+	path->search.run(map, path, &A, 1, maxDist, kind, null);
+}
+
+void visit(HexMap* map, PathHeuristic* path, const vector<xpoint>& sources, int maxDist, SegmentKind kind) {
+	if (sources.size() > 0)
+		path->search.run(map, path, &sources[0], sources.size(), maxDist, kind, null);
+	else
+		path->search.run(map, path, null, 0, maxDist, kind, null);
+}
+
+void visitToward(HexMap* map, PathHeuristic* path, xpoint A, xpoint B, int maxDist, SegmentKind kind) {
+	path->search.run(map, path, &A, 1, maxDist, kind, &B);
+}
 
-		// insert the original node
+void PathSearch::addOrigin(HexMap* map, xpoint hx, int h) {
+	Marking& origin = _mark[xpointToIndex(map, hx)];
+	if (origin.generation == _generation)
+		return;
+	origin.generation = _generation;
+	origin.n = newNode(hx, h, 0);
+	origin.direction = DirStart;
+}
 
-	Node* N = newNode(A, 0, 0);
-	mark[xpointToIndex(map, A)].n = N;
-	mark[xpointToIndex(map, A)].direction = DirStart;
+void PathSearch::run(HexMap* map, PathHeuristic* path, const xpoint* sources, int count, int maxDist, SegmentKind kind, const xpoint* goal) {
+	start(map);
+
+		// insert the original nodes
+
+	for (int i = 0; i < count; i++)
+		addOrigin(map, sources[i], goal != null ? path->estimate(sources[i], *goal) : 0);
 
 	int nodesRemoved = 0;
 
-	// * Things in OPEN are in the open container (which is a heap),
-	//   and also their mark[...].f value is nonnegative.
-	// * Things in CLOSED are in the visited container (which is unordered),
-	//   and also their mark[...].direction value is not DirNone.
+	// * Things in OPEN are in the _open heap,
+	//   and also their node's heapIndex is nonnegative.
+	// * Things in CLOSED are in the _visited list (which is unordered),
+	//   and also their mark[...] is stamped with the current generation.
 
 	// While there are still nodes to visit, visit them!
 	for (;;) {
-		N = open.getFirstNode();
-		if (N == null)
+		int ni = popFirst();
+		if (ni < 0)
 			break;
-		xpoint h = N->h;
-		mark[xpointToIndex(map, h)].n = null;
+		xpoint h = _nodes[ni].h;
+		int g = _nodes[ni].gval;
 		PathContinuation result = path->visit(h);
 		if (result == PC_STOP_ALL)
 			break;
@@ -280,7 +343,7 @@ void visit(HexMap* map, PathHeuristic* path, engine::xpoint A, int maxDist, Segm
 		if (nodesRemoved > path->visitLimit)
 			break;
 
-		visited.append(N);
+		_visited[_visitedCount++] = ni;
 
 		if (result == PC_STOP_THIS)
 			continue;
@@ -292,46 +355,141 @@ void visit(HexMap* map, PathHeuristic* path, engine::xpoint A, int maxDist, Segm
 			if(!map->valid(hn))
 				continue;
 
-			int k = N->gval + path->kost(h, d, hn);
+			int k = g + path->kost(h, d, hn);
 			if (k >= maxDist)
 				continue;
 
-				// If this spot (hn) hasn't been visited, its mark is DirNone
-			Marking& m = mark[xpointToIndex(map, hn)];
-			if (m.direction == DirNone) {
+				// If this spot (hn) hasn't been visited, its mark is from an older search
+			Marking& m = _mark[xpointToIndex(map, hn)];
+			if (m.generation != _generation) {
 				// The space is not marked
 
-				Node* N2 = newNode(hn, 0, k);
+				int e = 0;
+				if (goal != null) {
+					e = path->estimate(hn, *goal);
+
+						// Any path to the goal through here is too long.
+
+					if (k + e >= maxDist)
+						continue;
+				}
+				m.generation = _generation;
 				m.direction = reverseDirection(d);
-				m.n = N2;
+				m.n = newNode(hn, e, k);
 			}
 				// We know it's in OPEN or VISITED...
-			else if (m.n != null) {
+			else if (_nodes[m.n].heapIndex >= 0) {
 				// It's in OPEN
-				Node* find1 = m.n;
+				Node* find1 = &_nodes[m.n];
 
 				// It's in OPEN, so figure out whether g is better
 				if (k < find1->gval) {
-					// Search for hn in open
-
-            
-					// Replace *find1's gval with N2.gval in the list&map
+					// Replace *find1's gval with N2.gval in the heap&map
 					m.direction = reverseDirection(d);
 					find1->gval = k;
-					open.recalc(find1);
+					recalc(m.n);
 
 					// This next step is not needed for most games
 
-					propagate_down(map, path, find1);
+					propagateDown(map, path, m.n);
 				}
 			}
 		}
 	}
 	path->finished(map, kind);
-	if (N != null)
-		freeNodes.clear(map, N);
-	open.clear(map);
-	visited.clear(map);
+}
+
+bool PathSearch::meet(HexMap* map, PathHeuristic* path, PathSearch* reverse, xpoint A, xpoint B, int maxDist, xpoint* meetp) {
+	if (A == B) {
+		*meetp = A;
+		return true;
+	}
+	start(map);
+	reverse->start(map);
+	addOrigin(map, A, path->estimate(A, B));
+	reverse->addOrigin(map, B, path->estimate(A, B));
+
+	int best = maxDist;
+	bool met = false;
+	int nodesRemoved = 0;
+	while (_openCount > 0 && reverse->_openCount > 0) {
+
+			// Grow whichever search has the smaller frontier.
+
+		bool forward = _openCount <= reverse->_openCount;
+		PathSearch* side = forward ? this : reverse;
+		PathSearch* other = forward ? reverse : this;
+
+			// With an estimate that never overstates, no path still to be
+			// found by this side can be shorter than its first node's f.
+
+		Node* first = &side->_nodes[side->_open[0]];
+		if (first->gval + first->hval >= best)
+			break;
+
+		nodesRemoved++;
+		if (nodesRemoved > path->visitLimit)
+			break;
+
+		int ni = side->popFirst();
+		xpoint h = side->_nodes[ni].h;
+		int g = side->_nodes[ni].gval;
+		side->_visited[side->_visitedCount++] = ni;
+
+		for (HexDirection d = 0; d < 6; ++d) {
+			xpoint hn = neighbor(h, d);
+			if (!map->valid(hn))
+				continue;
+
+				// The reverse search runs against the direction of travel, so
+				// each of its steps costs the move from hn to h.
+
+			int k;
+			if (forward)
+				k = g + path->kost(h, d, hn);
+			else
+				k = g + path->kost(hn, reverseDirection(d), h);
+			if (k >= best)
+				continue;
+
+			Marking& m = side->_mark[xpointToIndex(map, hn)];
+			if (m.generation != side->_generation) {
+				int e = forward ? path->estimate(hn, B) : path->estimate(A, hn);
+				if (k + e >= best)
+					continue;
+				m.generation = side->_generation;
+				m.direction = reverseDirection(d);
+				m.n = side->newNode(hn, e, k);
+			} else {
+				Node* n = &side->_nodes[m.n];
+				if (n->heapIndex < 0 || k >= n->gval)
+					continue;
+				m.direction = reverseDirection(d);
+				n->gval = k;
+				side->recalc(m.n);
+			}
+
+				// If the other side has been here, the two halves make a path.
+
+			const Marking& o = other->_mark[xpointToIndex(map, hn)];
+			if (o.generation == other->_generation) {
+				int through = k + other->_nodes[o.n].gval;
+				if (through < best) {
+					best = through;
+					*meetp = hn;
+					met = true;
+				}
+			}
+		}
+	}
+	return met;
+}
+
+void PathSearch::review(HexMap* map, PathHeuristic* path) {
+	for (int i = 0; i < _visitedCount; i++) {
+		Node* v = &_nodes[_visited[i]];
+		path->reviewHex(map, v->h, v->gval);
+	}
 }
 /*
 	This Path heuristic will find the shortest distance between A and B by using visit with
@@ -347,10 +505,29 @@ Segment* StraightPath::find(HexMap* map, xpoint A, xpoint B, SegmentKind kind) {
 	destination = B;
 	foundIt = false;
 	visitLimit = 1000;
-	engine::visit(map, this, A, map->getRows() + map->getColumns(), kind);
+	minimumStep = 1;					// kost is at least the square of a step's length
+	seek(map, map->getRows() + map->getColumns(), kind);
 	return path;
 }
 
+int StraightPath::estimate(xpoint a, xpoint b) {
+	return hexDistance(a, b) * minimumStep;
+}
+
+void StraightPath::seek(HexMap* map, int maxDist, SegmentKind kind) {
+	if (global::bidirectionalPathDistance > 0 &&
+		hexDistance(source, destination) >= global::bidirectionalPathDistance &&
+		meetsHalfway()) {
+		xpoint meeting;
+
+		path = null;
+		foundIt = false;
+		if (search.meet(map, this, &_reverse, source, destination, maxDist, &meeting))
+			trace(map, meeting, kind);
+	} else
+		visitToward(map, this, source, destination, maxDist, kind);
+}
+
 int StraightPath::kost(xpoint a, HexDirection dir, xpoint b) {
     double dx1 = double(a.x - b.x);
 	double dy1 = double(a.y - b.y);
@@ -381,33 +558,62 @@ PathContinuation StraightPath::visit(xpoint h) {
 
 void StraightPath::finished(HexMap* map, SegmentKind kind) {
 	path = null;
-	if (foundIt){
-
-		// We have found a path, so let's copy it into `path'
-
-		xpoint h = destination;
-		while( h.x != source.x || h.y != source.y ){
-			HexDirection dir = mark[xpointToIndex(map, h)].direction;
-			xpoint hn = neighbor(h, dir);
-			Segment* s = new Segment;
-			s->next = path;
-			s->nextp = h;
-			s->hex = hn;
-			s->dir = dir;
-			s->kind = kind;
-			s->cost = kost(hn, reverseDirection(dir), h);
-			h = hn;
-			path = s;
-		}
-		// path now contains the hexes in which the unit must travel ..
-		// backwards (like a stack)
+	if (foundIt)
+		trace(map, destination, kind);
+}
+/*
+	Copies the path through the meeting hex into `path'.  The forward search's marks lead from
+	there back to the source, and, if the meeting hex is not the destination, the reverse
+	search's marks lead on to the destination.
+ */
+void StraightPath::trace(HexMap* map, xpoint meeting, SegmentKind kind) {
+	path = null;
+	xpoint h = meeting;
+	while( h.x != source.x || h.y != source.y ){
+		HexDirection dir = search.direction(map, h);
+		xpoint hn = neighbor(h, dir);
+		Segment* s = new Segment;
+		s->next = path;
+		s->nextp = h;
+		s->hex = hn;
+		s->dir = dir;
+		s->kind = kind;
+		s->cost = kost(hn, reverseDirection(dir), h);
+		h = hn;
+		path = s;
 	}
+	// path now contains the hexes in which the unit must travel ..
+	// backwards (like a stack)
+
+	Segment** tail = &path;
+	while (*tail != null)
+		tail = &(*tail)->next;
+	h = meeting;
+	while (h != destination) {
+		HexDirection dir = _reverse.direction(map, h);
+		xpoint hn = neighbor(h, dir);
+		Segment* s = new Segment;
+		s->next = null;
+		s->hex = h;
+		s->nextp = hn;
+		s->dir = reverseDirection(dir);
+		s->kind = kind;
+		s->cost = kost(h, dir, hn);
+		*tail = s;
+		tail = &s->next;
+		h = hn;
+	}
+	foundIt = true;
 }
 
 int PathHeuristic::kost(xpoint a, HexDirection dir, xpoint b) {
 	return 0;
 }
 
+int PathHeuristic::estimate(xpoint a, xpoint b) {
+	return 0;
+}
+
 PathContinuation PathHeuristic::visit(xpoint a) {
 	return PC_CONTINUE;
 }
@@ -416,8 +622,7 @@ void PathHeuristic::finished(HexMap* map, SegmentKind kind) {
 }
 
 void PathHeuristic::review(HexMap* map) {
-	for (Node* v = visited.first; v != null; v = v->next)
-		reviewHex(map, v->h, v->gval);
+	search.review(map, this);
 }
 
 void PathHeuristic::reviewHex(HexMap* map, xpoint a, int distance) {
@@ -517,29 +722,30 @@ HexDirection directionTo(xpoint a, xpoint b) {
 // sure I did right. BJ: - Looks right to me.  Of course, I've re-written
 // it to be recursive, so who knows whether the original code worked.
 
-void propagate_down(HexMap* map, PathHeuristic* heuristic, Node* H) {
+void PathSearch::propagateDown(HexMap* map, PathHeuristic* heuristic, int H) {
+	xpoint h = _nodes[H].h;
 
     // Examine its neighbors
     for (HexDirection d = 0; d < 6; ++d) {
-        xpoint hn = neighbor(H->h, d);
+        xpoint hn = neighbor(h, d);
 		if (!map->valid(hn))
 			continue;
-		Marking& m = mark[xpointToIndex(map, hn)];
-        if (m.direction != DirNone && m.n != null) {
+		Marking& m = _mark[xpointToIndex(map, hn)];
+        if (m.generation == _generation && _nodes[m.n].heapIndex >= 0) {
             // This node is in OPEN                
-			int new_g = H->gval + heuristic->kost(H->h, d, hn);
+			int new_g = _nodes[H].gval + heuristic->kost(h, d, hn);
 
             // Compare this `g' to the stored `g' in the array
-			Node* n = m.n;
+			Node* n = &_nodes[m.n];
             if (new_g < n->gval) {
                 // Push this thing UP in the heap (only up allowed!)
                 n->gval = new_g;
-				open.recalc(n);
+				recalc(m.n);
 
                 // Set its direction to the parent node
 
                 m.direction = reverseDirection(d);
-				propagate_down(map, heuristic, n);
+				propagateDown(map, heuristic, m.n);
             } else {
                 // The new node is no better, so stop here
             }
@@ -578,11 +784,21 @@ max: private (a: int, b: int) int
 		return b
 }
 */
+static ObjectPool segmentPool("Segment");
+
 Segment::~Segment() {
 	if (next)
 		delete next;
 }
 
+void* Segment::operator new(size_t size) {
+	return segmentPool.allocate(size);
+}
+
+void Segment::operator delete(void* p, size_t size) {
+	segmentPool.release(p, size);
+}
+
 Segment* Segment::factory(fileSystem::Storage::Reader* r) {
 	Segment* s = new Segment();
 	int kind;
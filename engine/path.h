@@ -1,5 +1,6 @@
 #pragma once
 #include "../common/file_system.h"
+#include "../common/vector.h"
 #include "basic_types.h"
 #include "constants.h"
 
@@ -8,7 +9,10 @@ namespace engine {
 class Detachment;
 class Force;
 class HexMap;
+class Landmarks;
+class Node;
 class PathHeuristic;
+struct Marking;
 class Segment;
 class SupplyDepot;
 class Unit;
@@ -34,9 +38,10 @@ class Unit;
 // of Amit's unit pathfinding code, since it relied on his terrain
 // model.  I've had to substitute my own terrain model.
 //
-// I've also chosen to limit the code to a single thread at a time.
-// Repeat: this is not thread-safe code.  The OPEN set is maintained
-// in a Container object that is global to the process.
+// The code originally ran a single search at a time, with the OPEN
+// set kept in a Container object that was global to the process.  The
+// search state now lives in a PathSearch owned by each PathHeuristic,
+// so distinct heuristic objects can be used from different threads.
 //////////////////////////////////////////////////////////////////////
 // Amit's Path-finding (A*) code.
 //
@@ -99,19 +104,127 @@ class Unit;
 	distribute supplies, etc.
  */
 void visit(HexMap* map, PathHeuristic* path, engine::xpoint A, int maxDist, SegmentKind kind);
+/*
+	This is the same tour, started from several points at once.  Each hex is reached
+	from whichever source is closest, and following the marked directions back from
+	any hex ends at that source.
+ */
+void visit(HexMap* map, PathHeuristic* path, const vector<xpoint>& sources, int maxDist, SegmentKind kind);
+/*
+	This is the tour aimed at B: an A* search, in which each hex is ranked by the distance
+	traveled to it plus the path's estimate of the distance left to B.  Hexes that could
+	only be on a path to B at least maxDist long are not visited.  The path's visit method
+	must still stop the search when it gets to B.
+ */
+void visitToward(HexMap* map, PathHeuristic* path, xpoint A, xpoint B, int maxDist, SegmentKind kind);
 
 enum PathContinuation {
 	PC_CONTINUE,					// tracing paths should continue with more hexes.
 	PC_STOP_ALL,					// tracing should stop.
 	PC_STOP_THIS					// tracing along this path should stop, continue others.
 };
+/*
+ *	PathSearch
+ *
+ *	This holds the working state of a visit: the OPEN set (a binary heap
+ *	of nodes), the marking array and the node arena.  The marks carry the
+ *	generation of the search that wrote them, so a new search does not
+ *	have to erase the previous one.  The storage is kept from one search
+ *	to the next.
+ *
+ *	A PathSearch is not shared, so only one search at a time may use it.
+ */
+class PathSearch {
+public:
+	PathSearch();
+
+	~PathSearch();
+
+	/*
+	 *	run
+	 *
+	 *	Tours the map from the sources.  If goal is not null, the
+	 *	path's estimate of the distance left to it guides the
+	 *	search.
+	 */
+	void run(HexMap* map, PathHeuristic* path, const xpoint* sources, int count, int maxDist, SegmentKind kind, const xpoint* goal);
+	/*
+	 *	meet
+	 *
+	 *	Searches for the cheapest path from A to B from both ends at
+	 *	once: this search goes forward from A and reverse backward from
+	 *	B, each guided by the path's estimate of the distance to the far
+	 *	end.  It stops when neither search can improve on the best path
+	 *	found through a hex they have both reached.  The path's visit
+	 *	and finished methods are not called, so this is only for paths
+	 *	whose visit does no more than watch for B (see
+	 *	StraightPath::meetsHalfway).
+	 *
+	 *	Returns true if there is a path shorter than maxDist, and sets
+	 *	*meetp to a hex on it.  The directions of this search lead back
+	 *	from there to A, and those of reverse lead on to B.
+	 */
+	bool meet(HexMap* map, PathHeuristic* path, PathSearch* reverse, xpoint A, xpoint B, int maxDist, xpoint* meetp);
+
+	void review(HexMap* map, PathHeuristic* path);
+	/*
+	 *	direction
+	 *
+	 *	Returns the direction from hx back towards the origin of the
+	 *	last search, or DirNone if that search never reached hx.
+	 */
+	HexDirection direction(HexMap* map, xpoint hx) const;
+
+private:
+	PathSearch(const PathSearch&);
+
+	void operator= (const PathSearch&);
+
+	void start(HexMap* map);
+
+	void addOrigin(HexMap* map, xpoint hx, int h);
+
+	int newNode(xpoint p, int h, int g);
+
+	int popFirst();
+
+	void recalc(int n);
+
+	void siftUp(int i);
+
+	void siftDown(int i);
+
+	void propagateDown(HexMap* map, PathHeuristic* heuristic, int H);
+
+	Marking*		_mark;
+	int				_cells;
+	unsigned		_generation;
+	Node*			_nodes;			// The node arena
+	int*			_open;			// Binary heap of indices into _nodes
+	int*			_visited;		// Indices of CLOSED nodes, in the order they were closed
+	int				_capacity;		// Size of each of the three arrays above
+	int				_nodeCount;
+	int				_openCount;
+	int				_visitedCount;
+	unsigned		_sequence;
+};
 
 class PathHeuristic {
 public:
 	int			visitLimit;
 	xpoint		source;
+	PathSearch	search;
 
 	virtual int kost(xpoint a, HexDirection dir, xpoint b);
+	/*
+	 *	estimate
+	 *
+	 *	Returns a lower bound on the cost of any path from a to b.  For
+	 *	the paths found to be the cheapest, the estimate from one end of
+	 *	a step must never exceed the cost of the step plus the estimate
+	 *	from the other end.  Zero, the default, always qualifies.
+	 */
+	virtual int estimate(xpoint a, xpoint b);
 
 		// This is called once for each hex each time the path to
 		// that hex is found to be shorter than any previously 
@@ -140,14 +253,45 @@ public:
 	Segment* find(HexMap* map, xpoint A, xpoint B, SegmentKind kind);
 
 	virtual int kost(xpoint a, HexDirection dir, xpoint b);
+	/*
+	 *	The estimate is minimumStep for each hex between a and b, so
+	 *	minimumStep must be no more than the cost of any step.
+	 */
+	virtual int estimate(xpoint a, xpoint b);
 
 	virtual PathContinuation visit(xpoint a);
+	/*
+	 *	meetsHalfway
+	 *
+	 *	Returns true if seek may search from both ends at once.  That
+	 *	search never calls visit, so a path whose visit can stop the
+	 *	search anywhere but at the destination must return false, and
+	 *	seek then uses visitToward for it.
+	 */
+	virtual bool meetsHalfway() const { return true; }
 
 	virtual void finished(HexMap* map, SegmentKind kind);
 
 	xpoint			destination;
 	bool			foundIt;
 	Segment*		path;
+	int				minimumStep;
+
+protected:
+	/*
+	 *	seek
+	 *
+	 *	Finds path, from source to destination, searching from both
+	 *	ends at once if they are at least global::bidirectionalPathDistance
+	 *	hexes apart and meetsHalfway allows it, and otherwise with
+	 *	visitToward.
+	 */
+	void seek(HexMap* map, int maxDist, SegmentKind kind);
+
+private:
+	void trace(HexMap* map, xpoint meeting, SegmentKind kind);
+
+	PathSearch		_reverse;			// The search from the destination, when seek uses both
 };
 
 extern StraightPath straightPath;
@@ -168,6 +312,13 @@ int hexDistance(xpoint a, xpoint b);
 class Segment {
 public:
 	~Segment();
+	/*
+	 *	Segments are built by the thousand in every path search, so
+	 *	they come from an ObjectPool rather than the heap.
+	 */
+	static void* operator new(size_t size);
+
+	static void operator delete(void* p, size_t size);
 
 	static Segment* factory(fileSystem::Storage::Reader* r);
 
@@ -266,10 +417,18 @@ class SupplyPath : public StraightPath {
 public:
 	UnitCarriers	carriers;
 	Force*			force;
+	Landmarks*		landmarks;			// The map's index for carriers, if it has one
 
 	Segment* find(Unit* u, xpoint A, xpoint B);
 
 	virtual int kost(xpoint a, HexDirection dir, xpoint b);
+	/*
+	 *	Each step of a supply path is charged for the distance still
+	 *	left from the hex it enters, so the estimate grows with the
+	 *	square of the distance from a to b.  The cost of the moves
+	 *	themselves is bounded by the landmarks when there are any.
+	 */
+	virtual int estimate(xpoint a, xpoint b);
 };
 
 class DepotPath : public SupplyPath {
@@ -280,15 +439,71 @@ public:
 
 	virtual PathContinuation visit(xpoint a);
 
+	virtual bool meetsHalfway() const { return false; }
+
 private:
 	Detachment*		_excludeThis;
 };
+/*
+	SupplyField
+
+	This is a supply distance field for one force and one set of carriers.
+	It is built with a single search seeded from every hex holding one of the
+	force's supply depots.  The search runs the SupplyPath costs backwards, so
+	the direction marked in each hex leads to the nearest depot, and a
+	detachment's supply line is found by following the marks from its hex.
+
+	The field describes the map as it was when it was built.  It is only
+	meant to be used until the next change to the game state.
+ */
+class SupplyField : public SupplyPath {
+public:
+	void build(Force* force, UnitCarriers carriers);
+	/*
+	 *	find
+	 *
+	 *	Answers the question DepotPath::find would for excludeThis.
+	 *	Returns false if the field cannot answer it, which happens when
+	 *	the nearest depot hex only holds depots attached to excludeThis.
+	 *	Otherwise *linep and *depotp are set, to null if no depot can be
+	 *	reached.
+	 */
+	bool find(Detachment* excludeThis, Segment** linep, SupplyDepot** depotp);
+
+	virtual int kost(xpoint a, HexDirection dir, xpoint b);
+
+	virtual void finished(HexMap* map, SegmentKind kind);
+};
 
 class UnitPath : public StraightPath {
 public:
+	UnitPath() {
+		moveManner = MM_BEST;
+		_map = null;
+		_carriers = UC_FOOT;
+		_force = null;
+		_landmarks = null;
+		adjacentHexes = false;
+		confrontEnemy = false;
+	}
+
 	Segment* find(HexMap* map, Unit* u, xpoint A, UnitModes mode, xpoint B, bool ce);
+	/*
+	 *	unchanged
+	 *
+	 *	Returns true if each step of path, which must start at A,
+	 *	would still cost what it did when it was found by a call to
+	 *	find with the same arguments.  This only takes one cost
+	 *	calculation per step, so it is far cheaper than a new find.
+	 */
+	bool unchanged(HexMap* map, Unit* u, xpoint A, UnitModes mode, xpoint B, bool ce, Segment* path);
 
 	virtual int kost(xpoint a, HexDirection dir, xpoint b);
+	/*
+	 *	The landmarks, if the map has them, often bound the cost of
+	 *	the moves still ahead far better than minimumStep does.
+	 */
+	virtual int estimate(xpoint a, xpoint b);
 
 	HexMap* map() const { return _map; }
 
@@ -298,9 +513,14 @@ protected:
 	MoveManner		moveManner;
 
 private:
+	bool refine(HexMap* map, xpoint A, xpoint B);
+
+	bool railRoute(HexMap* map, xpoint A, xpoint B);
+
 	HexMap*			_map;
 	UnitCarriers	_carriers;
 	Force*			_force;
+	Landmarks*		_landmarks;
 	bool			adjacentHexes;
 	bool			confrontEnemy;
 };
@@ -320,5 +540,35 @@ int movementCost(HexMap* map,
 				 MoveManner moveManner,
 				 float* fuelRateP, 
 				 bool confrontEnemy);
+/*
+ *	pathCost
+ *
+ *	The same cost as movementCost, for callers that do not need the
+ *	fuel rate.  The terrain part of the cost comes from the map's edge
+ *	cost tables, so this is the one to use inside path searches.
+ */
+int pathCost(HexMap* map,
+			 xpoint a,
+			 HexDirection dir,
+			 xpoint b,
+			 Force* force,
+			 UnitCarriers carriers,
+			 MoveManner moveManner,
+			 bool confrontEnemy);
+/*
+ *	terrainMoveCost
+ *
+ *	The part of movementCost that depends only on the map: terrain,
+ *	edges and transport.  If useRoads is false, roads are ignored, as
+ *	they are for a unit that has to deal with the enemy.
+ */
+int terrainMoveCost(HexMap* map,
+					xpoint a,
+					HexDirection dir,
+					xpoint b,
+					UnitCarriers carriers,
+					MoveManner moveManner,
+					bool useRoads,
+					float* fuelRateP);
 
 }  // namespace engine
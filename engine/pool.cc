@@ -0,0 +1,78 @@
+#include "../common/platform.h"
+#include "pool.h"
+
+namespace engine {
+
+ObjectPool* ObjectPool::_first;
+
+ObjectPool::ObjectPool(const char* name) {
+	allocations = 0;
+	reuses = 0;
+	large = 0;
+	live = 0;
+	peak = 0;
+	chunks = 0;
+	_name = name;
+	for (int i = 0; i < POOL_LARGEST / POOL_GRAIN; i++)
+		_free[i] = null;
+	_chunk = null;
+	_chunkLeft = 0;
+	_next = _first;
+	_first = this;
+}
+
+void* ObjectPool::allocate(size_t size) {
+	if (size > POOL_LARGEST) {
+		_lock.lock();
+		allocations++;
+		large++;
+		_lock.unlock();
+		return ::operator new(size);
+	}
+	int slot = size > 0 ? int(size - 1) / POOL_GRAIN : 0;
+	int blockSize = (slot + 1) * POOL_GRAIN;
+	void* p;
+	_lock.lock();
+	allocations++;
+	live++;
+	if (live > peak)
+		peak = live;
+	if (_free[slot] != null) {
+		p = _free[slot];
+		_free[slot] = *(void**)p;
+		reuses++;
+	} else {
+		if (_chunkLeft < blockSize) {
+
+				// Whatever is left of the old chunk is too small for
+				// this block, so it is lost.  It is never more than
+				// POOL_LARGEST bytes per chunk.
+
+			_chunk = (char*)::operator new(POOL_CHUNK);
+			_chunkLeft = POOL_CHUNK;
+			chunks++;
+		}
+		p = _chunk;
+		_chunk += blockSize;
+		_chunkLeft -= blockSize;
+	}
+	_lock.unlock();
+	return p;
+}
+
+void ObjectPool::release(void* p, size_t size) {
+	if (p == null)
+		return;
+	if (size > POOL_LARGEST) {
+		::operator delete(p);
+		return;
+	}
+	int slot = size > 0 ? int(size - 1) / POOL_GRAIN : 0;
+	_lock.lock();
+	live--;
+	*(void**)p = _free[slot];
+	_free[slot] = p;
+	_lock.unlock();
+}
+
+}  // namespace engine
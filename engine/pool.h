@@ -0,0 +1,68 @@
+#pragma once
+#include <stddef.h>
+#include "parallel.h"
+
+namespace engine {
+
+const int POOL_GRAIN = 8;					// Block sizes are rounded up to a multiple of this
+const int POOL_LARGEST = 256;				// Larger objects go straight to the heap
+const int POOL_CHUNK = 64 * 1024;			// Bytes obtained from the heap at a time
+/*
+ *	ObjectPool
+ *
+ *	A free list allocator for the small objects the engine creates
+ *	and destroys by the million over a long game: events, path
+ *	segments and the combat bookkeeping records.  A class uses a
+ *	pool by defining operator new and operator delete to call
+ *	allocate and release.
+ *
+ *	Each block size (in steps of POOL_GRAIN bytes) has its own free
+ *	list, so one pool can serve a whole class hierarchy whose
+ *	members differ in size.  Blocks are carved from POOL_CHUNK byte
+ *	chunks that are never given back to the heap; a released block
+ *	waits on its free list for the next object of the same size.
+ *
+ *	Supply line searches build Segments on worker threads, so
+ *	allocate and release take a spin lock.
+ *
+ *	The counters cover the life of the process.
+ */
+class ObjectPool {
+public:
+	ObjectPool(const char* name);
+
+	void* allocate(size_t size);
+
+	void release(void* p, size_t size);
+	/*
+	 *	first
+	 *
+	 *	Every pool is chained on a list when it is constructed, so
+	 *	that statistics can be reported without knowing which
+	 *	pools exist.
+	 */
+	static ObjectPool* first() { return _first; }
+
+	ObjectPool* next() const { return _next; }
+
+	const char* name() const { return _name; }
+
+	__int64			allocations;			// Calls to allocate
+	__int64			reuses;					// Allocations served from a free list
+	__int64			large;					// Allocations passed through to the heap
+	int				live;					// Blocks allocated and not yet released
+	int				peak;					// Highest value of live
+	int				chunks;					// Chunks obtained from the heap
+
+private:
+	static ObjectPool*	_first;
+
+	ObjectPool*			_next;
+	const char*			_name;
+	SpinLock			_lock;
+	void*				_free[POOL_LARGEST / POOL_GRAIN];
+	char*				_chunk;				// Unused tail of the newest chunk
+	int					_chunkLeft;
+};
+
+}  // namespace engine
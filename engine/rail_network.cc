@@ -0,0 +1,513 @@
+#include "../common/platform.h"
+#include "rail_network.h"
+
+#include "game_map.h"
+#include "path.h"
+
+namespace engine {
+
+RailNetwork::RailNetwork(HexMap* map) {
+	_map = map;
+	_columns = map->getColumns();
+	int cells = map->getRows() * _columns;
+	_node = new int[cells];
+	_track = new int[cells];
+	_forward = new byte[cells];
+	_backward = new byte[cells];
+	for (int i = 0; i < cells; i++) {
+		_node[i] = -1;
+		_track[i] = -1;
+		_forward[i] = 0;
+		_backward[i] = 0;
+	}
+	_generation = 0;
+	_minimumStep = 0;
+
+	vector<xpoint> rails;
+	xpoint origin = map->subsetOrigin();
+	xpoint opposite = map->subsetOpposite();
+	xpoint hx;
+	for (hx.y = origin.y; hx.y < opposite.y; hx.y++)
+		for (hx.x = origin.x; hx.x < opposite.x; hx.x++)
+			if (degree(hx) > 0)
+				rails.push_back(hx);
+	lay(rails);
+}
+
+RailNetwork::~RailNetwork() {
+	delete [] _node;
+	delete [] _track;
+	delete [] _forward;
+	delete [] _backward;
+}
+
+void RailNetwork::changed(xpoint hx, HexDirection dir) {
+	xpoint n = neighbor(hx, dir);
+	if (!_map->valid(hx) || !_map->valid(n))
+		return;
+	int a = index(hx);
+	int b = index(n);
+
+		// Most edges changed in play have no rails on them, before
+		// or after.
+
+	if (_node[a] < 0 && _track[a] < 0 && _node[b] < 0 && _track[b] < 0 &&
+		_map->edgeCost(hx, dir, UC_RAIL, MM_RAIL, true) > MAXIMUM_PATH_LENGTH)
+		return;
+	_changed.push_back(hx);
+	_changed.push_back(n);
+}
+
+void RailNetwork::update() {
+	if (_changed.size() == 0)
+		return;
+	vector<xpoint> loose;
+	for (int i = 0; i < _changed.size(); i++) {
+		xpoint hx = _changed[i];
+		int c = index(hx);
+		if (_node[c] >= 0)
+			pullNode(_node[c], &loose);
+		else if (_track[c] >= 0)
+			pullTrack(_track[c], &loose);
+		loose.push_back(hx);
+	}
+	_changed.clear();
+	lay(loose);
+}
+
+int RailNetwork::route(xpoint A, xpoint B, int step, vector<xpoint>* hexes, int* capacity) {
+	update();
+	if (!_map->valid(A) || !_map->valid(B))
+		return MAXIMUM_PATH_LENGTH + 1;
+	int a = index(A);
+	int b = index(B);
+	if (A == B) {
+		if (_node[a] < 0 && _track[a] < 0)
+			return MAXIMUM_PATH_LENGTH + 1;
+		hexes->clear();
+		hexes->push_back(A);
+		if (capacity != null)
+			*capacity = _track[a] >= 0 ? _tracks[_track[a]].capacity : 0;
+		return 0;
+	}
+	End head[2];
+	End tail[2];
+	int heads = ends(A, false, step, head);
+	int tails = ends(B, true, step, tail);
+	if (heads == 0 || tails == 0)
+		return MAXIMUM_PATH_LENGTH + 1;
+
+	int best = MAXIMUM_PATH_LENGTH + 1;
+	int bestTail = -1;
+	bool directForward = false;
+	xpoint none(-1, -1);
+
+		// When A and B are on the same track, going straight along it,
+		// one way or the other, may be best.
+
+	if (_track[a] >= 0 && _track[a] == _track[b]) {
+		xpoint end;
+		best = follow(A, _forward[a], true, B, step, null, &end);
+		directForward = true;
+		if (end != B) {
+			best = follow(A, _backward[a], false, B, step, null, &end);
+			directForward = false;
+		}
+	}
+
+	_generation++;
+	if (_generation == 0) {
+		for (int i = 0; i < _nodes.size(); i++)
+			_nodes[i].stamp = 0;
+		_generation = 1;
+	}
+	_minimumStep = step + _map->minimumEdgeCost(UC_RAIL, MM_RAIL);
+	_open.clear();
+	for (int i = 0; i < heads; i++)
+		relax(head[i].node, head[i].cost, -1, B);
+	while (_open.size() > 0) {
+		Entry e = _open[0];
+		int n = _open.size() - 1;
+		Entry moved = _open[n];
+		_open.resize(n);
+		if (n > 0) {
+			int i = 0;
+			for (;;) {
+				int child = 2 * i + 1;
+				if (child >= n)
+					break;
+				if (child + 1 < n && _open[child + 1].fval < _open[child].fval)
+					child++;
+				if (_open[child].fval >= moved.fval)
+					break;
+				_open[i] = _open[child];
+				i = child;
+			}
+			_open[i] = moved;
+		}
+		if (e.fval >= best)
+			break;
+		if (_nodes[e.node].closed || _nodes[e.node].gval != e.gval)
+			continue;						// A better entry for the node came first
+		_nodes[e.node].closed = true;
+		for (int i = 0; i < tails; i++)
+			if (tail[i].node == e.node && e.gval + tail[i].cost < best) {
+				best = e.gval + tail[i].cost;
+				bestTail = i;
+			}
+		const vector<int>& tracks = _nodes[e.node].tracks;
+		for (int i = 0; i < tracks.size(); i++) {
+			const Track& t = _tracks[tracks[i]];
+			if (t.from == t.to)
+				continue;					// A loop leads nowhere new
+			if (t.from == e.node)
+				relax(t.to, e.gval + t.forward + t.length * step, tracks[i], B);
+			else
+				relax(t.from, e.gval + t.backward + t.length * step, tracks[i], B);
+		}
+	}
+	if (best > MAXIMUM_PATH_LENGTH)
+		return best;
+
+	hexes->clear();
+	hexes->push_back(A);
+	int least = _track[a] >= 0 ? _tracks[_track[a]].capacity : MAXIMUM_PATH_LENGTH;
+	if (bestTail < 0) {
+		follow(A, directForward ? _forward[a] : _backward[a], directForward, B, step, hexes, null);
+		if (capacity != null)
+			*capacity = least;
+		return best;
+	}
+
+		// Find the tracks taken, from the last node back to the first.
+
+	vector<int> taken;
+	int n = tail[bestTail].node;
+	while (_nodes[n].via >= 0) {
+		const Track& t = _tracks[_nodes[n].via];
+		taken.push_back(_nodes[n].via);
+		n = t.to == n ? t.from : t.to;
+	}
+	if (heads > 1) {
+		int i = 0;
+		while (head[i].node != n || head[i].cost != _nodes[n].gval)
+			i++;
+		follow(A, head[i].forward ? _forward[a] : _backward[a], head[i].forward, none, step, hexes, null);
+	}
+	for (int i = taken.size() - 1; i >= 0; i--) {
+		const Track& t = _tracks[taken[i]];
+		if (t.from == n) {
+			follow(_nodes[n].hex, t.fromDir, true, none, step, hexes, null);
+			n = t.to;
+		} else {
+			follow(_nodes[n].hex, t.toDir, false, none, step, hexes, null);
+			n = t.from;
+		}
+		if (t.capacity < least)
+			least = t.capacity;
+	}
+	if (tails > 1) {
+		const Track& t = _tracks[_track[b]];
+		if (tail[bestTail].forward)
+			follow(_nodes[t.to].hex, t.toDir, false, B, step, hexes, null);
+		else
+			follow(_nodes[t.from].hex, t.fromDir, true, B, step, hexes, null);
+		if (t.capacity < least)
+			least = t.capacity;
+	}
+	if (capacity != null)
+		*capacity = least;
+	return best;
+}
+/*
+ *	open
+ *
+ *	A rail edge is open if a train can cross it both ways.
+ */
+bool RailNetwork::open(xpoint hx, HexDirection dir) const {
+	xpoint n = neighbor(hx, dir);
+	return _map->valid(hx) &&
+		   _map->valid(n) &&
+		   _map->edgeCost(hx, dir, UC_RAIL, MM_RAIL, true) <= MAXIMUM_PATH_LENGTH &&
+		   _map->edgeCost(n, reverseDirection(dir), UC_RAIL, MM_RAIL, true) <= MAXIMUM_PATH_LENGTH;
+}
+
+int RailNetwork::degree(xpoint hx) const {
+	int d = 0;
+	for (HexDirection dir = 0; dir < 6; dir++)
+		if (open(hx, dir))
+			d++;
+	return d;
+}
+
+int RailNetwork::capacity(xpoint hx, HexDirection dir) const {
+	int t = _map->getTransportEdge(hx, dir);
+	int c = 0;
+	int tbit, i;
+	for (tbit = TF_MINTRANS, i = 0; i < TF_MAXTRANS; tbit <<= 1, i++)
+		if ((t & tbit) != 0 && _map->transportData[i].railCap > c)
+			c = _map->transportData[i].railCap;
+	return c;
+}
+/*
+ *	lay
+ *
+ *	Lays track through the given hexes, none of which may be on a
+ *	track yet, except as nodes.  Every open rail edge out of a node
+ *	must either be on a track already or lead to one of the hexes.
+ */
+void RailNetwork::lay(const vector<xpoint>& hexes) {
+
+		// Nodes first, so that every trace ends at one.
+
+	for (int i = 0; i < hexes.size(); i++) {
+		int c = index(hexes[i]);
+		if (_node[c] >= 0 || _track[c] >= 0)
+			continue;
+		int d = degree(hexes[i]);
+		if (d > 0 && d != 2)
+			addNode(hexes[i]);
+	}
+	for (int i = 0; i < hexes.size(); i++) {
+		int n = _node[index(hexes[i])];
+		if (n < 0)
+			continue;
+		for (HexDirection dir = 0; dir < 6; dir++)
+			if (open(hexes[i], dir) && !covered(n, dir))
+				trace(n, dir);
+	}
+
+		// Anything left is a ring of rail with no junction on it, and
+		// any hex of it will do as a node.
+
+	for (int i = 0; i < hexes.size(); i++) {
+		int c = index(hexes[i]);
+		if (_node[c] >= 0 || _track[c] >= 0 || degree(hexes[i]) != 2)
+			continue;
+		int n = addNode(hexes[i]);
+		for (HexDirection dir = 0; dir < 6; dir++)
+			if (open(hexes[i], dir) && !covered(n, dir))
+				trace(n, dir);
+	}
+}
+
+int RailNetwork::addNode(xpoint hx) {
+	int n;
+	if (_freeNodes.size() > 0) {
+		n = _freeNodes[_freeNodes.size() - 1];
+		_freeNodes.resize(_freeNodes.size() - 1);
+	} else {
+		n = _nodes.size();
+		_nodes.push_back(Node());
+	}
+	_nodes[n].hex = hx;
+	_nodes[n].tracks.clear();
+	_nodes[n].stamp = 0;
+	_node[index(hx)] = n;
+	return n;
+}
+/*
+ *	trace
+ *
+ *	Lays a track from node n in direction dir, through hexes with two
+ *	open rail edges, to the next node.
+ */
+void RailNetwork::trace(int n, HexDirection dir) {
+	int ti;
+	if (_freeTracks.size() > 0) {
+		ti = _freeTracks[_freeTracks.size() - 1];
+		_freeTracks.resize(_freeTracks.size() - 1);
+	} else {
+		ti = _tracks.size();
+		_tracks.push_back(Track());
+	}
+	Track t;
+	t.from = n;
+	t.fromDir = dir;
+	t.length = 0;
+	t.forward = 0;
+	t.backward = 0;
+	t.capacity = capacity(_nodes[n].hex, dir);
+	xpoint at = _nodes[n].hex;
+	for (;;) {
+		xpoint next = neighbor(at, dir);
+		HexDirection back = reverseDirection(dir);
+		t.length++;
+		t.forward += _map->edgeCost(at, dir, UC_RAIL, MM_RAIL, true);
+		t.backward += _map->edgeCost(next, back, UC_RAIL, MM_RAIL, true);
+		int cap = capacity(at, dir);
+		if (cap < t.capacity)
+			t.capacity = cap;
+		int c = index(next);
+		if (_node[c] >= 0) {
+			t.to = _node[c];
+			t.toDir = back;
+			break;
+		}
+		HexDirection out;
+		for (out = 0; out < 6; out++)
+			if (out != back && open(next, out))
+				break;
+		_track[c] = ti;
+		_forward[c] = byte(out);
+		_backward[c] = byte(back);
+		at = next;
+		dir = out;
+	}
+	_tracks[ti] = t;
+	_nodes[n].tracks.push_back(ti);
+	if (t.to != n)
+		_nodes[t.to].tracks.push_back(ti);
+}
+
+bool RailNetwork::covered(int n, HexDirection dir) const {
+	const vector<int>& tracks = _nodes[n].tracks;
+	for (int i = 0; i < tracks.size(); i++) {
+		const Track& t = _tracks[tracks[i]];
+		if ((t.from == n && t.fromDir == dir) || (t.to == n && t.toDir == dir))
+			return true;
+	}
+	return false;
+}
+/*
+ *	pullNode
+ *
+ *	Takes up node n and every track ending at it, adding the hexes
+ *	they leave to *loose.
+ */
+void RailNetwork::pullNode(int n, vector<xpoint>* loose) {
+	while (_nodes[n].tracks.size() > 0)
+		pullTrack(_nodes[n].tracks[0], loose);
+	xpoint hx = _nodes[n].hex;
+	_node[index(hx)] = -1;
+	_nodes[n].hex = xpoint(-1, -1);
+	_freeNodes.push_back(n);
+	loose->push_back(hx);
+}
+/*
+ *	pullTrack
+ *
+ *	Takes up track t, adding the hexes along it and its end nodes,
+ *	which stay, to *loose.  The hexes are followed by the directions
+ *	recorded when the track was laid, since the rails may no longer
+ *	be open.
+ */
+void RailNetwork::pullTrack(int t, vector<xpoint>* loose) {
+	Track& tr = _tracks[t];
+	xpoint at = _nodes[tr.from].hex;
+	HexDirection dir = tr.fromDir;
+	for (int i = 1; i < tr.length; i++) {
+		at = neighbor(at, dir);
+		int c = index(at);
+		_track[c] = -1;
+		loose->push_back(at);
+		dir = _forward[c];
+	}
+	unlink(tr.from, t);
+	if (tr.to != tr.from)
+		unlink(tr.to, t);
+	loose->push_back(_nodes[tr.from].hex);
+	loose->push_back(_nodes[tr.to].hex);
+	tr.from = -1;
+	tr.to = -1;
+	_freeTracks.push_back(t);
+}
+
+void RailNetwork::unlink(int n, int t) {
+	vector<int>& tracks = _nodes[n].tracks;
+	for (int i = 0; i < tracks.size(); i++)
+		if (tracks[i] == t) {
+			tracks[i] = tracks[tracks.size() - 1];
+			tracks.resize(tracks.size() - 1);
+			return;
+		}
+}
+/*
+ *	follow
+ *
+ *	Walks a track from at, first in direction dir and then toward its
+ *	to node if forward is set, or its from node if not, until it
+ *	reaches stop or a node.  Each hex entered is added to *hexes, if
+ *	hexes is not null, and the hex the walk ends at is stored in *end,
+ *	if end is not null.  Returns the cost of the walk, charging step
+ *	for each hex entered.
+ */
+int RailNetwork::follow(xpoint at, HexDirection dir, bool forward, xpoint stop, int step, vector<xpoint>* hexes, xpoint* end) const {
+	int cost = 0;
+	for (;;) {
+		xpoint next = neighbor(at, dir);
+		cost += _map->edgeCost(at, dir, UC_RAIL, MM_RAIL, true) + step;
+		if (hexes != null)
+			hexes->push_back(next);
+		int c = index(next);
+		if (next == stop || _node[c] >= 0) {
+			if (end != null)
+				*end = next;
+			return cost;
+		}
+		dir = forward ? _forward[c] : _backward[c];
+		at = next;
+	}
+}
+/*
+ *	ends
+ *
+ *	Fills in e with the ways between hx and the network's nodes:
+ *	none if hx is off the rails, one if it is a node, and one to each
+ *	end of its track otherwise.  The costs are of the walk from the
+ *	node to hx if toward is set, and from hx to the node if not.
+ *	Returns the number of ways.
+ */
+int RailNetwork::ends(xpoint hx, bool toward, int step, End* e) {
+	int c = index(hx);
+	if (_node[c] >= 0) {
+		e[0].node = _node[c];
+		e[0].forward = true;
+		e[0].cost = 0;
+		return 1;
+	}
+	if (_track[c] < 0)
+		return 0;
+	const Track& t = _tracks[_track[c]];
+	xpoint none(-1, -1);
+	e[0].node = t.to;
+	e[0].forward = true;
+	e[1].node = t.from;
+	e[1].forward = false;
+	if (toward) {
+		e[0].cost = follow(_nodes[t.to].hex, t.toDir, false, hx, step, null, null);
+		e[1].cost = follow(_nodes[t.from].hex, t.fromDir, true, hx, step, null, null);
+	} else {
+		e[0].cost = follow(hx, _forward[c], true, none, step, null, null);
+		e[1].cost = follow(hx, _backward[c], false, none, step, null, null);
+	}
+	return 2;
+}
+
+void RailNetwork::relax(int n, int g, int via, xpoint goal) {
+	Node& node = _nodes[n];
+	if (node.stamp != _generation) {
+		node.stamp = _generation;
+		node.closed = false;
+	} else if (node.closed || g >= node.gval)
+		return;
+	node.gval = g;
+	node.via = via;
+
+	Entry e;
+	e.gval = g;
+	e.fval = g + hexDistance(node.hex, goal) * _minimumStep;
+	e.node = n;
+	int i = _open.size();
+	_open.push_back(e);
+	while (i > 0) {
+		int parentSlot = (i - 1) / 2;
+		if (_open[parentSlot].fval <= e.fval)
+			break;
+		_open[i] = _open[parentSlot];
+		i = parentSlot;
+	}
+	_open[i] = e;
+}
+
+}  // namespace engine
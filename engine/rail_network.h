@@ -0,0 +1,156 @@
+#pragma once
+#include "../common/vector.h"
+#include "basic_types.h"
+
+namespace engine {
+
+class HexMap;
+/*
+ *	RailNetwork
+ *
+ *	The rail lines of a map, boiled down to a graph.  Its nodes are
+ *	the hexes where rail lines meet, branch or end, and each track
+ *	between two nodes stands for a whole run of rail through hexes
+ *	with exactly two open rail edges.  A track records its length in
+ *	hexes, the cost of travelling it each way and its capacity, the
+ *	least railCap of its edges.
+ *
+ *	The costs are those of entrained movement in the map's edge cost
+ *	table, so a rail edge is open when a train can cross it: not torn,
+ *	not clogged and not over a blown bridge.  When the map changes the
+ *	cost of an edge, the tracks and nodes at either end of it are
+ *	pulled up and laid again, from those hexes only, the next time the
+ *	network is used.
+ *
+ *	Searches of the network take a handful of nodes where a search of
+ *	the hexes would take thousands, so entrained moves, which can only
+ *	follow the rails anyway, are routed here.  Only the stretches from
+ *	the start to the first node and from the last node to the end are
+ *	walked hex by hex.
+ */
+class RailNetwork {
+public:
+	RailNetwork(HexMap* map);
+
+	~RailNetwork();
+	/*
+	 *	changed
+	 *
+	 *	Notes that the cost of the move from hx in direction dir may
+	 *	have changed.
+	 */
+	void changed(xpoint hx, HexDirection dir);
+	/*
+	 *	update
+	 *
+	 *	Relays the rails around any edges changed since the last call.
+	 */
+	void update();
+	/*
+	 *	route
+	 *
+	 *	Finds the cheapest route along open rails from A to B, charging
+	 *	step for each hex entered on top of the cost of the move.  On
+	 *	success, *hexes is set to the hexes of the route, from A to B,
+	 *	*capacity (if capacity is not null) to the least capacity of
+	 *	the tracks it uses, and the cost of the route is returned.
+	 *	Returns MAXIMUM_PATH_LENGTH + 1 if no open rails connect A and B.
+	 */
+	int route(xpoint A, xpoint B, int step, vector<xpoint>* hexes, int* capacity);
+
+	int nodes() const { return _nodes.size() - _freeNodes.size(); }
+
+	int tracks() const { return _tracks.size() - _freeTracks.size(); }
+
+private:
+	RailNetwork(const RailNetwork&);
+
+	void operator= (const RailNetwork&);
+
+	class Node {
+	public:
+		xpoint			hex;				// (-1, -1) if the node is free
+		vector<int>		tracks;				// Tracks with an end here
+
+			// Search state, current when stamp is the generation
+
+		unsigned		stamp;
+		int				gval;
+		int				via;				// Track the search arrived by, or -1 at the start
+		bool			closed;
+	};
+
+	class Track {
+	public:
+		int				from;				// -1 if the track is free
+		int				to;					// May be from, for a loop
+		HexDirection	fromDir;			// Out of from along the track
+		HexDirection	toDir;				// Out of to along the track
+		int				length;				// In hexes
+		int				forward;			// Cost from from to to
+		int				backward;			// Cost from to to from
+		int				capacity;
+	};
+
+	class Entry {
+	public:
+		int				fval;
+		int				gval;
+		int				node;
+	};
+	/*
+	 *	An end is one way from a hex in the middle of a track to one of
+	 *	the nodes at its ends.
+	 */
+	class End {
+	public:
+		int				node;
+		bool			forward;			// Toward the track's to node
+		int				cost;
+	};
+
+	int index(xpoint hx) const { return hx.y * _columns + hx.x; }
+
+	bool open(xpoint hx, HexDirection dir) const;
+
+	int degree(xpoint hx) const;
+
+	int capacity(xpoint hx, HexDirection dir) const;
+
+	void lay(const vector<xpoint>& hexes);
+
+	int addNode(xpoint hx);
+
+	void trace(int n, HexDirection dir);
+
+	bool covered(int n, HexDirection dir) const;
+
+	void pullNode(int n, vector<xpoint>* loose);
+
+	void pullTrack(int t, vector<xpoint>* loose);
+
+	void unlink(int n, int t);
+
+	int follow(xpoint at, HexDirection dir, bool forward, xpoint stop, int step, vector<xpoint>* hexes, xpoint* end) const;
+
+	int ends(xpoint hx, bool toward, int step, End* e);
+
+	void relax(int n, int g, int via, xpoint goal);
+
+	HexMap*			_map;
+	int				_columns;
+	int*			_node;					// Per hex, the node there or -1
+	int*			_track;					// Per hex, the track passing through or -1
+	byte*			_forward;				// Per hex on a track, the direction toward its to node
+	byte*			_backward;				// Per hex on a track, the direction toward its from node
+	vector<Node>	_nodes;
+	vector<Track>	_tracks;
+	vector<int>		_freeNodes;
+	vector<int>		_freeTracks;
+	vector<xpoint>	_changed;				// Hexes at either end of edges changed since update
+	unsigned		_generation;
+	int				_minimumStep;			// Least cost of an open rail edge, for the estimate
+	vector<Entry>	_open;					// Binary heap on fval, may hold stale entries
+};
+
+}  // namespace engine
@@ -0,0 +1,30 @@
+#include "../common/platform.h"
+#include "simulation.h"
+
+#include "game.h"
+#include "scenario.h"
+
+namespace engine {
+
+Game* runSimulation(const Scenario* scenario, unsigned seed, SimulationStats* stats) {
+	__int64 start = millisecondMark();
+	Game* game = startGame(scenario, seed);
+	__int64 end = millisecondMark();
+	if (game == null)
+		return null;
+	if (stats != null)
+		stats->startSeconds = (end - start) / 1000.0;
+	while (!game->over() && game->time() < scenario->end) {
+		__int64 dayStart = millisecondMark();
+		game->advanceClock();
+		if (stats != null)
+			stats->daySeconds.push_back((millisecondMark() - dayStart) / 1000.0);
+	}
+	if (stats != null) {
+		stats->runSeconds = (millisecondMark() - end) / 1000.0;
+		stats->events = game->eventsProcessed();
+	}
+	return game;
+}
+
+}  // namespace engine
@@ -0,0 +1,41 @@
+#pragma once
+#include "../common/vector.h"
+#include "basic_types.h"
+
+namespace engine {
+
+class Game;
+class Scenario;
+/*
+ *	SimulationStats
+ *
+ *	Wall clock timings for one headless run of a scenario.  All
+ *	times are in seconds.  daySeconds holds the time taken by each
+ *	call to Game::advanceClock, AI included, in game order.
+ */
+class SimulationStats {
+public:
+	SimulationStats() {
+		startSeconds = 0;
+		runSeconds = 0;
+		events = 0;
+	}
+
+	double			startSeconds;
+	double			runSeconds;
+	unsigned		events;
+	vector<double>	daySeconds;
+};
+/*
+ *	runSimulation
+ *
+ *	Starts a game of the scenario with the given random seed and
+ *	advances it, one day at a time, until the scenario end date.
+ *	Nothing here touches the display, so this is the entry point for
+ *	batch runs, benchmarks and parameter tuning.  The finished game
+ *	is returned for inspection and must be deleted by the caller.
+ *	If stats is not null, it is filled in.
+ */
+Game* runSimulation(const Scenario* scenario, unsigned seed, SimulationStats* stats);
+
+}  // namespace engine
@@ -0,0 +1,442 @@
+#include "../common/platform.h"
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../common/file_system.h"
+#include "../common/vector.h"
+#include "game.h"
+#include "global.h"
+#include "mapped_file.h"
+
+namespace engine {
+
+const int SNAPSHOT_MAGIC = ('H' << 24) + ('S' << 16) + ('B' << 8) + '1';
+const int SNAPSHOT_VERSION = 1;
+
+enum SnapshotKind {
+	SK_FULL,
+	SK_DELTA
+};
+/*
+ *	SnapshotHeader
+ *
+ *	A snapshot file starts with this header, which is followed by
+ *	a stream of sections, each a SectionHeader and its data, ending
+ *	with an ST_END section.  A reader skips sections it does not
+ *	know, so later versions may add them.
+ *
+ *	The state image is what fileSystem::Storage writes for the game
+ *	with its event log left out.  A full snapshot carries it whole
+ *	in an ST_STATE section.  A delta snapshot carries an ST_BASE
+ *	section naming the full snapshot it was made from, and an
+ *	ST_DELTA section of DeltaEdits that rebuild the image from the
+ *	base's.  The checksum covers the rebuilt image.
+ */
+struct SnapshotHeader {
+	int				magic;
+	int				version;
+	int				kind;
+	minutes			time;				// Game time when the snapshot was taken
+	int				stateLength;		// Bytes in the state image
+	unsigned		stateChecksum;
+};
+
+enum SectionTag {
+	ST_END,
+	ST_STATE,							// The state image
+	ST_BASE,							// Checksum of the base's state image, then its name
+	ST_DELTA							// DeltaEdits
+};
+
+struct SectionHeader {
+	int				tag;
+	int				length;				// Bytes of data after this header
+};
+
+enum DeltaOp {
+	DO_COPY,							// Copy length bytes of the base image from offset
+	DO_LITERAL							// The next length bytes of the section are new
+};
+
+struct DeltaEdit {
+	int				op;
+	int				offset;
+	int				length;
+};
+	//
+	// The state images are cut into chunks at content defined
+	// boundaries, so that a unit added or removed early in the
+	// image only disturbs the chunks around it.  Chunks of the new
+	// image found in the base are written as copies.
+	//
+const int CHUNK_MIN = 256;
+const int CHUNK_MAX = 16 * 1024;
+const unsigned CHUNK_MASK = 0x7ff;		// Average chunk is about 2K
+
+struct BaseChunk {
+	unsigned		hash;
+	int				offset;
+	int				length;
+};
+
+static unsigned gear(byte b) {
+	unsigned x = b * 0x9e3779b1 + 0x7f4a7c15;
+	x ^= x >> 15;
+	x *= 0x85ebca6b;
+	x ^= x >> 13;
+	return x;
+}
+
+static int chunkEnd(const byte* data, int start, int length) {
+	int limit = start + CHUNK_MAX;
+	if (limit > length)
+		limit = length;
+	unsigned h = 0;
+	for (int i = start; i < limit; i++) {
+		h = (h << 1) + gear(data[i]);
+		if (i + 1 - start >= CHUNK_MIN && (h & CHUNK_MASK) == 0)
+			return i + 1;
+	}
+	return limit;
+}
+
+static unsigned checksum(const byte* data, int length) {
+	unsigned h = 2166136261;
+	for (int i = 0; i < length; i++) {
+		h ^= data[i];
+		h *= 16777619;
+	}
+	return h;
+}
+
+static int compareChunks(const void* a, const void* b) {
+	const BaseChunk* ca = (const BaseChunk*)a;
+	const BaseChunk* cb = (const BaseChunk*)b;
+	if (ca->hash != cb->hash)
+		return ca->hash < cb->hash ? -1 : 1;
+	return ca->offset - cb->offset;
+}
+/*
+ *	findChunk
+ *
+ *	Returns the offset in the base image of a chunk with the same
+ *	bytes as data, or -1 if there is none.
+ */
+static int findChunk(const vector<BaseChunk>& chunks, const byte* base, const byte* data, int length) {
+	unsigned h = checksum(data, length);
+	int lo = 0;
+	int hi = chunks.size();
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (chunks[mid].hash < h)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (int i = lo; i < chunks.size() && chunks[i].hash == h; i++)
+		if (chunks[i].length == length &&
+			memcmp(base + chunks[i].offset, data, length) == 0)
+			return chunks[i].offset;
+	return -1;
+}
+
+static void addEdit(vector<byte>* edits, int op, int offset, int length, const byte* data) {
+	if (length == 0)
+		return;
+	DeltaEdit e;
+	e.op = op;
+	e.offset = offset;
+	e.length = length;
+	int at = edits->size();
+	edits->resize(at + sizeof e + (op == DO_LITERAL ? length : 0));
+	memcpy(&(*edits)[at], &e, sizeof e);
+	if (op == DO_LITERAL)
+		memcpy(&(*edits)[at + sizeof e], data, length);
+}
+/*
+ *	buildDelta
+ *
+ *	Collects in edits the edits that turn base into state.  Runs of
+ *	copied chunks that are also adjacent in the base become one edit,
+ *	as do runs of new chunks.
+ */
+static void buildDelta(vector<byte>* edits, const byte* base, int baseLength, const byte* state, int stateLength) {
+	vector<BaseChunk> chunks;
+	for (int i = 0; i < baseLength; ) {
+		int end = chunkEnd(base, i, baseLength);
+		BaseChunk c;
+		c.hash = checksum(base + i, end - i);
+		c.offset = i;
+		c.length = end - i;
+		chunks.push_back(c);
+		i = end;
+	}
+	if (chunks.size() > 0)
+		qsort(&chunks[0], chunks.size(), sizeof (BaseChunk), compareChunks);
+	int copyOffset = 0;
+	int copyLength = 0;
+	int literalStart = 0;
+	int literalLength = 0;
+	for (int i = 0; i < stateLength; ) {
+		int end = chunkEnd(state, i, stateLength);
+		int offset = findChunk(chunks, base, state + i, end - i);
+		if (offset < 0) {
+			addEdit(edits, DO_COPY, copyOffset, copyLength, null);
+			copyLength = 0;
+			if (literalLength == 0)
+				literalStart = i;
+			literalLength += end - i;
+		} else {
+			addEdit(edits, DO_LITERAL, 0, literalLength, state + literalStart);
+			literalLength = 0;
+			if (copyLength > 0 && copyOffset + copyLength != offset) {
+				addEdit(edits, DO_COPY, copyOffset, copyLength, null);
+				copyLength = 0;
+			}
+			if (copyLength == 0)
+				copyOffset = offset;
+			copyLength += end - i;
+		}
+		i = end;
+	}
+	addEdit(edits, DO_COPY, copyOffset, copyLength, null);
+	addEdit(edits, DO_LITERAL, 0, literalLength, state + literalStart);
+}
+
+static bool applyDelta(const byte* edits, int length, const byte* base, int baseLength, byte* state, int stateLength) {
+	int out = 0;
+	int i = 0;
+	while (i < length) {
+		if (length - i < int(sizeof (DeltaEdit)))
+			return false;
+		DeltaEdit e;
+		memcpy(&e, edits + i, sizeof e);
+		i += sizeof e;
+		if (e.length < 0 || e.length > stateLength - out)
+			return false;
+		if (e.op == DO_COPY) {
+			if (e.offset < 0 || e.offset > baseLength - e.length)
+				return false;
+			memcpy(state + out, base + e.offset, e.length);
+		} else if (e.op == DO_LITERAL) {
+			if (e.length > length - i)
+				return false;
+			memcpy(state + out, edits + i, e.length);
+			i += e.length;
+		} else
+			return false;
+		out += e.length;
+	}
+	return out == stateLength;
+}
+/*
+ *	findSection
+ *
+ *	Looks through the sections of a snapshot file already known to
+ *	have a good header.  Returns a pointer to the data of the first
+ *	section with the given tag and sets *length to its size, or
+ *	returns null if there is no such section.
+ */
+static const byte* findSection(const MappedFile& f, int tag, int* length) {
+	int i = sizeof (SnapshotHeader);
+	while (f.size() - i >= int(sizeof (SectionHeader))) {
+		SectionHeader s;
+		memcpy(&s, f.data() + i, sizeof s);
+		i += sizeof s;
+		if (s.tag == ST_END || s.length < 0 || s.length > f.size() - i)
+			break;
+		if (s.tag == tag) {
+			*length = s.length;
+			return f.data() + i;
+		}
+		i += s.length;
+	}
+	return null;
+}
+
+static const SnapshotHeader* openSnapshot(MappedFile* f, const string& filename) {
+	if (!f->open(filename)) {
+		warningMessage("Couldn't open snapshot: " + filename);
+		return null;
+	}
+	const SnapshotHeader* h = (const SnapshotHeader*)f->data();
+	if (f->size() < int(sizeof (SnapshotHeader)) ||
+		h->magic != SNAPSHOT_MAGIC ||
+		h->version != SNAPSHOT_VERSION ||
+		h->stateLength < 0) {
+		warningMessage("Not a snapshot file: " + filename);
+		return null;
+	}
+	return h;
+}
+/*
+ *	openBase
+ *
+ *	Opens the full snapshot named by base (relative to the snapshot
+ *	filename) and finds its state image.
+ */
+static const SnapshotHeader* openBase(MappedFile* f, const string& base, const string& filename, const byte** state) {
+	string baseFile = fileSystem::pathRelativeTo(base, filename);
+	const SnapshotHeader* h = openSnapshot(f, baseFile);
+	if (h == null)
+		return null;
+	int length;
+	if (h->kind != SK_FULL ||
+		(*state = findSection(*f, ST_STATE, &length)) == null ||
+		length != h->stateLength) {
+		warningMessage("Not a full snapshot: " + baseFile);
+		return null;
+	}
+	return h;
+}
+
+static bool writeSection(FILE* fp, int tag, const void* data, int length) {
+	SectionHeader s;
+	s.tag = tag;
+	s.length = length;
+	return fwrite(&s, sizeof s, 1, fp) == 1 &&
+		   (length == 0 || fwrite(data, 1, length, fp) == size_t(length));
+}
+/*
+ *	stateFile
+ *
+ *	The game storage code only reads and writes files, so a state
+ *	image passes through this file, next to the snapshot, on its way
+ *	in or out.  It is removed as soon as it has been used.
+ */
+static string stateFile(const string& filename) {
+	return filename + ".state";
+}
+
+static bool writeSnapshot(FILE* fp, minutes time, const byte* state, int stateLength, const string& base, const string& filename) {
+	SnapshotHeader h;
+	h.magic = SNAPSHOT_MAGIC;
+	h.version = SNAPSHOT_VERSION;
+	h.kind = base.size() > 0 ? SK_DELTA : SK_FULL;
+	h.time = time;
+	h.stateLength = stateLength;
+	h.stateChecksum = checksum(state, stateLength);
+	if (fwrite(&h, sizeof h, 1, fp) != 1)
+		return false;
+	if (h.kind == SK_FULL)
+		return writeSection(fp, ST_STATE, state, stateLength) &&
+			   writeSection(fp, ST_END, null, 0);
+	MappedFile baseFile;
+	const byte* baseState;
+	const SnapshotHeader* bh = openBase(&baseFile, base, filename, &baseState);
+	if (bh == null)
+		return false;
+	vector<byte> name;
+	name.resize(sizeof bh->stateChecksum + base.size());
+	memcpy(&name[0], &bh->stateChecksum, sizeof bh->stateChecksum);
+	memcpy(&name[sizeof bh->stateChecksum], base.c_str(), base.size());
+	vector<byte> edits;
+	buildDelta(&edits, baseState, bh->stateLength, state, stateLength);
+	return writeSection(fp, ST_BASE, &name[0], name.size()) &&
+		   writeSection(fp, ST_DELTA, edits.size() > 0 ? &edits[0] : null, edits.size()) &&
+		   writeSection(fp, ST_END, null, 0);
+}
+
+bool saveSnapshot(Game* game, const string& filename, const string& base) {
+	string scratch = stateFile(filename);
+	game->storeHistory = false;
+	fileSystem::Storage s(scratch, &global::storageMap);
+	s.store(game);
+	bool stored = s.write();
+	game->storeHistory = true;
+	if (!stored) {
+		remove(scratch.c_str());
+		warningMessage("Couldn't write game state: " + scratch);
+		return false;
+	}
+	MappedFile state;
+	if (!state.open(scratch)) {
+		remove(scratch.c_str());
+		warningMessage("Couldn't read game state: " + scratch);
+		return false;
+	}
+	FILE* fp = fileSystem::createBinaryFile(filename);
+	if (fp == null) {
+		state.close();
+		remove(scratch.c_str());
+		warningMessage("Couldn't create file: " + filename);
+		return false;
+	}
+	bool result = writeSnapshot(fp, game->time(), state.data(), state.size(), base, filename);
+	if (fclose(fp) != 0)
+		result = false;
+	state.close();
+	remove(scratch.c_str());
+	if (!result) {
+		remove(filename.c_str());
+		warningMessage("Write error on file: " + filename);
+	}
+	return result;
+}
+
+Game* loadSnapshot(const string& filename) {
+	MappedFile f;
+	const SnapshotHeader* h = openSnapshot(&f, filename);
+	if (h == null)
+		return null;
+	const byte* state;
+	byte* image = null;
+	int length;
+	if (h->kind == SK_FULL) {
+		state = findSection(f, ST_STATE, &length);
+		if (state == null || length != h->stateLength) {
+			warningMessage("Snapshot has no game state: " + filename);
+			return null;
+		}
+	} else {
+		const byte* name = findSection(f, ST_BASE, &length);
+		if (name == null || length <= int(sizeof (unsigned))) {
+			warningMessage("Snapshot has no base: " + filename);
+			return null;
+		}
+		unsigned baseChecksum;
+		memcpy(&baseChecksum, name, sizeof baseChecksum);
+		string base((const char*)name + sizeof baseChecksum, int(length - sizeof baseChecksum));
+		MappedFile baseFile;
+		const byte* baseState;
+		const SnapshotHeader* bh = openBase(&baseFile, base, filename, &baseState);
+		if (bh == null)
+			return null;
+		if (bh->stateChecksum != baseChecksum) {
+			warningMessage("Base snapshot has changed: " + base);
+			return null;
+		}
+		const byte* edits = findSection(f, ST_DELTA, &length);
+		image = new byte[h->stateLength];
+		if (edits == null ||
+			!applyDelta(edits, length, baseState, bh->stateLength, image, h->stateLength)) {
+			delete [] image;
+			warningMessage("Bad delta in snapshot: " + filename);
+			return null;
+		}
+		state = image;
+	}
+	if (checksum(state, h->stateLength) != h->stateChecksum) {
+		delete [] image;
+		warningMessage("Snapshot is corrupt: " + filename);
+		return null;
+	}
+	string scratch = stateFile(filename);
+	FILE* fp = fileSystem::createBinaryFile(scratch);
+	bool written = fp != null &&
+				   fwrite(state, 1, h->stateLength, fp) == size_t(h->stateLength);
+	if (fp != null && fclose(fp) != 0)
+		written = false;
+	delete [] image;
+	Game* game = null;
+	if (written)
+		game = loadGame(scratch);
+	else
+		warningMessage("Couldn't write the game state of " + filename);
+	remove(scratch.c_str());
+	return game;
+}
+
+}  // namespace engine
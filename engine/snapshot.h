@@ -0,0 +1,33 @@
+#pragma once
+#include "../common/string.h"
+
+namespace engine {
+
+class Game;
+/*
+ *	saveSnapshot
+ *
+ *	Writes the game to a snapshot (.hsb) file.  A snapshot holds the
+ *	same state as a saved game, less the log of events that have
+ *	already happened, so its size does not grow with the length of
+ *	the game.
+ *
+ *	If base is empty the snapshot is a full one.  Otherwise base
+ *	names a full snapshot of an earlier moment in the same game, and
+ *	only the differences from it are written.  A relative base name
+ *	is taken to be relative to filename.  The base must not be
+ *	changed or removed while any snapshot made from it is wanted.
+ *
+ *	Returns true if the file was written.
+ */
+bool saveSnapshot(Game* game, const string& filename, const string& base);
+/*
+ *	loadSnapshot
+ *
+ *	Reads a full or delta snapshot written by saveSnapshot and
+ *	returns the restored game, or null if the file (or the base
+ *	snapshot it was made from) could not be read.
+ */
+Game* loadSnapshot(const string& filename);
+
+}  // namespace engine
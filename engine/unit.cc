@@ -4,14 +4,17 @@
 #include "../common/machine.h"
 #include "../common/xml.h"
 #include "../test/test.h"
+#include "cluster_map.h"
 #include "detachment.h"
 #include "engine.h"
 #include "force.h"
 #include "game.h"
 #include "game_event.h"
 #include "global.h"
+#include "landmarks.h"
 #include "order.h"
 #include "path.h"
+#include "rail_network.h"
 #include "scenario.h"
 #include "theater.h"
 #include "unitdef.h"
@@ -117,6 +120,11 @@ Unit::Unit(Section *s, Unit *p, minutes tip, minutes start) {
 	_definition = s;
 	_detachment = null;
 	objective = null;
+	pendingEvents = null;
+	_totalsValid = false;
+	_moveInfo = null;
+	_moveInfoValid = false;
+	_carrierMap = null;
 	next = null;
 	units = null;
 	parent = p;
@@ -131,9 +139,15 @@ Unit::Unit(Section *s, Unit *p, minutes tip, minutes start) {
 }
 
 Unit::Unit() {
+	pendingEvents = null;
+	_totalsValid = false;
+	_moveInfo = null;
+	_moveInfoValid = false;
+	_carrierMap = null;
 }
 
 Unit::~Unit() {
+	delete _moveInfo;
 	delete _detachment;
 	delete next;
 	delete units;
@@ -474,7 +488,10 @@ void Unit::breakoutLosses() {
 			else if (w->fuel != 0)
 				p = global::isolatedVehicleSurrender;
 			int x = game()->random.binomial(_equipment[j].onHand, p);
-			_equipment[j].onHand -= x;
+			if (x != 0) {
+				_equipment[j].onHand -= x;
+				invalidateTotals();
+			}
 		}
 	}
 }
@@ -485,6 +502,7 @@ void Unit::surrender() {
 	for (int j = 0; j < _equipment.size(); j++) {
 		_equipment[j].onHand = 0;
 	}
+	invalidateTotals();
 	if (_detachment != null)
 		_detachment->game()->purge(_detachment);
 }
@@ -505,6 +523,93 @@ void Unit::calculate(MoveInfo* mi) {
 		u->calculate(mi);
 	summarizeEquipment(mi);
 }
+
+const MoveInfo* Unit::moveInfo() {
+	if (!_moveInfoValid) {
+		if (_moveInfo == null)
+			_moveInfo = new MoveInfo;
+		memset(_moveInfo, 0, sizeof (MoveInfo));
+		calculate(_moveInfo);
+		_moveInfoValid = true;
+		_carrierMap = null;
+	}
+	return _moveInfo;
+}
+
+UnitCarriers Unit::carrier(HexMap* map) {
+	const MoveInfo* cached = moveInfo();
+	if (_carrierMap != map) {
+		MoveInfo mi = *cached;
+		const TerrainKeyItem& tki = map->terrainKey.table[CLEARED];
+		for (int i = UC_MINCARRIER; i < UC_MAXCARRIER; i++)
+			mi.rawCost[i] = int(1000 / tki.moveCost[i]);
+		deriveMoveCost(this, &mi);
+		_carrier = mi.carrier;
+		_carrierMap = map;
+	}
+	return _carrier;
+}
+
+void Unit::invalidateTotals(Unit* top) {
+
+		// Every unit above this one includes it in its own totals.
+
+	for (Unit* u = this; u != null; u = u->parent) {
+		u->_totalsValid = false;
+		u->_moveInfoValid = false;
+		if (u == top)
+			break;
+	}
+}
+/*
+ *	totals
+ *
+ *	The sums are accumulated in the same order as the tree walks
+ *	that they replace: subordinates first, then the unit's own
+ *	equipment.
+ */
+const Unit::Totals& Unit::totals() {
+	if (_totalsValid)
+		return _totals;
+	memset(&_totals, 0, sizeof _totals);
+	for (Unit* u = units; u != null; u = u->next) {
+		const Totals& t = u->totals();
+		_totals.attack += t.attack;
+		_totals.bombard += t.bombard;
+		_totals.defense += t.defense;
+		_totals.establishment += t.establishment;
+		_totals.onHand += t.onHand;
+		_totals.guns += t.guns;
+		_totals.tanks += t.tanks;
+		_totals.fuelUse += t.fuelUse;
+		_totals.fuelCapacity += t.fuelCapacity;
+		_totals.ammunitionCapacity += t.ammunitionCapacity;
+	}
+	BadgeRole r = _definition->badge()->role;
+	for (int j = 0; j < _equipment.size(); j++) {
+		Weapon* w = _equipment[j].definition->weapon;
+		int oh = _equipment[j].onHand;
+		if (r == BR_ATTDEF || r == BR_TAC)
+			_totals.attack += oh * w->attack();
+		if (r == BR_ART && w->range > 0)
+			_totals.bombard += oh * w->bombard();
+		if (!isNoncombat(r) && r != BR_ART)
+			_totals.defense += oh * w->defense();
+		_totals.establishment += _equipment[j].definition->authorized * w->crew;
+		_totals.onHand += oh * w->crew;
+		if (w->weaponClass == WC_ART ||
+			w->weaponClass == WC_RKT)
+			_totals.guns += oh;
+		if (w->weaponClass == WC_AFV)
+			_totals.tanks += oh;
+		if (w->fuel != 0)
+			_totals.fuelUse += oh / w->fuel;						// fuel is km/ton, hence tons/km
+		_totals.fuelCapacity += oh * w->fuelCap;
+		_totals.ammunitionCapacity += oh * w->ammoCap;
+	}
+	_totalsValid = true;
+	return _totals;
+}
 /*
 	validate:	(mi2: pointer MoveInfo)
 	{
@@ -632,18 +737,22 @@ void Unit::append(Unit* u) {
 			;
 		s->next = u;
 	}
+	invalidateTotals();
 }
 
 void Unit::insertAfter(Unit* u) {
 	u->parent = parent;
 	u->next = next;
 	next = u;
+	if (parent != null)
+		parent->invalidateTotals();
 }
 
 void Unit::insertFirst(Unit* u) {
 	u->parent = this;
 	u->next = units;
 	units = u;
+	invalidateTotals();
 }
 
 void Unit::extract() {
@@ -658,6 +767,7 @@ void Unit::extract() {
 					pc->next = next;
 				else
 					parent->units = next;
+				parent->invalidateTotals();
 				parent = null;
 				next = null;
 				return;
@@ -689,46 +799,15 @@ BadgeRole Unit::defenseRole() {
 }
 
 float Unit::attack() {
-	float a = 0.0f;
-	BadgeRole r = _definition->badge()->role;
-	for (Unit* u = units; u != null; u = u->next)
-		a += u->attack();
-	if (r != BR_ATTDEF && r != BR_TAC)
-		return a;
-	for (int j = 0; j < _equipment.size(); j++){
-		Weapon* w = _equipment[j].definition->weapon;
-		a += _equipment[j].onHand * w->attack();
-	}
-	return a;
+	return totals().attack;
 }
 
 float Unit::bombard() {
-	float a = 0.0f;
-	BadgeRole r = _definition->badge()->role;
-	for (Unit* u = units; u != null; u = u->next)
-		a += u->bombard();
-	if (r != BR_ART)
-		return a;
-	for (int j = 0; j < _equipment.size(); j++){
-		Weapon* w = _equipment[j].definition->weapon;
-		if (w->range > 0)
-			a += _equipment[j].onHand * w->bombard();
-	}
-	return a;
+	return totals().bombard;
 }
 
 float Unit::defense() {
-	float a = 0.0f;
-	BadgeRole r = _definition->badge()->role;
-	for (Unit* u = units; u != null; u = u->next)
-		a += u->defense();
-	if (isNoncombat(r) || r == BR_ART)
-		return a;
-	for (int j = 0; j < _equipment.size(); j++){
-		Weapon* w = _equipment[j].definition->weapon;
-		a += _equipment[j].onHand * w->defense();
-	}
-	return a;
+	return totals().defense;
 }
 
 minutes Unit::start() {
@@ -746,50 +825,19 @@ minutes Unit::end() {
 }
 
 int Unit::establishment() {
-	int a = 0;
-	for (Unit* u = units; u != null; u = u->next)
-		a += u->establishment();
-	for (int j = 0; j < _equipment.size(); j++) {
-		Weapon* w = _equipment[j].definition->weapon;
-		a += _equipment[j].definition->authorized * w->crew;
-	}
-	return a;
+	return totals().establishment;
 }
 
 int Unit::onHand() {
-	int a = 0;
-	for (Unit* u = units; u != null; u = u->next)
-		a += u->onHand();
-	for (int j = 0; j < _equipment.size(); j++) {
-		Weapon* w = _equipment[j].definition->weapon;
-		a += _equipment[j].onHand * w->crew;
-	}
-	return a;
+	return totals().onHand;
 }
 
 int Unit::guns() {
-	int a = 0;
-	for (Unit* u = units; u != null; u = u->next)
-		a += u->guns();
-	for (int j = 0; j < _equipment.size(); j++) {
-		Weapon* w = _equipment[j].definition->weapon;
-		if (w->weaponClass == WC_ART ||
-			w->weaponClass == WC_RKT)
-			a += _equipment[j].onHand;
-	}
-	return a;
+	return totals().guns;
 }
 
 int Unit::tanks() {
-	int a = 0;
-	for (Unit* u = units; u != null; u = u->next)
-		a += u->tanks();
-	for (int j = 0; j < _equipment.size(); j++) {
-		Weapon* w = _equipment[j].definition->weapon;
-		if (w->weaponClass == WC_AFV)
-			a += _equipment[j].onHand;
-	}
-	return a;
+	return totals().tanks;
 }
 
 bool Unit::opposes(Unit* u) {
@@ -865,15 +913,7 @@ Detachment* Unit::getFirstDetachment() {
 }
 
 tons Unit::fuelUse() {
-	float f = 0.0f;
-	for (Unit* u = units; u != null; u = u->next)
-		f += u->fuelUse();
-	for (int j = 0; j < _equipment.size(); j++) {
-		Weapon* w = _equipment[j].definition->weapon;
-		if (w->fuel != 0)
-			f += _equipment[j].onHand / w->fuel;						// fule is km/ton, hence f is tons/km
-	}
-	return f;
+	return totals().fuelUse;
 }
 /*
 	daysOfFuel:	float
@@ -905,14 +945,7 @@ tons Unit::fuelUse() {
 		}
  */
 tons Unit::fuelCapacity() {
-	float fc = 0.0f;
-	for (Unit* u = units; u != null; u = u->next)
-		fc += u->fuelCapacity();
-	for (int j = 0; j < _equipment.size(); j++) {
-		Weapon* w = _equipment[j].definition->weapon;
-		fc += _equipment[j].onHand * w->fuelCap;
-	}
-	return fc;
+	return totals().fuelCapacity;
 }
 
 tons Unit::fuelAvailable() {
@@ -942,14 +975,7 @@ tons Unit::fuelDemand(minutes duration) {
 }
 
 tons Unit::ammunitionCapacity() {
-	float fc = 0.0f;
-	for (Unit* u = units; u != null; u = u->next)
-		fc += u->ammunitionCapacity();
-	for (int j = 0; j < _equipment.size(); j++) {
-		Weapon* w = _equipment[j].definition->weapon;
-		fc += _equipment[j].onHand * w->ammoCap;
-	}
-	return fc;
+	return totals().ammunitionCapacity;
 }
 
 tons Unit::ammunitionAvailable() {
@@ -1064,9 +1090,12 @@ void Unit::breakdown(float duration) {					// duration in fractions of a day
 		u->breakdown(duration);
 	for (int j = 0; j < _equipment.size(); j++) {
 		Weapon* w = _equipment[j].definition->weapon;
-		float p = 1 - pow(1 - w->breakdown, duration * global::breakdownModifier);
+		float p = 1 - pow(1 - w->breakdown, duration * game()->parameters.breakdownModifier);
 		int b = game()->random.binomial(_equipment[j].onHand, p);
-		_equipment[j].onHand -= b;
+		if (b != 0) {
+			_equipment[j].onHand -= b;
+			invalidateTotals();
+		}
 	}
 }
 
@@ -1133,6 +1162,7 @@ bool Unit::pruneUndeployed() {
 				units = u->next;
 			u->next = null;
 			delete u;
+			invalidateTotals();
 		} else {
 			if (d == DS_PARTIAL)
 				anyPartial = true;
@@ -1248,8 +1278,7 @@ int calculateMoveCost(Detachment* det, xpoint src, xpoint dest, bool inCombat, f
 	MoveInfo mi;
 
 	HexDirection d = directionTo(src, dest);
-	memset(&mi, 0, sizeof mi);
-	det->unit->calculate(&mi);
+	mi = *det->unit->moveInfo();
 	MoveManner mm = moveManner(det->mode());
 	for (int i = UC_MINCARRIER; i < UC_MAXCARRIER; i++){
 		if (mi.needsCost[i])
@@ -1492,29 +1521,49 @@ SupplyPath: type inherits StraightPath {
 */
 Segment* SupplyPath::find(Unit *u, xpoint A, xpoint B) {
 	force = u->combatant()->force;
+	HexMap* map = force->game()->map();
 	source = A;
 	destination = B;
-	carriers = force->game()->map()->calculateCarrier(u);
+	carriers = map->calculateCarrier(u);
 	visitLimit = 10000;
 	foundIt = false;
-	engine::visit(force->game()->map(), this, A, 6000 * hexDistance(A, B), SK_SUPPLY);
+	minimumStep = map->minimumEdgeCost(carriers, MM_ROAD);
+	landmarks = map->landmarks(carriers, MM_ROAD);
+	visitToward(map, this, A, B, 6000 * hexDistance(A, B), SK_SUPPLY);
 	return path;
 }
 
+int SupplyPath::estimate(xpoint a, xpoint b) {
+
+		// Every step closes the distance by at most one hex, so the
+		// hexes entered on the way are at least n - 1, n - 2, ... 0
+		// from b.
+
+	int n = hexDistance(a, b);
+	int perHex = int(24 * global::kmPerHex / 30);
+	int moves = n * minimumStep;
+	if (landmarks != null) {
+		int l = landmarks->estimate(a, b);
+		if (l > moves)
+			moves = l;
+	}
+	return perHex * (n * (n - 1) / 2) + moves;
+}
+
 int SupplyPath::kost(xpoint a, HexDirection dir, xpoint b) {
 	if (force->game()->map()->enemyZoc(force, b))
 		return MAXIMUM_PATH_LENGTH + 1;
 	if (!force->game()->map()->isFriendly(force, b))
 		return MAXIMUM_PATH_LENGTH + 1;
-	float f;
 	int d = 0;
 	if (destination.x != -1)
 	    d = hexDistance(b, destination) * (24 * global::kmPerHex / 30);
-	return d + movementCost(force->game()->map(), a, dir, b, force, carriers, MM_ROAD, &f, false);
+	return d + pathCost(force->game()->map(), a, dir, b, force, carriers, MM_ROAD, false);
 }
 
 Segment* DepotPath::find(Detachment* excludeThis, xpoint A) {
 	_excludeThis = excludeThis;
+	sourceDepot = null;
 	source = A;
 	destination.x = -1;
 	force = excludeThis->unit->combatant()->force;
@@ -1546,6 +1595,91 @@ PathContinuation DepotPath::visit(xpoint h) {
 
 	return PC_CONTINUE;
 }
+
+void SupplyField::build(Force* force, UnitCarriers carriers) {
+	this->force = force;
+	this->carriers = carriers;
+	destination.x = -1;
+	foundIt = false;
+	HexMap* map = force->game()->map();
+	visitLimit = map->getRows() * map->getColumns();
+
+		// Seed the search with every hex DepotPath::visit would stop in.
+
+	vector<xpoint> depots;
+	xpoint hx;
+	for (hx.x = map->subsetOrigin().x; hx.x < map->subsetOpposite().x; hx.x++)
+		for (hx.y = map->subsetOrigin().y; hx.y < map->subsetOpposite().y; hx.y++) {
+			Detachment* d = map->getDetachments(hx);
+			if (d == null || d->unit->combatant()->force != force)
+				continue;
+			for (; d != null; d = d->next)
+				if (d->unit->hasSupplyDepot()) {
+					depots.push_back(hx);
+					break;
+				}
+		}
+	engine::visit(map, this, depots, 60000, SK_SUPPLY);
+}
+
+bool SupplyField::find(Detachment* excludeThis, Segment** linep, SupplyDepot** depotp) {
+	HexMap* map = force->game()->map();
+	xpoint h = excludeThis->location();
+	*linep = null;
+	*depotp = null;
+	if (search.direction(map, h) == DirNone)
+		return true;
+
+	xpoint depotHex = h;
+	for (;;) {
+		HexDirection dir = search.direction(map, depotHex);
+		if (dir == DirStart)
+			break;
+		depotHex = neighbor(depotHex, dir);
+	}
+	SupplyDepot* depot = null;
+	for (Detachment* d = map->getDetachments(depotHex); d != null; d = d->next)
+		if (!d->unit->attachedTo(excludeThis->unit) && d->unit->hasSupplyDepot()) {
+			depot = (SupplyDepot*)d;
+			break;
+		}
+	if (depot == null)
+		return false;
+
+		// Copy out the path the way DepotPath would have, including
+		// the costs, which it computes with the destination known.
+
+	destination = depotHex;
+	Segment** tail = linep;
+	while (h != depotHex) {
+		HexDirection dir = search.direction(map, h);
+		xpoint hn = neighbor(h, dir);
+		Segment* s = new Segment;
+		s->next = null;
+		s->hex = h;
+		s->nextp = hn;
+		s->dir = reverseDirection(dir);
+		s->kind = SK_SUPPLY;
+		s->cost = SupplyPath::kost(h, dir, hn);
+		*tail = s;
+		tail = &s->next;
+		h = hn;
+	}
+	destination.x = -1;
+	*depotp = depot;
+	return true;
+}
+
+int SupplyField::kost(xpoint a, HexDirection dir, xpoint b) {
+
+		// The search spreads out from the depots, but supplies
+		// travel the other way, from b to a.
+
+	return SupplyPath::kost(b, reverseDirection(dir), a);
+}
+
+void SupplyField::finished(HexMap* map, SegmentKind kind) {
+}
 /*
 unitPath: instance UnitPath
 
@@ -1569,9 +1703,153 @@ Segment* UnitPath::find(HexMap* map, Unit* u, xpoint A, UnitModes mode, xpoint B
 	foundIt = false;
 	moveManner = engine::moveManner(mode);
 	confrontEnemy = ce;
-	engine::visit(map, this, A, 6000 * hexDistance(A, B), SK_POSSIBLE_ORDER);
+
+		// Each step costs the distance charge in kost plus at least the
+		// cheapest move in the map's cost table, except the artificially
+		// cheap attack on an adjacent hex.
+
+	if (adjacentHexes)
+		minimumStep = 0;
+	else
+		minimumStep = int(24 * global::kmPerHex / 30) + map->minimumEdgeCost(_carriers, moveManner);
+	_landmarks = map->landmarks(_carriers, moveManner);
+	if (moveManner == MM_RAIL && railRoute(map, A, B))
+		return path;
+	if (global::hierarchicalPathDistance > 0 &&
+		hexDistance(A, B) >= global::hierarchicalPathDistance &&
+		refine(map, A, B))
+		return path;
+	seek(map, 6000 * hexDistance(A, B), SK_POSSIBLE_ORDER);
 	return path;
 }
+/*
+ *	refine
+ *
+ *	Finds the path from A to B a few clusters at a time, following
+ *	the plan of the map's clusters.  Each leg is found with the full cost
+ *	of the moves, enemy included.  Returns false if there is no plan,
+ *	or if a leg cannot be found, in which case the caller searches
+ *	the whole map instead.
+ */
+bool UnitPath::refine(HexMap* map, xpoint A, xpoint B) {
+	ClusterMap* clusters = map->clusters(_carriers, moveManner);
+	vector<xpoint> waypoints;
+	if (clusters == null || !clusters->plan(A, B, &waypoints))
+		return false;
+	Segment* route = null;
+	Segment** tail = &route;
+	xpoint at = A;
+	for (int i = 0; i < waypoints.size(); i++) {
+
+			// Each leg is aimed two clusters ahead, so it can cut the
+			// corner at the gate in between.
+
+		if (i % 2 == 0 && i < waypoints.size() - 1)
+			continue;
+		xpoint w = waypoints[i];
+		if (w == at)
+			continue;
+		source = at;
+		destination = w;
+		foundIt = false;
+		visitToward(map, this, at, w, 6000 * hexDistance(at, w), SK_POSSIBLE_ORDER);
+		if (path == null) {
+			delete route;
+			source = A;
+			destination = B;
+			return false;
+		}
+		*tail = path;
+		while (*tail != null)
+			tail = &(*tail)->next;
+		at = w;
+	}
+	source = A;
+	destination = B;
+	foundIt = true;
+	path = route;
+	return true;
+}
+
+/*
+ *	railRoute
+ *
+ *	Finds the path of an entrained move over the map's rail network.
+ *	The network knows nothing of the enemy, so if the route it finds
+ *	passes an enemy unit or runs through an enemy ZOC, this returns
+ *	false and the caller searches the hexes instead.  Otherwise the
+ *	route is the cheapest there is, since the enemy can only add to
+ *	the cost of a move.
+ */
+bool UnitPath::railRoute(HexMap* map, xpoint A, xpoint B) {
+	RailNetwork* rails = map->railNetwork();
+	if (rails == null)
+		return false;
+	int step = int(24 * global::kmPerHex / 30);
+	vector<xpoint> hexes;
+	int c = rails->route(A, B, step, &hexes, null);
+	path = null;
+	foundIt = false;
+
+		// A route dearer than the hex search allows would not have
+		// been found by it either.
+
+	if (c >= 6000 * hexDistance(A, B))
+		return true;
+	Segment** tail = &path;
+	for (int i = 1; i < hexes.size(); i++) {
+		xpoint a = hexes[i - 1];
+		xpoint b = hexes[i];
+		HexDirection dir = 0;
+		while (neighbor(a, dir) != b)
+			dir++;
+		int k = kost(a, dir, b);
+		if (k != step + map->edgeCost(a, dir, UC_RAIL, MM_RAIL, true)) {
+			delete path;
+			path = null;
+			return false;
+		}
+		Segment* s = new Segment;
+		s->next = null;
+		s->hex = a;
+		s->nextp = b;
+		s->dir = reverseDirection(dir);
+		s->kind = SK_POSSIBLE_ORDER;
+		s->cost = k;
+		*tail = s;
+		tail = &s->next;
+	}
+	foundIt = true;
+	return true;
+}
+
+bool UnitPath::unchanged(HexMap* map, Unit* u, xpoint A, UnitModes mode, xpoint B, bool ce, Segment* path) {
+	source = A;
+	destination = B;
+	adjacentHexes = adjacent(A, B);
+	cache(map, u);
+	moveManner = engine::moveManner(mode);
+	confrontEnemy = ce;
+	for (Segment* s = path; s != null; s = s->next)
+		if (s->cost != kost(s->hex, reverseDirection(s->dir), s->nextp))
+			return false;
+	return true;
+}
+
+int UnitPath::estimate(xpoint a, xpoint b) {
+	int e = StraightPath::estimate(a, b);
+	if (_landmarks != null && !adjacentHexes) {
+
+			// The landmarks bound the terrain part of the cost, so
+			// add the distance charge kost makes for each step.
+
+		int n = hexDistance(a, b);
+		int l = n * int(24 * global::kmPerHex / 30) + _landmarks->estimate(a, b);
+		if (l > e)
+			return l;
+	}
+	return e;
+}
 
 int UnitPath::kost(xpoint a, HexDirection dir, xpoint b) {
 	if (moveManner == MM_CROSS_COUNTRY && 
@@ -1583,11 +1861,10 @@ int UnitPath::kost(xpoint a, HexDirection dir, xpoint b) {
 		return 1;						// return an artificially low movement cost when
 										// attacking a single hex.
 	}
-	float f;
     int d = 0;
 	if (destination.x != -1)
 		d = hexDistance(a, b) * (24 * global::kmPerHex / 30);
-	return d + movementCost(_map, a, dir, b, _force, _carriers, moveManner, &f, confrontEnemy);
+	return d + pathCost(_map, a, dir, b, _force, _carriers, moveManner, confrontEnemy);
 }
 
 void UnitPath::cache(HexMap* map, Unit* u) {
@@ -1612,6 +1889,37 @@ MoveManner moveManner(UnitModes mode) {
 		return MM_CROSS_COUNTRY;
 }
 
+/*
+ *	enemyMultiplier
+ *
+ *	Returns the factor by which enemy units make the move from a to b
+ *	more expensive, or 0 if the move is not allowed at all.
+ */
+static int enemyMultiplier(HexMap* map, xpoint a, xpoint b, Force* force, bool confrontEnemy) {
+	if (force == null)
+		return 1;
+	Detachment* occ = map->getDetachments(b);
+
+		// Assume combat will be expensive
+
+	if (occ != null){
+		if (occ->unit->combatant()->force != force){
+			if (!confrontEnemy)
+				return 0;
+			return 4;
+		}
+	} else if (map->enemyZoc(force, b) && map->enemyZoc(force, a)){
+		if (!confrontEnemy)
+			return 0;
+		return 2;
+	} else if (map->startingMeetingEngagement(b, force)){
+		if (!confrontEnemy)
+			return 0;
+		return 2;
+	}
+	return 1;
+}
+
 int movementCost(HexMap* map,
 				 xpoint a,
 				 HexDirection dir,
@@ -1625,32 +1933,44 @@ int movementCost(HexMap* map,
     // paths, this must be greater than or equal to the change in the
     // distance function when you take a step.
 
+	int m = enemyMultiplier(map, a, b, force, confrontEnemy);
+	if (m == 0)
+		return MAXIMUM_PATH_LENGTH + 1;
+	int c = terrainMoveCost(map, a, dir, b, carriers, moveManner, m == 1, fuelRateP);
+	if (c > MAXIMUM_PATH_LENGTH)
+		return c;
+	return c * m;
+}
+
+int pathCost(HexMap* map,
+			 xpoint a,
+			 HexDirection dir,
+			 xpoint b,
+			 Force* force,
+			 UnitCarriers carriers,
+			 MoveManner moveManner,
+			 bool confrontEnemy) {
+	int m = enemyMultiplier(map, a, b, force, confrontEnemy);
+	if (m == 0)
+		return MAXIMUM_PATH_LENGTH + 1;
+	int c = map->edgeCost(a, dir, carriers, moveManner, m == 1);
+	if (c > MAXIMUM_PATH_LENGTH)
+		return c;
+	return c * m;
+}
+
+int terrainMoveCost(HexMap* map,
+					xpoint a,
+					HexDirection dir,
+					xpoint b,
+					UnitCarriers carriers,
+					MoveManner moveManner,
+					bool useRoads,
+					float* fuelRateP) {
 	float moveRate;					// movement rate in km/h
 
 	if (carriers == UC_RAIL)
 		moveManner = MM_RAIL;
-	int enemyMultiplier = 1;
-	if (force != null){
-		Detachment* occ = map->getDetachments(b);
-
-			// Assume combat will be expensive
-
-		if (occ != null){
-			if (occ->unit->combatant()->force != force){
-				if (!confrontEnemy)
-					return MAXIMUM_PATH_LENGTH + 1;
-				enemyMultiplier = 4;
-			}
-		} else if (map->enemyZoc(force, b) && map->enemyZoc(force, a)){
-			if (!confrontEnemy)
-				return MAXIMUM_PATH_LENGTH + 1;
-			enemyMultiplier = 2;
-		} else if (map->startingMeetingEngagement(b, force)){
-			if (!confrontEnemy)
-				return MAXIMUM_PATH_LENGTH + 1;
-			enemyMultiplier = 2;
-		}
-	}
 	int t = map->getTransportEdge(a, dir);
 	float edgeEffect = 0.0f;
 	EdgeValues e = map->edgeCrossing(a, dir);
@@ -1690,7 +2010,7 @@ int movementCost(HexMap* map,
 		float fuelRate = map->terrainKey.roughModifier[rough].fuel * tki->fuel;
 		t &= ~(TF_RAIL|TF_DOUBLE_RAIL|TF_TORN_RAIL|TF_RAIL_CLOGGED|TF_BRIDGE|TF_BLOWN_BRIDGE);
 		if ((moveManner == MM_ROAD || moveManner == MM_BEST) && (t & TF_CLOGGED) == 0){
-			if (enemyMultiplier == 1){
+			if (useRoads){
 				int tbit, i;
 				for (tbit = TF_MINTRANS, i = 0; i < TF_MAXTRANS; 
 								tbit <<= 1, i++){
@@ -1719,7 +2039,7 @@ int movementCost(HexMap* map,
 	if (logIt)
 		log(string("temc=") + map->terrainEdge[e].moveCost[carriers]);
 	float hours = global::kmPerHex / moveRate + edgeEffect;
-    return int(hours * 60) * enemyMultiplier;
+    return int(hours * 60);
 }
 
 SupplyDepot* getSupplyDepot(Detachment* excludeThis, xpoint hex) {
@@ -21,6 +21,8 @@ class Detachment;
 class Doctrine;
 class Equipment;
 class Game;
+class GameEvent;
+class HexMap;
 class MoveInfo;
 class Objective;
 class OobMap;
@@ -83,6 +85,10 @@ public:
 
 	Objective*				objective;
 
+		// Maintained by the Game while events naming this unit are queued
+
+	GameEvent*				pendingEvents;
+
 		// This function is called both at game startup and after a reload
 
 	int ordinal();
@@ -114,6 +120,36 @@ public:
 	void validate(MoveInfo* mi2);
 
 	void summarizeEquipment(MoveInfo* mi);
+	/*
+	 *	moveInfo
+	 *
+	 *	Returns what calculate would add to a cleared MoveInfo.  The
+	 *	answer is kept until invalidateTotals is called.
+	 */
+	const MoveInfo* moveInfo();
+	/*
+	 *	carrier
+	 *
+	 *	Returns the carrier the unit moves with on clear terrain, as
+	 *	HexMap::calculateCarrier defines it.  This is kept along with
+	 *	the MoveInfo.
+	 */
+	UnitCarriers carrier(HexMap* map);
+	/*
+	 *	invalidateTotals
+	 *
+	 *	Must be called whenever the equipment on hand in this unit
+	 *	changes, or a unit is added or removed under it.  The MoveInfo
+	 *	and the totals over the unit's equipment and subordinates
+	 *	(attack, defense, fuelCapacity and the like) are then computed
+	 *	again when next asked for, here and in every unit above.
+	 *
+	 *	If top is given, only the units from here up to and including
+	 *	top are marked.  Combats resolved on worker threads use this
+	 *	to stay within their own detachment, and the units above are
+	 *	marked once the workers are done.
+	 */
+	void invalidateTotals(Unit* top = null);
 	/*
 	 *	regroupRate
 	 *
@@ -324,6 +360,32 @@ private:
 	vector<AvailableEquipment>		_equipment;
 	Detachment*						_detachment;
 	Postures						_posture;
+
+	class Totals {
+	public:
+		float	attack;
+		float	bombard;
+		float	defense;
+		int		establishment;
+		int		onHand;
+		int		guns;
+		int		tanks;
+		tons	fuelUse;
+		tons	fuelCapacity;
+		tons	ammunitionCapacity;
+	};
+
+	const Totals& totals();
+
+		// Cached sums over the equipment of the unit and its
+		// subordinates, see invalidateTotals
+
+	Totals							_totals;
+	bool							_totalsValid;
+	MoveInfo*						_moveInfo;
+	bool							_moveInfoValid;
+	HexMap*							_carrierMap;			// Map _carrier was computed for, null if none
+	UnitCarriers					_carrier;
 };
 
 /*
@@ -77,7 +77,7 @@ bool Frame::openFile(const string &filename) {
 	string path = fileSystem::absolutePath(filename);
 	Entity*const* entry = _filenameMap.get(path);
 	if (*entry == null) {
-		if (filename.endsWith(".xmp")) {
+		if (filename.endsWith(".xmp") || filename.endsWith(".xmp2")) {
 			engine::HexMap* map = engine::loadHexMap(path, global::namesFile, global::terrainKeyFile);
 			if (map) {
 				MapEditor2* me = new MapEditor2(map);